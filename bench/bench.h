@@ -0,0 +1,98 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __INC_BLEPP_BENCH_H
+#define __INC_BLEPP_BENCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <ctime>
+
+//A very small microbenchmark harness. Each benchmark is a function which
+//runs the code under test state.iterations times. The harness scales the 
+//iteration count until the run takes long enough to time reliably, then 
+//reports the results as JSON.
+//
+//Benchmarks which process several items per iteration (packets, elements,
+//bytes...) should add to state.items so per-item rates are reported. Setup 
+//which should not be timed goes between state.pause() and state.resume().
+namespace BLEPP
+{
+	namespace Bench
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		inline double cpu_seconds()
+		{
+			timespec t;
+			clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+			return t.tv_sec + t.tv_nsec * 1e-9;
+		}
+
+		struct State
+		{
+			std::uint64_t iterations=0;
+			std::uint64_t items=0;
+			std::map<std::string, double> counters;
+
+			void pause()
+			{
+				paused_at = Clock::now();
+				paused_cpu_at = cpu_seconds();
+			}
+
+			void resume()
+			{
+				paused += Clock::now() - paused_at;
+				paused_cpu += cpu_seconds() - paused_cpu_at;
+			}
+
+			Clock::duration paused{};
+			Clock::time_point paused_at;
+			double paused_cpu=0, paused_cpu_at=0;
+		};
+
+		typedef std::function<void(State&)> Function;
+
+		struct Registration
+		{
+			Registration(const char* name, Function f);
+		};
+
+		//Stop the optimizer from removing a computation whose result is unused.
+		template<class C> inline void do_not_optimize(const C& c)
+		{
+			asm volatile("" : : "g"(&c) : "memory");
+		}
+	}
+}
+
+#define BENCHMARK(X) \
+	static void X(BLEPP::Bench::State&);\
+	static BLEPP::Bench::Registration X##_registration(#X, X);\
+	static void X(BLEPP::Bench::State& state)
+
+#endif
@@ -0,0 +1,487 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "bench.h"
+
+#include <blepp/att.h>
+#include <blepp/att_schema.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+using namespace std;
+using namespace BLEPP;
+
+//The legacy codecs are compiled here rather than in the library. Stop the
+//compiler from specialising them for their call sites, which it can't do for
+//the library's, so that the comparison is like for like.
+#if defined(__clang__)
+	#define OUT_OF_LINE __attribute__((noinline))
+#else
+	#define OUT_OF_LINE __attribute__((noipa))
+#endif
+
+namespace
+{
+	//The BlueZ list decoder as it was before the glib calls were commented out,
+	//with malloc standing in for g_malloc0. This is the "before".
+	namespace legacy
+	{
+		att_data_list* att_data_list_alloc(uint16_t num, uint16_t len)
+		{
+			att_data_list* list = (att_data_list*)calloc(1, sizeof(att_data_list));
+			list->len = len;
+			list->num = num;
+			list->data = (uint8_t**)calloc(num, sizeof(uint8_t*));
+
+			for(int i=0; i < num; i++)
+				list->data[i] = (uint8_t*)calloc(len, 1);
+
+			return list;
+		}
+
+		void att_data_list_free(att_data_list* list)
+		{
+			for(int i=0; i < list->num; i++)
+				free(list->data[i]);
+			free(list->data);
+			free(list);
+		}
+
+		att_data_list* dec_read_by_type_resp(const uint8_t* pdu, size_t len)
+		{
+			if(pdu[0] != ATT_OP_READ_BY_TYPE_RESP)
+				return NULL;
+
+			uint16_t elen = pdu[1];
+			uint16_t num = (len - 2) / elen;
+			att_data_list* list = att_data_list_alloc(num, elen);
+
+			const uint8_t* ptr = &pdu[2];
+			for(int i=0; i < num; i++)
+			{
+				memcpy(list->data[i], ptr, list->len);
+				ptr += list->len;
+			}
+
+			return list;
+		}
+
+		//The hand written fixed layout codecs, before they were generated from
+		//att_schema.h.
+		OUT_OF_LINE uint16_t enc_read_by_type_req(uint16_t start, uint16_t end, bt_uuid_t *uuid,
+								uint8_t *pdu, size_t len)
+		{
+			uint16_t min_len = sizeof(pdu[0]) + sizeof(start) + sizeof(end);
+			uint16_t length;
+
+			if (!uuid)
+				return 0;
+
+			if (uuid->type == BT_UUID16)
+				length = 2;
+			else if (uuid->type == BT_UUID128)
+				length = 16;
+			else
+				return 0;
+
+			if (len < min_len + length)
+				return 0;
+
+			pdu[0] = ATT_OP_READ_BY_TYPE_REQ;
+			att_put_u16(start, &pdu[1]);
+			att_put_u16(end, &pdu[3]);
+
+			att_put_uuid(*uuid, &pdu[5]);
+
+			return min_len + length;
+		}
+
+		OUT_OF_LINE uint16_t dec_read_by_type_req(const uint8_t *pdu, size_t len, uint16_t *start,
+								uint16_t *end, bt_uuid_t *uuid)
+		{
+			const size_t min_len = sizeof(pdu[0]) + sizeof(*start) + sizeof(*end);
+
+			if (pdu == NULL)
+				return 0;
+
+			if (start == NULL || end == NULL || uuid == NULL)
+				return 0;
+
+			if (len < min_len + 2)
+				return 0;
+
+			if (pdu[0] != ATT_OP_READ_BY_TYPE_REQ)
+				return 0;
+
+			*start = att_get_u16(&pdu[1]);
+			*end = att_get_u16(&pdu[3]);
+
+			if (len == min_len + 2)
+				*uuid = att_get_uuid16(&pdu[5]);
+			else
+				*uuid = att_get_uuid128(&pdu[5]);
+
+			return len;
+		}
+
+		OUT_OF_LINE uint16_t enc_write_req(uint16_t handle, const uint8_t *value, size_t vlen,
+								uint8_t *pdu, size_t len)
+		{
+			const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle);
+
+			if (pdu == NULL)
+				return 0;
+
+			if (len < min_len)
+				return 0;
+
+			if (vlen > len - min_len)
+				vlen = len - min_len;
+
+			pdu[0] = ATT_OP_WRITE_REQ;
+			att_put_u16(handle, &pdu[1]);
+
+			if (vlen > 0) {
+				memcpy(&pdu[3], value, vlen);
+				return min_len + vlen;
+			}
+
+			return min_len;
+		}
+
+		OUT_OF_LINE uint16_t dec_write_req(const uint8_t *pdu, size_t len, uint16_t *handle,
+								uint8_t *value, size_t *vlen)
+		{
+			const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle);
+
+			if (pdu == NULL)
+				return 0;
+
+			if (value == NULL || vlen == NULL || handle == NULL)
+				return 0;
+
+			if (len < min_len)
+				return 0;
+
+			if (pdu[0] != ATT_OP_WRITE_REQ)
+				return 0;
+
+			*handle = att_get_u16(&pdu[1]);
+			*vlen = len - min_len;
+			if (*vlen > 0)
+				memcpy(value, pdu + min_len, *vlen);
+
+			return len;
+		}
+
+		OUT_OF_LINE uint16_t enc_mtu_req(uint16_t mtu, uint8_t *pdu, size_t len)
+		{
+			const uint16_t min_len = sizeof(pdu[0]) + sizeof(mtu);
+
+			if (pdu == NULL)
+				return 0;
+
+			if (len < min_len)
+				return 0;
+
+			pdu[0] = ATT_OP_MTU_REQ;
+			att_put_u16(mtu, &pdu[1]);
+
+			return min_len;
+		}
+
+		OUT_OF_LINE uint16_t dec_mtu_req(const uint8_t *pdu, size_t len, uint16_t *mtu)
+		{
+			const uint16_t min_len = sizeof(pdu[0]) + sizeof(*mtu);
+
+			if (pdu == NULL)
+				return 0;
+
+			if (mtu == NULL)
+				return 0;
+
+			if (len < min_len)
+				return 0;
+
+			if (pdu[0] != ATT_OP_MTU_REQ)
+				return 0;
+
+			*mtu = att_get_u16(&pdu[1]);
+
+			return min_len;
+		}
+
+		OUT_OF_LINE uint16_t enc_error_resp(uint8_t opcode, uint16_t handle, uint8_t status,
+									uint8_t *pdu, size_t len)
+		{
+			const uint16_t min_len = sizeof(pdu[0]) + sizeof(opcode) +
+								sizeof(handle) + sizeof(status);
+			uint16_t u16;
+
+			if (len < min_len)
+				return 0;
+
+			u16 = htobs(handle);
+			pdu[0] = ATT_OP_ERROR;
+			pdu[1] = opcode;
+			memcpy(&pdu[2], &u16, sizeof(u16));
+			pdu[4] = status;
+
+			return min_len;
+		}
+	}
+
+	//Read By Type responses of every MTU from the default to the
+	//largest LE one, with 16 and 128 bit characteristic declarations.
+	struct Corpus
+	{
+		vector<vector<uint8_t>> pdus;
+
+		Corpus()
+		{
+			mt19937 rng(1);
+			for(int i=0; i < 1024; i++)
+			{
+				int mtu = ATT_DEFAULT_LE_MTU + rng() % (247 - ATT_DEFAULT_LE_MTU + 1);
+				int elen = (rng() & 1) ? 7 : 21;
+				int num = (mtu - 2) / elen;
+
+				vector<uint8_t> pdu(2 + num * elen);
+				pdu[0] = ATT_OP_READ_BY_TYPE_RESP;
+				pdu[1] = elen;
+				for(size_t j=2; j < pdu.size(); j++)
+					pdu[j] = rng();
+
+				pdus.push_back(pdu);
+			}
+		}
+	};
+
+	const Corpus& corpus()
+	{
+		static Corpus c;
+		return c;
+	}
+
+	//The arguments for a mix of the fixed layout requests a client sends
+	//and a server decodes: discovery with both sizes of UUID, writes of
+	//every length up to the default MTU, MTU exchange and errors.
+	struct Request
+	{
+		uint16_t start, end, handle, mtu;
+		bt_uuid_t type;
+		uint8_t value[ATT_DEFAULT_LE_MTU];
+		size_t vlen;
+	};
+
+	const vector<Request>& requests()
+	{
+		static vector<Request> r;
+		if(r.empty())
+		{
+			mt19937 rng(2);
+			for(int i=0; i < 1024; i++)
+			{
+				Request q;
+				q.start = rng();
+				q.end = rng();
+				q.handle = rng();
+				q.mtu = rng();
+				if(rng() & 1)
+					bt_uuid16_create(&q.type, rng());
+				else
+				{
+					uint128_t u;
+					for(auto& b: u.data)
+						b = rng();
+					bt_uuid128_create(&q.type, u);
+				}
+
+				q.vlen = rng() % (ATT_DEFAULT_LE_MTU - 3 + 1);
+				for(auto& b: q.value)
+					b = rng();
+
+				r.push_back(q);
+			}
+		}
+		return r;
+	}
+
+	//Each round is 7 codec calls.
+	template<class Codec> uint64_t codec_round(const Request& q)
+	{
+		uint8_t pdu[ATT_DEFAULT_LE_MTU];
+		uint8_t value[ATT_DEFAULT_LE_MTU];
+		uint16_t start, end, handle, mtu;
+		bt_uuid_t type;
+		size_t vlen;
+		uint64_t sum=0;
+
+		uint16_t len = Codec::enc_read_by_type_req(q.start, q.end, const_cast<bt_uuid_t*>(&q.type), pdu, sizeof(pdu));
+		sum += Codec::dec_read_by_type_req(pdu, len, &start, &end, &type) + start + end + type.type;
+
+		len = Codec::enc_write_req(q.handle, q.value, q.vlen, pdu, sizeof(pdu));
+		sum += Codec::dec_write_req(pdu, len, &handle, value, &vlen) + handle + vlen;
+
+		len = Codec::enc_mtu_req(q.mtu, pdu, sizeof(pdu));
+		sum += Codec::dec_mtu_req(pdu, len, &mtu) + mtu;
+
+		sum += Codec::enc_error_resp(ATT_OP_READ_REQ, q.handle, ATT_ECODE_INVALID_HANDLE, pdu, sizeof(pdu)) + pdu[2];
+
+		return sum;
+	}
+
+	//The library's codecs are reached through the PLT, so reach these
+	//through a pointer as well.
+	template<class F> F* indirect(F* f)
+	{
+		F* volatile p = f;
+		return p;
+	}
+
+	struct LegacyCodec
+	{
+		static uint16_t enc_read_by_type_req(uint16_t s, uint16_t e, bt_uuid_t* u, uint8_t* p, size_t l) { return indirect(legacy::enc_read_by_type_req)(s, e, u, p, l); }
+		static uint16_t dec_read_by_type_req(const uint8_t* p, size_t l, uint16_t* s, uint16_t* e, bt_uuid_t* u) { return indirect(legacy::dec_read_by_type_req)(p, l, s, e, u); }
+		static uint16_t enc_write_req(uint16_t h, const uint8_t* v, size_t vl, uint8_t* p, size_t l) { return indirect(legacy::enc_write_req)(h, v, vl, p, l); }
+		static uint16_t dec_write_req(const uint8_t* p, size_t l, uint16_t* h, uint8_t* v, size_t* vl) { return indirect(legacy::dec_write_req)(p, l, h, v, vl); }
+		static uint16_t enc_mtu_req(uint16_t m, uint8_t* p, size_t l) { return indirect(legacy::enc_mtu_req)(m, p, l); }
+		static uint16_t dec_mtu_req(const uint8_t* p, size_t l, uint16_t* m) { return indirect(legacy::dec_mtu_req)(p, l, m); }
+		static uint16_t enc_error_resp(uint8_t o, uint16_t h, uint8_t s, uint8_t* p, size_t l) { return indirect(legacy::enc_error_resp)(o, h, s, p, l); }
+	};
+
+	struct SchemaCodec
+	{
+		static uint16_t enc_read_by_type_req(uint16_t s, uint16_t e, bt_uuid_t* u, uint8_t* p, size_t l) { return BLEPP::enc_read_by_type_req(s, e, u, p, l); }
+		static uint16_t dec_read_by_type_req(const uint8_t* p, size_t l, uint16_t* s, uint16_t* e, bt_uuid_t* u) { return BLEPP::dec_read_by_type_req(p, l, s, e, u); }
+		static uint16_t enc_write_req(uint16_t h, const uint8_t* v, size_t vl, uint8_t* p, size_t l) { return BLEPP::enc_write_req(h, v, vl, p, l); }
+		static uint16_t dec_write_req(const uint8_t* p, size_t l, uint16_t* h, uint8_t* v, size_t* vl) { return BLEPP::dec_write_req(p, l, h, v, vl); }
+		static uint16_t enc_mtu_req(uint16_t m, uint8_t* p, size_t l) { return BLEPP::enc_mtu_req(m, p, l); }
+		static uint16_t dec_mtu_req(const uint8_t* p, size_t l, uint16_t* m) { return BLEPP::dec_mtu_req(p, l, m); }
+		static uint16_t enc_error_resp(uint8_t o, uint16_t h, uint8_t s, uint8_t* p, size_t l) { return BLEPP::enc_error_resp(o, h, s, p, l); }
+	};
+
+	//The schema used directly, as code inside the library can. Everything is
+	//inlined into the caller and the sizes are constants.
+	struct InlineCodec
+	{
+		static uint16_t enc_read_by_type_req(uint16_t s, uint16_t e, bt_uuid_t* u, uint8_t* p, size_t l)
+		{
+			if(u->type == BT_UUID16)
+				return ATTSchema::ReadByTypeReq16::encode(p, l, s, e, *u);
+			else
+				return ATTSchema::ReadByTypeReq128::encode(p, l, s, e, *u);
+		}
+
+		static uint16_t dec_read_by_type_req(const uint8_t* p, size_t l, uint16_t* s, uint16_t* e, bt_uuid_t* u)
+		{
+			if(l == ATTSchema::ReadByTypeReq16::size)
+				return ATTSchema::ReadByTypeReq16::decode(p, l, s, e, u);
+			else
+				return ATTSchema::ReadByTypeReq128::decode(p, l, s, e, u);
+		}
+
+		static uint16_t enc_write_req(uint16_t h, const uint8_t* v, size_t vl, uint8_t* p, size_t l)
+		{
+			return ATTSchema::WriteReq::encode_with_value(p, l, v, vl, h);
+		}
+
+		static uint16_t dec_write_req(const uint8_t* p, size_t l, uint16_t* h, uint8_t* v, size_t* vl)
+		{
+			if(!ATTSchema::WriteReq::decode(p, l, h))
+				return 0;
+			*vl = l - ATTSchema::WriteReq::size;
+			memcpy(v, p + ATTSchema::WriteReq::size, *vl);
+			return l;
+		}
+
+		static uint16_t enc_mtu_req(uint16_t m, uint8_t* p, size_t l) { return ATTSchema::MTUReq::encode(p, l, m); }
+		static uint16_t dec_mtu_req(const uint8_t* p, size_t l, uint16_t* m) { return ATTSchema::MTUReq::decode(p, l, m); }
+		static uint16_t enc_error_resp(uint8_t o, uint16_t h, uint8_t s, uint8_t* p, size_t l) { return ATTSchema::ErrorResp::encode(p, l, o, h, s); }
+	};
+
+	template<class Codec> void codec_mix(Bench::State& state)
+	{
+		const vector<Request>& r = requests();
+		uint64_t sum=0;
+
+		for(uint64_t i=0; i < state.iterations; i++)
+			for(const auto& q: r)
+				sum += codec_round<Codec>(q);
+
+		state.items += state.iterations * r.size() * 7;
+		Bench::do_not_optimize(sum);
+	}
+}
+
+BENCHMARK(att_dec_read_by_type_resp_att_data_list)
+{
+	const Corpus& c = corpus();
+	uint64_t sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& pdu: c.pdus)
+		{
+			att_data_list* list = legacy::dec_read_by_type_resp(pdu.data(), pdu.size());
+			for(int j=0; j < list->num; j++)
+				sum += att_get_u16(list->data[j]);
+			state.items += list->num;
+			legacy::att_data_list_free(list);
+		}
+
+	Bench::do_not_optimize(sum);
+}
+
+BENCHMARK(att_dec_read_by_type_resp_att_data_view)
+{
+	const Corpus& c = corpus();
+	uint64_t sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& pdu: c.pdus)
+		{
+			att_data_view list;
+			dec_read_by_type_resp(pdu.data(), pdu.size(), &list);
+			for(int j=0; j < list.num; j++)
+				sum += att_get_u16(att_data_view_get(&list, j));
+			state.items += list.num;
+		}
+
+	Bench::do_not_optimize(sum);
+}
+
+BENCHMARK(att_codec_mix_legacy)
+{
+	codec_mix<LegacyCodec>(state);
+}
+
+BENCHMARK(att_codec_mix_schema)
+{
+	codec_mix<SchemaCodec>(state);
+}
+
+BENCHMARK(att_codec_mix_schema_inline)
+{
+	codec_mix<InlineCodec>(state);
+}
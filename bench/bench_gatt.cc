@@ -0,0 +1,407 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "bench.h"
+
+#include <blepp/blestatemachine.h>
+
+#include <stdexcept>
+#include <cstring>
+#include <random>
+#include <algorithm>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace BLEPP;
+
+namespace
+{
+	//A state machine connected over a socketpair to a "device" which does 
+	//nothing but blast notifications for a single characteristic.
+	struct NotificationFlood
+	{
+		BLEGATTStateMachine gatt;
+		int peer=-1;
+		uint64_t received=0;
+		static const uint16_t handle = 0x0010;
+
+		NotificationFlood()
+		{
+			int fds[2];
+			if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1)
+				throw runtime_error(string("socketpair: ") + strerror(errno));
+
+			gatt.adopt_socket(fds[0]);
+			peer = fds[1];
+
+			PrimaryService service;
+			service.start_handle = 0x0001;
+			service.end_handle = 0xffff;
+			service.uuid = UUID(0x180d);
+
+			Characteristic c(&gatt);
+			c.notify = true;
+			c.uuid = UUID(0x2a37);
+			c.first_handle = handle - 1;
+			c.last_handle = 0xffff;
+			c.value_handle = handle;
+			c.client_characteric_configuration_handle = 0;
+			c.cb_notify_or_indicate = [this](const PDUNotificationOrIndication&)
+			{
+				received++;
+			};
+			service.characteristics.push_back(c);
+			gatt.primary_services.push_back(service);
+		}
+
+		~NotificationFlood()
+		{
+			::close(peer);
+		}
+
+		void blast(int n)
+		{
+			uint8_t pdu[23] = {ATT_OP_HANDLE_NOTIFY, handle & 0xff, handle >> 8};
+			for(int i=0; i < n; i++)
+			{
+				pdu[3] = i;
+				if(write(peer, pdu, sizeof(pdu)) != sizeof(pdu))
+					throw runtime_error(string("write: ") + strerror(errno));
+			}
+		}
+	};
+
+	const int burst=64;
+
+	//A device with 8 services of 8 characteristics, notifying on all of
+	//them in turn, so each notification has to be matched to its
+	//characteristic.
+	struct Dispatch
+	{
+		BLEGATTStateMachine gatt;
+		int peer=-1;
+		uint64_t received=0;
+		vector<uint16_t> handles;
+
+		Dispatch()
+		{
+			int fds[2];
+			if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1)
+				throw runtime_error(string("socketpair: ") + strerror(errno));
+
+			gatt.adopt_socket(fds[0]);
+			peer = fds[1];
+
+			uint16_t h=1;
+			for(int i=0; i < 8; i++)
+			{
+				PrimaryService service;
+				service.start_handle = h++;
+				service.uuid = UUID(0x1800 + i);
+
+				for(int j=0; j < 8; j++)
+				{
+					Characteristic c(&gatt);
+					c.notify = true;
+					c.uuid = UUID(0x2a00 + 8*i + j);
+					c.first_handle = h++;
+					c.value_handle = h++;
+					c.last_handle = h++;
+					c.client_characteric_configuration_handle = c.last_handle;
+					c.cb_notify_or_indicate = [this](const PDUNotificationOrIndication&)
+					{
+						received++;
+					};
+					service.characteristics.push_back(c);
+					handles.push_back(c.value_handle);
+				}
+
+				service.end_handle = h - 1;
+				gatt.primary_services.push_back(service);
+			}
+
+			shuffle(handles.begin(), handles.end(), mt19937(5));
+		}
+
+		~Dispatch()
+		{
+			::close(peer);
+		}
+
+		void blast()
+		{
+			uint8_t pdu[5] = {ATT_OP_HANDLE_NOTIFY};
+			for(uint16_t h: handles)
+			{
+				att_put_u16(h, pdu+1);
+				if(write(peer, pdu, sizeof(pdu)) != sizeof(pdu))
+					throw runtime_error(string("write: ") + strerror(errno));
+			}
+		}
+	};
+
+	//Read By Type responses as seen in characteristic discovery, for both
+	//sizes of UUID and a range of MTUs.
+	const vector<vector<uint8_t>>& characteristic_responses()
+	{
+		static vector<vector<uint8_t>> r;
+		if(r.empty())
+		{
+			mt19937 rng(6);
+			for(int i=0; i < 256; i++)
+			{
+				int mtu = ATT_DEFAULT_LE_MTU + rng() % (247 - ATT_DEFAULT_LE_MTU + 1);
+				int elen = (i & 1) ? 7 : 21;
+				int num = (mtu - 2) / elen;
+
+				vector<uint8_t> pdu = {ATT_OP_READ_BY_TYPE_RESP, uint8_t(elen)};
+				for(int j=0; j < num; j++)
+				{
+					uint16_t h = 2 + 3*j;
+					uint8_t e[21] = {0, 0, GATT_CHARACTERISTIC_FLAGS_READ | GATT_CHARACTERISTIC_FLAGS_NOTIFY, 0, 0};
+					att_put_u16(h, e);
+					att_put_u16(h + 1, e + 3);
+					for(int k=5; k < elen; k++)
+						e[k] = rng();
+					pdu.insert(pdu.end(), e, e + elen);
+				}
+				r.push_back(pdu);
+			}
+		}
+		return r;
+	}
+}
+
+//One read() and one trip through the state machine per notification.
+BENCHMARK(gatt_notification_flood_read_and_process_next)
+{
+	NotificationFlood f;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		state.pause();
+		f.blast(burst);
+		state.resume();
+
+		for(int j=0; j < burst; j++)
+			f.gatt.read_and_process_next();
+	}
+
+	state.items = f.received;
+}
+
+//Everything which is waiting is processed on a single wakeup.
+BENCHMARK(gatt_notification_flood_process_all_pending)
+{
+	NotificationFlood f;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		state.pause();
+		f.blast(burst);
+		state.resume();
+
+		f.gatt.process_all_pending();
+	}
+
+	state.items = f.received;
+}
+
+BENCHMARK(gatt_notification_dispatch_64_characteristics)
+{
+	Dispatch d;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		state.pause();
+		d.blast();
+		state.resume();
+
+		d.gatt.process_all_pending();
+	}
+
+	state.items = d.received;
+}
+
+//Just the generic view of the response.
+BENCHMARK(gatt_pdu_read_by_type_response)
+{
+	const auto& r = characteristic_responses();
+	uint64_t sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& pdu: r)
+		{
+			PDUReadByTypeResponse p(PDUResponse(pdu.data(), pdu.size()));
+			for(int j=0; j < p.num_elements(); j++)
+				sum += p.handle(j) + p.value(j).first[0];
+			state.items += p.num_elements();
+		}
+
+	Bench::do_not_optimize(sum);
+}
+
+//The same responses interpreted as characteristic declarations, as discovery does.
+BENCHMARK(gatt_read_characteristic)
+{
+	const auto& r = characteristic_responses();
+	uint64_t sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& pdu: r)
+		{
+			GATTReadCharacteristic p(PDUResponse(pdu.data(), pdu.size()));
+			for(int j=0; j < p.num_elements(); j++)
+			{
+				GATTReadCharacteristic::Characteristic c = p.characteristic(j);
+				sum += c.handle + c.flags + c.uuid.type;
+			}
+			state.items += p.num_elements();
+		}
+
+	Bench::do_not_optimize(sum);
+}
+
+namespace
+{
+	//Heart rate notification payloads with every combination of fields.
+	const vector<vector<uint8_t>>& heart_rate_values()
+	{
+		static vector<vector<uint8_t>> v;
+		if(v.empty())
+		{
+			mt19937 rng(5);
+			for(int i=0; i < 32; i++)
+			{
+				uint8_t flags = rng() & 0x1f;
+				vector<uint8_t> b = {flags, uint8_t(rng())};
+				if(flags & 0x01)
+					b.push_back(rng());
+				if(flags & 0x08)
+					for(int j=0; j < 2; j++)
+						b.push_back(rng());
+				if(flags & 0x10)
+					for(int j=0; j < 2*int(1 + rng()%4); j++)
+						b.push_back(rng());
+				v.push_back(b);
+			}
+		}
+		return v;
+	}
+}
+
+//Straight into the struct, when the type is known.
+BENCHMARK(gatt_value_decode_heart_rate)
+{
+	const auto& v = heart_rate_values();
+	uint64_t sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& b: v)
+		{
+			HeartRateMeasurement hr;
+			decode(b.data(), b.data() + b.size(), hr);
+			sum += hr.bpm + hr.num_rr_intervals;
+		}
+
+	state.items = state.iterations * v.size();
+	Bench::do_not_optimize(sum);
+}
+
+//Through the decoder a characteristic gets at discovery.
+BENCHMARK(gatt_value_decode_registered)
+{
+	const auto& v = heart_rate_values();
+	const ValueDecoder* d = find_value_decoder(UUID(0x2a37));
+	uint64_t sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& b: v)
+		{
+			CharacteristicValue value;
+			d->decode(b.data(), b.data() + b.size(), value);
+			sum += value.heart_rate.bpm + value.heart_rate.num_rr_intervals;
+		}
+
+	state.items = state.iterations * v.size();
+	Bench::do_not_optimize(sum);
+}
+
+//What discovery pays per characteristic.
+BENCHMARK(gatt_find_value_decoder)
+{
+	vector<UUID> u;
+	for(int i=0; i < 128; i++)
+		u.push_back(UUID(0x2a00 + i));
+	size_t found=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: u)
+			found += find_value_decoder(a) != nullptr;
+
+	state.items = state.iterations * u.size();
+	Bench::do_not_optimize(found);
+}
+
+//A block written as a stream of write commands, with the peer draining the
+//socket whenever it fills. Items are bytes.
+BENCHMARK(gatt_stream_write_commands)
+{
+	NotificationFlood f;
+	vector<uint8_t> data(4096, 0x5a), sink(512);
+
+	//About as many packets as a controller buffers, so it does stall.
+	int sndbuf = 8192;
+	if(setsockopt(f.gatt.socket(), SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) == -1)
+		throw runtime_error(string("setsockopt: ") + strerror(errno));
+	bool done = false;
+	int stalls = 0;
+	f.gatt.cb_stream_complete = [&](const StreamStats& s)
+	{
+		done = true;
+		stalls += s.stalls;
+	};
+
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		done = false;
+		f.gatt.stream_write_commands(NotificationFlood::handle, data.data(), data.size());
+		while(!done)
+		{
+			state.pause();
+			while(recv(f.peer, sink.data(), sink.size(), MSG_DONTWAIT) > 0)
+			{}
+			state.resume();
+
+			f.gatt.write_and_process_next();
+		}
+
+		state.pause();
+		while(recv(f.peer, sink.data(), sink.size(), MSG_DONTWAIT) > 0)
+		{}
+		state.resume();
+	}
+
+	state.items = state.iterations * data.size();
+	state.counters["stalls_per_stream"] = state.iterations ? double(stalls) / state.iterations : 0;
+}
@@ -0,0 +1,279 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "bench.h"
+
+#include <blepp/lescan.h>
+#include <blepp/recorder.h>
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace std;
+using namespace BLEPP;
+
+namespace
+{
+	//An LE Advertising Report event with one report, as read from the HCI socket.
+	vector<uint8_t> report(uint8_t event_type, uint8_t addr_type, const vector<uint8_t>& ad)
+	{
+		vector<uint8_t> p = {HCI_EVENT_PKT, EVT_LE_META_EVENT, uint8_t(ad.size() + 12), 0x02, 1, event_type, addr_type, 0x0B, 0x57, 0x16, 0x21, 0x76, 0x7C, uint8_t(ad.size())};
+		for(uint8_t b: ad)
+			p.push_back(b);
+		p.push_back(0xBC); //RSSI
+		return p;
+	}
+
+	//Adverts as they come off the air: the recordings from tests/test_scan.cc,
+	//and the common beacon formats.
+	const vector<vector<uint8_t>>& adverts()
+	{
+		static vector<vector<uint8_t>> a;
+		if(a.empty())
+		{
+			//Flags and a 128 bit service
+			a.push_back(report(0x00, 0x00, {0x02, 0x01, 0x06, 0x11, 0x06, 0x64, 0x97, 0x81, 0xD1, 0xED, 0xBA, 0x6B, 0xAC, 0x11, 0x4C, 0x9D, 0x34, 0x3E, 0x20, 0x09, 0x73}));
+
+			//Scan response with a name
+			a.push_back(report(0x04, 0x00, {0x17, 0x09, 'D', 'y', 'n', 'o', 'f', 'i', 't', ' ', 'I', 'n', 'c', ' ', 'D', 'O', 'T', 'S', ' ', 'x', 'x', 'x', 'x', '1'}));
+
+			//Apple manufacturer data
+			a.push_back(report(0x00, 0x01, {0x02, 0x01, 0x1A, 0x07, 0xFF, 0x4C, 0x00, 0x10, 0x02, 0x0A, 0x00}));
+
+			//iBeacon
+			a.push_back(report(0x03, 0x01, {0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5}));
+
+			//Eddystone UID
+			a.push_back(report(0x03, 0x01, {0x03, 0x03, 0xAA, 0xFE, 0x17, 0x16, 0xAA, 0xFE, 0x00, 0xEE, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x00, 0x00}));
+
+			//16 bit services, TX power and a short name
+			a.push_back(report(0x00, 0x00, {0x02, 0x01, 0x06, 0x05, 0x02, 0x0D, 0x18, 0x0F, 0x18, 0x02, 0x0A, 0x04, 0x05, 0x08, 'H', 'R', 'M', '1'}));
+
+			for(const auto& p: a)
+				if(HCIScanner::parse_packet(p).size() != 1)
+					throw logic_error("bad advert in the scan benchmark");
+		}
+		return a;
+	}
+}
+
+BENCHMARK(scan_parse_packet)
+{
+	const auto& a = adverts();
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& p: a)
+		{
+			vector<AdvertisingResponse> r = HCIScanner::parse_packet(p);
+			n += r.size();
+			Bench::do_not_optimize(r);
+		}
+
+	state.items = n;
+}
+
+//Filtering the capture, at various rejection rates. Each reports the
+//fraction of adverts rejected alongside the time per advert.
+namespace
+{
+	void parse_filtered(BLEPP::Bench::State& state, const AdvertFilter& filter)
+	{
+		const auto& a = adverts();
+		size_t n=0;
+
+		for(uint64_t i=0; i < state.iterations; i++)
+			for(const auto& p: a)
+			{
+				vector<AdvertisingResponse> r = HCIScanner::parse_packet(p, filter);
+				n += r.size();
+				Bench::do_not_optimize(r);
+			}
+
+		state.items = state.iterations * a.size();
+		state.counters["rejected"] = 1 - double(n) / state.items;
+	}
+}
+
+BENCHMARK(scan_filter_accept_all)
+{
+	parse_filtered(state, AdvertFilter());
+}
+
+BENCHMARK(scan_filter_apple)
+{
+	parse_filtered(state, manufacturer_is(0x004C));
+}
+
+BENCHMARK(scan_filter_eddystone)
+{
+	parse_filtered(state, uuid_is(0xFEAA) && rssi_above(-80));
+}
+
+BENCHMARK(scan_filter_reject_all)
+{
+	parse_filtered(state, address_starts_with("00:00") || name_starts_with("nobody"));
+}
+
+//What it replaces: parsing everything, then looking at the result.
+BENCHMARK(scan_filter_eddystone_after_parse)
+{
+	const auto& a = adverts();
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& p: a)
+		{
+			vector<AdvertisingResponse> r = HCIScanner::parse_packet(p);
+			r.erase(remove_if(r.begin(), r.end(), [](const AdvertisingResponse& x){
+				return x.rssi <= -80 || find(x.UUIDs.begin(), x.UUIDs.end(), UUID(0xFEAA)) == x.UUIDs.end();
+			}), r.end());
+			n += r.size();
+			Bench::do_not_optimize(r);
+		}
+
+	state.items = state.iterations * a.size();
+	state.counters["rejected"] = 1 - double(n) / state.items;
+}
+
+//Beacons straight from the packets, against picking them out of the full parse.
+BENCHMARK(scan_beacons)
+{
+	const auto& a = adverts();
+	vector<BeaconReport> beacons;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& p: a)
+		{
+			beacons.clear();
+			HCIScanner::parse_beacons(p, beacons);
+			Bench::do_not_optimize(beacons);
+		}
+
+	state.items = state.iterations * a.size();
+}
+
+BENCHMARK(scan_beacons_after_parse)
+{
+	const auto& a = adverts();
+	vector<Beacon> beacons;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& p: a)
+		{
+			beacons.clear();
+			for(const auto& r: HCIScanner::parse_packet(p))
+				if(r.beacon.type != BeaconType::None)
+					beacons.push_back(r.beacon);
+			Bench::do_not_optimize(beacons);
+		}
+
+	state.items = state.iterations * a.size();
+}
+
+//Recording the capture, and reading it back. The segments are removed as
+//they're finished, so long runs don't fill the disk.
+namespace
+{
+	string bench_directory()
+	{
+		char dir[] = "/tmp/blepp_bench_XXXXXX";
+		if(mkdtemp(dir) == nullptr)
+			throw runtime_error("Could not make a directory for the recorder benchmark");
+		return dir;
+	}
+
+	vector<RawAdvert> raw_adverts()
+	{
+		vector<RawAdvert> raw;
+		for(const auto& p: adverts())
+			raw.push_back(RawAdvert{p[5], p[6], p.data() + 7, p.data() + 14, p[13], int8_t(p.back())});
+		return raw;
+	}
+}
+
+BENCHMARK(scan_record)
+{
+	string dir = bench_directory();
+	vector<RawAdvert> raw = raw_adverts();
+	auto t = AdvertRecorder::Clock::now();
+
+	{
+		AdvertRecorder r(dir + "/bench");
+		string segment = r.segment();
+		for(uint64_t i=0; i < state.iterations; i++)
+		{
+			for(const auto& a: raw)
+				r.record(a, t += chrono::microseconds(100));
+
+			if(r.segment() != segment)
+			{
+				unlink(segment.c_str());
+				segment = r.segment();
+			}
+		}
+		r.close();
+		unlink(segment.c_str());
+	}
+	rmdir(dir.c_str());
+
+	state.items = state.iterations * raw.size();
+}
+
+BENCHMARK(scan_replay)
+{
+	state.pause();
+	string dir = bench_directory();
+	vector<RawAdvert> raw = raw_adverts();
+	string segment;
+	size_t adverts=0;
+	{
+		AdvertRecorder r(dir + "/bench");
+		segment = r.segment();
+		auto t = AdvertRecorder::Clock::now();
+		for(; adverts < 1000000; adverts += raw.size())
+			for(const auto& a: raw)
+				r.record(a, t += chrono::microseconds(100));
+	}
+	RecordingReader reader(segment);
+	state.resume();
+
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		int64_t sum = 0;
+		reader.for_each([&](AdvertRecorder::Clock::time_point, const RawAdvert& a){
+			sum += a.rssi + a.length + a.address[0];
+		});
+		Bench::do_not_optimize(sum);
+	}
+
+	state.items = state.iterations * reader.size();
+	size_t bytes = 0;
+	for(const auto& b: reader.blocks())
+		bytes += b.payload_offsets[b.size] + (b.payload - reinterpret_cast<const uint8_t*>(b.time_offsets));
+	state.counters["bytes_per_advert"] = double(bytes) / reader.size();
+
+	unlink(segment.c_str());
+	rmdir(dir.c_str());
+}
@@ -0,0 +1,247 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "bench.h"
+
+#include <blepp/simulator.h>
+#include <blepp/notification_log.h>
+
+#include <memory>
+#include <stdexcept>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace std;
+using namespace BLEPP;
+
+//Whole conversations between the state machine and a simulated peripheral.
+//The link runs on simulated time, so these measure the CPU cost on both
+//sides, and the simulated time is reported alongside.
+namespace
+{
+	//A typical connection: 7.5ms intervals, a little latency, 4 PDUs per event.
+	SimulatedPeripheral::Link typical_link()
+	{
+		SimulatedPeripheral::Link link;
+		link.connection_interval = 0.0075;
+		link.latency = 0.0005;
+		link.pdus_per_event = 4;
+		return link;
+	}
+
+	//A few services with a few characteristics each. Returns the handle of
+	//the first characteristic, which can be read, written and notified.
+	uint16_t make_table(BLEGATTServer& s)
+	{
+		uint16_t first=0;
+		for(int i=0; i < 4; i++)
+		{
+			s.add_primary_service(UUID(0x1800 + i));
+			for(int j=0; j < 4; j++)
+			{
+				uint16_t h = s.add_characteristic(UUID(0x2a00 + 4*i + j), GATT_CHARACTERISTIC_FLAGS_READ | GATT_CHARACTERISTIC_FLAGS_WRITE | GATT_CHARACTERISTIC_FLAGS_NOTIFY, {uint8_t(i), uint8_t(j)});
+				if(!first)
+					first = h;
+			}
+		}
+		return first;
+	}
+
+	struct Connected
+	{
+		SimulatedPeripheral sim;
+		BLEGATTStateMachine gatt;
+		uint16_t handle;
+
+		Connected()
+		:sim(typical_link())
+		{
+			handle = make_table(sim.server);
+
+			bool done=false;
+			std::function<void()> cb = [&](){ done = true; };
+			gatt.setup_standard_scan(cb);
+			gatt.adopt_socket(sim.connect());
+			if(!sim.run(gatt, [&](){ return done; }))
+				throw runtime_error("simulated discovery failed");
+		}
+
+		Characteristic& characteristic()
+		{
+			return gatt.primary_services.at(0).characteristics.at(0);
+		}
+	};
+}
+
+BENCHMARK(sim_discovery)
+{
+	double simulated=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		state.pause();
+		unique_ptr<SimulatedPeripheral> sim(new SimulatedPeripheral(typical_link()));
+		make_table(sim->server);
+		BLEGATTStateMachine gatt;
+		bool done=false;
+		std::function<void()> cb = [&](){ done = true; };
+		gatt.setup_standard_scan(cb);
+		state.resume();
+
+		gatt.adopt_socket(sim->connect());
+		if(!sim->run(gatt, [&](){ return done; }))
+			throw runtime_error("simulated discovery failed");
+		simulated = sim->now();
+
+		state.pause();
+		sim.reset();
+		state.resume();
+	}
+
+	state.items = state.iterations;
+	state.counters["simulated_s_per_discovery"] = simulated;
+}
+
+BENCHMARK(sim_read)
+{
+	Connected c;
+	Characteristic& ch = c.characteristic();
+	uint64_t reads=0;
+	ch.cb_read = [&](const PDUReadResponse&)
+	{
+		reads++;
+	};
+
+	double t0 = c.sim.now();
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		ch.read_request();
+		c.sim.run_until_idle(c.gatt);
+	}
+
+	state.items = reads;
+	state.counters["simulated_reads_per_s"] = reads / (c.sim.now() - t0);
+}
+
+BENCHMARK(sim_write)
+{
+	Connected c;
+	Characteristic& ch = c.characteristic();
+
+	double t0 = c.sim.now();
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		ch.write_request((uint8_t)i);
+		c.sim.run_until_idle(c.gatt);
+	}
+
+	state.items = state.iterations;
+	state.counters["simulated_writes_per_s"] = state.iterations / (c.sim.now() - t0);
+}
+
+//Bursts of notifications, from BLEGATTServer::notify() to the callback.
+BENCHMARK(sim_notification_throughput)
+{
+	Connected c;
+	Characteristic& ch = c.characteristic();
+	uint64_t received=0;
+	ch.cb_notify_or_indicate = [&](const PDUNotificationOrIndication&)
+	{
+		received++;
+	};
+	c.gatt.set_notify_and_indicate(ch, true, false);
+	c.sim.run_until_idle(c.gatt);
+
+	uint8_t value[20]={};
+	double t0 = c.sim.now();
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		for(int j=0; j < 16; j++)
+		{
+			value[0] = j;
+			c.sim.server.notify(c.handle, value, sizeof(value));
+		}
+		c.sim.run_until_idle(c.gatt);
+	}
+
+	state.items = received;
+	state.counters["simulated_notifications_per_s"] = received / (c.sim.now() - t0);
+}
+
+//The same, with the kernel's receive times and every notification logged,
+//as blepp-logger does.
+BENCHMARK(sim_notification_logging)
+{
+	char dir[] = "/tmp/blepp_bench_XXXXXX";
+	if(mkdtemp(dir) == nullptr)
+		throw runtime_error("Could not make a directory for the logging benchmark");
+
+	uint64_t received=0;
+	{
+		Connected c;
+		c.gatt.set_kernel_timestamps(true);
+
+		NotificationLogOptions o;
+		o.rotate_bytes = 16 << 20;
+		NotificationLogWriter log(string(dir) + "/bench", o);
+		uint16_t stream = log.add_stream("00:00:00:00:00:00", "2a00", "bench");
+		string file = log.file();
+		SequenceCounter counter;
+		counter.offset = 0;
+
+		Characteristic& ch = c.characteristic();
+		ch.cb_notify_or_indicate = [&](const PDUNotificationOrIndication& n)
+		{
+			const timespec& k = c.gatt.packet_time();
+			log.log(stream, n.value().first, n.value().second - n.value().first, received, k.tv_sec * 1000000000ll + k.tv_nsec);
+			counter.observe(n.value().first, n.value().second - n.value().first);
+			received++;
+		};
+		c.gatt.set_notify_and_indicate(ch, true, false);
+		c.sim.run_until_idle(c.gatt);
+
+		uint8_t value[20]={};
+		for(uint64_t i=0; i < state.iterations; i++)
+		{
+			for(int j=0; j < 16; j++)
+			{
+				value[0]++;
+				c.sim.server.notify(c.handle, value, sizeof(value));
+			}
+			c.sim.run_until_idle(c.gatt);
+
+			//Long runs would otherwise fill the disk.
+			if(log.file() != file)
+			{
+				unlink(file.c_str());
+				file = log.file();
+			}
+		}
+
+		log.close();
+		unlink(file.c_str());
+		state.counters["gaps"] = counter.gaps;
+	}
+	rmdir(dir);
+
+	state.items = received;
+}
@@ -0,0 +1,519 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "bench.h"
+
+#include <blepp/uuid.h>
+#include <blepp/blestatemachine.h>
+#include <blepp/pretty_printers.h>
+#include <blepp/float.h>
+#include <blepp/assigned_numbers.h>
+
+#include <random>
+#include <unordered_map>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+using namespace std;
+using namespace BLEPP;
+
+//The small utilities which end up on every path: UUIDs, the pretty
+//printers used by the logging, and the conversion of measurements.
+namespace
+{
+	const char* uuid_strings[] = {
+		"2a37",
+		"180d",
+		"0x2902",
+		"00002a19-0000-1000-8000-00805f9b34fb",
+		"7309203e-349d-4c11-ac6b-baedd1819764",
+		"6e400001-b5a3-f393-e0a9-e50e24dcca9e",
+		"6e400002-b5a3-f393-e0a9-e50e24dcca9e",
+		"0000fe59-0000-1000-8000-00805f9b34fb",
+	};
+	const int num_uuids = sizeof(uuid_strings) / sizeof(uuid_strings[0]);
+
+	const vector<bt_uuid_t>& uuids()
+	{
+		static vector<bt_uuid_t> u;
+		if(u.empty())
+			for(const char* s: uuid_strings)
+			{
+				bt_uuid_t b;
+				bt_string_to_uuid(&b, s);
+				u.push_back(b);
+			}
+		return u;
+	}
+
+	//Packet sized chunks of bytes, printable and otherwise.
+	const vector<vector<uint8_t>>& payloads()
+	{
+		static vector<vector<uint8_t>> p;
+		if(p.empty())
+		{
+			mt19937 rng(3);
+			for(int i=0; i < 64; i++)
+			{
+				vector<uint8_t> v(1 + rng() % 22);
+				for(auto& b: v)
+					b = (i & 1) ? ' ' + rng() % 95 : rng();
+				p.push_back(v);
+			}
+		}
+		return p;
+	}
+
+	//The iostream formatting the pretty printers used to do, for comparison.
+	namespace legacy
+	{
+		string to_hex(const uint8_t& u)
+		{
+			stringstream os;
+			os << setw(2) << setfill('0') << hex << (int)u;
+			return os.str();
+		}
+
+		string to_hex(const vector<uint8_t>& v)
+		{
+			stringstream os;
+			for(uint8_t b: v)
+				os << to_hex(b) << " ";
+			return os.str();
+		}
+
+		string to_str(const bt_uuid_t& uuid)
+		{
+			if(uuid.type == BT_UUID16)
+			{
+				stringstream os;
+				os << setw(4) << setfill('0') << hex << uuid.value.u16;
+				return os.str();
+			}
+			char s[] = "xoxoxoxo-xoxo-xoxo-xoxo-xoxoxoxoxoxo";
+			bt_uuid_to_string(&uuid, s, sizeof(s));
+			return s;
+		}
+
+		string address(const uint8_t* a)
+		{
+			string address;
+			for(int j=0; j < 6; j++)
+			{
+				ostringstream s;
+				s << hex << setw(2) << setfill('0') << (int)a[j];
+				if(j != 0)
+					s << ":";
+				address = s.str() + address;
+			}
+			return address;
+		}
+
+		//What bluetooth_float_to_IEEE754 used to do.
+		float float_with_pow(const uint8_t* bytes)
+		{
+			int exponent = (int8_t)bytes[3];
+			int mantissa = int32_t((bytes[0] << 8) | (bytes[1] << 16) | (uint32_t(bytes[2]) << 24)) >> 8;
+			return mantissa * pow(10, exponent);
+		}
+	}
+
+	//Temperature measurement style values: a 24 bit mantissa and small
+	//exponents of either sign.
+	const vector<uint8_t>& float_values()
+	{
+		static vector<uint8_t> values;
+		if(values.empty())
+		{
+			mt19937 rng(4);
+			for(int i=0; i < 256; i++)
+			{
+				uint32_t m = rng() & 0xffffff;
+				values.push_back(m);
+				values.push_back(m >> 8);
+				values.push_back(m >> 16);
+				values.push_back(int8_t(rng() % 9) - 4);
+			}
+		}
+		return values;
+	}
+
+	//Blood pressure and pulse oximeter style SFLOATs.
+	const vector<uint8_t>& sfloat_values()
+	{
+		static vector<uint8_t> values;
+		if(values.empty())
+		{
+			mt19937 rng(6);
+			for(int i=0; i < 512; i++)
+			{
+				uint16_t v = (rng() & 0x0fff) | (uint16_t(int(rng() % 5) - 2) << 12);
+				values.push_back(v);
+				values.push_back(v >> 8);
+			}
+		}
+		return values;
+	}
+
+	const uint8_t addresses[][6] = {
+		{0x0B, 0x57, 0x16, 0x21, 0x76, 0x7C},
+		{0x00, 0x1B, 0xEE, 0xB5, 0x80, 0x07},
+		{0xff, 0x01, 0x20, 0x03, 0x40, 0xC5},
+		{0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc},
+	};
+}
+
+//Every pair, so mixed sizes (which need converting to 128 bits) are included.
+BENCHMARK(uuid_bt_uuid_cmp)
+{
+	const auto& u = uuids();
+	int sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: u)
+			for(const auto& b: u)
+				sum += bt_uuid_cmp(&a, &b) == 0;
+
+	state.items = state.iterations * u.size() * u.size();
+	Bench::do_not_optimize(sum);
+}
+
+//The same comparisons with the normalised values.
+BENCHMARK(uuid_operator_eq)
+{
+	vector<UUID> u;
+	for(const auto& b: uuids())
+		u.push_back(UUID::from(b));
+	int sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: u)
+			for(const auto& b: u)
+				sum += a == b;
+
+	state.items = state.iterations * u.size() * u.size();
+	Bench::do_not_optimize(sum);
+}
+
+//Routing notifications by characteristic UUID.
+BENCHMARK(uuid_unordered_map_lookup)
+{
+	unordered_map<UUID, int> routes;
+	for(int i=0; i < 64; i++)
+		routes[UUID(0x2a00 + i)] = i;
+	for(const auto& b: uuids())
+		routes[UUID::from(b)] = 1;
+
+	vector<UUID> keys;
+	for(const auto& r: routes)
+		keys.push_back(r.first);
+	int sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& k: keys)
+			sum += routes.find(k)->second;
+
+	state.items = state.iterations * keys.size();
+	Bench::do_not_optimize(sum);
+}
+
+BENCHMARK(uuid_bt_string_to_uuid)
+{
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const char* s: uuid_strings)
+		{
+			bt_uuid_t u;
+			bt_string_to_uuid(&u, s);
+			Bench::do_not_optimize(u);
+		}
+
+	state.items = state.iterations * num_uuids;
+}
+
+BENCHMARK(uuid_parse)
+{
+	vector<string> strings(uuid_strings, uuid_strings + num_uuids);
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const string& s: strings)
+		{
+			UUID u(s);
+			Bench::do_not_optimize(u);
+		}
+
+	state.items = state.iterations * num_uuids;
+}
+
+//Finding a characteristic the way the examples do, constructing the UUID to
+//look for from a string each time round the loop...
+BENCHMARK(uuid_find_constructed)
+{
+	vector<UUID> u;
+	for(const auto& b: uuids())
+		u.push_back(UUID::from(b));
+	int sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: u)
+			sum += a == UUID("6e400002-b5a3-f393-e0a9-e50e24dcca9e");
+
+	state.items = state.iterations * u.size();
+	Bench::do_not_optimize(sum);
+}
+
+//...and with a literal, which is parsed by the compiler.
+BENCHMARK(uuid_find_literal)
+{
+	vector<UUID> u;
+	for(const auto& b: uuids())
+		u.push_back(UUID::from(b));
+	int sum=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: u)
+			sum += a == "6e400002-b5a3-f393-e0a9-e50e24dcca9e"_uuid;
+
+	state.items = state.iterations * u.size();
+	Bench::do_not_optimize(sum);
+}
+
+//Naming the characteristics in a device, as pretty_print_tree does.
+BENCHMARK(assigned_numbers_lookup_characteristic)
+{
+	vector<UUID> u;
+	for(int i=0; i < 64; i++)
+		u.push_back(UUID(0x2a00 + i));
+	for(const auto& b: uuids())
+		u.push_back(UUID::from(b));
+	size_t found=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: u)
+			found += lookup_characteristic(a) != nullptr;
+
+	state.items = state.iterations * u.size();
+	Bench::do_not_optimize(found);
+}
+
+BENCHMARK(pretty_to_str_uuid)
+{
+	const auto& u = uuids();
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: u)
+			n += to_str(a).size();
+
+	state.items = state.iterations * u.size();
+	Bench::do_not_optimize(n);
+}
+
+BENCHMARK(pretty_to_str_uuid_legacy)
+{
+	const auto& u = uuids();
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: u)
+			n += legacy::to_str(a).size();
+
+	state.items = state.iterations * u.size();
+	Bench::do_not_optimize(n);
+}
+
+//No heap at all.
+BENCHMARK(pretty_to_short_str_uuid)
+{
+	const auto& u = uuids();
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: u)
+		{
+			UUIDString s = to_short_str(a);
+			n += s.size();
+			Bench::do_not_optimize(s);
+		}
+
+	state.items = state.iterations * u.size();
+	Bench::do_not_optimize(n);
+}
+
+BENCHMARK(pretty_to_hex_bytes_legacy)
+{
+	const auto& p = payloads();
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& v: p)
+			n += legacy::to_hex(v).size();
+
+	state.items = state.iterations * p.size();
+	Bench::do_not_optimize(n);
+}
+
+BENCHMARK(pretty_to_hex_chars_bytes)
+{
+	const auto& p = payloads();
+	char buf[3*32];
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& v: p)
+		{
+			n += to_hex_chars(buf, v.data(), v.size()) - buf;
+			Bench::do_not_optimize(buf);
+		}
+
+	state.items = state.iterations * p.size();
+	Bench::do_not_optimize(n);
+}
+
+BENCHMARK(pretty_address_legacy)
+{
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: addresses)
+			n += legacy::address(a).size();
+
+	state.items = state.iterations * 4;
+	Bench::do_not_optimize(n);
+}
+
+BENCHMARK(pretty_address_to_short_str)
+{
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& a: addresses)
+		{
+			AddressString s = address_to_short_str(a);
+			n += s.size();
+			Bench::do_not_optimize(s);
+		}
+
+	state.items = state.iterations * 4;
+	Bench::do_not_optimize(n);
+}
+
+BENCHMARK(pretty_to_hex_bytes)
+{
+	const auto& p = payloads();
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& v: p)
+			n += to_hex(v).size();
+
+	state.items = state.iterations * p.size();
+	Bench::do_not_optimize(n);
+}
+
+BENCHMARK(pretty_to_str_bytes)
+{
+	const auto& p = payloads();
+	size_t n=0;
+
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(const auto& v: p)
+			n += to_str(v).size();
+
+	state.items = state.iterations * p.size();
+	Bench::do_not_optimize(n);
+}
+
+BENCHMARK(float_bluetooth_float_to_IEEE754)
+{
+	const auto& values = float_values();
+	float sum=0;
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(size_t j=0; j < values.size(); j+=4)
+			sum += bluetooth_float_to_IEEE754(&values[j]);
+
+	state.items = state.iterations * values.size() / 4;
+	Bench::do_not_optimize(sum);
+}
+
+BENCHMARK(float_bluetooth_float_with_pow_legacy)
+{
+	const auto& values = float_values();
+	float sum=0;
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(size_t j=0; j < values.size(); j+=4)
+			sum += legacy::float_with_pow(&values[j]);
+
+	state.items = state.iterations * values.size() / 4;
+	Bench::do_not_optimize(sum);
+}
+
+BENCHMARK(float_bluetooth_float_batch)
+{
+	const auto& values = float_values();
+	vector<float> out(values.size() / 4);
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		bluetooth_float_to_IEEE754(values.data(), out.size(), out.data());
+		Bench::do_not_optimize(out);
+	}
+
+	state.items = state.iterations * out.size();
+}
+
+BENCHMARK(float_bluetooth_sfloat)
+{
+	const auto& values = sfloat_values();
+	float sum=0;
+	for(uint64_t i=0; i < state.iterations; i++)
+		for(size_t j=0; j < values.size(); j+=2)
+			sum += bluetooth_sfloat_to_IEEE754(&values[j]);
+
+	state.items = state.iterations * values.size() / 2;
+	Bench::do_not_optimize(sum);
+}
+
+BENCHMARK(float_bluetooth_sfloat_batch)
+{
+	const auto& values = sfloat_values();
+	vector<float> out(values.size() / 2);
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		bluetooth_sfloat_to_IEEE754(values.data(), out.size(), out.data());
+		Bench::do_not_optimize(out);
+	}
+
+	state.items = state.iterations * out.size();
+}
+
+BENCHMARK(float_bluetooth_sfloat_batch_double)
+{
+	const auto& values = sfloat_values();
+	vector<double> out(values.size() / 2);
+	for(uint64_t i=0; i < state.iterations; i++)
+	{
+		bluetooth_sfloat_to_IEEE754(values.data(), out.size(), out.data());
+		Bench::do_not_optimize(out);
+	}
+
+	state.items = state.iterations * out.size();
+}
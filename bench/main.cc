@@ -0,0 +1,139 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "bench.h"
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace std::chrono;
+using namespace BLEPP::Bench;
+
+namespace
+{
+	vector<pair<string, Function>>& registry()
+	{
+		static vector<pair<string, Function>> r;
+		return r;
+	}
+
+	string json_escape(const string& s)
+	{
+		string r;
+		for(char c: s)
+			if(c == '"' || c == '\\')
+				r += string("\\") + c;
+			else
+				r += c;
+		return r;
+	}
+}
+
+BLEPP::Bench::Registration::Registration(const char* name, Function f)
+{
+	registry().emplace_back(name, f);
+}
+
+int main(int argc, char** argv)
+{
+	double min_time = 0.25;
+	string filter;
+
+	for(int i=1; i < argc; i++)
+	{
+		if(argv[i] == string("--min-time") && i+1 < argc)
+			min_time = atof(argv[++i]);
+		else if(argv[i] == string("--filter") && i+1 < argc)
+			filter = argv[++i];
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--filter substring] [--min-time seconds]\n";
+			cerr << "Results are written to stdout as JSON.\n";
+			return 1;
+		}
+	}
+
+	cout << "{\n  \"benchmarks\": [";
+	bool first=true;
+
+	for(const auto& b: registry())
+	{
+		if(!filter.empty() && b.first.find(filter) == string::npos)
+			continue;
+
+		State s;
+		double wall=0, cpu=0;
+
+		//Keep scaling up until the run is long enough to measure.
+		for(uint64_t n=1;;)
+		{
+			s = State();
+			s.iterations = n;
+
+			double c0 = cpu_seconds();
+			auto t0 = Clock::now();
+			b.second(s);
+			auto t1 = Clock::now();
+			cpu = cpu_seconds() - c0 - s.paused_cpu;
+			wall = duration_cast<duration<double>>(t1 - t0 - s.paused).count();
+
+			if(wall >= min_time || n >= (1ull<<40))
+				break;
+
+			//Aim a little past the target, but grow by at most 10x per step
+			//so that the first (cold) runs don't throw the estimate off.
+			double scale = min(min_time * 1.4 / max(wall, 1e-9), 10.0);
+			n = max<uint64_t>(n + 1, n * scale);
+		}
+
+		double ns_per_iter = wall * 1e9 / s.iterations;
+
+		cerr << left << setw(50) << b.first << right << setw(14) << fixed << setprecision(1) << ns_per_iter << " ns/iter";
+		if(s.items)
+			cerr << setw(14) << wall * 1e9 / s.items << " ns/item";
+		cerr << endl;
+
+		cout << (first?"":",") << "\n    {\n";
+		cout << "      \"name\": \"" << json_escape(b.first) << "\",\n";
+		cout << "      \"iterations\": " << s.iterations << ",\n";
+		cout << setprecision(3) << fixed;
+		cout << "      \"real_time_s\": " << wall << ",\n";
+		cout << "      \"cpu_time_s\": " << cpu << ",\n";
+		cout << "      \"ns_per_iteration\": " << ns_per_iter;
+		if(s.items)
+		{
+			cout << ",\n      \"items\": " << s.items;
+			cout << ",\n      \"ns_per_item\": " << wall * 1e9 / s.items;
+			cout << ",\n      \"items_per_second\": " << s.items / wall;
+			cout << ",\n      \"items_per_cpu_second\": " << s.items / max(cpu, 1e-9);
+		}
+		for(const auto& c: s.counters)
+			cout << ",\n      \"" << json_escape(c.first) << "\": " << c.second;
+		cout << "\n    }";
+		first=false;
+	}
+
+	cout << "\n  ]\n}\n";
+}
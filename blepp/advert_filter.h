@@ -0,0 +1,136 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#ifndef __INC_BLEPP_ADVERT_FILTER_H
+#define __INC_BLEPP_ADVERT_FILTER_H
+
+#include <blepp/blestatemachine.h> //for UUID
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace BLEPP
+{
+	///One advertising report as it comes from the controller, before it's
+	///been parsed.
+	struct RawAdvert
+	{
+		uint8_t event_type;
+		uint8_t address_type;
+
+		///6 bytes, least significant first.
+		const uint8_t* address;
+
+		///The AD structures.
+		const uint8_t* data;
+		size_t length;
+
+		int8_t rssi;
+	};
+
+	///A test on adverts, run on the raw report so that unwanted ones can be
+	///dropped before anything is allocated. Filters are built from the
+	///functions below and combined with &&, || and !, for example:
+	///
+	///    scanner.set_filter(uuid_is(0xFEAA) && rssi_above(-80));
+	///
+	///The expression is flattened into a small program, which is evaluated
+	///with the usual short circuiting.
+	class AdvertFilter
+	{
+		public:
+			///Accepts everything.
+			AdvertFilter() = default;
+
+			bool operator()(const RawAdvert&) const;
+
+			bool accepts_all() const
+			{
+				return program.empty();
+			}
+
+			friend AdvertFilter operator&&(const AdvertFilter&, const AdvertFilter&);
+			friend AdvertFilter operator||(const AdvertFilter&, const AdvertFilter&);
+			friend AdvertFilter operator!(const AdvertFilter&);
+
+			friend AdvertFilter uuid_is(const UUID&);
+			friend AdvertFilter manufacturer_is(uint16_t);
+			friend AdvertFilter name_starts_with(const std::string&);
+			friend AdvertFilter rssi_above(int);
+			friend AdvertFilter address_starts_with(const std::string&);
+
+		private:
+			enum class Code: uint8_t
+			{
+				True,
+				And,
+				Or,
+				Not,
+				UUID,
+				Manufacturer,
+				NamePrefix,
+				RSSIAbove,
+				AddressPrefix,
+			};
+
+			//Operators are followed by their operands, and size is the
+			//number of instructions in the whole subexpression, so the
+			//second operand starts at this + 1 + (this+1)->size.
+			struct Instruction
+			{
+				Code code;
+				uint32_t size;
+				int32_t arg;
+
+				//Bytes to compare against, in constants.
+				uint32_t offset;
+				uint32_t length;
+			};
+
+			std::vector<Instruction> program;
+			std::string constants;
+
+			AdvertFilter(Code, int32_t arg, const std::string& bytes);
+			static AdvertFilter combine(Code, const AdvertFilter&, const AdvertFilter&);
+			bool run(const Instruction*, const RawAdvert&) const;
+	};
+
+	///Advertising the service, in a list of service UUIDs or with service data.
+	AdvertFilter uuid_is(const UUID&);
+	AdvertFilter uuid_is(uint16_t);
+
+	///With manufacturer specific data from the company.
+	AdvertFilter manufacturer_is(uint16_t company);
+
+	///With a local name, complete or shortened, starting with the prefix.
+	AdvertFilter name_starts_with(const std::string& prefix);
+
+	///Heard louder than the threshold, in dBm. An unavailable RSSI isn't.
+	AdvertFilter rssi_above(int dBm);
+
+	///From an address starting with the prefix, written the usual way,
+	///e.g. "7c:76:21". Throws std::invalid_argument if it isn't.
+	AdvertFilter address_starts_with(const std::string& prefix);
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __INC_BLEPP_ASSIGNED_NUMBERS_H
+#define __INC_BLEPP_ASSIGNED_NUMBERS_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace BLEPP
+{
+	class UUID;
+
+	///How a characteristic or descriptor value is encoded, if it is a
+	///single field. Struct means there's more than one field.
+	enum class ValueFormat: std::uint8_t
+	{
+		Unknown,
+		Struct,
+		UTF8S,
+		UInt8,
+		UInt16,
+		UInt24,
+		UInt32,
+		SInt8,
+		SInt16,
+		SInt24,
+		SInt32,
+		SFloat,
+		Float,
+	};
+
+	///An entry in one of the Bluetooth SIG assigned numbers lists.
+	struct AssignedNumber
+	{
+		std::uint16_t number;
+		const char* name;
+		const char* id;      ///< org.bluetooth.xxx identifier, or "" if there isn't one.
+		ValueFormat format;
+	};
+
+	enum class AssignedNumberKind
+	{
+		Service,
+		Characteristic,
+		Descriptor,
+		Company,
+		ADType,
+	};
+
+	///One of the lists, sorted by number.
+	struct AssignedNumberTable
+	{
+		const AssignedNumber* first;
+		const AssignedNumber* last;
+
+		const AssignedNumber* begin() const
+		{
+			return first;
+		}
+
+		const AssignedNumber* end() const
+		{
+			return last;
+		}
+
+		std::size_t size() const
+		{
+			return last - first;
+		}
+	};
+
+	AssignedNumberTable assigned_numbers(AssignedNumberKind kind);
+
+	///Find a number in a list by binary search. The tables are generated
+	///from src/assigned_numbers.txt at build time and need no initialisation,
+	///so these are safe to call from anywhere. They return nullptr for
+	///numbers which aren't known.
+	const AssignedNumber* lookup_assigned_number(AssignedNumberKind kind, std::uint16_t number);
+
+	///Only UUIDs in the Bluetooth base range have assigned numbers, however
+	///they happen to be written.
+	const AssignedNumber* lookup_service(const UUID& uuid);
+	const AssignedNumber* lookup_characteristic(const UUID& uuid);
+	const AssignedNumber* lookup_descriptor(const UUID& uuid);
+
+	///Company identifiers, as found at the start of manufacturer specific data.
+	const AssignedNumber* lookup_company(std::uint16_t id);
+
+	///Advertising data types (GAP::AD_Type and the rest).
+	const AssignedNumber* lookup_ad_type(std::uint8_t type);
+}
+
+#endif
@@ -44,6 +44,9 @@
  *
  */
 
+#ifndef __INC_BLEPP_ATT_H
+#define __INC_BLEPP_ATT_H
+
 #include <blepp/uuid.h>
 
 namespace BLEPP
@@ -56,6 +59,8 @@ namespace BLEPP
 #define GATT_UUID_PRIMARY 0x2800
 #define GATT_CHARACTERISTIC 0x2803
 #define GATT_CLIENT_CHARACTERISTIC_CONFIGURATION 0x2902
+#define GATT_CLIENT_CHARACTERISTIC_CONFIGURATION_NOTIFY   0x0001
+#define GATT_CLIENT_CHARACTERISTIC_CONFIGURATION_INDICATE 0x0002
 #define GATT_CHARACTERISTIC_FLAGS_BROADCAST     0x01
 #define GATT_CHARACTERISTIC_FLAGS_READ          0x02
 #define GATT_CHARACTERISTIC_FLAGS_WRITE_WITHOUT_RESPONSE 0x04
@@ -96,6 +101,9 @@ namespace BLEPP
 #define ATT_OP_HANDLE_CNF		0x1E
 #define ATT_OP_SIGNED_WRITE_CMD		0xD2
 
+	/* Opcodes with this bit set are commands, which get no response (3.F.3.3.1) */
+#define ATT_OP_CMD_FLAG			0x40
+
 	/* Error codes for Error response PDU */
 #define ATT_ECODE_INVALID_HANDLE		0x01
 #define ATT_ECODE_READ_NOT_PERM			0x02
@@ -150,6 +158,19 @@ namespace BLEPP
 		uint8_t **data;
 	};
 
+	/* Allocation free alternative to att_data_list. It points at the
+	 * elements in place in the PDU, so the PDU must outlive it. */
+	struct att_data_view {
+		uint16_t num;
+		uint16_t len;
+		const uint8_t *data;
+	};
+
+	static inline const uint8_t *att_data_view_get(const struct att_data_view *list, int i)
+	{
+		return list->data + i * list->len;
+	}
+
 	struct att_range {
 		uint16_t start;
 		uint16_t end;
@@ -261,6 +282,7 @@ namespace BLEPP
 	//uint16_t enc_find_by_type_resp(GSList *ranges, uint8_t *pdu, size_t len);
 	//GSList *dec_find_by_type_resp(const uint8_t *pdu, size_t len);
 	struct att_data_list *dec_read_by_grp_resp(const uint8_t *pdu, size_t len);
+	uint16_t dec_read_by_grp_resp(const uint8_t *pdu, size_t len, struct att_data_view *list);
 	uint16_t enc_read_by_type_req(uint16_t start, uint16_t end, bt_uuid_t *uuid,
 			uint8_t *pdu, size_t len);
 	uint16_t dec_read_by_type_req(const uint8_t *pdu, size_t len, uint16_t *start,
@@ -272,6 +294,7 @@ namespace BLEPP
 	uint16_t dec_write_cmd(const uint8_t *pdu, size_t len, uint16_t *handle,
 			uint8_t *value, size_t *vlen);
 	struct att_data_list *dec_read_by_type_resp(const uint8_t *pdu, size_t len);
+	uint16_t dec_read_by_type_resp(const uint8_t *pdu, size_t len, struct att_data_view *list);
 	uint16_t enc_write_req(uint16_t handle, const uint8_t *value, size_t vlen,
 			uint8_t *pdu, size_t len);
 	uint16_t dec_write_req(const uint8_t *pdu, size_t len, uint16_t *handle,
@@ -299,6 +322,8 @@ namespace BLEPP
 			uint8_t *pdu, size_t len);
 	struct att_data_list *dec_find_info_resp(const uint8_t *pdu, size_t len,
 			uint8_t *format);
+	uint16_t dec_find_info_resp(const uint8_t *pdu, size_t len, uint8_t *format,
+			struct att_data_view *list);
 	uint16_t enc_notification(uint16_t handle, uint8_t *value, size_t vlen,
 			uint8_t *pdu, size_t len);
 	uint16_t enc_indication(uint16_t handle, uint8_t *value, size_t vlen,
@@ -321,3 +346,5 @@ namespace BLEPP
 	uint16_t enc_exec_write_req(uint8_t flags, uint8_t *pdu, size_t len);
 	uint16_t dec_exec_write_resp(const uint8_t *pdu, size_t len);
 }
+
+#endif
@@ -29,8 +29,8 @@
 	The format of the packets is covered in Core Spec 4.0 3.F.3.4
 
 	Logic errors (such as trying to construct a PDU packet class from the 
-	wrong PDU data) come back as std::logic_error. Runtime errors, such as
-	invalid packets come back as exceptions derived from std::runtime_error.
+	wrong PDU data) come back as std::logic_error. Invalid packets come back
+	as InvalidPDU, which is derived from std::runtime_error.
 
 */
 
@@ -42,10 +42,12 @@
 #include <utility>
 
 #include <blepp/att.h>
+#include <blepp/att_schema.h>
 #include <blepp/logging.h>
 
 namespace BLEPP
 {
+	class InvalidPDU: public std::runtime_error { using runtime_error::runtime_error; };
 
 	/* Basic PDU response as in 3.F.3.3.1 */
 	class PDUResponse
@@ -65,6 +67,14 @@ namespace BLEPP
 					error<std::logic_error>(std::string("Error converting PDUResponse to ") +att_op2str(target)  + ". Type is " + att_op2str(type()));
 			}
 
+			//Once this has passed, the fixed part of the PDU can be read without
+			//further checks.
+			void size_check(int min_length, const char* name) const
+			{
+				if(length < min_length)
+					error<InvalidPDU>(std::string("Invalid packet length for ") + name);
+			}
+
 		public:
 
 			const uint8_t* data; //Pointer to the underlying data
@@ -118,21 +128,22 @@ namespace BLEPP
 				:PDUResponse(p_)
 			{
 				type_check(ATT_OP_ERROR);
+				size_check(ATTSchema::ErrorResp::size, "PDUErrorResponse");
 			}
 
 			uint8_t request_opcode() const
 			{
-				return uint8(1);
+				return ATTSchema::ErrorResp::get<0>(data);
 			}
 
 			uint16_t handle() const
 			{
-				return uint16(2);
+				return ATTSchema::ErrorResp::get<1>(data);
 			}
 
 			uint8_t error_code() const
 			{
-				return uint8(4);
+				return ATTSchema::ErrorResp::get<2>(data);
 			}
 
 			const char* error_str() const
@@ -161,7 +172,7 @@ namespace BLEPP
 
 			std::pair<const uint8_t*, const uint8_t*> value() const
 			{
-				return std::make_pair(data + 1, data + length);
+				return std::make_pair(data + ATTSchema::ReadResp::size, data + length);
 			}
 	};
 
@@ -175,39 +186,40 @@ namespace BLEPP
 			:PDUResponse(p_)
 			{
 				type_check(ATT_OP_READ_BY_TYPE_RESP);
+				size_check(Header::size, "PDUReadByTypeResponse");
 
-				if((length - 2) % element_size() != 0)
-					error<std::runtime_error>("Invalid packet length for PDUReadByTypeResponse");
+				if(element_size() < Element::size || (length - Header::size) % element_size() != 0)
+					error<InvalidPDU>("Invalid packet length for PDUReadByTypeResponse");
 			}
 
 
 			//Size of each element in the response
 			int element_size() const
 			{
-				return uint8(1);
+				return Header::get<0>(data);
 			}
 
 			//Elements consist of a handle and a value.
 			//This is the size of just the value.
 			int value_size() const
 			{
-				return uint8(1) -2;
+				return element_size() - Element::size;
 			}
 
 			int num_elements() const
 			{
-				return (length - 1) / element_size();
+				return (length - Header::size) / element_size();
 			}
 
 			uint16_t handle(int i) const
 			{
-				return uint16(i*element_size() + 2);
+				return Element::get<0>(element(i));
 			}
 
 			//Return pointer span of the ith chunk of data
 			std::pair<const uint8_t*, const uint8_t*> value(int i) const
 			{
-				const uint8_t* begin = data + i*element_size() + 4;
+				const uint8_t* begin = element(i) + Element::size;
 				return std::make_pair(begin, begin + value_size());
 			}
 
@@ -217,7 +229,17 @@ namespace BLEPP
 				if(value_size() != 2)
 					error<std::logic_error>("Wrong size for uint16 in PDUReadByTypeResponse");
 
-				return uint16(i*element_size()+4);
+				return ATTSchema::U16::get(value(i).first);
+			}
+
+		private:
+			typedef ATTSchema::ReadByTypeResp Header;
+			typedef ATTSchema::ReadByTypeElement Element;
+
+			const uint8_t* element(int i) const
+			{
+				assert(i >= 0 && i < num_elements());
+				return data + Header::size + i*element_size();
 			}
 	};
 
@@ -230,40 +252,41 @@ namespace BLEPP
 			:PDUResponse(p_)
 			{
 				type_check(ATT_OP_READ_BY_GROUP_RESP);
+				size_check(Header::size, "PDUReadGroupByTypeResponse");
 
-				if((length - 2) % element_size() != 0)
-					error<std::runtime_error>("Invalid packet length for PDUReadGroupByTypeResponse");
+				if(element_size() < Element::size || (length - Header::size) % element_size() != 0)
+					error<InvalidPDU>("Invalid packet length for PDUReadGroupByTypeResponse");
 
 			}
 
 			int value_size() const
 			{
-				return uint8(1) -4;
+				return element_size() - Element::size;
 			}
 
 			int element_size() const
 			{
-				return uint8(1);
+				return Header::get<0>(data);
 			}
 
 			int num_elements() const
 			{
-				return (length - 2) / element_size();
+				return (length - Header::size) / element_size();
 			}
 
 			uint16_t start_handle(int i) const
 			{
-				return uint16(i*element_size() + 2);
+				return Element::get<0>(element(i));
 			}
 
 			uint16_t end_handle(int i) const
 			{
-				return uint16(i*element_size() + 4);
+				return Element::get<1>(element(i));
 			}
 
 			std::pair<const uint8_t*, const uint8_t*> value(int i) const
 			{
-				const uint8_t* begin = data + i*element_size() + 6;
+				const uint8_t* begin = element(i) + Element::size;
 				return std::make_pair(begin, begin + value_size());
 			}
 
@@ -271,9 +294,18 @@ namespace BLEPP
 			{
 				if(value_size() != 2)
 					error<std::logic_error>("Wrong size for uint16 in PDUReadGroupByTypeResponse");
-				return uint16(i*element_size()+4);
+				return ATTSchema::U16::get(value(i).first);
 			}
 
+		private:
+			typedef ATTSchema::ReadByGroupResp Header;
+			typedef ATTSchema::ReadByGroupElement Element;
+
+			const uint8_t* element(int i) const
+			{
+				assert(i >= 0 && i < num_elements());
+				return data + Header::size + i*element_size();
+			}
 	};
 
 	class PDUFindInformationResponse: public PDUResponse
@@ -284,38 +316,49 @@ namespace BLEPP
 			:PDUResponse(p_)
 			{
 				type_check(ATT_OP_FIND_INFO_RESP);
-				if( (length-2) % element_size())
-					error<std::runtime_error>("Invalid packet length for PDUReadGroupByTypeResponse");
+				size_check(Header::size, "PDUFindInformationResponse");
+				if( (length - Header::size) % element_size())
+					error<InvalidPDU>("Invalid packet length for PDUFindInformationResponse");
 			}
 
 			bool is_16_bit() const
 			{
 				//Table 3.8
-				return uint8(1) == 1;
+				return Header::get<0>(data) == ATT_FIND_INFO_RESP_FMT_16BIT;
 
 			};
 
 			int element_size() const
 			{
-				return 2 + (is_16_bit() ? 2 : 16);
+				return is_16_bit() ? ATTSchema::FindInfoElement16::size : ATTSchema::FindInfoElement128::size;
 			}
 
 			int num_elements() const
 			{
-				return (length - 2) / element_size();
+				return (length - Header::size) / element_size();
 			}
 
 			uint16_t handle(int i) const
 			{
-				return uint16(2 + i * element_size());
+				//The handle is in the same place in both layouts
+				return ATTSchema::FindInfoElement16::get<0>(element(i));
 			}
 
 			bt_uuid_t uuid(int i) const
 			{
 				if(is_16_bit())
-					return att_get_uuid16(data + 2 + 2 + i * element_size());
+					return ATTSchema::FindInfoElement16::get<1>(element(i));
 				else
-					return att_get_uuid128(data + 2 + 2 + i * element_size());
+					return ATTSchema::FindInfoElement128::get<1>(element(i));
+			}
+
+		private:
+			typedef ATTSchema::FindInfoResp Header;
+
+			const uint8_t* element(int i) const
+			{
+				assert(i >= 0 && i < num_elements());
+				return data + Header::size + i*element_size();
 			}
 	};
 
@@ -328,6 +371,9 @@ namespace BLEPP
 			{
 				if(type() != ATT_OP_HANDLE_NOTIFY && type() != ATT_OP_HANDLE_IND)
 					error<std::logic_error>(std::string("Error converting PDUResponse to NotifyOrIndicate. Type is ") + att_op2str(type()));
+
+				//Notifications and indications have the same layout.
+				size_check(ATTSchema::Notification::size, "PDUNotificationOrIndication");
 			}
 
 			bool notification() const
@@ -343,13 +389,13 @@ namespace BLEPP
 
 			uint16_t handle() const
 			{
-				return uint16(1);
+				return ATTSchema::Notification::get<0>(data);
 			}
 
 			//Return pointer span of the ith chunk of data
 			std::pair<const uint8_t*, const uint8_t*> value() const
 			{
-				return std::make_pair(data + 3, data + length);
+				return std::make_pair(data + ATTSchema::Notification::size, data + length);
 			}
 	};
 
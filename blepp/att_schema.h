@@ -0,0 +1,268 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __INC_BLEPP_ATT_SCHEMA_H
+#define __INC_BLEPP_ATT_SCHEMA_H
+
+#include <cstring>
+#include <algorithm>
+#include <blepp/att.h>
+
+/*
+	The layouts of the ATT PDUs (Core Spec 4.0 3.F.3.4), written down once.
+
+	A PDU is an opcode followed by a list of fixed size fields, and possibly
+	a variable length value. Everything about the fixed part (size, field
+	offsets, how to read and write each field) is known at compile time, so the
+	encoders and decoders in att.cc and the accessors in att_pdu.h are generated
+	from these descriptions with a single bounds check each, and no branching
+	on field sizes. Where the size depends on the contents (16 or 128 bit UUIDs)
+	there are two layouts, and the caller picks one.
+*/
+namespace BLEPP
+{
+	namespace ATTSchema
+	{
+		////////////////////////////////////////////////////////////////////////////////
+		//
+		// Field types
+		//
+
+		struct U8
+		{
+			typedef uint8_t type;
+			static const int size=1;
+			static void put(uint8_t* p, type v) { p[0] = v; }
+			static type get(const uint8_t* p) { return p[0]; }
+		};
+
+		struct U16
+		{
+			typedef uint16_t type;
+			static const int size=2;
+			static void put(uint8_t* p, type v) { att_put_u16(v, p); }
+			static type get(const uint8_t* p) { return att_get_u16(p); }
+		};
+
+		struct UUID16
+		{
+			typedef bt_uuid_t type;
+			static const int size=2;
+			static void put(uint8_t* p, const type& v) { att_put_u16(v.value.u16, p); }
+			static type get(const uint8_t* p) { return att_get_uuid16(p); }
+		};
+
+		struct UUID128
+		{
+			typedef bt_uuid_t type;
+			static const int size=16;
+			static void put(uint8_t* p, const type& v) { att_put_u128(v.value.u128, p); }
+			static type get(const uint8_t* p) { return att_get_uuid128(p); }
+		};
+
+		////////////////////////////////////////////////////////////////////////////////
+		//
+		// Lists of fields
+		//
+
+		template<class... Fields> struct Size;
+
+		template<> struct Size<>
+		{
+			static const int value=0;
+		};
+
+		template<class F, class... Rest> struct Size<F, Rest...>
+		{
+			static const int value = F::size + Size<Rest...>::value;
+		};
+
+		//The Ith field and its offset
+		template<int I, class... Fields> struct At;
+
+		template<class F, class... Rest> struct At<0, F, Rest...>
+		{
+			typedef F type;
+			static const int offset=0;
+		};
+
+		template<int I, class F, class... Rest> struct At<I, F, Rest...>
+		{
+			typedef typename At<I-1, Rest...>::type type;
+			static const int offset = F::size + At<I-1, Rest...>::offset;
+		};
+
+		template<class... Fields> struct Layout
+		{
+			static const int size = Size<Fields...>::value;
+
+			template<int I> struct Field
+			{
+				typedef typename At<I, Fields...>::type layout;
+				typedef typename layout::type type;
+				static const int offset = At<I, Fields...>::offset;
+			};
+
+			//Unchecked: the caller must have checked the size already.
+			template<int I> static typename Field<I>::type get(const uint8_t* p)
+			{
+				return Field<I>::layout::get(p + Field<I>::offset);
+			}
+
+			template<int I> static void put(uint8_t* p, const typename Field<I>::type& v)
+			{
+				Field<I>::layout::put(p + Field<I>::offset, v);
+			}
+
+			static void put_all(uint8_t* p, const typename Fields::type&... v)
+			{
+				put_from<0>(p, v...);
+			}
+
+			static void get_all(const uint8_t* p, typename Fields::type*... v)
+			{
+				get_from<0>(p, v...);
+			}
+
+			private:
+				template<int I> static void put_from(uint8_t*) {}
+
+				template<int I, class V, class... Vs> static void put_from(uint8_t* p, const V& v, const Vs&... vs)
+				{
+					put<I>(p, v);
+					put_from<I+1>(p, vs...);
+				}
+
+				template<int I> static void get_from(const uint8_t*) {}
+
+				template<int I, class V, class... Vs> static void get_from(const uint8_t* p, V* v, Vs*... vs)
+				{
+					*v = get<I>(p);
+					get_from<I+1>(p, vs...);
+				}
+		};
+
+		inline bool all_nonnull()
+		{
+			return true;
+		}
+
+		template<class V, class... Vs> bool all_nonnull(const V* v, const Vs*... vs)
+		{
+			return v != NULL && all_nonnull(vs...);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////
+		//
+		// PDUs
+		//
+
+		template<uint8_t Opcode, class... Fields> struct PDU
+		{
+			typedef Layout<Fields...> fields;
+			static const uint8_t opcode = Opcode;
+			static const int size = 1 + fields::size;
+
+			template<int I> static typename fields::template Field<I>::type get(const uint8_t* pdu)
+			{
+				return fields::template get<I>(pdu + 1);
+			}
+
+			static bool matches(const uint8_t* pdu, size_t len)
+			{
+				return pdu != NULL && len >= (size_t)size && pdu[0] == Opcode;
+			}
+
+			//Encode the fixed part. Returns the number of bytes written, or 0 if it doesn't fit.
+			static uint16_t encode(uint8_t* pdu, size_t len, const typename Fields::type&... v)
+			{
+				if(pdu == NULL || len < (size_t)size)
+					return 0;
+
+				pdu[0] = Opcode;
+				fields::put_all(pdu + 1, v...);
+				return size;
+			}
+
+			//Encode the fixed part followed by as much of value as fits.
+			static uint16_t encode_with_value(uint8_t* pdu, size_t len, const uint8_t* value, size_t vlen, const typename Fields::type&... v)
+			{
+				uint16_t n = encode(pdu, len, v...);
+				if(n == 0)
+					return 0;
+
+				vlen = std::min(vlen, len - n);
+				if(vlen > 0)
+					memcpy(pdu + n, value, vlen);
+				return n + vlen;
+			}
+
+			//Decode the fixed part. Returns its size, or 0 if the PDU is the wrong type or too short.
+			static uint16_t decode(const uint8_t* pdu, size_t len, typename Fields::type*... v)
+			{
+				if(!matches(pdu, len) || !all_nonnull(v...))
+					return 0;
+
+				fields::get_all(pdu + 1, v...);
+				return size;
+			}
+		};
+
+		typedef PDU<ATT_OP_ERROR, U8, U16, U8>                   ErrorResp;       //Request opcode, handle, error code
+		typedef PDU<ATT_OP_MTU_REQ, U16>                         MTUReq;
+		typedef PDU<ATT_OP_MTU_RESP, U16>                        MTUResp;
+		typedef PDU<ATT_OP_FIND_INFO_REQ, U16, U16>              FindInfoReq;     //Start, end
+		typedef PDU<ATT_OP_FIND_INFO_RESP, U8>                   FindInfoResp;    //Format, then elements
+		typedef PDU<ATT_OP_FIND_BY_TYPE_REQ, U16, U16, UUID16>   FindByTypeReq;   //Start, end, type, then value
+		typedef PDU<ATT_OP_FIND_BY_TYPE_RESP>                    FindByTypeResp;  //Elements
+		typedef PDU<ATT_OP_READ_BY_TYPE_REQ, U16, U16, UUID16>   ReadByTypeReq16; //Start, end, type
+		typedef PDU<ATT_OP_READ_BY_TYPE_REQ, U16, U16, UUID128>  ReadByTypeReq128;
+		typedef PDU<ATT_OP_READ_BY_TYPE_RESP, U8>                ReadByTypeResp;  //Element length, then elements
+		typedef PDU<ATT_OP_READ_REQ, U16>                        ReadReq;         //Handle
+		typedef PDU<ATT_OP_READ_RESP>                            ReadResp;        //Value
+		typedef PDU<ATT_OP_READ_BLOB_REQ, U16, U16>              ReadBlobReq;     //Handle, offset
+		typedef PDU<ATT_OP_READ_BLOB_RESP>                       ReadBlobResp;    //Value
+		typedef PDU<ATT_OP_READ_BY_GROUP_REQ, U16, U16, UUID16>  ReadByGroupReq16;//Start, end, type
+		typedef PDU<ATT_OP_READ_BY_GROUP_REQ, U16, U16, UUID128> ReadByGroupReq128;
+		typedef PDU<ATT_OP_READ_BY_GROUP_RESP, U8>               ReadByGroupResp; //Element length, then elements
+		typedef PDU<ATT_OP_WRITE_REQ, U16>                       WriteReq;        //Handle, then value
+		typedef PDU<ATT_OP_WRITE_RESP>                           WriteResp;
+		typedef PDU<ATT_OP_WRITE_CMD, U16>                       WriteCmd;        //Handle, then value
+		typedef PDU<ATT_OP_PREP_WRITE_REQ, U16, U16>             PrepWriteReq;    //Handle, offset, then value
+		typedef PDU<ATT_OP_PREP_WRITE_RESP, U16, U16>            PrepWriteResp;   //Handle, offset, then value
+		typedef PDU<ATT_OP_EXEC_WRITE_REQ, U8>                   ExecWriteReq;    //Flags
+		typedef PDU<ATT_OP_EXEC_WRITE_RESP>                      ExecWriteResp;
+		typedef PDU<ATT_OP_HANDLE_NOTIFY, U16>                   Notification;    //Handle, then value
+		typedef PDU<ATT_OP_HANDLE_IND, U16>                      Indication;      //Handle, then value
+		typedef PDU<ATT_OP_HANDLE_CNF>                           Confirmation;
+
+		//Elements of the lists in responses. Each is followed by a value
+		//of the size given in the header, less the size of the fields.
+		typedef Layout<U16>          ReadByTypeElement;    //Handle
+		typedef Layout<U16, U16>     ReadByGroupElement;   //Start, end
+		typedef Layout<U16, U16>     FindByTypeElement;    //Found handle, group end handle
+		typedef Layout<U16, UUID16>  FindInfoElement16;    //Handle, type
+		typedef Layout<U16, UUID128> FindInfoElement128;
+	}
+}
+
+#endif
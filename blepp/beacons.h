@@ -0,0 +1,150 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#ifndef __INC_BLEPP_BEACONS_H
+#define __INC_BLEPP_BEACONS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+//Decoded beacon frames. Each is a plain struct filled in straight from one
+//AD structure (length, type, data) of an advert, without allocating, so
+//heavy beacon traffic can be handled cheaply. Multi-byte fields are in host
+//order. The formats are:
+//
+//  iBeacon:   Apple manufacturer data (0x004C), type 0x02, length 0x15
+//  AltBeacon: manufacturer data with beacon code 0xBEAC
+//  Eddystone: 16 bit service data for 0xFEAA, frame type 0x00 (UID),
+//             0x10 (URL), 0x20 (TLM, unencrypted only) or 0x30 (EID)
+namespace BLEPP
+{
+	class UUID;
+
+	struct IBeacon
+	{
+		std::uint8_t proximity_uuid[16];  ///< As sent: most significant byte first
+		std::uint16_t major;
+		std::uint16_t minor;
+		std::int8_t measured_power;       ///< RSSI at 1m, dBm
+
+		UUID uuid() const;
+	};
+
+	struct AltBeacon
+	{
+		std::uint16_t manufacturer;
+		std::uint8_t beacon_id[20];
+		std::int8_t reference_rssi;       ///< RSSI at 1m, dBm
+		std::uint8_t manufacturer_reserved;
+	};
+
+	struct EddystoneUID
+	{
+		std::int8_t tx_power;             ///< At 0m, dBm
+		std::uint8_t name_space[10];
+		std::uint8_t instance[6];
+	};
+
+	struct EddystoneURL
+	{
+		static const int max_length = 17;
+
+		std::int8_t tx_power;             ///< At 0m, dBm
+		std::uint8_t scheme;              ///< 0: http://www. 1: https://www. 2: http:// 3: https://
+		std::uint8_t length;
+		std::uint8_t encoded[max_length]; ///< With the expansion codes for .com/ etc.
+
+		///The URL written out in full.
+		std::string url() const;
+	};
+
+	struct EddystoneTLM
+	{
+		std::uint16_t battery_mv;         ///< 0 if not known
+		std::int16_t temperature;         ///< 1/256 degrees C, -32768 if not known
+		std::uint32_t advert_count;       ///< Since power on or reboot
+		std::uint32_t uptime;             ///< 1/10 s, since power on or reboot
+
+		bool has_temperature() const { return temperature != -32768; }
+		double temperature_celsius() const { return temperature / 256.0; }
+	};
+
+	struct EddystoneEID
+	{
+		std::int8_t tx_power;             ///< At 0m, dBm
+		std::uint8_t eid[8];
+	};
+
+	enum class BeaconType: std::uint8_t
+	{
+		None,
+		IBeacon,
+		AltBeacon,
+		EddystoneUID,
+		EddystoneURL,
+		EddystoneTLM,
+		EddystoneEID,
+	};
+
+	///Any of the above.
+	struct Beacon
+	{
+		BeaconType type;
+		union
+		{
+			IBeacon ibeacon;
+			AltBeacon altbeacon;
+			EddystoneUID eddystone_uid;
+			EddystoneURL eddystone_url;
+			EddystoneTLM eddystone_tlm;
+			EddystoneEID eddystone_eid;
+		};
+	};
+
+	///Decode one AD structure, starting with its length byte and with
+	///size bytes available. Return false if it's not a beacon frame of that
+	///kind.
+	bool decode(const std::uint8_t* ad, std::size_t size, IBeacon&);
+	bool decode(const std::uint8_t* ad, std::size_t size, AltBeacon&);
+	bool decode(const std::uint8_t* ad, std::size_t size, EddystoneUID&);
+	bool decode(const std::uint8_t* ad, std::size_t size, EddystoneURL&);
+	bool decode(const std::uint8_t* ad, std::size_t size, EddystoneTLM&);
+	bool decode(const std::uint8_t* ad, std::size_t size, EddystoneEID&);
+
+	///Decode one AD structure as whichever kind of beacon frame it is.
+	bool decode(const std::uint8_t* ad, std::size_t size, Beacon&);
+
+	///Find the first beacon frame in a whole advert's data.
+	bool find_beacon(const std::uint8_t* data, std::size_t length, Beacon&);
+
+	///A beacon frame as heard in an advertising report.
+	struct BeaconReport
+	{
+		std::uint8_t address[6];          ///< Least significant byte first
+		std::uint8_t address_type;
+		std::int8_t rssi;
+		Beacon beacon;
+	};
+}
+
+#endif
@@ -28,12 +28,17 @@
 #include <string>
 #include <blepp/att_pdu.h>
 
+#include <sys/socket.h>
+#include <ctime>
+
 namespace BLEPP
 {
 
 	//Almost zero resource to represent the ATT protocol on a BLE
 	//device. This class does none of its own memory management, and will not generally allocate
-	//or do other nasty things. Oh no, it allocates a buffer! FIXME!
+	//or do other nasty things. Oh no, it allocates a buffer! FIXME! It's only for receiving
+	//into (and it knows the MTU): sends encode the header on the stack and gather the payload
+	//straight from the caller.
 	//
 	//Mostly what it can do is write ATT command packets (PDUs) and receive PDUs back.
 	struct BLEDevice
@@ -53,15 +58,54 @@ namespace BLEPP
 		void send_read_by_type(const bt_uuid_t& uuid, std::uint16_t start = 0x0001, std::uint16_t end=0xffff);
 		void send_find_information(std::uint16_t start = 0x0001, std::uint16_t end=0xffff);
 		void send_read_group_by_type(const bt_uuid_t& uuid, std::uint16_t start = 0x0001, std::uint16_t end=0xffff);
+		//Writes throw std::logic_error if the value is longer than
+		//max_write_length(), rather than sending part of it.
 		void send_write_request(std::uint16_t handle, const std::uint8_t* data, int length);
 		void send_write_request(std::uint16_t handle, std::uint16_t data);
 		void send_handle_value_confirmation();
 		void send_write_command(std::uint16_t handle, const std::uint8_t* data, int length);
 		void send_write_command(std::uint16_t handle, std::uint16_t data);
-		void process_att_mtu_request(PDUResponse &req_pdu);
-		void process_att_mtu_response(PDUResponse &resp_pdu);
+
+		//Send a write command without blocking. Returns false if the socket's
+		//send buffer is full, i.e. the controller has run out of credits.
+		bool try_send_write_command(std::uint16_t handle, const std::uint8_t* data, int length);
+
+		//The longest value a write can carry at the current MTU.
+		int max_write_length() const;
+		void process_att_mtu_request(const PDUResponse &req_pdu);
+		void process_att_mtu_response(const PDUResponse &resp_pdu);
 		PDUResponse receive(std::uint8_t* buf, int max);
 		PDUResponse receive(std::vector<std::uint8_t>& v);
+
+		//Receive up to max PDUs of up to size bytes each using a single 
+		//recvmmsg(), without blocking. Returns the number received, which 
+		//is 0 if nothing is waiting. The PDUs are valid until the next call.
+		static const int max_batch=32;
+		int receive_batch(int max, int size);
+		PDUResponse batch_pdu(int i) const;
+
+		//Pick up the kernel's receive times, which it attaches to each PDU
+		//once SO_TIMESTAMPNS is set on the socket. receive() then uses
+		//recvmsg() rather than read().
+		void set_timestamps(bool);
+
+		//When the PDU from the last receive(), or batch PDU i, arrived.
+		//Zero if it isn't known.
+		timespec timestamp() const;
+		timespec batch_timestamp(int i) const;
+
+		private:
+			int send_pdu(const std::uint8_t* header, int header_len, const std::uint8_t* payload=nullptr, int payload_len=0, int flags=0);
+			int check_payload(int length) const;
+
+			std::vector<std::uint8_t> batch_buf;
+			std::vector<iovec> batch_iov;
+			std::vector<mmsghdr> batch_msg;
+			int batch_slot=0;
+
+			bool timestamps=false;
+			timespec last_timestamp{};
+			std::vector<std::uint8_t> batch_control;
 	};
 
 }
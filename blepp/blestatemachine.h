@@ -25,10 +25,16 @@
 #include <vector>
 #include <stdexcept>
 #include <functional>
+#include <future>
+#include <memory>
+#include <chrono>
+#include <atomic>
 
 #include <blepp/logging.h>
 #include <blepp/bledevice.h>
 #include <blepp/att_pdu.h>
+#include <blepp/gatt_values.h>
+#include <blepp/mpsc_queue.h>
 
 
 #include <bluetooth/l2cap.h>
@@ -140,45 +146,248 @@ namespace BLEPP
 		GetClientCharaceristicConfiguration,
 		AwaitingWriteResponse,
 		AwaitingReadResponse,
+		StreamingWriteCommands,
 	};
 
 	static const int Waiting=-1;
 
 
-	class UUID: public bt_uuid_t
+	///A UUID, held as its full 128 bit value, worked out once on construction,
+	///so comparing and hashing are a few integer operations with no
+	///conversions. It also remembers whether it was given as 16, 32 or 128
+	///bits, since that's the form it goes over the air in, and bt_uuid()
+	///gives it back in that form. Both only change together, by assigning a
+	///new UUID.
+	class UUID
 	{
+		private:
+			//The 128 bit value as big endian 32 bit words, most significant
+			//first, which keeps it the size of a bt_uuid_t. 16 and 32 bit UUIDs
+			//are offsets into the Bluetooth base UUID,
+			//xxxxxxxx-0000-1000-8000-00805f9b34fb (Core Spec 3.B.2.5.1).
+			std::uint32_t w[4];
+			bt_uuid_type_t given;
+
+			static constexpr std::uint64_t base_hi(std::uint32_t u)
+			{
+				return (std::uint64_t(u) << 32) | 0x1000;
+			}
+
+			static constexpr std::uint64_t base_lo()
+			{
+				return 0x800000805f9b34fbull;
+			}
+
+			constexpr UUID(bt_uuid_type_t t, std::uint64_t h, std::uint64_t l)
+			:w{std::uint32_t(h >> 32), std::uint32_t(h), std::uint32_t(l >> 32), std::uint32_t(l)}, given(t)
+			{
+			}
+
+			static constexpr std::uint8_t byte(std::uint64_t x, int i)
+			{
+				return x >> (8*i);
+			}
+
+			//An unspecified UUID is not the same as the all zero one.
+			constexpr std::uint32_t specified() const
+			{
+				return given != BT_UUID_UNSPEC;
+			}
+
+			//The parsing is written as C++11 constexpr functions, so that
+			//any error becomes a throw, which in turn is a compile error
+			//when parsing a literal.
+			static constexpr std::uint64_t hex_digit(char c)
+			{
+				return (c >= '0' && c <= '9') ? c - '0' :
+				       (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+				       (c >= 'A' && c <= 'F') ? c - 'A' + 10 :
+				       throw std::invalid_argument("Invalid character in UUID");
+			}
+
+			static constexpr std::uint64_t hex(const char* s, int n, std::uint64_t acc=0)
+			{
+				return n == 0 ? acc : hex(s+1, n-1, (acc << 4) | hex_digit(*s));
+			}
+
+			static constexpr UUID parse_short(const char* s, std::size_t n)
+			{
+				return n == 4 ? UUID(std::uint16_t(hex(s, 4))) :
+				       n == 8 ? from_uuid32(hex(s, 8)) :
+				       throw std::invalid_argument("UUID is the wrong length");
+			}
+
+			static constexpr UUID parse_long(const char* s)
+			{
+				return (s[8] == '-' && s[13] == '-' && s[18] == '-' && s[23] == '-') ?
+				       from_uuid128((hex(s, 8) << 32) | (hex(s+9, 4) << 16) | hex(s+14, 4), (hex(s+19, 4) << 48) | hex(s+24, 12)) :
+				       throw std::invalid_argument("UUID is missing a -");
+			}
+
 		public:
 
-		explicit UUID(const uint16_t& u)
+		constexpr explicit UUID(const uint16_t& u)
+		:UUID(BT_UUID16, base_hi(u), base_lo())
 		{
-			type = BT_UUID16;
-			value.u16 = u;
 		}
 		
-		UUID(){}
+		///Unspecified, which is equal only to other unspecified UUIDs.
+		constexpr UUID()
+		:UUID(BT_UUID_UNSPEC, 0, 0)
+		{
+		}
 
 		UUID(const UUID&) = default;
+		UUID& operator=(const UUID&) = default;
 
 		static UUID from(const bt_uuid_t& uuid)
 		{
-			UUID ret;
-			(bt_uuid_t&)ret = uuid;
+			if(uuid.type == BT_UUID16)
+				return UUID(uuid.value.u16);
+			else if(uuid.type == BT_UUID32)
+				return from_uuid32(uuid.value.u32);
+			else if(uuid.type == BT_UUID128)
+			{
+				//Stored little endian.
+				std::uint64_t h=0, l=0;
+				for(int i=0; i < 8; i++)
+				{
+					l |= std::uint64_t(uuid.value.u128.data[i]) << (8*i);
+					h |= std::uint64_t(uuid.value.u128.data[i+8]) << (8*i);
+				}
+				return from_uuid128(h, l);
+			}
+			else
+				return UUID();
+		}
+
+		static constexpr UUID from_uuid32(std::uint32_t u)
+		{
+			return UUID(BT_UUID32, base_hi(u), base_lo());
+		}
+
+		///A 128 bit UUID from its most and least significant halves.
+		static constexpr UUID from_uuid128(std::uint64_t h, std::uint64_t l)
+		{
+			return UUID(BT_UUID128, h, l);
+		}
 
-			return ret;
+		///Parse the string forms that bt_string_to_uuid accepts: 4 or 8 hex
+		///digits, optionally with a leading 0x, giving a 16 or 32 bit UUID,
+		///or xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx, giving a 128 bit UUID.
+		///Anything else throws std::invalid_argument.
+		static constexpr UUID parse(const char* s, std::size_t n)
+		{
+			return n == 36 ? parse_long(s) :
+			       (n > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) ? parse_short(s+2, n-2) :
+			       parse_short(s, n);
 		}
 
 		UUID(const std::string& uuid_str)
+		:UUID(parse(uuid_str.data(), uuid_str.size()))
+		{
+		}
+
+		///How it was given: BT_UUID16, BT_UUID32, BT_UUID128, or
+		///BT_UUID_UNSPEC if it wasn't.
+		constexpr bt_uuid_type_t type() const
+		{
+			return given;
+		}
+
+		///As BlueZ has it, in the form it was given.
+		constexpr bt_uuid_t bt_uuid() const
+		{
+			return given == BT_UUID16 ? bt_uuid_t{BT_UUID16, {std::uint16_t(w[0])}} :
+			       given == BT_UUID32 ? bt_uuid_t{BT_UUID32, bt_uuid_t::bt_uuid_value(w[0])} :
+			       given == BT_UUID128 ? bt_uuid_t{BT_UUID128, bt_uuid_t::bt_uuid_value(uint128_t{{
+			           byte(low64(), 0), byte(low64(), 1), byte(low64(), 2), byte(low64(), 3),
+			           byte(low64(), 4), byte(low64(), 5), byte(low64(), 6), byte(low64(), 7),
+			           byte(high64(), 0), byte(high64(), 1), byte(high64(), 2), byte(high64(), 3),
+			           byte(high64(), 4), byte(high64(), 5), byte(high64(), 6), byte(high64(), 7)}})} :
+			       bt_uuid_t{BT_UUID_UNSPEC, {0}};
+		}
+
+		///So it can be passed to anything taking a bt_uuid_t.
+		constexpr operator bt_uuid_t() const
+		{
+			return bt_uuid();
+		}
+
+		///The 128 bit value, most and least significant halves.
+		constexpr std::uint64_t high64() const
+		{
+			return (std::uint64_t(w[0]) << 32) | w[1];
+		}
+
+		constexpr std::uint64_t low64() const
+		{
+			return (std::uint64_t(w[2]) << 32) | w[3];
+		}
+
+		///True if this is in the base UUID range, so it can be sent as 16 or
+		///32 bits however it was written.
+		constexpr bool is_short() const
+		{
+			return low64() == base_lo() && w[1] == 0x1000;
+		}
+
+		///The 16 or 32 bit value, if is_short().
+		constexpr std::uint32_t short_value() const
+		{
+			return w[0];
+		}
+
+		constexpr bool operator==(const UUID& uuid) const
+		{
+			return ((w[0] ^ uuid.w[0]) | (w[1] ^ uuid.w[1]) | (w[2] ^ uuid.w[2]) | (w[3] ^ uuid.w[3]) | (specified() ^ uuid.specified())) == 0;
+		}
+
+		constexpr bool operator!=(const UUID& uuid) const
+		{
+			return !(*this == uuid);
+		}
+
+		///Ordered as 128 bit numbers, after the unspecified UUID.
+		constexpr bool operator<(const UUID& uuid) const
+		{
+			return int(specified() < uuid.specified()) | (int(specified() == uuid.specified()) & 
+			       (int(high64() < uuid.high64()) | (int(high64() == uuid.high64()) & int(low64() < uuid.low64()))));
+		}
+
+		constexpr bool operator>(const UUID& uuid) const
+		{
+			return uuid < *this;
+		}
+
+		constexpr bool operator<=(const UUID& uuid) const
+		{
+			return !(uuid < *this);
+		}
+
+		constexpr bool operator>=(const UUID& uuid) const
 		{
-			//FIXME: check errors!
-			bt_string_to_uuid(this, uuid_str.c_str());
+			return !(*this < uuid);
 		}
 
-		bool operator==(const UUID& uuid) const
+		std::size_t hash() const
 		{
-			return bt_uuid_cmp(this, &uuid) == 0;
+			//Mix both halves, since 16 bit UUIDs only differ in the high one.
+			std::uint64_t h = (high64() ^ (low64() * 0x9e3779b97f4a7c15ull) ^ specified()) * 0xff51afd7ed558ccdull;
+			return h ^ (h >> 33);
 		}
 	};
 
+	inline namespace literals
+	{
+		///"180d"_uuid or "7309203e-349d-4c11-ac6b-baedd1819764"_uuid. Use it
+		///to initialise a constexpr UUID and a malformed string will not compile.
+		constexpr UUID operator"" _uuid(const char* s, std::size_t n)
+		{
+			return UUID::parse(s, n);
+		}
+	}
+
 
 	struct Characteristic
 	{	
@@ -191,6 +400,11 @@ namespace BLEPP
 		:s(s_)
 		{}
 
+		///Decode a value of this characteristic with its decoder. Returns
+		///false if there isn't one, or the value is malformed.
+		bool decode(const PDUNotificationOrIndication& n, CharacteristicValue& v) const;
+		bool decode(const PDUReadResponse& r, CharacteristicValue& v) const;
+
 		void set_notify_and_indicate(bool , bool, WriteType type=WriteType::Request );
 		std::function<void(const PDUNotificationOrIndication&)> cb_notify_or_indicate;
 		std::function<void(const PDUReadResponse&)> cb_read;
@@ -219,6 +433,10 @@ namespace BLEPP
 		//UUID, i.e. name of what the characteristic represents semantically
 		UUID uuid;
 
+		//How to decode the value, chosen from the UUID at discovery, or
+		//nullptr if it isn't a characteristic with a known format.
+		const ValueDecoder* decoder = nullptr;
+
 		//Where the value can be read/written
 		uint16_t value_handle;
 
@@ -241,7 +459,8 @@ namespace BLEPP
 
 	struct ServiceInfo
 	{
-		std::string name, id;
+		const char* name;
+		const char* id;
 		UUID uuid;
 	};
 
@@ -254,8 +473,20 @@ namespace BLEPP
 	};
 
 
+	///Look up a standard service. See also lookup_service() in
+	///blepp/assigned_numbers.h.
 	const ServiceInfo* lookup_service_by_UUID(const UUID& uuid);
 
+	///How a stream_write_commands() went.
+	struct StreamStats
+	{
+		size_t bytes=0;
+		int packets=0;
+		int stalls=0;        //Number of times the socket pushed back
+		double seconds=0;
+		double bytes_per_second=0;
+	};
+
 	class BLEGATTStateMachine
 	{
 		public:
@@ -282,6 +513,13 @@ namespace BLEPP
 			static const char* get_disconnect_string(Disconnect); 
 
 		private:
+			struct Submission
+			{
+				std::function<void()> run;
+				std::function<void(Disconnect)> abort;
+				std::uint64_t connection;
+			};
+
 			struct sockaddr_l2 addr;
 			
 			int sock = -1;
@@ -300,6 +538,31 @@ namespace BLEPP
 			
 			std::vector<std::uint8_t> buf;
 
+			bool kernel_timestamps=false;
+			timespec current_packet_time{};
+			void apply_kernel_timestamps();
+
+			MPSCQueue<Submission> submissions;
+			int submission_event = -1;
+
+			//Counts sockets opened and closed, so it's odd while there is one.
+			//Submissions are only run on the connection they were made on.
+			std::atomic<std::uint64_t> connection{0};
+			void set_connected(bool);
+
+			//One-shot hooks for the operation in flight, if it was started by one of
+			//the *_async functions. If set, these replace the usual callbacks. 
+			std::function<void(const PDUResponse&)> response_hook;
+			std::function<void()> completion_hook;
+			std::function<void(Disconnect)> abort_hook;
+
+			std::vector<std::uint8_t> stream_data;
+			size_t stream_pos=0;
+			uint16_t stream_handle=0;
+			StreamStats stream_stats;
+			std::chrono::steady_clock::time_point stream_start;
+			void continue_stream();
+
 
 			struct PrimaryServiceInfo
 			{
@@ -313,6 +576,10 @@ namespace BLEPP
 			void fail(Disconnect);
 			Characteristic* characteristic_of_handle(uint16_t handle);
 			void close_and_cleanup();
+			void process(const PDUResponse&);
+			void drain_submissions();
+			void abort_submissions(Disconnect);
+			void complete(const std::function<void()>& cb);
 
 		public:
 
@@ -327,6 +594,7 @@ namespace BLEPP
 			std::function<void()> cb_write_response = buggerall;
 			std::function<void(Characteristic&, const PDUNotificationOrIndication&)> cb_notify_or_indicate;
 			std::function<void(Characteristic&, const PDUReadResponse&)> cb_read;
+			std::function<void(const StreamStats&)> cb_stream_complete;
 
 
 			BLEGATTStateMachine();
@@ -336,9 +604,20 @@ namespace BLEPP
 			void connect_blocking(const std::string& addres);
 			void connect_nonblocking(const std::string& addres);
 			void connect(const std::string& addresa, bool blocking, bool pubaddr = true, std::string device = "");
+
+			///Take ownership of an already connected ATT socket, for example one
+			///end of a socketpair() talking to a simulated device.
+			void adopt_socket(int fd);
 			void close();
 
 			int socket();
+
+			///Changes whenever a connection is made or lost, even if the new
+			///socket has the same number as the old one.
+			std::uint64_t connection_number() const
+			{
+				return connection.load();
+			}
 		
 			bool wait_on_write();
 			
@@ -346,18 +625,92 @@ namespace BLEPP
 			{
 				return state == Idle;
 			}
+
+			bool is_connecting()
+			{
+				return state == Connecting;
+			}
 			
+			///These throw std::logic_error if the value is too long for the
+			///MTU. Use stream_write_commands() for longer ones.
 			void send_write_request(uint16_t handle, const uint8_t* data, int length);
 			void send_write_command(uint16_t handle, const uint8_t* data, int length);
 			void send_read_request(uint16_t handle);
 
+			///Write a block of data of any size to a handle, as a sequence of write
+			///commands, each as large as the MTU allows. As much as possible is sent
+			///straight away. When the controller runs out of buffers, wait_on_write()
+			///returns true: wait for the socket to be writable and call 
+			///write_and_process_next() to send more. Notifications are still processed
+			///as normal meanwhile. When everything is sent, the machine goes back to 
+			///idle and cb_stream_complete is called with the throughput achieved.
+			void stream_write_commands(uint16_t handle, const uint8_t* data, int length);
+
 			void read_primary_services();
 			void find_all_characteristics();
 			void get_client_characteristic_configuration();
 			void read_and_process_next();
+
+			///Like read_and_process_next(), but process every PDU which can be read
+			///without blocking, up to a maximum of max. This reads in batches, so a
+			///flood of notifications costs one wakeup and a handful of system calls
+			///rather than one of each per notification. Returns the number of PDUs
+			///processed, which may be zero.
+			int process_all_pending(int max=256);
+
+			///Record when the kernel received each PDU, for logging. This
+			///applies to the current connection and any later ones.
+			void set_kernel_timestamps(bool);
+
+			///During a callback, when the kernel received the PDU being
+			///processed, on the wall clock. Zero if timestamps are off.
+			const timespec& packet_time() const
+			{
+				return current_packet_time;
+			}
 			void write_and_process_next();
 			void set_notify_and_indicate(Characteristic& c, bool notify, bool indicate, WriteType type = WriteType::Request);
 
+			///Thread safe. Everything else in this class must be called from the
+			///thread running the event loop, but submit() may be called from any
+			///thread. The operation is queued, and run on the event loop thread
+			///once the state machine is idle, so it may freely call send_write_command(),
+			///read_primary_services() and so on. Operations are run one at a time,
+			///in the order submitted. If the connection goes away before an operation
+			///is run, then abort is called (also on the event loop thread) instead.
+			///If there is no connection, abort is called straight away, on the
+			///calling thread.
+			void submit(std::function<void()> op, std::function<void(Disconnect)> abort=nullptr);
+
+			///File descriptor which becomes readable when something has been
+			///submitted. Wait on it alongside socket(), and call run_submissions()
+			///when it is readable.
+			int submission_fd();
+			void run_submissions();
+
+			///Thread safe. Callback versions of the *_async functions, for
+			///building other asynchronous front ends. Exactly one of done or abort is
+			///called, on the event loop thread. done gets the response PDU, which may
+			///be an error response.
+			void submit_read(uint16_t handle, std::function<void(const PDUResponse&)> done, std::function<void(Disconnect)> abort);
+			void submit_write(uint16_t handle, const uint8_t* data, int length, WriteType type, std::function<void(const PDUResponse&)> done, std::function<void(Disconnect)> abort);
+			void submit_discover(std::function<void()> done, std::function<void(Disconnect)> abort);
+
+			///Thread safe. Read a handle. The future holds the value, or throws
+			///ATTError if the device refused, or OperationAborted on disconnection.
+			std::future<std::vector<uint8_t>> read_async(uint16_t handle);
+
+			///Thread safe. Write a handle. For write commands, the future is ready as
+			///soon as the command is sent, since there is no response. A value too
+			///long for the MTU isn't sent, and fails with ATTError, with the error
+			///code ATT_ECODE_INVAL_ATTR_VALUE_LEN.
+			std::future<void> write_async(uint16_t handle, const uint8_t* data, int length, WriteType type=WriteType::Request);
+
+			///Thread safe. Read the services, characteristics and client characteristic
+			///configurations, i.e. what setup_standard_scan() does, but without using
+			///the cb_* callbacks. Look at primary_services once the future is ready.
+			std::future<void> discover_async();
+
 
 			void setup_standard_scan(std::function<void()>& cb);
 	};
@@ -365,6 +718,23 @@ namespace BLEPP
 
 	void pretty_print_tree(const BLEGATTStateMachine& s);
 
+	///The device sent an error response to an asynchronous operation.
+	class ATTError: public std::runtime_error
+	{
+		public:
+			ATTError(const PDUErrorResponse&);
+			uint8_t request_opcode, error_code;
+			uint16_t handle;
+	};
+
+	///The connection went away before an asynchronous operation completed.
+	class OperationAborted: public std::runtime_error
+	{
+		public:
+			OperationAborted(BLEGATTStateMachine::Disconnect);
+			BLEGATTStateMachine::Disconnect reason;
+	};
+
 
 
 	class SocketAllocationFailed: public std::runtime_error { using runtime_error::runtime_error; };
@@ -372,4 +742,16 @@ namespace BLEPP
 	class SocketGetSockOptFailed: public std::runtime_error { using runtime_error::runtime_error; };
 	class SocketConnectFailed: public std::runtime_error { using runtime_error::runtime_error; };
 }
+
+namespace std
+{
+	template<> struct hash<BLEPP::UUID>
+	{
+		std::size_t operator()(const BLEPP::UUID& u) const
+		{
+			return u.hash();
+		}
+	};
+}
+
 #endif
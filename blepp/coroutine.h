@@ -0,0 +1,248 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __INC_BLEPP_COROUTINE_H
+#define __INC_BLEPP_COROUTINE_H
+
+#if __cplusplus < 202002L
+	#error "blepp/coroutine.h needs C++20. Configure CMake with -DBLEPP_COROUTINES=ON."
+#endif
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <blepp/blestatemachine.h>
+
+//A coroutine front end for BLEGATTStateMachine. Coroutines are stackless, so
+//a thread can run as many per-device workflows as it likes:
+//
+//  Task poll_battery(Executor& ex, BLEGATTStateMachine& gatt, std::string addr)
+//  {
+//      co_await ex.connect(gatt, addr);
+//      co_await ex.discover(gatt);
+//      auto level = co_await ex.read(gatt, handle);
+//      ...
+//  }
+//
+//Everything runs on the thread calling Executor::run(). Failures come out of
+//co_await as exceptions: ATTError, OperationAborted, or whatever connect() throws.
+namespace BLEPP
+{
+	///Fire and forget coroutine. It starts running immediately and cleans
+	///itself up when it finishes. Exceptions escaping it are logged.
+	struct Task
+	{
+		struct promise_type
+		{
+			Task get_return_object() { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception();
+		};
+	};
+
+	class Executor;
+
+	///Notifications and indications from a characteristic, queued up
+	///for co_await next(). The stream ends, with next() throwing
+	///OperationAborted, when the device disconnects.
+	class NotificationStream
+	{
+		public:
+			NotificationStream(Executor&, BLEGATTStateMachine&, Characteristic&);
+			NotificationStream(const NotificationStream&) = delete;
+			NotificationStream& operator=(const NotificationStream&) = delete;
+			~NotificationStream();
+
+			struct Next
+			{
+				NotificationStream& s;
+				bool await_ready() const noexcept;
+				void await_suspend(std::coroutine_handle<>) noexcept;
+				std::vector<uint8_t> await_resume();
+			};
+
+			Next next()
+			{
+				return Next{*this};
+			}
+
+		private:
+			friend class Executor;
+			void close(BLEGATTStateMachine::Disconnect);
+
+			Executor& ex;
+			BLEGATTStateMachine& gatt;
+			Characteristic* characteristic;
+			std::deque<std::vector<uint8_t>> pending;
+			std::coroutine_handle<> waiter;
+			std::exception_ptr error;
+	};
+
+	///Single threaded epoll based executor. It watches the sockets of the state
+	///machines it is given (including across reconnections) and drives them
+	///with write_and_process_next(), process_all_pending() and run_submissions().
+	class Executor
+	{
+		public:
+			Executor();
+			Executor(const Executor&) = delete;
+			Executor& operator=(const Executor&) = delete;
+			~Executor();
+
+			///Start watching a state machine. The awaitables do this for you.
+			void add(BLEGATTStateMachine&);
+
+			///Stop watching a state machine. Its notification streams end with
+			///OperationAborted, as does a connect() in progress. Operations
+			///already submitted stay with the machine, for whoever drives it next.
+			void remove(BLEGATTStateMachine&);
+
+			///Run until stop() is called (from within the loop).
+			void run();
+			void stop();
+
+			///Resume a coroutine from the loop, rather than from deep inside a callback.
+			void post(std::coroutine_handle<>);
+
+			struct Connect
+			{
+				Executor& ex;
+				BLEGATTStateMachine& gatt;
+				std::string address;
+				bool pubaddr;
+
+				bool await_ready();
+				void await_suspend(std::coroutine_handle<>);
+				void await_resume();
+			};
+
+			struct Read
+			{
+				Executor& ex;
+				BLEGATTStateMachine& gatt;
+				uint16_t handle;
+				std::vector<uint8_t> value;
+				std::exception_ptr error;
+
+				bool await_ready() const noexcept { return false; }
+				void await_suspend(std::coroutine_handle<>);
+				std::vector<uint8_t> await_resume();
+			};
+
+			struct Write
+			{
+				Executor& ex;
+				BLEGATTStateMachine& gatt;
+				uint16_t handle;
+				std::vector<uint8_t> data;
+				WriteType type;
+				std::exception_ptr error;
+
+				bool await_ready() const noexcept { return false; }
+				void await_suspend(std::coroutine_handle<>);
+				void await_resume();
+			};
+
+			struct Discover
+			{
+				Executor& ex;
+				BLEGATTStateMachine& gatt;
+				std::exception_ptr error;
+
+				bool await_ready() const noexcept { return false; }
+				void await_suspend(std::coroutine_handle<>);
+				void await_resume();
+			};
+
+			Connect connect(BLEGATTStateMachine& gatt, const std::string& address, bool pubaddr=true)
+			{
+				return Connect{*this, gatt, address, pubaddr};
+			}
+
+			Read read(BLEGATTStateMachine& gatt, uint16_t handle)
+			{
+				return Read{*this, gatt, handle, {}, {}};
+			}
+
+			Write write(BLEGATTStateMachine& gatt, uint16_t handle, const uint8_t* data, int length, WriteType type=WriteType::Request)
+			{
+				return Write{*this, gatt, handle, std::vector<uint8_t>(data, data+length), type, {}};
+			}
+
+			Discover discover(BLEGATTStateMachine& gatt)
+			{
+				return Discover{*this, gatt, {}};
+			}
+
+			NotificationStream notifications(BLEGATTStateMachine& gatt, Characteristic& c)
+			{
+				return NotificationStream(*this, gatt, c);
+			}
+
+		private:
+			friend class NotificationStream;
+
+			struct Device;
+
+			//What epoll hands back: which device, and which of its fds.
+			struct Watch
+			{
+				Device* device;
+				bool submissions;
+			};
+
+			struct Device
+			{
+				BLEGATTStateMachine* gatt;
+				int fd=-1;
+				std::uint64_t connection=0;
+				uint32_t events=0;
+				Watch socket_watch, submission_watch;
+				std::coroutine_handle<> connecting;
+				std::list<NotificationStream*> streams;
+				bool removed=false;
+			};
+
+			Device& device(BLEGATTStateMachine&);
+			void sync(Device&);
+			void dispatch(const Watch&, uint32_t events);
+			void resume_ready();
+
+			int epoll_fd=-1;
+			bool running=false;
+			bool dispatching=false;
+			std::list<Device> devices;
+
+			//Devices removed part way through a batch of events, which may still
+			//have events of their own to come in the batch.
+			std::list<Device> removed;
+			std::deque<std::coroutine_handle<>> ready;
+	};
+}
+
+#endif
@@ -24,9 +24,26 @@
 #define __INC_LIBATTGATT_FLOAT_H
 
 #include <cstdint>
+#include <cstddef>
 namespace BLEPP
 {
+	///Decode a 4 byte IEEE-11073 FLOAT. NaN, NRes and the reserved value
+	///come out as NaN, and +/-INFINITY as infinities.
 	float bluetooth_float_to_IEEE754(const std::uint8_t* bytes);
+
+	///Decode a 2 byte IEEE-11073 SFLOAT, with the same special values.
+	float bluetooth_sfloat_to_IEEE754(const std::uint8_t* bytes);
+
+	///Decode n packed FLOATs (4n bytes) or SFLOATs (2n bytes), for example
+	///the arrays of samples some devices send.
+	void bluetooth_float_to_IEEE754(const std::uint8_t* bytes, std::size_t n, float* out);
+	void bluetooth_float_to_IEEE754(const std::uint8_t* bytes, std::size_t n, double* out);
+	void bluetooth_sfloat_to_IEEE754(const std::uint8_t* bytes, std::size_t n, float* out);
+	void bluetooth_sfloat_to_IEEE754(const std::uint8_t* bytes, std::size_t n, double* out);
+
+	///From the value as a little endian integer.
+	double bluetooth_float_to_double(std::uint32_t raw);
+	double bluetooth_sfloat_to_double(std::uint16_t raw);
 }
 
 #endif
@@ -13,11 +13,15 @@ namespace BLEPP
 			flags = 0x01,
 			incomplete_list_of_16_bit_UUIDs = 0x02,
 			complete_list_of_16_bit_UUIDs = 0x03,
+			incomplete_list_of_32_bit_UUIDs = 0x04,
+			complete_list_of_32_bit_UUIDs = 0x05,
 			incomplete_list_of_128_bit_UUIDs = 0x06,
 			complete_list_of_128_bit_UUIDs = 0x07,
 			shortened_local_name = 0x08,
 			complete_local_name = 0x09,
 			service_data_16_bit_UUID = 0x16,
+			service_data_32_bit_UUID = 0x20,
+			service_data_128_bit_UUID = 0x21,
 			manufacturer_data = 0xff
 		};
 
@@ -0,0 +1,182 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __INC_BLEPP_GATT_VALUES_H
+#define __INC_BLEPP_GATT_VALUES_H
+
+#include <cstdint>
+#include <utility>
+
+//Decoded values of the standard characteristics. Each one is a plain struct
+//filled in straight from the bytes of a read response or notification,
+//following the layouts in the GATT Specification Supplement. Optional fields
+//are present according to the flags, which are kept so the has_xxx()
+//functions can say what was there. Fields which aren't present are zero.
+//Bytes beyond the end of the known fields are ignored, as later versions of
+//a characteristic may append fields.
+namespace BLEPP
+{
+	class UUID;
+
+	///Date Time (0x2A08), which also appears in other characteristics.
+	struct DateTime
+	{
+		std::uint16_t year;  ///< 0 if not known
+		std::uint8_t month;  ///< 1-12, 0 if not known
+		std::uint8_t day;    ///< 1-31, 0 if not known
+		std::uint8_t hours;
+		std::uint8_t minutes;
+		std::uint8_t seconds;
+	};
+
+	///Heart Rate Measurement (0x2A37)
+	struct HeartRateMeasurement
+	{
+		static const std::uint16_t assigned_number = 0x2A37;
+
+		///Enough for a notification with the default ATT MTU. Any more are dropped.
+		static const int max_rr_intervals = 9;
+
+		std::uint8_t flags;
+		std::uint16_t bpm;
+		std::uint16_t energy_expended;  ///< kJ
+		std::uint8_t num_rr_intervals;
+		std::uint16_t rr_intervals[max_rr_intervals];  ///< 1/1024 s
+
+		bool sensor_contact_supported() const { return flags & 0x04; }
+		bool sensor_contact_detected() const { return flags & 0x02; }
+		bool has_energy_expended() const { return flags & 0x08; }
+		bool has_rr_intervals() const { return flags & 0x10; }
+	};
+
+	///Temperature Measurement (0x2A1C), and Intermediate Temperature
+	///(0x2A1E) which has the same layout.
+	struct TemperatureMeasurement
+	{
+		static const std::uint16_t assigned_number = 0x2A1C;
+
+		std::uint8_t flags;
+		float temperature;
+		DateTime timestamp;
+		std::uint8_t temperature_type;  ///< Where on the body, as for Temperature Type (0x2A1D)
+
+		bool fahrenheit() const { return flags & 0x01; }
+		bool has_timestamp() const { return flags & 0x02; }
+		bool has_temperature_type() const { return flags & 0x04; }
+	};
+
+	///Battery Level (0x2A19)
+	struct BatteryLevel
+	{
+		static const std::uint16_t assigned_number = 0x2A19;
+
+		std::uint8_t level;  ///< percent
+	};
+
+	///CSC Measurement (0x2A5B), from cycling speed and cadence sensors.
+	struct CSCMeasurement
+	{
+		static const std::uint16_t assigned_number = 0x2A5B;
+
+		std::uint8_t flags;
+		std::uint32_t cumulative_wheel_revolutions;
+		std::uint16_t last_wheel_event_time;  ///< 1/1024 s
+		std::uint16_t cumulative_crank_revolutions;
+		std::uint16_t last_crank_event_time;  ///< 1/1024 s
+
+		bool has_wheel_revolutions() const { return flags & 0x01; }
+		bool has_crank_revolutions() const { return flags & 0x02; }
+	};
+
+	///RSC Measurement (0x2A53), from running speed and cadence sensors.
+	struct RSCMeasurement
+	{
+		static const std::uint16_t assigned_number = 0x2A53;
+
+		std::uint8_t flags;
+		std::uint16_t speed;          ///< 1/256 m/s
+		std::uint8_t cadence;         ///< steps per minute
+		std::uint16_t stride_length;  ///< cm
+		std::uint32_t total_distance; ///< 1/10 m
+
+		bool has_stride_length() const { return flags & 0x01; }
+		bool has_total_distance() const { return flags & 0x02; }
+		bool running() const { return flags & 0x04; }
+	};
+
+	enum class ValueType: std::uint8_t
+	{
+		Unknown,
+		HeartRateMeasurement,
+		TemperatureMeasurement,
+		BatteryLevel,
+		CSCMeasurement,
+		RSCMeasurement,
+		Integer,  ///< Any characteristic which is a single integer, e.g. Appearance
+	};
+
+	///The decoded value of any characteristic with a decoder.
+	struct CharacteristicValue
+	{
+		ValueType type;
+		union
+		{
+			HeartRateMeasurement heart_rate;
+			TemperatureMeasurement temperature;
+			BatteryLevel battery_level;
+			CSCMeasurement csc;
+			RSCMeasurement rsc;
+			std::int64_t integer;
+		};
+	};
+
+	///Decodes values of one kind of characteristic. These are found once
+	///by UUID and then used for every value.
+	struct ValueDecoder
+	{
+		ValueType type;
+
+		///Returns false if the value is too short for what the flags say
+		///should be in it.
+		bool (*decode)(const std::uint8_t* begin, const std::uint8_t* end, CharacteristicValue& value);
+	};
+
+	///The decoder for a characteristic, or nullptr if there isn't one.
+	///Characteristic::decoder is set to this during discovery.
+	const ValueDecoder* find_value_decoder(const UUID& uuid);
+
+	///Decode a value known to be of a particular type. These return false
+	///if the value is too short for what the flags say should be in it.
+	bool decode(const std::uint8_t* begin, const std::uint8_t* end, HeartRateMeasurement& value);
+	bool decode(const std::uint8_t* begin, const std::uint8_t* end, TemperatureMeasurement& value);
+	bool decode(const std::uint8_t* begin, const std::uint8_t* end, BatteryLevel& value);
+	bool decode(const std::uint8_t* begin, const std::uint8_t* end, CSCMeasurement& value);
+	bool decode(const std::uint8_t* begin, const std::uint8_t* end, RSCMeasurement& value);
+
+	///For use with PDUNotificationOrIndication::value() and PDUReadResponse::value().
+	template<class T> bool decode(const std::pair<const std::uint8_t*, const std::uint8_t*>& bytes, T& value)
+	{
+		return decode(bytes.first, bytes.second, value);
+	}
+}
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __INC_BLEPP_GATTSERVER_H
+#define __INC_BLEPP_GATTSERVER_H
+
+#include <vector>
+#include <deque>
+#include <list>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+#include <blepp/blestatemachine.h>
+
+namespace BLEPP
+{
+	///The peripheral side of GATT: an attribute database, served over ATT to
+	///any number of clients. A client is just a connected file descriptor, so
+	///this works equally over L2CAP sockets from listen()/accept(), or one end
+	///of a socketpair() with a BLEGATTStateMachine on the other.
+	///
+	///The database is built up with add_primary_service() and add_characteristic(),
+	///which allocate handles in order. It is stored as a flat array sorted by
+	///handle, so lookups are a binary search.
+	///
+	///The server does no I/O of its own accord: wait for a client's fd to become
+	///readable, then call process() with it. Responses which don't fit in a
+	///client's socket are kept until there's room, so while has_unsent() is
+	///true, wait for the fd to become writable as well, then call flush().
+	class BLEGATTServer
+	{
+		public:
+			enum Permissions
+			{
+				Readable=1,
+				Writable=2,
+			};
+
+			struct Attribute
+			{
+				uint16_t handle;
+				UUID type;
+				std::vector<uint8_t> value;
+				uint8_t permissions;
+
+				//For services, the last handle in the group. For everything else,
+				//the attribute's own handle.
+				uint16_t group_end;
+
+				//Client characteristic configurations have a value per client,
+				//which lives with the client instead.
+				bool is_ccc;
+
+				///Called before the value is read, so it can be brought up to date
+				///with set_value().
+				std::function<void(int client, Attribute&)> on_read;
+
+				///Called after a client has written to the value.
+				std::function<void(int client, Attribute&)> on_write;
+			};
+
+			BLEGATTServer();
+			BLEGATTServer(const BLEGATTServer&) = delete;
+			BLEGATTServer& operator=(const BLEGATTServer&) = delete;
+			~BLEGATTServer();
+
+			///Start a new service. Returns its handle. Characteristics added
+			///from now on belong to it.
+			uint16_t add_primary_service(const UUID& uuid);
+
+			///Add a characteristic to the current service, with flags made from
+			///GATT_CHARACTERISTIC_FLAGS_*. This adds the declaration, the value and,
+			///if the characteristic can notify or indicate, a client characteristic
+			///configuration. Returns the value handle.
+			uint16_t add_characteristic(const UUID& uuid, uint8_t flags, const std::vector<uint8_t>& value=std::vector<uint8_t>());
+
+			///Add a descriptor to the current characteristic. Returns its handle.
+			uint16_t add_descriptor(const UUID& uuid, const std::vector<uint8_t>& value, uint8_t permissions=Readable);
+
+			///Look up a handle. Returns nullptr if there is no such attribute.
+			Attribute* attribute(uint16_t handle);
+			const std::vector<Attribute>& attributes() const
+			{
+				return db;
+			}
+
+			void set_value(uint16_t handle, const uint8_t* data, int length);
+
+			///Set the value of a characteristic and send it to every client which
+			///has subscribed to it. Notifications are sent immediately, or dropped
+			///for clients whose socket is full. Indications are queued for clients
+			///still waiting to confirm an earlier one, or whose socket is full.
+			///Clients which can't be written to at all are disconnected. Returns the
+			///number of clients the value was sent or queued to.
+			int notify(uint16_t value_handle, const uint8_t* data, int length);
+
+			///Notifications a client has missed because its socket was full.
+			std::uint64_t dropped_notifications(int fd);
+
+			///Largest MTU the server will agree to.
+			uint16_t max_mtu=517;
+
+			///Responses and indications can't be dropped, so when a client's
+			///socket is full they're kept until flush() finds room. A client
+			///which lets more than this many pile up is disconnected.
+			std::size_t max_unsent=16;
+
+			///Listen for LE connections on the ATT channel. Clients are
+			///picked up with accept().
+			void listen(const std::string& device="");
+			int listen_socket() const
+			{
+				return listen_fd;
+			}
+
+			///Accept a client from the listening socket. Returns its fd, or -1
+			///with errno set if that failed.
+			int accept();
+
+			///Start serving a connected socket. The server takes ownership of it.
+			void add_client(int fd);
+			void remove_client(int fd);
+			std::vector<int> clients() const;
+
+			///Read one PDU from a client and respond to it. Returns false if the
+			///client has gone, in which case it has been removed.
+			bool process(int fd);
+
+			///Respond to a PDU as if it came from a client. This is what process()
+			///calls once it has read something.
+			void process(int fd, const uint8_t* pdu, int length);
+
+			///True if there are PDUs waiting for room in the client's socket.
+			bool has_unsent(int fd);
+
+			///Send as much as will fit of what's waiting for the client. Call it
+			///when the fd is writable. Returns false if the client has gone, in
+			///which case it has been removed.
+			bool flush(int fd);
+
+			///Called whenever a client is removed, whether it went away or
+			///remove_client() was called.
+			std::function<void(int client)> cb_disconnected;
+
+			///Called when a client writes a client characteristic configuration.
+			std::function<void(int client, uint16_t value_handle, uint16_t ccc)> cb_subscribed;
+
+		private:
+			struct Client
+			{
+				int fd;
+				uint16_t mtu;
+
+				//Written client characteristic configurations, as (handle, value)
+				std::vector<std::pair<uint16_t, uint16_t>> ccc;
+
+				bool awaiting_confirmation;
+				std::deque<std::vector<uint8_t>> indications;
+
+				//PDUs which didn't fit in the socket, in the order they go out.
+				std::deque<std::vector<uint8_t>> unsent;
+
+				//Failed clients are only removed once nothing is using them.
+				bool dead;
+
+				std::uint64_t dropped;
+			};
+
+			//Counts the public calls in progress, since callbacks may call back in.
+			struct Busy;
+			int busy=0;
+			void reap();
+
+			Client* client(int fd);
+			uint16_t ccc_value(const Client&, uint16_t handle) const;
+			std::vector<Attribute>::iterator first_at_or_after(uint16_t handle);
+			std::pair<const uint8_t*, const uint8_t*> value_of(Client&, Attribute&, uint8_t* ccc);
+
+			bool send(Client&, const uint8_t* pdu, int length, bool droppable=false);
+			bool write_unsent(Client&);
+			void send_error(Client&, uint8_t opcode, uint16_t handle, uint8_t error);
+			void send_next_indication(Client&);
+
+			void mtu_exchange(Client&, const uint8_t* pdu, int length);
+			void find_information(Client&, const uint8_t* pdu, int length, uint8_t* buf);
+			void find_by_type_value(Client&, const uint8_t* pdu, int length, uint8_t* buf);
+			void read_by_type(Client&, const uint8_t* pdu, int length, uint8_t* buf);
+			void read(Client&, const uint8_t* pdu, int length, uint8_t* buf);
+			void read_blob(Client&, const uint8_t* pdu, int length, uint8_t* buf);
+			void read_by_group_type(Client&, const uint8_t* pdu, int length, uint8_t* buf);
+			void write(Client&, const uint8_t* pdu, int length, bool command, uint8_t* buf);
+			void confirmation(Client&);
+
+			std::vector<Attribute> db;
+			int current_service=-1;
+			std::list<Client> client_list;
+			std::vector<uint8_t> in;
+
+			//Responses are built here. Callbacks run while one is being built
+			//can call back in, so each call to process() takes the buffer for
+			//itself, and one nested inside it makes its own.
+			std::vector<uint8_t> out;
+			int listen_fd=-1;
+	};
+
+	class SocketListenFailed: public std::runtime_error { using runtime_error::runtime_error; };
+}
+
+#endif
@@ -0,0 +1,71 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#ifndef __INC_BLEPP_KERNEL_FILTER_H
+#define __INC_BLEPP_KERNEL_FILTER_H
+
+#include <blepp/lescan.h>
+#include <boost/optional.hpp>
+#include <linux/filter.h>
+#include <vector>
+
+namespace BLEPP
+{
+	///Criteria for dropping HCI events in the kernel, before they wake up
+	///the program. They're compiled to a classic BPF program and attached
+	///to the socket with SO_ATTACH_FILTER.
+	///
+	///Only LE meta events are filtered. Everything else, in particular the
+	///answers to commands, is let through. The report criteria work on
+	///fixed offsets, so apply only to packets with a single report: the
+	///rare packets with several are let through, to be dealt with in user
+	///space.
+	struct KernelFilter
+	{
+		///The LE meta subevent to keep.
+		uint8_t subevent = EVT_LE_ADVERTISING_REPORT;
+
+		///The advertising event types to keep. Empty keeps all.
+		std::vector<LeAdvertisingEventType> event_types;
+
+		///The devices to keep. Empty keeps all.
+		std::vector<AcceptListEntry> addresses;
+
+		///Keep only adverts whose advertising data has manufacturer specific
+		///data from this company, in the AD structure starting at
+		///manufacturer_offset. For example, an iBeacon's follows the 3
+		///bytes of flags.
+		boost::optional<uint16_t> manufacturer;
+		uint8_t manufacturer_offset = 0;
+
+		///Throws std::length_error if the program is too long for the kernel.
+		std::vector<sock_filter> compile() const;
+
+		///Compile and attach to a socket, replacing any filter already there.
+		void attach(int fd) const;
+
+		///Remove any filter from a socket.
+		static void detach(int fd);
+	};
+}
+
+#endif
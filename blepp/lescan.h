@@ -30,8 +30,14 @@
 #include <stdexcept>
 #include <cstdint>
 #include <set>
+#include <array>
+#include <deque>
+#include <memory>
+#include <chrono>
 #include <boost/optional.hpp>
 #include <blepp/blestatemachine.h> //for UUID. FIXME mofo
+#include <blepp/advert_filter.h>
+#include <blepp/beacons.h>
 #include <bluetooth/hci.h>
 
 namespace BLEPP
@@ -54,6 +60,7 @@ namespace BLEPP
 	struct AdvertisingResponse
 	{
 		std::string address;
+		uint8_t address_type = LE_PUBLIC_ADDRESS;
 		LeAdvertisingEventType type;
 		int8_t rssi;
 		struct Name
@@ -86,8 +93,122 @@ namespace BLEPP
 		std::vector<std::vector<uint8_t>> service_data;
 		std::vector<std::vector<uint8_t>> unparsed_data_with_types;
 		std::vector<std::vector<uint8_t>> raw_packet;
+
+		///The first beacon frame in the advert, if there is one.
+		Beacon beacon = Beacon();
+	};
+
+	///The parameters for LE Set Scan Parameters (Vol 2, Part E, 7.8.10),
+	///plus how long to wait for the controller to answer.
+	struct ScanParameters
+	{
+		///How often the controller starts listening, in units of 0.625ms.
+		///From 0x0004 to 0x4000.
+		uint16_t interval = 0x0010;
+
+		///How long it listens each time, in the same units. No longer
+		///than the interval.
+		uint16_t window = 0x0010;
+
+		///LE_PUBLIC_ADDRESS or LE_RANDOM_ADDRESS, for active scanning.
+		uint8_t own_address_type = LE_PUBLIC_ADDRESS;
+
+		///0 to hear everyone, 1 to hear only the devices on the accept list.
+		uint8_t filter_policy = 0x00;
+
+		///How long to wait for the controller to answer a command, in ms.
+		int timeout = 10000;
+
+		///Interval and window in milliseconds, rounded to the nearest unit.
+		static ScanParameters from_milliseconds(double interval, double window);
+
+		double duty_cycle() const
+		{
+			return double(window) / interval;
+		}
+
+		///Throws std::invalid_argument if the controller would refuse them.
+		void validate() const;
 	};
 
+	///How to adapt the scan window to what's about. The window varies between
+	///min_window and the one given in the ScanParameters, halving or doubling
+	///once a period as needed. The interval stays the same.
+	struct AdaptiveScan
+	{
+		///The smallest window, used when nothing is about.
+		uint16_t min_window = 0x0004;
+
+		///Below this many reports per second, listen less.
+		double idle_rate = 1;
+
+		///Above this many, listen more.
+		double busy_rate = 20;
+
+		///How often to reconsider, in seconds.
+		double period = 5;
+	};
+
+	///Decides the scan window from the report rate. Dropped reports mean the
+	///host isn't keeping up, and listening more would only lose more, so they
+	///shrink the window whatever the rate. Used by HCIScanner, but it doesn't
+	///touch the controller so is usable (and testable) on its own.
+	class ScanScheduler
+	{
+		public:
+			typedef std::chrono::steady_clock Clock;
+
+			ScanScheduler(const ScanParameters& full, const AdaptiveScan& adapt, Clock::time_point now=Clock::now());
+
+			///Count some reports, and some which were dropped. Returns true
+			///if the parameters have changed.
+			bool observe(unsigned reports, unsigned dropped, Clock::time_point now=Clock::now());
+
+			const ScanParameters& parameters() const
+			{
+				return current;
+			}
+
+			///When the current period ends. If nothing is heard, call
+			///observe() then anyway, so the window shrinks.
+			Clock::time_point period_end() const
+			{
+				return period_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(adapt.period));
+			}
+
+			///The report rate over the last complete period.
+			double report_rate() const
+			{
+				return rate;
+			}
+
+		private:
+			ScanParameters current;
+			uint16_t max_window;
+			AdaptiveScan adapt;
+			Clock::time_point period_start;
+			unsigned reports=0, dropped=0;
+			double rate=0;
+	};
+
+	///A device on the controller's accept list.
+	struct AcceptListEntry
+	{
+		///As it comes over the air, least significant byte first.
+		std::array<uint8_t, 6> address;
+		uint8_t address_type;
+
+		///From the usual form, e.g. "7c:76:21:16:57:0b". Throws
+		///std::invalid_argument if it isn't an address.
+		AcceptListEntry(const std::string& address, uint8_t address_type=LE_PUBLIC_ADDRESS);
+		AcceptListEntry(const uint8_t* address, uint8_t address_type);
+
+		bool operator<(const AcceptListEntry&) const;
+		bool operator==(const AcceptListEntry&) const;
+	};
+
+	struct KernelFilter;
+
 	/// Class for scanning for BLE devices
 	/// this must be run as root, because it requires getting packets from the HCI.
 	/// The HCI requires root since it has no permissions on setting filters, so 
@@ -174,24 +295,97 @@ namespace BLEPP
 		HCIScanner(bool start);
 		HCIScanner(bool start, FilterDuplicates duplicates, ScanType, std::string device="");
 
+		///Use an HCI socket which is already open, for example one opened by
+		///hand or a stand-in for a controller in tests. The scanner takes
+		///ownership of it.
+		HCIScanner(bool start, FilterDuplicates duplicates, ScanType, int fd);
+
 
 		void start();
 		void stop();
+
+		///Change the scan parameters. If scanning, the scan is restarted
+		///with the new ones. This turns off any adaptive scanning.
+		void set_parameters(const ScanParameters&);
+
+		///The parameters in use. With adaptive scanning, that's the adapted
+		///window, within the parameters last set.
+		const ScanParameters& parameters() const;
+
+		///Adapt the scan window to the report rate, with the parameters last
+		///set as the most it will listen for.
+		void set_adaptive(const AdaptiveScan&);
+
+		///Only parse and return the adverts which pass the filter. They're
+		///tested before being parsed, so rejecting them is cheap.
+		void set_filter(const AdvertFilter&);
+
+		///Drop unwanted events in the kernel, before they're read. This
+		///saves waking up for them at all, but the criteria are simpler
+		///than set_filter()'s. See blepp/kernel_filter.h.
+		void set_kernel_filter(const KernelFilter&);
+		void clear_kernel_filter();
+
+		///Tell the adaptive scan about reports which were dropped, for
+		///example because a queue downstream was full.
+		void count_dropped(unsigned n);
+
+		///Only hear the given devices. The controller's accept list is
+		///brought in line with as few commands as it can be, and the scan
+		///set to use it. If there are more than the controller can hold, the
+		///filtering is done in software instead. An empty list hears
+		///everyone again.
+		void set_accept_list(const std::vector<AcceptListEntry>&);
+
+		///How many devices the controller's accept list holds.
+		int accept_list_size();
+
+		///Whether the controller is doing the filtering.
+		bool accept_list_in_hardware() const;
 		
 		///get the file descriptor.
 		///Use with select(), poll() or whatever.
 		int get_fd() const;
+
+		///Adverts which arrived while waiting for the controller to answer a
+		///command are waiting. get_advertisements() returns them without the
+		///file descriptor becoming readable, so don't wait for it.
+		bool has_pending() const;
+
+		///How long to wait for the file descriptor, in milliseconds, for
+		///poll(): 0 if has_pending(), -1 for ever, or with adaptive scanning,
+		///until it's time to reconsider the window. If the wait times out,
+		///call check_idle().
+		int poll_timeout() const;
+
+		///Tell the adaptive scan that time has passed, even though nothing
+		///was heard, so it can listen less.
+		void check_idle();
 		
 		~HCIScanner();
 
 		///Blocking call. Use select() on the FD if you don't want to block.
-		///This reads and parses the HCI packets.
+		///This reads and parses the HCI packets. Adverts which arrived while
+		///the scanner was waiting for the controller to answer a command are
+		///returned first, without blocking.
 		std::vector<AdvertisingResponse> get_advertisements();
 		
+		///Like get_advertisements(), but only for beacon frames, which are
+		///decoded straight from the packet and appended to beacons. Once
+		///it has room, nothing is allocated. Returns how many were added.
+		///Duplicates aren't filtered, since beacons repeat by design.
+		std::size_t get_beacons(std::vector<BeaconReport>& beacons);
+
+		///Decode the beacon frames in an HCI advertising packet.
+		static std::size_t parse_beacons(const std::vector<uint8_t>& packet, std::vector<BeaconReport>& beacons, const AdvertFilter& filter=AdvertFilter());
+
 		///Parse an HCI advertising packet. There's probably not much
 		///reason to call this yourself.
 		static std::vector<AdvertisingResponse> parse_packet(const std::vector<uint8_t>& p);
 
+		///Parse only the adverts which pass the filter.
+		static std::vector<AdvertisingResponse> parse_packet(const std::vector<uint8_t>& p, const AdvertFilter& filter);
+
 		private:
 			struct FilterEntry
 			{
@@ -207,10 +401,49 @@ namespace BLEPP
 
 			FD hci_fd;
 			bool running=0;
+			bool has_filter=0;
 			hci_filter old_filter;
+
+			ScanParameters scan_parameters;
+			std::unique_ptr<ScanScheduler> scheduler;
+			unsigned dropped=0;
+
+			//The devices to hear, what's on the controller's list, and
+			//which of them is doing the filtering. The controller's list
+			//is unknown until it's first cleared.
+			std::set<AcceptListEntry> accept_list;
+			std::set<AcceptListEntry> controller_accept_list;
+			bool controller_accept_list_known=0;
+			int controller_accept_list_size=-1;
+			bool hardware_accept=0;
+			bool software_accept=0;
+
+			AdvertFilter filter;
+
+			//LE meta events which arrived while waiting for a command.
+			std::deque<std::vector<uint8_t>> held_packets;
 			
 			///Read the HCI data, but don't parse it.
 			std::vector<uint8_t> read_with_retry();
+			void read_with_retry(std::vector<uint8_t>& buffer);
+
+			///The next packet, or one held while waiting for a command.
+			///False if it's the answer to a command.
+			bool next_packet(std::vector<uint8_t>& packet);
+			std::vector<uint8_t> packet_buffer;
+
+			void adapt(std::size_t reports);
+
+			///Send an LE controller command, and wait for it to complete.
+			///Returns the status: 0 for success. Any other return parameters
+			///go in reply.
+			uint8_t send_command(uint16_t ocf, const void* params, uint8_t length, std::vector<uint8_t>* reply=nullptr);
+			void accept_list_command(uint16_t ocf, const AcceptListEntry&);
+			void sync_accept_list();
+			bool accepted(const std::vector<uint8_t>& packet) const;
+			void set_scan_enable(bool enable);
+			void set_scan_parameters();
+			void reconfigure();
 			std::set<FilterEntry> scanned_devices;
 	};
 }
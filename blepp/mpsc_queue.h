@@ -0,0 +1,110 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __INC_BLEPP_MPSC_QUEUE_H
+#define __INC_BLEPP_MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+namespace BLEPP
+{
+	///Lock free multiple producer, single consumer FIFO.
+	///
+	///This is the linked list queue due to Dmitry Vyukov. Pushing is a single
+	///atomic exchange and can be done from any number of threads at once. Popping
+	///must only ever be done from one thread (the consumer) at a time. 
+	///
+	///There is a short window during a push where the item is in the queue but
+	///not visible to the consumer. If you need to know when something has arrived,
+	///signal the consumer *after* the push returns, and it will see the item.
+	template<class T>
+	class MPSCQueue
+	{
+		private:
+			struct Node
+			{
+				std::atomic<Node*> next;
+				T value;
+
+				Node()
+				:next(nullptr)
+				{}
+			};
+
+			std::atomic<Node*> head; //Producers add here
+			Node* tail;              //The consumer removes from here. Always a dummy node.
+
+		public:
+			MPSCQueue()
+			{
+				tail = new Node;
+				head.store(tail);
+			}
+
+			MPSCQueue(const MPSCQueue&) = delete;
+			MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+			~MPSCQueue()
+			{
+				while(tail)
+				{
+					Node* n = tail->next.load(std::memory_order_relaxed);
+					delete tail;
+					tail = n;
+				}
+			}
+
+			///Any thread.
+			void push(T value)
+			{
+				Node* n = new Node;
+				n->value = std::move(value);
+
+				Node* prev = head.exchange(n, std::memory_order_acq_rel);
+				prev->next.store(n, std::memory_order_release);
+			}
+
+			///Consumer only.
+			bool empty() const
+			{
+				return tail->next.load(std::memory_order_acquire) == nullptr;
+			}
+
+			///Consumer only. Returns false if there is nothing (visible) in the queue.
+			bool pop(T& value)
+			{
+				Node* next = tail->next.load(std::memory_order_acquire);
+				if(!next)
+					return false;
+
+				//next becomes the new dummy node.
+				value = std::move(next->value);
+				next->value = T();
+				delete tail;
+				tail = next;
+				return true;
+			}
+	};
+}
+
+#endif
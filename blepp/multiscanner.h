@@ -0,0 +1,123 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#ifndef __INC_BLEPP_MULTISCANNER_H
+#define __INC_BLEPP_MULTISCANNER_H
+
+#include <blepp/lescan.h>
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace BLEPP
+{
+	///Scan with several adapters at once, to catch more of the adverts on a
+	///busy channel. The adverts are merged into one stream, and one sent by
+	///a device and heard by several adapters comes out once, with the RSSI
+	///as heard by each of them.
+	///
+	///Everything runs from one poll loop, either get_advertisements(), or
+	///your own loop using get_fds() and read().
+	class MultiScanner
+	{
+		public:
+			///An advert as heard by any of the adapters.
+			struct Report
+			{
+				///As it was first heard, but with the best RSSI from any adapter.
+				AdvertisingResponse advertisement;
+
+				///The best RSSI from each adapter, by index. 127 (unavailable)
+				///if the adapter didn't hear it.
+				std::vector<int8_t> rssi;
+
+				///The adapter which heard it first.
+				int first_adapter;
+
+				///How many times it was heard, across all the adapters.
+				int sightings;
+			};
+
+			///The same advert heard again within window seconds is merged
+			///into the same report. Reports come out when the window closes.
+			explicit MultiScanner(double window=0.1);
+
+			///Scan with each of the named adapters, e.g. {"hci0", "hci1"}.
+			MultiScanner(const std::vector<std::string>& devices, HCIScanner::FilterDuplicates filter=HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType type=HCIScanner::ScanType::Active, double window=0.1);
+
+			///Add an adapter, returning its index.
+			int add_adapter(const std::string& device, HCIScanner::FilterDuplicates filter=HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType type=HCIScanner::ScanType::Active, bool start=true);
+
+			///Add an adapter from an open HCI socket, which the scanner takes
+			///ownership of. Returns its index.
+			int add_adapter(int fd, HCIScanner::FilterDuplicates filter=HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType type=HCIScanner::ScanType::Active, bool start=true);
+
+			HCIScanner& adapter(int i);
+			int num_adapters() const;
+
+			void start();
+			void stop();
+
+			///The adapters' file descriptors, in index order.
+			std::vector<int> get_fds() const;
+
+			///Read from an adapter whose file descriptor is readable, or which
+			///has_pending(). For adaptive scanning, call check_idle() on
+			///those which haven't been heard from by their poll_timeout().
+			void read(int adapter);
+
+			///Wait up to timeout milliseconds (forever if negative) for reports
+			///whose window has closed, reading from the adapters meanwhile.
+			std::vector<Report> get_advertisements(int timeout=-1);
+
+			///The reports whose window has closed.
+			std::vector<Report> get_finished();
+
+			///All the reports, whether or not their windows have closed.
+			std::vector<Report> flush();
+
+		private:
+			typedef std::chrono::steady_clock Clock;
+
+			struct Pending
+			{
+				Report report;
+				Clock::time_point closes;
+			};
+
+			std::chrono::nanoseconds window;
+			std::vector<std::unique_ptr<HCIScanner>> adapters;
+
+			//Reports in the order they were opened, so also in the order
+			//their windows close.
+			std::map<std::string, Pending> pending;
+			std::deque<std::map<std::string, Pending>::iterator> order;
+
+			void merge(int adapter, AdvertisingResponse&& a);
+	};
+}
+
+#endif
@@ -0,0 +1,202 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#ifndef __INC_BLEPP_NOTIFICATION_LOG_H
+#define __INC_BLEPP_NOTIFICATION_LOG_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace BLEPP
+{
+	///A notification log couldn't be written or read.
+	class NotificationLogError: public std::runtime_error
+	{
+		using runtime_error::runtime_error;
+	};
+
+	///The notifications from one characteristic on one device.
+	struct NotificationLogStream
+	{
+		std::uint16_t id;
+		std::string device;
+		std::string characteristic;
+		std::string label;
+	};
+
+	///Count the gaps in a sequence number which the device puts in each
+	///notification, such as a packet counter. The number is little endian,
+	///and wraps.
+	struct SequenceCounter
+	{
+		///Where it is in the payload, and how many bytes: 1, 2 or 4. With a
+		///negative offset, only the notifications are counted.
+		int offset=-1;
+		int size=1;
+
+		std::uint64_t received=0;
+
+		///Places where notifications were missed, and how many in all.
+		std::uint64_t gaps=0;
+		std::uint64_t missed=0;
+
+		///Repeated or out of order numbers, and notifications too short to
+		///hold one.
+		std::uint64_t out_of_order=0;
+		std::uint64_t malformed=0;
+
+		void observe(const std::uint8_t* data, std::size_t length);
+
+		private:
+			bool started=false;
+			std::uint32_t last=0;
+	};
+
+	struct NotificationLogOptions
+	{
+		///Start a new file once the current one is this big, or its
+		///notifications span this many seconds. 0 for never.
+		std::uint64_t rotate_bytes = 256u << 20;
+		double rotate_seconds = 0;
+
+		///Write with O_DIRECT, bypassing the page cache, in whole blocks.
+		///Where the filesystem doesn't support it, ordinary writes are used.
+		bool direct = false;
+
+		///How much is gathered before it's written. A multiple of 4096,
+		///and at least 128k.
+		std::size_t buffer_size = 1 << 20;
+	};
+
+	///Write notifications to a compact binary log. Each is stored with its
+	///stream, its length, and two times in nanoseconds, as given: typically
+	///CLOCK_MONOTONIC when it was processed and the kernel's receive time.
+	///That's 20 bytes on top of the payload.
+	///
+	///The log is a series of files, prefix-000000.blepplog and so on. The
+	///streams are described at the start of each file, so each can be read
+	///on its own. Notifications are buffered, and only reach the file when
+	///the buffer fills or on flush(), rotate() or close().
+	class NotificationLogWriter
+	{
+		public:
+			NotificationLogWriter(const std::string& prefix, const NotificationLogOptions& options=NotificationLogOptions());
+			~NotificationLogWriter();
+
+			NotificationLogWriter(const NotificationLogWriter&)=delete;
+			NotificationLogWriter& operator=(const NotificationLogWriter&)=delete;
+
+			///Describe a stream, returning its ID for log().
+			std::uint16_t add_stream(const std::string& device, const std::string& characteristic, const std::string& label);
+
+			void log(std::uint16_t stream, const std::uint8_t* data, std::size_t length, std::int64_t monotonic_ns, std::int64_t kernel_ns);
+
+			void flush();
+			void rotate();
+			void close();
+
+			///The name of the file being written.
+			const std::string& file() const;
+
+			///Whether O_DIRECT is in use.
+			bool direct() const;
+
+			static std::string file_name(const std::string& prefix, unsigned n);
+
+			///The files written with a prefix, in order.
+			static std::vector<std::string> files(const std::string& prefix);
+
+		private:
+			std::string prefix;
+			NotificationLogOptions options;
+			unsigned file_number=0;
+			std::string filename;
+			int fd=-1;
+			bool using_direct=false;
+
+			std::vector<NotificationLogStream> streams;
+
+			//Written at file_offset. With O_DIRECT, that's always a whole
+			//number of blocks into the file.
+			std::uint8_t* buffer=nullptr;
+			std::size_t used=0;
+			std::uint64_t file_offset=0;
+
+			bool first_in_file=true;
+			std::int64_t file_start_ns=0;
+
+			void open_file();
+			void close_file();
+			void write_out(bool all);
+			void append(const void* data, std::size_t length);
+			void append_record(std::uint16_t stream, const std::uint8_t* data, std::size_t length, std::int64_t monotonic_ns, std::int64_t kernel_ns);
+			void append_definition(const NotificationLogStream&);
+	};
+
+	///Read a notification log file, in order.
+	class NotificationLogReader
+	{
+		public:
+			struct Notification
+			{
+				std::uint16_t stream;
+				std::int64_t monotonic_ns;
+				std::int64_t kernel_ns;
+
+				///Pointing into the file, valid while the reader is.
+				const std::uint8_t* data;
+				std::size_t length;
+			};
+
+			///Throws NotificationLogError if it isn't a notification log.
+			explicit NotificationLogReader(const std::string& filename);
+			~NotificationLogReader();
+
+			NotificationLogReader(const NotificationLogReader&)=delete;
+			NotificationLogReader& operator=(const NotificationLogReader&)=delete;
+
+			///The next notification. False at the end.
+			bool next(Notification&);
+
+			///A stream described so far, or null. Those described at the start
+			///of the file are known straight away.
+			const NotificationLogStream* stream(std::uint16_t id) const;
+
+			///Whether the file ended part way through a record, for example
+			///because the logger died while writing it.
+			bool truncated() const;
+
+		private:
+			const std::uint8_t* map=nullptr;
+			std::size_t size=0;
+			std::size_t offset=0;
+			bool ended_early=false;
+			std::vector<NotificationLogStream> streams;
+
+			const std::uint8_t* next_record(std::uint16_t& stream, std::uint16_t& length);
+			void add_definition(const std::uint8_t* text, std::size_t length);
+	};
+}
+
+#endif
@@ -26,12 +26,91 @@
 #include <blepp/uuid.h>
 
 #include <cstdint>
+#include <cstring>
 #include <utility>
 #include <vector>
 #include <string>
+#include <ostream>
 
 namespace BLEPP
 {
+	//Formatters which write into the caller's buffer and never allocate.
+	//They don't write a terminating null, and return the end of what they
+	//wrote. The output is the same as from the string versions below.
+	char* to_hex_chars(char* out, std::uint8_t u);                  //2 characters
+	char* to_hex_chars(char* out, std::uint16_t u);                 //4 characters
+	char* to_hex_chars(char* out, const std::uint8_t* d, int l);    //3 per byte
+	char* to_str_chars(char* out, const std::uint8_t* d, int l);    //At most 4 per byte
+	char* to_str_chars(char* out, const bt_uuid_t& uuid);           //At most MAX_LEN_UUID_STR-1
+
+	//6 bytes, least significant first as they are on the air, to the usual
+	//aa:bb:cc:dd:ee:ff (17 characters).
+	char* address_to_chars(char* out, const std::uint8_t* address);
+
+	///A string of at most N characters which lives on the stack, for
+	///formatting UUIDs and addresses without touching the heap.
+	template<int N> class ShortString
+	{
+		public:
+			ShortString()
+			:length(0)
+			{
+				buf[0] = 0;
+			}
+
+			//Take the characters written into data() up to end.
+			void set_end(const char* end)
+			{
+				length = end - buf;
+				buf[length] = 0;
+			}
+
+			char* data()
+			{
+				return buf;
+			}
+
+			const char* c_str() const
+			{
+				return buf;
+			}
+
+			int size() const
+			{
+				return length;
+			}
+
+			std::string str() const
+			{
+				return std::string(buf, length);
+			}
+
+			operator std::string() const
+			{
+				return str();
+			}
+
+			bool operator==(const char* s) const
+			{
+				return strcmp(buf, s) == 0;
+			}
+
+		private:
+			char buf[N+1];
+			int length;
+	};
+
+	template<int N> std::ostream& operator<<(std::ostream& o, const ShortString<N>& s)
+	{
+		return o.write(s.c_str(), s.size());
+	}
+
+	typedef ShortString<MAX_LEN_UUID_STR-1> UUIDString;
+	typedef ShortString<17> AddressString;
+
+	UUIDString to_short_str(const bt_uuid_t& uuid);
+	AddressString address_to_short_str(const std::uint8_t* address);
+
 	std::string to_hex(const std::uint16_t& u);
 	std::string to_hex(const std::uint8_t& u);
 	std::string to_str(const std::uint8_t& u);
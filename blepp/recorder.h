@@ -0,0 +1,244 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#ifndef __INC_BLEPP_RECORDER_H
+#define __INC_BLEPP_RECORDER_H
+
+#include <blepp/lescan.h>
+#include <blepp/advert_filter.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace BLEPP
+{
+	///A recording couldn't be written or read.
+	class RecordingError: public std::runtime_error
+	{
+		using runtime_error::runtime_error;
+	};
+
+	///Append adverts to a recording on disk, for analysis later.
+	///
+	///The recording is a series of segment files, prefix-000000.blepp,
+	///prefix-000001.blepp and so on, each mapped into memory while it's
+	///written. Adverts are gathered into blocks, and each block is stored
+	///column by column:
+	///   times (32 bit offsets in microseconds from the block's first)
+	///   addresses (6 bytes and the address type, packed into 8)
+	///   RSSIs
+	///   event types
+	///   offsets of the AD data in the payload (count + 1 of them)
+	///   the AD data
+	///That's 18 bytes per advert on top of the AD data, about a fifth of
+	///what printing them as text takes. When a segment is full, an index of
+	///its blocks and their time ranges is written on the end and the next
+	///one started.
+	///
+	///Everything is in the host's byte order.
+	///
+	///A block reaches the file when it's full, when flush() is called, or
+	///when the recorder is closed. The blocks in a segment whose recorder
+	///died are still readable, since the reader can find them without the
+	///index.
+	class AdvertRecorder
+	{
+		public:
+			typedef std::chrono::system_clock Clock;
+
+			///Start a new segment after any already recorded with the same
+			///prefix. Segments are at most segment_size bytes, and blocks at
+			///most block_adverts adverts.
+			AdvertRecorder(const std::string& prefix, std::size_t segment_size=64<<20, std::uint32_t block_adverts=4096);
+			~AdvertRecorder();
+
+			AdvertRecorder(const AdvertRecorder&)=delete;
+			AdvertRecorder& operator=(const AdvertRecorder&)=delete;
+
+			void record(const RawAdvert&, Clock::time_point time=Clock::now());
+
+			///Record a parsed advert, from its address and raw data.
+			void record(const AdvertisingResponse&, Clock::time_point time=Clock::now());
+
+			///Write the current block to the file.
+			void flush();
+
+			///Finish the current segment, and start the next.
+			void rotate();
+
+			///Finish the current segment. Nothing more can be recorded.
+			void close();
+
+			///The name of the segment being written.
+			const std::string& segment() const;
+
+			static std::string segment_name(const std::string& prefix, unsigned n);
+
+		private:
+			friend class RecordingReader;
+
+			std::string prefix;
+			unsigned segment_number=0;
+			std::string segment_filename;
+			std::size_t segment_size;
+			std::uint32_t block_adverts;
+
+			int fd=-1;
+			std::uint8_t* map=nullptr;
+			std::size_t write_offset=0;
+
+			struct IndexEntry
+			{
+				std::uint64_t offset;
+				std::uint32_t count;
+				std::uint32_t size;
+				std::int64_t first_time;
+				std::int64_t last_time;
+			};
+			std::vector<IndexEntry> index;
+
+			//The block being gathered.
+			std::vector<std::int64_t> times;
+			std::vector<std::array<std::uint8_t, 8>> addresses;
+			std::vector<std::int8_t> rssis;
+			std::vector<std::uint8_t> event_types;
+			std::vector<std::uint32_t> payload_offsets;
+			std::vector<std::uint8_t> payload;
+			std::int64_t first_time=0, last_time=0;
+
+			void open_segment();
+			void close_segment();
+			void write_block();
+			std::size_t space_left(std::size_t blocks) const;
+	};
+
+	///Read a segment written by AdvertRecorder. The file is mapped into
+	///memory, and the blocks' columns are read in place.
+	class RecordingReader
+	{
+		public:
+			typedef std::chrono::system_clock Clock;
+
+			///One block of adverts, as columns.
+			struct Block
+			{
+				std::uint32_t size;
+
+				///Microseconds since the epoch.
+				std::int64_t first_time;
+				std::int64_t last_time;
+
+				const std::uint32_t* time_offsets;
+				const std::uint8_t* addresses;
+				const std::int8_t* rssis;
+				const std::uint8_t* event_types;
+				const std::uint32_t* payload_offsets;
+				const std::uint8_t* payload;
+
+				Clock::time_point time(std::uint32_t i) const
+				{
+					return Clock::time_point(std::chrono::microseconds(first_time + time_offsets[i]));
+				}
+
+				///The advert, pointing into the file.
+				RawAdvert advert(std::uint32_t i) const
+				{
+					return RawAdvert{event_types[i], addresses[8*i+6], addresses + 8*i, payload + payload_offsets[i], payload_offsets[i+1] - payload_offsets[i], rssis[i]};
+				}
+			};
+
+			///Throws RecordingError if it isn't a recording, or is damaged.
+			explicit RecordingReader(const std::string& filename);
+			~RecordingReader();
+
+			RecordingReader(const RecordingReader&)=delete;
+			RecordingReader& operator=(const RecordingReader&)=delete;
+
+			const std::vector<Block>& blocks() const;
+
+			///How many adverts there are.
+			std::size_t size() const;
+
+			///Whether the segment was finished with an index. If not, the
+			///blocks were found by walking the file.
+			bool complete() const;
+
+			///Call f(time, advert) for each advert, in the order they were
+			///recorded.
+			template<class F> void for_each(F f) const
+			{
+				for(const auto& b: block_list)
+					for(std::uint32_t i=0; i < b.size; i++)
+						f(b.time(i), b.advert(i));
+			}
+
+			///Only those recorded in [from, to). Blocks entirely outside the
+			///range aren't looked at.
+			template<class F> void for_each(Clock::time_point from, Clock::time_point to, F f) const
+			{
+				std::int64_t t0 = microseconds(from), t1 = microseconds(to);
+				for(const auto& b: block_list)
+					if(b.last_time >= t0 && b.first_time < t1)
+						for(std::uint32_t i=0; i < b.size; i++)
+						{
+							std::int64_t t = b.first_time + b.time_offsets[i];
+							if(t >= t0 && t < t1)
+								f(b.time(i), b.advert(i));
+						}
+			}
+
+			///Only those which pass the filter.
+			template<class F> void for_each(const AdvertFilter& filter, F f) const
+			{
+				for_each([&](Clock::time_point t, const RawAdvert& a){
+					if(filter(a))
+						f(t, a);
+				});
+			}
+
+			///The segments recorded with a prefix, in order.
+			static std::vector<std::string> segments(const std::string& prefix);
+
+		private:
+			int fd=-1;
+			const std::uint8_t* map=nullptr;
+			std::size_t map_size=0;
+			bool has_index=false;
+			std::vector<Block> block_list;
+			std::size_t count=0;
+
+			bool read_index();
+			void find_blocks();
+			std::size_t add_block(std::size_t offset, std::size_t limit);
+
+			static std::int64_t microseconds(Clock::time_point t)
+			{
+				return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+			}
+	};
+}
+
+#endif
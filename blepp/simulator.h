@@ -0,0 +1,161 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __INC_BLEPP_SIMULATOR_H
+#define __INC_BLEPP_SIMULATOR_H
+
+#include <vector>
+#include <deque>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+#include <blepp/gattserver.h>
+#include <blepp/blestatemachine.h>
+
+namespace BLEPP
+{
+	///A peripheral which exists only in software, for testing and benchmarking
+	///BLEGATTStateMachine without a radio.
+	///
+	///The attribute table is an ordinary BLEGATTServer. Between it and the
+	///central is an emulated link which delays PDUs, paces them onto connection
+	///events and loses some of them. Lost PDUs are retransmitted at the next
+	///connection event, as the link layer would, so loss costs time but ATT
+	///never sees it.
+	///
+	///Time is simulated unless link.real_time is set: whenever nothing is
+	///runnable, the clock jumps straight to the next scheduled event. A run
+	///with a 50ms connection interval therefore takes as much CPU as one without,
+	///and the simulated times it reports are reproducible.
+	class SimulatedPeripheral
+	{
+		public:
+			struct Link
+			{
+				///One way delay added to every PDU, in seconds.
+				double latency=0;
+
+				///Time between connection events, in seconds. PDUs only cross
+				///the link at connection events. With 0, PDUs cross whenever
+				///they are sent.
+				double connection_interval=0;
+
+				///The most PDUs which cross in each direction per connection
+				///event. 0 for no limit.
+				int pdus_per_event=0;
+
+				///Probability that a PDU is lost and has to be sent again, at the
+				///next connection event or, with no events, after another latency.
+				double loss=0;
+
+				///Run against the clock on the wall rather than a simulated one.
+				bool real_time=false;
+
+				unsigned int seed=1;
+			};
+
+			SimulatedPeripheral();
+			explicit SimulatedPeripheral(const Link& link);
+			SimulatedPeripheral(const SimulatedPeripheral&) = delete;
+			SimulatedPeripheral& operator=(const SimulatedPeripheral&) = delete;
+			~SimulatedPeripheral();
+
+			///The attribute table. Build it before connecting.
+			BLEGATTServer server;
+
+			///Connect a central. Returns a socket for BLEGATTStateMachine::adopt_socket(),
+			///which takes ownership of it. Any previous central is disconnected.
+			int connect();
+
+			///Every period seconds, set the value of a characteristic to the
+			///result of generate() and send it to subscribers.
+			void notify_every(uint16_t value_handle, double period, std::function<std::vector<uint8_t>()> generate);
+			void stop_notifying();
+
+			///Seconds since construction, simulated or not.
+			double now() const;
+
+			///True if no PDUs are waiting to cross the link.
+			bool idle() const;
+
+			///Run the central and the peripheral until done() returns true, or
+			///timeout seconds have passed. Returns done().
+			bool run(BLEGATTStateMachine& gatt, const std::function<bool()>& done, double timeout=10);
+
+			///Run until the central is idle and nothing is in flight.
+			bool run_until_idle(BLEGATTStateMachine& gatt, double timeout=10);
+
+			///Counts of PDUs which have crossed the link, and of retransmissions.
+			uint64_t pdus_to_peripheral=0;
+			uint64_t pdus_to_central=0;
+			uint64_t retransmissions=0;
+
+		private:
+			struct Packet
+			{
+				double deliver_at;
+				std::vector<uint8_t> data;
+			};
+
+			//PDUs going one way across the link: read from one socket, held
+			//until they are due, then written to the other.
+			struct Direction
+			{
+				int from=-1, to=-1;
+				std::deque<Packet> queue;
+				long long event=-1;
+				int used=0;
+				double last=0;
+				uint64_t* count;
+			};
+
+			struct Notifier
+			{
+				uint16_t handle;
+				double period, next;
+				std::function<std::vector<uint8_t>()> generate;
+			};
+
+			double schedule(Direction&, double t);
+			bool receive(Direction&);
+			bool deliver(Direction&);
+			bool fire_notifiers();
+			double next_event() const;
+			void disconnect();
+
+			Link link;
+			std::minstd_rand rng;
+			std::uniform_real_distribution<double> uniform;
+
+			Direction to_peripheral, to_central;
+			int server_fd=-1;
+			std::vector<Notifier> notifiers;
+			std::vector<uint8_t> buf;
+
+			double simulated_now=0;
+			std::chrono::steady_clock::time_point start;
+	};
+}
+
+#endif
@@ -27,6 +27,7 @@
 
 #include <stdint.h>
 #include <bluetooth/bluetooth.h>
+#include <type_traits>
 
 namespace BLEPP
 {
@@ -113,12 +114,32 @@ namespace BLEPP
 		BT_UUID32 = 32,
 		BT_UUID128 = 128,
 	} bt_uuid_type_t;
-	typedef struct {
+	typedef struct bt_uuid {
 		bt_uuid_type_t type;
-		union {
+		//The constructors allow any member to be initialised in a constant
+		//expression. The 32 bit one only takes a uint32_t, so that {0} and
+		//{u16} still mean the 16 bit member.
+		union bt_uuid_value {
 			uint16_t  u16;
 			uint32_t  u32;
 			uint128_t u128;
+
+			constexpr bt_uuid_value()
+			:u16(0)
+			{}
+
+			constexpr bt_uuid_value(uint16_t u)
+			:u16(u)
+			{}
+
+			template<class T, class = typename std::enable_if<std::is_same<T, uint32_t>::value>::type>
+			constexpr bt_uuid_value(T u)
+			:u32(u)
+			{}
+
+			constexpr bt_uuid_value(const uint128_t& u)
+			:u128(u)
+			{}
 		} value;
 	} bt_uuid_t;
 
@@ -71,7 +71,7 @@ int main(int argc, char **argv)
 
 		for(auto& service: gatt.primary_services)
 			for(auto& characteristic: service.characteristics)
-				if(characteristic.uuid == UUID("53f72b8c-ff27-4177-9eee-30ace844f8f2"))
+				if(characteristic.uuid == "53f72b8c-ff27-4177-9eee-30ace844f8f2"_uuid)
 				{
 					characteristic.cb_notify_or_indicate = notify_cb;
 					characteristic.set_notify_and_indicate(true, false);
@@ -164,14 +164,20 @@ int main(int argc, char **argv)
 	// notifications on a device I have. You will need to modify this!
 	//
 	// Search for the service and attribute and set up notifications and the appropriate callback.
+	//
+	// The _uuid literals are parsed at compile time, so there's no work done
+	// comparing against them.
 	bool enable=true;
 	std::function<void()> cb = [&gatt, &notify_cb, &enable](){
 
 		pretty_print_tree(gatt);
 
+		constexpr UUID my_service = "7309203e-349d-4c11-ac6b-baedd1819764"_uuid;
+		constexpr UUID my_characteristic = "e5f49879-6ee1-479e-bfec-3d35e13d3b88"_uuid;
+
 		for(auto& service: gatt.primary_services)
 			for(auto& characteristic: service.characteristics)
-				if(service.uuid == UUID("7309203e-349d-4c11-ac6b-baedd1819764") && characteristic.uuid == UUID("e5f49879-6ee1-479e-bfec-3d35e13d3b88"))
+				if(service.uuid == my_service && characteristic.uuid == my_characteristic)
 				{
 					cout << "woooo\n";
 					characteristic.cb_notify_or_indicate = notify_cb;
@@ -0,0 +1,87 @@
+/*
+ *
+ *  libble++ - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <iostream>
+#include <list>
+#include <blepp/coroutine.h>
+#include <blepp/float.h>
+using namespace std;
+using namespace BLEPP;
+
+//The temperature example, but for any number of devices at once, and
+//written as straight line code rather than a chain of callbacks.
+Task log_temperature(Executor& ex, BLEGATTStateMachine& gatt, string address)
+{
+	try
+	{
+		co_await ex.connect(gatt, address);
+		co_await ex.discover(gatt);
+
+		for(auto& service: gatt.primary_services)
+			for(auto& characteristic: service.characteristics)
+				if(characteristic.uuid == "2a1c"_uuid && characteristic.client_characteric_configuration_handle)
+				{
+					auto temperatures = ex.notifications(gatt, characteristic);
+
+					//Ask for notifications by writing to the client characteristic configuration
+					uint8_t notify[] = {1, 0};
+					co_await ex.write(gatt, characteristic.client_characteric_configuration_handle, notify, 2);
+
+					for(;;)
+					{
+						vector<uint8_t> v = co_await temperatures.next();
+						if(v.size() >= 5)
+							cout << address << " " << bluetooth_float_to_IEEE754(v.data()+1) << endl;
+					}
+				}
+
+		cerr << address << ": no temperature characteristic" << endl;
+	}
+	catch(std::exception& e)
+	{
+		cerr << address << ": " << e.what() << endl;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 2)
+	{
+		cerr << "Please supply addresses.\n";
+		cerr << "Usage:\n";
+		cerr << "prog <address> [<address> ...]";
+		exit(1);
+	}
+
+	log_level = Error;
+
+	Executor ex;
+	list<BLEGATTStateMachine> devices;
+
+	for(int i=1; i < argc; i++)
+	{
+		devices.emplace_back();
+		log_temperature(ex, devices.back(), argv[i]);
+	}
+
+	ex.run();
+}
@@ -0,0 +1,79 @@
+/*
+ *
+ *  libble++ - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <iostream>
+#include <vector>
+#include <blepp/gattserver.h>
+#include <poll.h>
+using namespace std;
+using namespace BLEPP;
+
+//Pretend to be a battery, which slowly runs down. Connect to it with
+//something like gatttool and ask for notifications on the battery level.
+//
+//The adapter needs to be advertising for anyone to find it, e.g. with
+//"hciconfig hci0 leadv".
+int main(int argc, char **argv)
+{
+	log_level = Info;
+
+	BLEGATTServer server;
+
+	server.add_primary_service(UUID("180f"));
+	uint8_t level = 100;
+	uint16_t level_handle = server.add_characteristic(UUID("2a19"), GATT_CHARACTERISTIC_FLAGS_READ | GATT_CHARACTERISTIC_FLAGS_NOTIFY, {level});
+
+	server.cb_subscribed = [](int client, uint16_t handle, uint16_t ccc)
+	{
+		cerr << "Client " << client << " set configuration of " << handle << " to " << ccc << endl;
+	};
+
+	server.listen(argc > 1 ? argv[1] : "");
+
+	for(;;)
+	{
+		//The server doesn't own the main loop. Wait on the listening socket
+		//and every client, and hand over whatever is readable. Clients with
+		//responses waiting for room need to be watched for writing too.
+		vector<pollfd> fds(1, pollfd{server.listen_socket(), POLLIN, 0});
+		for(int fd: server.clients())
+			fds.push_back(pollfd{fd, short(server.has_unsent(fd) ? POLLIN | POLLOUT : POLLIN), 0});
+
+		if(poll(fds.data(), fds.size(), 1000) == 0)
+		{
+			level = level ? level - 1 : 100;
+			server.notify(level_handle, &level, 1);
+			continue;
+		}
+
+		if(fds[0].revents)
+			server.accept();
+
+		for(size_t i=1; i < fds.size(); i++)
+		{
+			if((fds[i].revents & POLLOUT) && !server.flush(fds[i].fd))
+				continue;
+			if(fds[i].revents & ~POLLOUT)
+				server.process(fds[i].fd);
+		}
+	}
+}
@@ -19,6 +19,7 @@
 #include <blepp/pretty_printers.h>
 #include <blepp/blestatemachine.h> //for UUID. FIXME mofo
 #include <blepp/lescan.h>
+#include <blepp/assigned_numbers.h>
 
 using namespace std;
 using namespace BLEPP;
@@ -118,7 +119,19 @@ int main(int argc, char** argv)
 				else
 					cout << "Scan response" << endl;
 				for(const auto& uuid: ad.UUIDs)
-					cout << "  Service: " << to_str(uuid) << endl;
+				{
+					cout << "  Service: " << to_str(uuid);
+					if(const AssignedNumber* s = lookup_service(uuid))
+						cout << " (" << s->name << ")";
+					cout << endl;
+				}
+				for(const auto& data: ad.manufacturer_specific_data)
+					if(data.size() >= 2)
+					{
+						uint16_t company = data[0] | (data[1] << 8);
+						const AssignedNumber* c = lookup_company(company);
+						cout << "  Manufacturer: " << (c ? string(c->name) : to_hex(company)) << endl;
+					}
 				if(ad.local_name)
 					cout << "  Name: " << ad.local_name->name << endl;
 				if(ad.rssi == 127)
@@ -56,7 +56,7 @@ int main(int argc, char **argv)
 	std::function<void()> found_services_and_characteristics_cb = [&gatt](){
 		for(auto& service: gatt.primary_services)
 			for(auto& characteristic: service.characteristics)
-				if(characteristic.uuid == UUID("2a00"))
+				if(characteristic.uuid == "2a00"_uuid)
 				{
 					characteristic.cb_read = [&](const PDUReadResponse& r)
 					{
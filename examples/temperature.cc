@@ -24,7 +24,6 @@
 #include <iostream>
 #include <iomanip>
 #include <blepp/blestatemachine.h>
-#include <blepp/float.h>  //BLE uses the obscure IEEE11073 decimal exponent floating point values
 #include <unistd.h>
 #include <chrono>
 using namespace std;
@@ -53,14 +52,17 @@ int main(int argc, char **argv)
 	BLEGATTStateMachine gatt;
 
 	//This function will be called when a push notification arrives from the device.
-	//Not much sanity/error checking here, just for clarity.
-	//Basically, extract the float and log it along with the time.
+	//The standard characteristics can be decoded into structs (see blepp/gatt_values.h),
+	//which deals with the flags and optional fields, and the obscure IEEE11073
+	//decimal exponent floating point values. Log the temperature along with the time.
 	std::function<void(const PDUNotificationOrIndication&)> notify_cb = [&](const PDUNotificationOrIndication& n)
 	{
 		auto ms_since_epoch = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
-		float temp = bluetooth_float_to_IEEE754(n.value().first+1);
+		TemperatureMeasurement t;
+		if(!decode(n.value(), t))
+			return;
 
-		cout << setprecision(15) << ms_since_epoch.count()/1000. << " " << setprecision(5) << temp << endl;
+		cout << setprecision(15) << ms_since_epoch.count()/1000. << " " << setprecision(5) << t.temperature << (t.fahrenheit()?" F":" C") << endl;
 	};
 	
 	//This is called when a complete scan of the device is done, giving
@@ -74,7 +76,7 @@ int main(int argc, char **argv)
 	std::function<void()> found_services_and_characteristics_cb = [&gatt, &notify_cb](){
 		for(auto& service: gatt.primary_services)
 			for(auto& characteristic: service.characteristics)
-				if(characteristic.uuid == UUID("2a1c"))
+				if(characteristic.uuid == "2a1c"_uuid)
 				{
 					characteristic.cb_notify_or_indicate = notify_cb;
 					characteristic.set_notify_and_indicate(true, false);
@@ -52,9 +52,9 @@ int main(int argc, char **argv)
 		//And you almost certainly don't.
 		//substitute your own numbers here.
 		for(auto& service: gatt.primary_services)
-			if(service.uuid == UUID("7309203e-349d-4c11-ac6b-baedd1819764"))
+			if(service.uuid == "7309203e-349d-4c11-ac6b-baedd1819764"_uuid)
 				for(auto& characteristic: service.characteristics)
-					if(characteristic.uuid == UUID("b8637601-a003-436d-a995-2a7f20bcb3d4"))
+					if(characteristic.uuid == "b8637601-a003-436d-a995-2a7f20bcb3d4"_uuid)
 					{
 						//Send a 1 (you can also send longer chunks of data too)
 						characteristic.write_request(uint8_t(1));
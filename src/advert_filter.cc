@@ -0,0 +1,248 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "blepp/advert_filter.h"
+#include "blepp/gap.h"
+
+#include <cstring>
+#include <cctype>
+#include <stdexcept>
+
+using namespace std;
+
+namespace BLEPP
+{
+	namespace
+	{
+		//Call f(type, payload, length) on each AD structure, until it
+		//returns true. Anything malformed ends the search.
+		template<class F> bool any_structure(const RawAdvert& a, F f)
+		{
+			const uint8_t* p = a.data;
+			const uint8_t* end = a.data + a.length;
+
+			while(end - p >= 2)
+			{
+				uint8_t length = p[0];
+				if(length == 0 || length > end - p - 1)
+					return false;
+				if(f(p[1], p + 2, length - 1))
+					return true;
+				p += length + 1;
+			}
+			return false;
+		}
+
+		uint32_t little_endian(const uint8_t* p, int n)
+		{
+			uint32_t v=0;
+			for(int i=n-1; i >= 0; i--)
+				v = v << 8 | p[i];
+			return v;
+		}
+
+		//Whether a list of n byte UUIDs contains the one being looked for.
+		bool contains(const uint8_t* p, size_t length, int n, int32_t short_value, const char* long_value)
+		{
+			for(; length >= size_t(n); p += n, length -= n)
+			{
+				if(n == 16)
+				{
+					if(memcmp(p, long_value, 16) == 0)
+						return true;
+				}
+				else if(short_value >= 0 && little_endian(p, n) == uint32_t(short_value))
+					return true;
+			}
+			return false;
+		}
+	}
+
+	AdvertFilter::AdvertFilter(Code c, int32_t arg, const string& bytes)
+	:program{{c, 1, arg, 0, uint32_t(bytes.size())}},constants(bytes)
+	{
+	}
+
+	AdvertFilter AdvertFilter::combine(Code c, const AdvertFilter& a, const AdvertFilter& b)
+	{
+		//Accepting everything still needs an instruction, to be an operand.
+		static const AdvertFilter all(Code::True, 0, "");
+		const AdvertFilter& x = a.accepts_all() ? all : a;
+		const AdvertFilter& y = b.accepts_all() ? all : b;
+
+		AdvertFilter r;
+		r.program.push_back({c, uint32_t(1 + x.program.size() + y.program.size()), 0, 0, 0});
+		r.program.insert(r.program.end(), x.program.begin(), x.program.end());
+		r.program.insert(r.program.end(), y.program.begin(), y.program.end());
+
+		for(auto i = r.program.end() - y.program.size(); i != r.program.end(); ++i)
+			i->offset += x.constants.size();
+		r.constants = x.constants + y.constants;
+
+		return r;
+	}
+
+	AdvertFilter operator&&(const AdvertFilter& a, const AdvertFilter& b)
+	{
+		return AdvertFilter::combine(AdvertFilter::Code::And, a, b);
+	}
+
+	AdvertFilter operator||(const AdvertFilter& a, const AdvertFilter& b)
+	{
+		return AdvertFilter::combine(AdvertFilter::Code::Or, a, b);
+	}
+
+	AdvertFilter operator!(const AdvertFilter& a)
+	{
+		AdvertFilter r(AdvertFilter::Code::Not, 0, "");
+		AdvertFilter x = a.accepts_all() ? AdvertFilter(AdvertFilter::Code::True, 0, "") : a;
+
+		r.program[0].size += x.program.size();
+		r.program.insert(r.program.end(), x.program.begin(), x.program.end());
+		r.constants = x.constants;
+		return r;
+	}
+
+	AdvertFilter uuid_is(const UUID& u)
+	{
+		//The full UUID as it's sent, least significant byte first, and the
+		//short form for comparing against 16 and 32 bit lists.
+		string bytes(16, 0);
+		for(int i=0; i < 8; i++)
+		{
+			bytes[i] = char(u.low64() >> (8*i));
+			bytes[i+8] = char(u.high64() >> (8*i));
+		}
+
+		int32_t short_value = -1;
+		if(u.is_short() && u.short_value() <= 0x7fffffff)
+			short_value = u.short_value();
+
+		return AdvertFilter(AdvertFilter::Code::UUID, short_value, bytes);
+	}
+
+	AdvertFilter uuid_is(uint16_t u)
+	{
+		return uuid_is(UUID(u));
+	}
+
+	AdvertFilter manufacturer_is(uint16_t company)
+	{
+		return AdvertFilter(AdvertFilter::Code::Manufacturer, company, "");
+	}
+
+	AdvertFilter name_starts_with(const string& prefix)
+	{
+		return AdvertFilter(AdvertFilter::Code::NamePrefix, 0, prefix);
+	}
+
+	AdvertFilter rssi_above(int dBm)
+	{
+		return AdvertFilter(AdvertFilter::Code::RSSIAbove, dBm, "");
+	}
+
+	AdvertFilter address_starts_with(const string& prefix)
+	{
+		//Most significant byte first, as written.
+		string bytes;
+		for(size_t i=0; i < prefix.size(); i += 3)
+		{
+			bool last = i + 2 == prefix.size();
+			if(bytes.size() == 6 || i + 2 > prefix.size() || !isxdigit(prefix[i]) || !isxdigit(prefix[i+1]) || (!last && (prefix[i+2] != ':' || i + 3 == prefix.size())))
+				throw invalid_argument("Bad address prefix " + prefix);
+			bytes += char(stoi(prefix.substr(i, 2), nullptr, 16));
+		}
+
+		return AdvertFilter(AdvertFilter::Code::AddressPrefix, 0, bytes);
+	}
+
+	bool AdvertFilter::operator()(const RawAdvert& a) const
+	{
+		return program.empty() || run(program.data(), a);
+	}
+
+	bool AdvertFilter::run(const Instruction* i, const RawAdvert& a) const
+	{
+		const char* bytes = constants.data() + i->offset;
+
+		switch(i->code)
+		{
+			case Code::True:
+				return true;
+
+			case Code::And:
+				return run(i+1, a) && run(i + 1 + i[1].size, a);
+
+			case Code::Or:
+				return run(i+1, a) || run(i + 1 + i[1].size, a);
+
+			case Code::Not:
+				return !run(i+1, a);
+
+			case Code::UUID:
+				return any_structure(a, [&](uint8_t type, const uint8_t* p, size_t length){
+					switch(type)
+					{
+						case GAP::incomplete_list_of_16_bit_UUIDs:
+						case GAP::complete_list_of_16_bit_UUIDs:
+							return contains(p, length, 2, i->arg, bytes);
+						case GAP::incomplete_list_of_32_bit_UUIDs:
+						case GAP::complete_list_of_32_bit_UUIDs:
+							return contains(p, length, 4, i->arg, bytes);
+						case GAP::incomplete_list_of_128_bit_UUIDs:
+						case GAP::complete_list_of_128_bit_UUIDs:
+							return contains(p, length, 16, i->arg, bytes);
+						case GAP::service_data_16_bit_UUID:
+							return contains(p, min<size_t>(length, 2), 2, i->arg, bytes);
+						case GAP::service_data_32_bit_UUID:
+							return contains(p, min<size_t>(length, 4), 4, i->arg, bytes);
+						case GAP::service_data_128_bit_UUID:
+							return contains(p, min<size_t>(length, 16), 16, i->arg, bytes);
+						default:
+							return false;
+					}
+				});
+
+			case Code::Manufacturer:
+				return any_structure(a, [&](uint8_t type, const uint8_t* p, size_t length){
+					return type == GAP::manufacturer_data && length >= 2 && little_endian(p, 2) == uint32_t(i->arg);
+				});
+
+			case Code::NamePrefix:
+				return any_structure(a, [&](uint8_t type, const uint8_t* p, size_t length){
+					return (type == GAP::shortened_local_name || type == GAP::complete_local_name) && length >= i->length && memcmp(p, bytes, i->length) == 0;
+				});
+
+			case Code::RSSIAbove:
+				return a.rssi != 127 && a.rssi > i->arg;
+
+			case Code::AddressPrefix:
+				for(uint32_t j=0; j < i->length; j++)
+					if(a.address[5-j] != uint8_t(bytes[j]))
+						return false;
+				return true;
+		}
+
+		return false;
+	}
+}
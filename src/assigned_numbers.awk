@@ -0,0 +1,108 @@
+#Turn assigned_numbers.txt into the C++ tables included by assigned_numbers.cc.
+#
+#    awk -v output=assigned_numbers_table.h -f assigned_numbers.awk assigned_numbers.txt
+#
+#The lookups are binary searches, so each section must be sorted. This checks
+#that it is rather than sorting it, so the data file stays easy to review.
+
+function fail(msg)
+{
+	print FILENAME ":" FNR ": " msg > "/dev/stderr"
+	failed = 1
+	exit 1
+}
+
+function hex_value(s,    i, n, d)
+{
+	if(s !~ /^0[xX][0-9a-fA-F]+$/)
+		fail("bad number " s)
+
+	n = 0
+	for(i=3; i <= length(s); i++)
+	{
+		d = index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+		n = n * 16 + d
+	}
+	return n
+}
+
+function quote(s)
+{
+	gsub(/\\/, "\\\\", s)
+	gsub(/"/, "\\\"", s)
+	return "\"" s "\""
+}
+
+function close_section()
+{
+	if(section != "")
+	{
+		print "};" > output
+		if(section == "services")
+			print services_info "};" > output
+		print "" > output
+	}
+}
+
+BEGIN{
+	FS = "\t+"
+
+	formats["-"] = "Unknown"
+	formats["struct"] = "Struct"
+	formats["utf8s"] = "UTF8S"
+	formats["uint8"] = "UInt8"
+	formats["uint16"] = "UInt16"
+	formats["uint24"] = "UInt24"
+	formats["uint32"] = "UInt32"
+	formats["sint8"] = "SInt8"
+	formats["sint16"] = "SInt16"
+	formats["sint24"] = "SInt24"
+	formats["sint32"] = "SInt32"
+	formats["sfloat"] = "SFloat"
+	formats["float"] = "Float"
+
+	if(output == "")
+		output = "/dev/stdout"
+
+	print "//Generated from assigned_numbers.txt by assigned_numbers.awk. Do not edit." > output
+	print "" > output
+}
+
+/^#/ || /^[ \t]*$/ { next }
+
+/^\[[a-z_]+\]$/{
+	close_section()
+	section = substr($0, 2, length($0) - 2)
+	last = -1
+	print "constexpr AssignedNumber " section "[] = {" > output
+	if(section == "services")
+		services_info = "constexpr ServiceInfo services_info[] = {\n"
+	next
+}
+
+{
+	if(section == "")
+		fail("entry before the first [section]")
+	if(NF != 4)
+		fail("expected 4 tab separated fields, got " NF)
+	if(!($2 in formats))
+		fail("unknown format " $2)
+
+	n = hex_value($1)
+	if(n > 65535)
+		fail($1 " is more than 16 bits")
+	if(n <= last)
+		fail($1 " is out of order or repeated in [" section "]")
+	last = n
+
+	id = ($3 == "-") ? "\"\"" : quote($3)
+	printf("\t{%s, %s, %s, ValueFormat::%s},\n", $1, quote($4), id, formats[$2]) > output
+
+	if(section == "services")
+		services_info = services_info sprintf("\t{%s, %s, UUID(%s)},\n", quote($4), id, $1)
+}
+
+END{
+	if(!failed)
+		close_section()
+}
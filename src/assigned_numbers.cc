@@ -0,0 +1,122 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#include "blepp/assigned_numbers.h"
+#include "blepp/blestatemachine.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace BLEPP
+{
+	namespace
+	{
+		//services, characteristics, descriptors, companies, ad_types and
+		//services_info, as constant initialised arrays.
+		#include "src/assigned_numbers_table.h"
+
+		template<size_t N>
+		AssignedNumberTable table(const AssignedNumber (&t)[N])
+		{
+			return {t, t+N};
+		}
+
+		const AssignedNumber* lookup(AssignedNumberTable t, uint16_t number)
+		{
+			auto i = lower_bound(t.begin(), t.end(), number, [](const AssignedNumber& a, uint16_t n)
+			{
+				return a.number < n;
+			});
+
+			if(i != t.end() && i->number == number)
+				return i;
+			else
+				return nullptr;
+		}
+
+		const AssignedNumber* lookup(AssignedNumberKind kind, const UUID& uuid)
+		{
+			if(!uuid.is_short() || uuid.short_value() > 0xffff)
+				return nullptr;
+			return lookup_assigned_number(kind, uuid.short_value());
+		}
+	}
+
+	AssignedNumberTable assigned_numbers(AssignedNumberKind kind)
+	{
+		switch(kind)
+		{
+			case AssignedNumberKind::Service: return table(services);
+			case AssignedNumberKind::Characteristic: return table(characteristics);
+			case AssignedNumberKind::Descriptor: return table(descriptors);
+			case AssignedNumberKind::Company: return table(companies);
+			case AssignedNumberKind::ADType: return table(ad_types);
+		}
+		return {nullptr, nullptr};
+	}
+
+	const AssignedNumber* lookup_assigned_number(AssignedNumberKind kind, uint16_t number)
+	{
+		return lookup(assigned_numbers(kind), number);
+	}
+
+	const AssignedNumber* lookup_service(const UUID& uuid)
+	{
+		return lookup(AssignedNumberKind::Service, uuid);
+	}
+
+	const AssignedNumber* lookup_characteristic(const UUID& uuid)
+	{
+		return lookup(AssignedNumberKind::Characteristic, uuid);
+	}
+
+	const AssignedNumber* lookup_descriptor(const UUID& uuid)
+	{
+		return lookup(AssignedNumberKind::Descriptor, uuid);
+	}
+
+	const AssignedNumber* lookup_company(uint16_t id)
+	{
+		return lookup_assigned_number(AssignedNumberKind::Company, id);
+	}
+
+	const AssignedNumber* lookup_ad_type(uint8_t type)
+	{
+		return lookup_assigned_number(AssignedNumberKind::ADType, type);
+	}
+
+	const ServiceInfo* lookup_service_by_UUID(const UUID& uuid)
+	{
+		//Sorted by number, which for the base range is sorted by UUID too.
+		auto i = lower_bound(begin(services_info), end(services_info), uuid, [](const ServiceInfo& s, const UUID& u)
+		{
+			return s.uuid < u;
+		});
+
+		if(i != end(services_info) && i->uuid == uuid)
+			return i;
+		else
+			return nullptr;
+	}
+}
@@ -59,6 +59,7 @@
 
 #include <blepp/uuid.h>
 #include <blepp/att.h>
+#include <blepp/att_schema.h>
 
 namespace BLEPP
 {
@@ -216,58 +217,30 @@ namespace BLEPP
 	uint16_t enc_read_by_grp_req(uint16_t start, uint16_t end, bt_uuid_t *uuid,
 							uint8_t *pdu, size_t len)
 	{
-		uint16_t min_len = sizeof(pdu[0]) + sizeof(start) + sizeof(end);
-		uint16_t length;
-
 		if (!uuid)
 			return 0;
 
 		if (uuid->type == BT_UUID16)
-			length = 2;
+			return ATTSchema::ReadByGroupReq16::encode(pdu, len, start, end, *uuid);
 		else if (uuid->type == BT_UUID128)
-			length = 16;
+			return ATTSchema::ReadByGroupReq128::encode(pdu, len, start, end, *uuid);
 		else
 			return 0;
-
-		if (len < min_len + length)
-			return 0;
-
-		pdu[0] = ATT_OP_READ_BY_GROUP_REQ;
-		att_put_u16(start, &pdu[1]);
-		att_put_u16(end, &pdu[3]);
-
-		att_put_uuid(*uuid, &pdu[5]);
-
-		return min_len + length;
 	}
-	/*
 	uint16_t dec_read_by_grp_req(const uint8_t *pdu, size_t len, uint16_t *start,
 							uint16_t *end, bt_uuid_t *uuid)
 	{
-		const size_t min_len = sizeof(pdu[0]) + sizeof(*start) + sizeof(*end);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (start == NULL || end == NULL || uuid == NULL)
-			return 0;
-
-		if (pdu[0] != ATT_OP_READ_BY_GROUP_REQ)
-			return 0;
-
-		if (len < min_len + 2)
-			return 0;
-
-		*start = att_get_u16(&pdu[1]);
-		*end = att_get_u16(&pdu[3]);
-		if (len == min_len + 2)
-			*uuid = att_get_uuid16(&pdu[5]);
+		/* As for read by type, the size of the group type is
+		 * given by the PDU size. */
+		if (len == ATTSchema::ReadByGroupReq16::size)
+			return ATTSchema::ReadByGroupReq16::decode(pdu, len, start, end, uuid);
+		else if (len == ATTSchema::ReadByGroupReq128::size)
+			return ATTSchema::ReadByGroupReq128::decode(pdu, len, start, end, uuid);
 		else
-			*uuid = att_get_uuid128(&pdu[5]);
-
-		return len;
+			return 0;
 	}
 
+	/*
 	uint16_t enc_read_by_grp_resp(struct att_data_list *list, uint8_t *pdu,
 									size_t len)
 	{
@@ -321,75 +294,71 @@ namespace BLEPP
 		return list;
 	}
 	*/
-	uint16_t enc_find_by_type_req(uint16_t start, uint16_t end, bt_uuid_t *uuid,
-						const uint8_t *value, size_t vlen,
-						uint8_t *pdu, size_t len)
-	{
-		uint16_t min_len = sizeof(pdu[0]) + sizeof(start) + sizeof(end) +
-								sizeof(uint16_t);
 
-		if (pdu == NULL)
+	/* The lists in responses are a header followed by num elements of
+	 * length elen. Fill in a view of them, without copying anything. */
+	static uint16_t dec_data_view(const uint8_t *pdu, size_t len, size_t hlen,
+						uint16_t elen, struct att_data_view *list)
+	{
+		if (elen == 0 || len < hlen)
 			return 0;
 
-		if (!uuid)
-			return 0;
+		list->len = elen;
+		list->num = (len - hlen) / elen;
+		list->data = &pdu[hlen];
 
-		if (uuid->type != BT_UUID16)
-			return 0;
+		return len;
+	}
 
-		if (len < min_len)
-			return 0;
+	uint16_t dec_read_by_grp_resp(const uint8_t *pdu, size_t len,
+						struct att_data_view *list)
+	{
+		uint8_t elen;
 
-		if (vlen > len - min_len)
-			vlen = len - min_len;
+		if (list == NULL || !ATTSchema::ReadByGroupResp::decode(pdu, len, &elen))
+			return 0;
 
-		pdu[0] = ATT_OP_FIND_BY_TYPE_REQ;
-		att_put_u16(start, &pdu[1]);
-		att_put_u16(end, &pdu[3]);
-		att_put_uuid16(*uuid, &pdu[5]);
+		return dec_data_view(pdu, len, ATTSchema::ReadByGroupResp::size, elen, list);
+	}
 
-		if (vlen > 0) {
-			memcpy(&pdu[7], value, vlen);
-			return min_len + vlen;
-		}
+	uint16_t enc_find_by_type_req(uint16_t start, uint16_t end, bt_uuid_t *uuid,
+						const uint8_t *value, size_t vlen,
+						uint8_t *pdu, size_t len)
+	{
+		if (!uuid || uuid->type != BT_UUID16)
+			return 0;
 
-		return min_len;
+		return ATTSchema::FindByTypeReq::encode_with_value(pdu, len, value, vlen,
+								start, end, *uuid);
 	}
 
 	uint16_t dec_find_by_type_req(const uint8_t *pdu, size_t len, uint16_t *start,
 							uint16_t *end, bt_uuid_t *uuid,
 							uint8_t *value, size_t *vlen)
 	{
+		typedef ATTSchema::FindByTypeReq P;
 		size_t valuelen;
-		uint16_t min_len = sizeof(pdu[0]) + sizeof(*start) +
-							sizeof(*end) + sizeof(uint16_t);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
 
-		if (pdu[0] != ATT_OP_FIND_BY_TYPE_REQ)
+		if (!P::matches(pdu, len))
 			return 0;
 
 		/* First requested handle number */
 		if (start)
-			*start = att_get_u16(&pdu[1]);
+			*start = P::get<0>(pdu);
 
 		/* Last requested handle number */
 		if (end)
-			*end = att_get_u16(&pdu[3]);
+			*end = P::get<1>(pdu);
 
 		/* Always UUID16 */
 		if (uuid)
-			*uuid = att_get_uuid16(&pdu[5]);
+			*uuid = P::get<2>(pdu);
 
-		valuelen = len - min_len;
+		valuelen = len - P::size;
 
 		/* Attribute value to find */
 		if (valuelen > 0 && value)
-			memcpy(value, pdu + min_len, valuelen);
+			memcpy(value, pdu + P::size, valuelen);
 
 		if (vlen)
 			*vlen = valuelen;
@@ -449,57 +418,28 @@ namespace BLEPP
 	uint16_t enc_read_by_type_req(uint16_t start, uint16_t end, bt_uuid_t *uuid,
 							uint8_t *pdu, size_t len)
 	{
-		uint16_t min_len = sizeof(pdu[0]) + sizeof(start) + sizeof(end);
-		uint16_t length;
-
 		if (!uuid)
 			return 0;
 
 		if (uuid->type == BT_UUID16)
-			length = 2;
+			return ATTSchema::ReadByTypeReq16::encode(pdu, len, start, end, *uuid);
 		else if (uuid->type == BT_UUID128)
-			length = 16;
+			return ATTSchema::ReadByTypeReq128::encode(pdu, len, start, end, *uuid);
 		else
 			return 0;
-
-		if (len < min_len + length)
-			return 0;
-
-		pdu[0] = ATT_OP_READ_BY_TYPE_REQ;
-		att_put_u16(start, &pdu[1]);
-		att_put_u16(end, &pdu[3]);
-
-		att_put_uuid(*uuid, &pdu[5]);
-
-		return min_len + length;
 	}
 
 	uint16_t dec_read_by_type_req(const uint8_t *pdu, size_t len, uint16_t *start,
 							uint16_t *end, bt_uuid_t *uuid)
 	{
-		const size_t min_len = sizeof(pdu[0]) + sizeof(*start) + sizeof(*end);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (start == NULL || end == NULL || uuid == NULL)
-			return 0;
-
-		if (len < min_len + 2)
-			return 0;
-
-		if (pdu[0] != ATT_OP_READ_BY_TYPE_REQ)
-			return 0;
-
-		*start = att_get_u16(&pdu[1]);
-		*end = att_get_u16(&pdu[3]);
-
-		if (len == min_len + 2)
-			*uuid = att_get_uuid16(&pdu[5]);
+		/* The type is the last thing in the PDU, so its size is given
+		 * by the PDU size. Anything else is malformed. */
+		if (len == ATTSchema::ReadByTypeReq16::size)
+			return ATTSchema::ReadByTypeReq16::decode(pdu, len, start, end, uuid);
+		else if (len == ATTSchema::ReadByTypeReq128::size)
+			return ATTSchema::ReadByTypeReq128::decode(pdu, len, start, end, uuid);
 		else
-			*uuid = att_get_uuid128(&pdu[5]);
-
-		return len;
+			return 0;
 	}
 	/*
 	uint16_t enc_read_by_type_resp(struct att_data_list *list, uint8_t *pdu,
@@ -555,51 +495,35 @@ namespace BLEPP
 		return list;
 	}
 	*/
-	uint16_t enc_write_cmd(uint16_t handle, const uint8_t *value, size_t vlen,
-							uint8_t *pdu, size_t len)
-	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle);
 
-		if (pdu == NULL)
-			return 0;
+	uint16_t dec_read_by_type_resp(const uint8_t *pdu, size_t len,
+						struct att_data_view *list)
+	{
+		uint8_t elen;
 
-		if (len < min_len)
+		if (list == NULL || !ATTSchema::ReadByTypeResp::decode(pdu, len, &elen))
 			return 0;
 
-		if (vlen > len - min_len)
-			vlen = len - min_len;
-
-		pdu[0] = ATT_OP_WRITE_CMD;
-		att_put_u16(handle, &pdu[1]);
-
-		if (vlen > 0) {
-			memcpy(&pdu[3], value, vlen);
-			return min_len + vlen;
-		}
+		return dec_data_view(pdu, len, ATTSchema::ReadByTypeResp::size, elen, list);
+	}
 
-		return min_len;
+	uint16_t enc_write_cmd(uint16_t handle, const uint8_t *value, size_t vlen,
+							uint8_t *pdu, size_t len)
+	{
+		return ATTSchema::WriteCmd::encode_with_value(pdu, len, value, vlen, handle);
 	}
 
 	uint16_t dec_write_cmd(const uint8_t *pdu, size_t len, uint16_t *handle,
 							uint8_t *value, size_t *vlen)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle);
+		typedef ATTSchema::WriteCmd P;
 
-		if (pdu == NULL)
+		if (value == NULL || vlen == NULL || !P::decode(pdu, len, handle))
 			return 0;
 
-		if (value == NULL || vlen == NULL || handle == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		if (pdu[0] != ATT_OP_WRITE_CMD)
-			return 0;
-
-		*handle = att_get_u16(&pdu[1]);
-		memcpy(value, pdu + min_len, len - min_len);
-		*vlen = len - min_len;
+		*vlen = len - P::size;
+		if (*vlen > 0)
+			memcpy(value, pdu + P::size, *vlen);
 
 		return len;
 	}
@@ -607,69 +531,32 @@ namespace BLEPP
 	uint16_t enc_write_req(uint16_t handle, const uint8_t *value, size_t vlen,
 							uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		if (vlen > len - min_len)
-			vlen = len - min_len;
-
-		pdu[0] = ATT_OP_WRITE_REQ;
-		att_put_u16(handle, &pdu[1]);
-
-		if (vlen > 0) {
-			memcpy(&pdu[3], value, vlen);
-			return min_len + vlen;
-		}
-
-		return min_len;
+		return ATTSchema::WriteReq::encode_with_value(pdu, len, value, vlen, handle);
 	}
 
 	uint16_t dec_write_req(const uint8_t *pdu, size_t len, uint16_t *handle,
 							uint8_t *value, size_t *vlen)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (value == NULL || vlen == NULL || handle == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
+		typedef ATTSchema::WriteReq P;
 
-		if (pdu[0] != ATT_OP_WRITE_REQ)
+		if (value == NULL || vlen == NULL || !P::decode(pdu, len, handle))
 			return 0;
 
-		*handle = att_get_u16(&pdu[1]);
-		*vlen = len - min_len;
+		*vlen = len - P::size;
 		if (*vlen > 0)
-			memcpy(value, pdu + min_len, *vlen);
+			memcpy(value, pdu + P::size, *vlen);
 
 		return len;
 	}
 
 	uint16_t enc_write_resp(uint8_t *pdu, size_t len)
 	{
-		if (pdu == NULL)
-			return 0;
-
-		pdu[0] = ATT_OP_WRITE_RESP;
-
-		return sizeof(pdu[0]);
+		return ATTSchema::WriteResp::encode(pdu, len);
 	}
 
 	uint16_t dec_write_resp(const uint8_t *pdu, size_t len)
 	{
-		if (pdu == NULL)
-			return 0;
-
-		if (pdu[0] != ATT_OP_WRITE_RESP)
+		if (!ATTSchema::WriteResp::matches(pdu, len))
 			return 0;
 
 		return len;
@@ -677,198 +564,74 @@ namespace BLEPP
 
 	uint16_t enc_read_req(uint16_t handle, uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		pdu[0] = ATT_OP_READ_REQ;
-		att_put_u16(handle, &pdu[1]);
-
-		return min_len;
+		return ATTSchema::ReadReq::encode(pdu, len, handle);
 	}
 
 	uint16_t enc_read_blob_req(uint16_t handle, uint16_t offset, uint8_t *pdu,
 										size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle) +
-								sizeof(offset);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		pdu[0] = ATT_OP_READ_BLOB_REQ;
-		att_put_u16(handle, &pdu[1]);
-		att_put_u16(offset, &pdu[3]);
-
-		return min_len;
+		return ATTSchema::ReadBlobReq::encode(pdu, len, handle, offset);
 	}
 
 	uint16_t dec_read_req(const uint8_t *pdu, size_t len, uint16_t *handle)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (handle == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		if (pdu[0] != ATT_OP_READ_REQ)
-			return 0;
-
-		*handle = att_get_u16(&pdu[1]);
-
-		return min_len;
+		return ATTSchema::ReadReq::decode(pdu, len, handle);
 	}
 
 	uint16_t dec_read_blob_req(const uint8_t *pdu, size_t len, uint16_t *handle,
 								uint16_t *offset)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle) +
-								sizeof(*offset);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (handle == NULL)
-			return 0;
-
-		if (offset == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		if (pdu[0] != ATT_OP_READ_BLOB_REQ)
-			return 0;
-
-		*handle = att_get_u16(&pdu[1]);
-		*offset = att_get_u16(&pdu[3]);
-
-		return min_len;
+		return ATTSchema::ReadBlobReq::decode(pdu, len, handle, offset);
 	}
 
 	uint16_t enc_read_resp(uint8_t *value, size_t vlen, uint8_t *pdu, size_t len)
 	{
-		if (pdu == NULL)
-			return 0;
-
 		/* If the attribute value length is longer than the allowed PDU size,
 		 * send only the octets that fit on the PDU. The remaining octets can
 		 * be requested using the Read Blob Request. */
-		if (vlen > len - 1)
-			vlen = len - 1;
-
-		pdu[0] = ATT_OP_READ_RESP;
-
-		memcpy(pdu + 1, value, vlen);
-
-		return vlen + 1;
+		return ATTSchema::ReadResp::encode_with_value(pdu, len, value, vlen);
 	}
 
 	uint16_t enc_read_blob_resp(uint8_t *value, size_t vlen, uint16_t offset,
 								uint8_t *pdu, size_t len)
 	{
-		if (pdu == NULL)
+		if (offset > vlen)
 			return 0;
 
-		vlen -= offset;
-		if (vlen > len - 1)
-			vlen = len - 1;
-
-		pdu[0] = ATT_OP_READ_BLOB_RESP;
-
-		memcpy(pdu + 1, &value[offset], vlen);
-
-		return vlen + 1;
+		return ATTSchema::ReadBlobResp::encode_with_value(pdu, len, value + offset,
+								vlen - offset);
 	}
 
 	ssize_t dec_read_resp(const uint8_t *pdu, size_t len, uint8_t *value, size_t vlen)
 	{
-		if (pdu == NULL)
-			return -EINVAL;
+		typedef ATTSchema::ReadResp P;
 
-		if (value == NULL)
+		if (value == NULL || !P::matches(pdu, len))
 			return -EINVAL;
 
-		if (pdu[0] != ATT_OP_READ_RESP)
-			return -EINVAL;
-
-		if (vlen < (len - 1))
+		if (vlen < len - P::size)
 			return -ENOBUFS;
 
-		memcpy(value, pdu + 1, len - 1);
+		memcpy(value, pdu + P::size, len - P::size);
 
-		return len - 1;
+		return len - P::size;
 	}
 
 	uint16_t enc_error_resp(uint8_t opcode, uint16_t handle, uint8_t status,
 								uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(opcode) +
-							sizeof(handle) + sizeof(status);
-		uint16_t u16;
-
-		if (len < min_len)
-			return 0;
-
-		u16 = htobs(handle);
-		pdu[0] = ATT_OP_ERROR;
-		pdu[1] = opcode;
-		memcpy(&pdu[2], &u16, sizeof(u16));
-		pdu[4] = status;
-
-		return min_len;
+		return ATTSchema::ErrorResp::encode(pdu, len, opcode, handle, status);
 	}
 
 	uint16_t enc_find_info_req(uint16_t start, uint16_t end, uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(start) + sizeof(end);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		pdu[0] = ATT_OP_FIND_INFO_REQ;
-		att_put_u16(start, &pdu[1]);
-		att_put_u16(end, &pdu[3]);
-
-		return min_len;
+		return ATTSchema::FindInfoReq::encode(pdu, len, start, end);
 	}
 
 	uint16_t dec_find_info_req(const uint8_t *pdu, size_t len, uint16_t *start,
 									uint16_t *end)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*start) + sizeof(*end);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		if (start == NULL || end == NULL)
-			return 0;
-
-		if (pdu[0] != ATT_OP_FIND_INFO_REQ)
-			return 0;
-
-		*start = att_get_u16(&pdu[1]);
-		*end = att_get_u16(&pdu[3]);
-
-		return min_len;
+		return ATTSchema::FindInfoReq::decode(pdu, len, start, end);
 	}
 	/*
 	uint16_t enc_find_info_resp(uint8_t format, struct att_data_list *list,
@@ -939,240 +702,119 @@ namespace BLEPP
 		return list;
 	}*/
 
-	uint16_t enc_notification(uint16_t handle, uint8_t *value, size_t vlen,
-							uint8_t *pdu, size_t len)
+	uint16_t dec_find_info_resp(const uint8_t *pdu, size_t len, uint8_t *format,
+						struct att_data_view *list)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(uint16_t);
+		typedef ATTSchema::FindInfoResp P;
 
-		if (pdu == NULL)
+		if (list == NULL || !P::decode(pdu, len, format))
 			return 0;
 
-		if (len < (vlen + min_len))
+		/* Each element is a handle followed by a 16 or 128 bit UUID */
+		if (*format == ATT_FIND_INFO_RESP_FMT_16BIT)
+			return dec_data_view(pdu, len, P::size, ATTSchema::FindInfoElement16::size, list);
+		else if (*format == ATT_FIND_INFO_RESP_FMT_128BIT)
+			return dec_data_view(pdu, len, P::size, ATTSchema::FindInfoElement128::size, list);
+		else
 			return 0;
+	}
 
-		pdu[0] = ATT_OP_HANDLE_NOTIFY;
-		att_put_u16(handle, &pdu[1]);
-		memcpy(&pdu[3], value, vlen);
+	uint16_t enc_notification(uint16_t handle, uint8_t *value, size_t vlen,
+							uint8_t *pdu, size_t len)
+	{
+		/* Unlike the writes, a truncated value is never sent */
+		if (len < ATTSchema::Notification::size + vlen)
+			return 0;
 
-		return vlen + min_len;
+		return ATTSchema::Notification::encode_with_value(pdu, len, value, vlen, handle);
 	}
 
 	uint16_t enc_indication(uint16_t handle, uint8_t *value, size_t vlen,
 							uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(uint16_t);
-
-		if (pdu == NULL)
+		if (len < ATTSchema::Indication::size + vlen)
 			return 0;
 
-		if (len < (vlen + min_len))
-			return 0;
-
-		pdu[0] = ATT_OP_HANDLE_IND;
-		att_put_u16(handle, &pdu[1]);
-		memcpy(&pdu[3], value, vlen);
-
-		return vlen + min_len;
+		return ATTSchema::Indication::encode_with_value(pdu, len, value, vlen, handle);
 	}
 
 	uint16_t dec_indication(const uint8_t *pdu, size_t len, uint16_t *handle,
 							uint8_t *value, size_t vlen)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(uint16_t);
+		typedef ATTSchema::Indication P;
 		uint16_t dlen;
 
-		if (pdu == NULL)
+		if (!P::matches(pdu, len))
 			return 0;
 
-		if (pdu[0] != ATT_OP_HANDLE_IND)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		dlen = MIN(len - min_len, vlen);
+		dlen = MIN(len - P::size, vlen);
 
 		if (handle)
-			*handle = att_get_u16(&pdu[1]);
+			*handle = P::get<0>(pdu);
 
-		memcpy(value, &pdu[3], dlen);
+		memcpy(value, pdu + P::size, dlen);
 
 		return dlen;
 	}
 
 	uint16_t enc_confirmation(uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		pdu[0] = ATT_OP_HANDLE_CNF;
-
-		return min_len;
+		return ATTSchema::Confirmation::encode(pdu, len);
 	}
 
 	uint16_t enc_mtu_req(uint16_t mtu, uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(mtu);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		pdu[0] = ATT_OP_MTU_REQ;
-		att_put_u16(mtu, &pdu[1]);
-
-		return min_len;
+		return ATTSchema::MTUReq::encode(pdu, len, mtu);
 	}
 
 	uint16_t dec_mtu_req(const uint8_t *pdu, size_t len, uint16_t *mtu)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*mtu);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (mtu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		if (pdu[0] != ATT_OP_MTU_REQ)
-			return 0;
-
-		*mtu = att_get_u16(&pdu[1]);
-
-		return min_len;
+		return ATTSchema::MTUReq::decode(pdu, len, mtu);
 	}
 
 	uint16_t enc_mtu_resp(uint16_t mtu, uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(mtu);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		pdu[0] = ATT_OP_MTU_RESP;
-		att_put_u16(mtu, &pdu[1]);
-
-		return min_len;
+		return ATTSchema::MTUResp::encode(pdu, len, mtu);
 	}
 
 	uint16_t dec_mtu_resp(const uint8_t *pdu, size_t len, uint16_t *mtu)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*mtu);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (mtu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		if (pdu[0] != ATT_OP_MTU_RESP)
-			return 0;
-
-		*mtu = att_get_u16(&pdu[1]);
-
-		return min_len;
+		return ATTSchema::MTUResp::decode(pdu, len, mtu);
 	}
 
 	uint16_t enc_prep_write_req(uint16_t handle, uint16_t offset,
 				const uint8_t *value, size_t vlen, uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle) +
-									sizeof(offset);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		if (vlen > len - min_len)
-			vlen = len - min_len;
-
-		pdu[0] = ATT_OP_PREP_WRITE_REQ;
-		att_put_u16(handle, &pdu[1]);
-		att_put_u16(offset, &pdu[3]);
-
-		if (vlen > 0) {
-			memcpy(&pdu[5], value, vlen);
-			return min_len + vlen;
-		}
-
-		return min_len;
+		return ATTSchema::PrepWriteReq::encode_with_value(pdu, len, value, vlen,
+								handle, offset);
 	}
 
 	uint16_t dec_prep_write_resp(const uint8_t *pdu, size_t len, uint16_t *handle,
 					uint16_t *offset, uint8_t *value, size_t *vlen)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle) +
-									sizeof(*offset);
-
-		if (pdu == NULL)
-			return 0;
+		typedef ATTSchema::PrepWriteResp P;
 
-		if (handle == NULL || offset == NULL || value == NULL || vlen == NULL)
+		if (value == NULL || vlen == NULL || !P::decode(pdu, len, handle, offset))
 			return 0;
 
-		if (len < min_len)
-			return 0;
-
-		if (pdu[0] != ATT_OP_PREP_WRITE_REQ)
-			return 0;
-
-		*handle = att_get_u16(&pdu[1]);
-		*offset = att_get_u16(&pdu[3]);
-		*vlen = len - min_len;
+		*vlen = len - P::size;
 		if (*vlen > 0)
-			memcpy(value, pdu + min_len, *vlen);
+			memcpy(value, pdu + P::size, *vlen);
 
 		return len;
 	}
 
 	uint16_t enc_exec_write_req(uint8_t flags, uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]) + sizeof(flags);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
 		if (flags > 1)
 			return 0;
 
-		pdu[0] = ATT_OP_EXEC_WRITE_REQ;
-		pdu[1] = flags;
-
-		return min_len;
+		return ATTSchema::ExecWriteReq::encode(pdu, len, flags);
 	}
 
 	uint16_t dec_exec_write_resp(const uint8_t *pdu, size_t len)
 	{
-		const uint16_t min_len = sizeof(pdu[0]);
-
-		if (pdu == NULL)
-			return 0;
-
-		if (len < min_len)
-			return 0;
-
-		if (pdu[0] != ATT_OP_EXEC_WRITE_RESP)
+		if (!ATTSchema::ExecWriteResp::matches(pdu, len))
 			return 0;
 
 		return len;
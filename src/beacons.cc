@@ -0,0 +1,228 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "blepp/beacons.h"
+#include "blepp/blestatemachine.h"
+#include "blepp/gap.h"
+
+#include <cstring>
+
+using namespace std;
+
+namespace BLEPP
+{
+	namespace
+	{
+		uint16_t big_endian_16(const uint8_t* p)
+		{
+			return p[0] << 8 | p[1];
+		}
+
+		uint32_t big_endian_32(const uint8_t* p)
+		{
+			return uint32_t(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+		}
+
+		//The data of an AD structure of the given type, if it has at least
+		//min_length bytes of it.
+		const uint8_t* payload(const uint8_t* ad, size_t size, uint8_t type, size_t min_length)
+		{
+			if(size < 2 || ad[0] < 1 || size_t(ad[0]) + 1 > size || ad[1] != type || size_t(ad[0]) - 1 < min_length)
+				return nullptr;
+			else
+				return ad + 2;
+		}
+
+		//Eddystone frames: the service data for 0xFEAA, with the frame type.
+		const uint8_t* eddystone(const uint8_t* ad, size_t size, uint8_t frame, size_t min_length)
+		{
+			const uint8_t* p = payload(ad, size, GAP::service_data_16_bit_UUID, 3 + min_length);
+			if(p && p[0] == 0xAA && p[1] == 0xFE && p[2] == frame)
+				return p + 3;
+			else
+				return nullptr;
+		}
+
+		const char* const url_schemes[] = {"http://www.", "https://www.", "http://", "https://"};
+
+		const char* const url_expansions[] = {".com/", ".org/", ".edu/", ".net/", ".info/", ".biz/", ".gov/", ".com", ".org", ".edu", ".net", ".info", ".biz", ".gov"};
+	}
+
+	UUID IBeacon::uuid() const
+	{
+		uint64_t high=0, low=0;
+		for(int i=0; i < 8; i++)
+		{
+			high = high << 8 | proximity_uuid[i];
+			low = low << 8 | proximity_uuid[i+8];
+		}
+		return UUID::from_uuid128(high, low);
+	}
+
+	string EddystoneURL::url() const
+	{
+		string u = scheme < 4 ? url_schemes[scheme] : "";
+		for(int i=0; i < length; i++)
+			if(encoded[i] < 14)
+				u += url_expansions[encoded[i]];
+			else
+				u += char(encoded[i]);
+		return u;
+	}
+
+	bool decode(const uint8_t* ad, size_t size, IBeacon& b)
+	{
+		const uint8_t* p = payload(ad, size, GAP::manufacturer_data, 25);
+		if(!p || p[0] != 0x4C || p[1] != 0x00 || p[2] != 0x02 || p[3] != 0x15)
+			return false;
+
+		memcpy(b.proximity_uuid, p + 4, 16);
+		b.major = big_endian_16(p + 20);
+		b.minor = big_endian_16(p + 22);
+		b.measured_power = p[24];
+		return true;
+	}
+
+	bool decode(const uint8_t* ad, size_t size, AltBeacon& b)
+	{
+		const uint8_t* p = payload(ad, size, GAP::manufacturer_data, 26);
+		if(!p || p[2] != 0xBE || p[3] != 0xAC)
+			return false;
+
+		b.manufacturer = p[0] | p[1] << 8;
+		memcpy(b.beacon_id, p + 4, 20);
+		b.reference_rssi = p[24];
+		b.manufacturer_reserved = p[25];
+		return true;
+	}
+
+	bool decode(const uint8_t* ad, size_t size, EddystoneUID& b)
+	{
+		const uint8_t* p = eddystone(ad, size, 0x00, 17);
+		if(!p)
+			return false;
+
+		b.tx_power = p[0];
+		memcpy(b.name_space, p + 1, 10);
+		memcpy(b.instance, p + 11, 6);
+		return true;
+	}
+
+	bool decode(const uint8_t* ad, size_t size, EddystoneURL& b)
+	{
+		const uint8_t* p = eddystone(ad, size, 0x10, 2);
+		if(!p)
+			return false;
+
+		size_t length = ad[0] - 6;
+		if(length > size_t(EddystoneURL::max_length))
+			return false;
+
+		b.tx_power = p[0];
+		b.scheme = p[1];
+		b.length = length;
+		memcpy(b.encoded, p + 2, length);
+		return true;
+	}
+
+	bool decode(const uint8_t* ad, size_t size, EddystoneTLM& b)
+	{
+		//Version 0 is unencrypted.
+		const uint8_t* p = eddystone(ad, size, 0x20, 13);
+		if(!p || p[0] != 0x00)
+			return false;
+
+		b.battery_mv = big_endian_16(p + 1);
+		b.temperature = int16_t(big_endian_16(p + 3));
+		b.advert_count = big_endian_32(p + 5);
+		b.uptime = big_endian_32(p + 9);
+		return true;
+	}
+
+	bool decode(const uint8_t* ad, size_t size, EddystoneEID& b)
+	{
+		const uint8_t* p = eddystone(ad, size, 0x30, 9);
+		if(!p)
+			return false;
+
+		b.tx_power = p[0];
+		memcpy(b.eid, p + 1, 8);
+		return true;
+	}
+
+	bool decode(const uint8_t* ad, size_t size, Beacon& b)
+	{
+		if(size < 2)
+			return false;
+
+		if(ad[1] == GAP::manufacturer_data)
+		{
+			if(decode(ad, size, b.ibeacon))
+				b.type = BeaconType::IBeacon;
+			else if(decode(ad, size, b.altbeacon))
+				b.type = BeaconType::AltBeacon;
+			else
+				return false;
+		}
+		else if(ad[1] == GAP::service_data_16_bit_UUID && size >= 5)
+		{
+			switch(ad[4])
+			{
+				case 0x00:
+					if(!decode(ad, size, b.eddystone_uid))
+						return false;
+					b.type = BeaconType::EddystoneUID;
+					break;
+				case 0x10:
+					if(!decode(ad, size, b.eddystone_url))
+						return false;
+					b.type = BeaconType::EddystoneURL;
+					break;
+				case 0x20:
+					if(!decode(ad, size, b.eddystone_tlm))
+						return false;
+					b.type = BeaconType::EddystoneTLM;
+					break;
+				case 0x30:
+					if(!decode(ad, size, b.eddystone_eid))
+						return false;
+					b.type = BeaconType::EddystoneEID;
+					break;
+				default:
+					return false;
+			}
+		}
+		else
+			return false;
+
+		return true;
+	}
+
+	bool find_beacon(const uint8_t* data, size_t length, Beacon& b)
+	{
+		for(const uint8_t* end = data + length; end - data >= 2 && data[0] != 0; data += data[0] + 1)
+			if(decode(data, end - data, b))
+				return true;
+		return false;
+	}
+}
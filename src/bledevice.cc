@@ -29,6 +29,9 @@
 
 #include <sys/socket.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <unistd.h>
 
 using namespace std;
@@ -80,43 +83,83 @@ namespace BLEPP
 		test_fd_<BLEDevice::WriteError>(read(sock, buf, len), line);
 	}
 
+	int BLEDevice::send_pdu(const uint8_t* header, int header_len, const uint8_t* payload, int payload_len, int flags)
+	{
+		//The header lives on the caller's stack and the payload stays wherever
+		//the caller has it, so nothing is copied on the way to the kernel, and
+		//the shared buffer isn't touched. SEQPACKET keeps it as one PDU.
+		iovec iov[2];
+		iov[0].iov_base = const_cast<uint8_t*>(header);
+		iov[0].iov_len = header_len;
+		iov[1].iov_base = const_cast<uint8_t*>(payload);
+		iov[1].iov_len = payload_len;
+
+		msghdr msg{};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = payload_len > 0 ? 2 : 1;
+
+		return sendmsg(sock, &msg, flags | MSG_NOSIGNAL);
+	}
+
+	int BLEDevice::max_write_length() const
+	{
+		//The 3 byte opcode and handle go in the MTU as well.
+		return (int)buf.size() - 3;
+	}
+
+	int BLEDevice::check_payload(int length) const
+	{
+		//Sending part of a value would look like success, so refuse it.
+		if(length < 0)
+			throw logic_error("Negative length given for a write");
+		if(length > max_write_length())
+			throw logic_error("Write of " + to_string(length) + " bytes is too long for an MTU of " + to_string(buf.size()));
+		return length;
+	}
+
 	void BLEDevice::send_read_request(uint16_t handle)
 	{
-		int len = enc_read_req(handle, buf.data(), buf.size());
+		uint8_t pdu[3];
+		int len = enc_read_req(handle, pdu, sizeof(pdu));
 		test_pdu(len);
-		int ret = write(sock, buf.data(), len);
+		int ret = send_pdu(pdu, len);
 		test(ret, Write);
 	}
 
 	void BLEDevice::send_read_by_type(const bt_uuid_t& uuid, uint16_t start, uint16_t end)
 	{
-		int len = enc_read_by_type_req(start, end, const_cast<bt_uuid_t*>(&uuid), buf.data(), buf.size());
+		uint8_t pdu[ATT_DEFAULT_LE_MTU];
+		int len = enc_read_by_type_req(start, end, const_cast<bt_uuid_t*>(&uuid), pdu, sizeof(pdu));
 		test_pdu(len);
-		int ret = write(sock, buf.data(), len);
+		int ret = send_pdu(pdu, len);
 		test(ret, Write);
 	}
 
 	void BLEDevice::send_find_information(uint16_t start, uint16_t end)
 	{
-		int len = enc_find_info_req(start, end, buf.data(), buf.size());
+		uint8_t pdu[5];
+		int len = enc_find_info_req(start, end, pdu, sizeof(pdu));
 		test_pdu(len);
-		int ret = write(sock, buf.data(), len);
+		int ret = send_pdu(pdu, len);
 		test(ret, Write);
 	}
 
 	void BLEDevice::send_read_group_by_type(const bt_uuid_t& uuid, uint16_t start, uint16_t end)
 	{
-		int len = enc_read_by_grp_req(start, end, const_cast<bt_uuid_t*>(&uuid), buf.data(), buf.size());
+		uint8_t pdu[ATT_DEFAULT_LE_MTU];
+		int len = enc_read_by_grp_req(start, end, const_cast<bt_uuid_t*>(&uuid), pdu, sizeof(pdu));
 		test_pdu(len);
-		int ret = write(sock, buf.data(), len);
+		int ret = send_pdu(pdu, len);
 		test(ret, Write);
 	}
 
 	void BLEDevice::send_write_request(uint16_t handle, const uint8_t* data, int length)
 	{
-		int len = enc_write_req(handle, data, length, buf.data(), buf.size());
+		//Encode only the header. The value goes in its own iovec.
+		uint8_t header[3];
+		int len = enc_write_req(handle, nullptr, 0, header, sizeof(header));
 		test_pdu(len);
-		int ret = write(sock, buf.data(), len);
+		int ret = send_pdu(header, len, data, check_payload(length));
 		test(ret, Write);
 	}
 
@@ -128,17 +171,19 @@ namespace BLEPP
 
 	void BLEDevice::send_handle_value_confirmation()
 	{
-		int len = enc_confirmation(buf.data(), buf.size());
+		uint8_t pdu[1];
+		int len = enc_confirmation(pdu, sizeof(pdu));
 		test_pdu(len);
-		int ret = write(sock, buf.data(), len);
+		int ret = send_pdu(pdu, len);
 		test(ret, Write);
 	}
 
 	void BLEDevice::send_write_command(uint16_t handle, const uint8_t* data, int length)
 	{
-		int len = enc_write_cmd(handle, data, length, buf.data(), buf.size());
+		uint8_t header[3];
+		int len = enc_write_cmd(handle, nullptr, 0, header, sizeof(header));
 		test_pdu(len);
-		int ret = write(sock, buf.data(), len);
+		int ret = send_pdu(header, len, data, check_payload(length));
 		test(ret, Write);
 	}
 
@@ -148,7 +193,19 @@ namespace BLEPP
 		send_write_command(handle, buf, 2);
 	}
 
-	void BLEDevice::process_att_mtu_request(PDUResponse &req_pdu)
+	bool BLEDevice::try_send_write_command(uint16_t handle, const uint8_t* data, int length)
+	{
+		uint8_t header[3];
+		int len = enc_write_cmd(handle, nullptr, 0, header, sizeof(header));
+		test_pdu(len);
+		int ret = send_pdu(header, len, data, check_payload(length), MSG_DONTWAIT);
+		if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return false;
+		test(ret, Write);
+		return true;
+	}
+
+	void BLEDevice::process_att_mtu_request(const PDUResponse &req_pdu)
 	{
 		uint8_t my_resp_pdu[3]; //1 byte opcode, two byte param with the size of negotiated MTU
 		uint8_t my_req_pdu[3];
@@ -169,7 +226,7 @@ namespace BLEPP
 			return;
 		}
 		LOG(Debug,"Sending MTU Request " << req_mtu);
-		int len = write(sock,my_req_pdu,3); //send MTU request before we resize our buffer, to spec
+		int len = send_pdu(my_req_pdu,3); //send MTU request before we resize our buffer, to spec
 		test(len, Write);
 		//TODO
 		// We are just accepting the remote end max recv MTU as our max
@@ -189,12 +246,12 @@ namespace BLEPP
 			LOG(Error,"Recovered local MTU to " << my_last_mtu);
 			return;
 		}
-		len = write(sock,my_resp_pdu,3); //send MTU response
+		len = send_pdu(my_resp_pdu,3); //send MTU response
 		test(len, Write);
 		LOG(Debug,"Sending MTU Resp " << my_current_mtu);
 	}
 
-	void BLEDevice::process_att_mtu_response(PDUResponse &resp_pdu)
+	void BLEDevice::process_att_mtu_response(const PDUResponse &resp_pdu)
 	{
 		uint16_t resp_mtu;
 		uint16_t my_current_mtu = (uint16_t)buf.size();
@@ -214,9 +271,60 @@ namespace BLEPP
 		}
 	}
 
+	namespace
+	{
+		//Room for the SCM_TIMESTAMPNS control message, and nothing else.
+		const size_t control_size = CMSG_SPACE(sizeof(timespec));
+
+		timespec find_timestamp(const msghdr& m)
+		{
+			for(cmsghdr* c = CMSG_FIRSTHDR(&m); c != nullptr; c = CMSG_NXTHDR(const_cast<msghdr*>(&m), c))
+				if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+				{
+					timespec t;
+					memcpy(&t, CMSG_DATA(c), sizeof(t));
+					return t;
+				}
+			return timespec{};
+		}
+	}
+
+	void BLEDevice::set_timestamps(bool t)
+	{
+		timestamps = t;
+		batch_control.assign(timestamps ? max_batch * control_size : 0, 0);
+		last_timestamp = timespec{};
+	}
+
+	timespec BLEDevice::timestamp() const
+	{
+		return last_timestamp;
+	}
+
+	timespec BLEDevice::batch_timestamp(int i) const
+	{
+		if(!timestamps)
+			return timespec{};
+		return find_timestamp(batch_msg[i].msg_hdr);
+	}
+
 	PDUResponse BLEDevice::receive(uint8_t* buf, int max)
 	{
-		int len = read(sock, buf, max);
+		int len;
+		if(timestamps)
+		{
+			alignas(cmsghdr) uint8_t control[control_size];
+			iovec iov{buf, size_t(max)};
+			msghdr m{};
+			m.msg_iov = &iov;
+			m.msg_iovlen = 1;
+			m.msg_control = control;
+			m.msg_controllen = sizeof(control);
+			len = recvmsg(sock, &m, 0);
+			last_timestamp = len < 0 ? timespec{} : find_timestamp(m);
+		}
+		else
+			len = read(sock, buf, max);
 		test(len, Read);
 		pretty_print(PDUResponse(buf, len));
 		return PDUResponse(buf, len);
@@ -227,6 +335,58 @@ namespace BLEPP
 		return receive(v.data(), v.size());
 	}
 
+	const int BLEDevice::max_batch;
+
+	int BLEDevice::receive_batch(int max, int size)
+	{
+		max = min(max, max_batch);
+		if(max <= 0)
+			return 0;
+
+		//The buffers are only (re)built when the MTU changes, so the
+		//steady state does no allocation at all.
+		if(size != batch_slot)
+		{
+			batch_slot = size;
+			batch_buf.resize(max_batch * size);
+			batch_iov.resize(max_batch);
+			batch_msg.resize(max_batch);
+
+			for(int i=0; i < max_batch; i++)
+			{
+				batch_iov[i].iov_base = batch_buf.data() + i * size;
+				batch_iov[i].iov_len = size;
+				memset(&batch_msg[i], 0, sizeof(batch_msg[i]));
+				batch_msg[i].msg_hdr.msg_iov = &batch_iov[i];
+				batch_msg[i].msg_hdr.msg_iovlen = 1;
+			}
+		}
+
+		//The kernel shrinks the control lengths to what it used.
+		for(int i=0; i < max; i++)
+		{
+			batch_msg[i].msg_hdr.msg_control = timestamps ? batch_control.data() + i * control_size : nullptr;
+			batch_msg[i].msg_hdr.msg_controllen = timestamps ? control_size : 0;
+		}
+
+		int n = recvmmsg(sock, batch_msg.data(), max, MSG_DONTWAIT, nullptr);
+
+		if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 0;
+		test(n, Read);
+
+		for(int i=0; i < n; i++)
+			if(batch_msg[i].msg_len > 0)
+				pretty_print(batch_pdu(i));
+
+		return n;
+	}
+
+	PDUResponse BLEDevice::batch_pdu(int i) const
+	{
+		return PDUResponse(batch_buf.data() + i * batch_slot, batch_msg[i].msg_len);
+	}
+
 
 
 
@@ -25,12 +25,14 @@
 #include "blepp/att_pdu.h"
 #include "blepp/pretty_printers.h"
 #include "blepp/blestatemachine.h"
+#include "blepp/assigned_numbers.h"
 
 #include <algorithm>
 
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/l2cap.h>
@@ -75,61 +77,6 @@ namespace BLEPP
 
 
 
-	const ServiceInfo* lookup_service_by_UUID(const UUID& uuid)
-	{
-		static vector<ServiceInfo> vec;
-
-		if(vec.size() == 0)
-		{
-			auto add = [](const char* n, const char* i, uint16_t u)
-			{
-				ServiceInfo s;
-				s.name=n;
-				s.id = i;
-				s.uuid = UUID(u);
-				vec.push_back(s);
-			};
-
-			add( "Alert Notification Service",    "org.bluetooth.service.alert_notification",        0x1811);
-			add( "Battery Service",               "org.bluetooth.service.battery_service",           0x180F);
-			add( "Blood Pressure",                "org.bluetooth.service.blood_pressure",            0x1810);
-			add( "Body Composition",              "org.bluetooth.service.body_composition",          0x181B);
-			add( "Bond Management",               "org.bluetooth.service.bond_management",           0x181E);
-			add( "Current Time Service",          "org.bluetooth.service.current_time",              0x1805);
-			add( "Cycling Power",                 "org.bluetooth.service.cycling_power",             0x1818);
-			add( "Cycling Speed and Cadence",     "org.bluetooth.service.cycling_speed_and_cadence", 0x1816);
-			add( "Device Information",            "org.bluetooth.service.device_information",        0x180A);
-			add( "Generic Access",                "org.bluetooth.service.generic_access",            0x1800);
-			add( "Generic Attribute",             "org.bluetooth.service.generic_attribute",         0x1801);
-			add( "Glucose",                       "org.bluetooth.service.glucose",                   0x1808);
-			add( "Health Thermometer",            "org.bluetooth.service.health_thermometer",        0x1809);
-			add( "Heart Rate",                    "org.bluetooth.service.heart_rate",                0x180D);
-			add( "Human Interface Device",        "org.bluetooth.service.human_interface_device",    0x1812);
-			add( "Immediate Alert",               "org.bluetooth.service.immediate_alert",           0x1802);
-			add( "Link Loss",                     "org.bluetooth.service.link_loss",                 0x1803);
-			add( "Location and Navigation",       "org.bluetooth.service.location_and_navigation",   0x1819);
-			add( "Next DST Change Service",       "org.bluetooth.service.next_dst_change",           0x1807);
-			add( "Phone Alert Status Service",    "org.bluetooth.service.phone_alert_status",        0x180E);
-			add( "Reference Time Update Service", "org.bluetooth.service.reference_time_update",     0x1806);
-			add( "Running Speed and Cadence",     "org.bluetooth.service.running_speed_and_cadence", 0x1814);
-			add( "Scan Parameters",               "org.bluetooth.service.scan_parameters",           0x1813);
-			add( "Tx Power",                      "org.bluetooth.service.tx_power",                  0x1804);
-			add( "User Data",                     "org.bluetooth.service.user_data",                 0x181C);
-			add( "Weight Scale",                  "org.bluetooth.service.weight_scale",              0x181D);
-		}
-
-		auto f = find_if(vec.begin(), vec.end(), [&](const ServiceInfo& s)
-		{
-			return s.uuid == uuid;
-		});
-
-		if(f == vec.end())
-			return 0;
-		else
-			return &*f;
-	}	
-
-
 	void BLEGATTStateMachine::buggerall()
 	{
 	}
@@ -148,16 +95,23 @@ namespace BLEPP
 		last_request=-1;
 
 		if(sock != -1)
+		{
 			log_fd(::close(sock));
+			set_connected(false);
+		}
 		sock = -1;
 		primary_services.clear();
+
+		response_hook = nullptr;
+		completion_hook = nullptr;
+		abort_hook = nullptr;
+
+		stream_data.clear();
 	}
 
 	void BLEGATTStateMachine::close()
 	{
-		close_and_cleanup();
-		cb_disconnected(Disconnect(Disconnect::ConnectionClosed, 0));
-
+		fail(Disconnect(Disconnect::ConnectionClosed, 0));
 	}
 
 	int log_l2cap_options(int sock)
@@ -188,7 +142,21 @@ namespace BLEPP
 	BLEGATTStateMachine::~BLEGATTStateMachine()
 	{
 		ENTER();
+
+		//Nothing outstanding will ever run now, so abort it, as fail() would,
+		//rather than leave futures broken. There's no cb_disconnected, since
+		//there's nothing left to reconnect.
+		function<void(Disconnect)> abort;
+		swap(abort, abort_hook);
+
 		close_and_cleanup();
+
+		Disconnect d(Disconnect::ConnectionClosed, Disconnect::NoErrorCode);
+		if(abort)
+			abort(d);
+		abort_submissions(d);
+
+		log_fd(::close(submission_event));
 	}
 
 	BLEGATTStateMachine::BLEGATTStateMachine()
@@ -197,6 +165,10 @@ namespace BLEPP
 		ENTER();
 		close_and_cleanup();
 		buf.resize(128);
+
+		submission_event = log_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+		if(submission_event == -1)
+			throw SocketAllocationFailed(strerror(errno));
 	}
 
 	void BLEGATTStateMachine::connect_blocking(const string& address)
@@ -228,6 +200,9 @@ namespace BLEPP
 		if(sock == -1)
 			throw SocketAllocationFailed(strerror(errno));
 
+		set_connected(true);
+		apply_kernel_timestamps();
+
 		////////////////////////////////////////
 		//Bind the socket
 		//I believe that l2 is for an l2cap socket. These are kind of like
@@ -317,8 +292,7 @@ namespace BLEPP
 		}
 		else if(errno == ENETUNREACH || errno == EHOSTUNREACH)
 		{
-			close_and_cleanup();
-			cb_disconnected(Disconnect(Disconnect::Reason::ConnectionFailed, errno));
+			fail(Disconnect(Disconnect::Reason::ConnectionFailed, errno));
 		}
 		else
 		{
@@ -329,6 +303,40 @@ namespace BLEPP
 
 
 
+	void BLEGATTStateMachine::adopt_socket(int fd)
+	{
+		ENTER();
+		close_and_cleanup();
+
+		//No connection phase, since the socket is already connected.
+		sock = fd;
+		set_connected(true);
+		apply_kernel_timestamps();
+		reset();
+		cb_connected();
+	}
+
+	void BLEGATTStateMachine::set_kernel_timestamps(bool on)
+	{
+		kernel_timestamps = on;
+		apply_kernel_timestamps();
+	}
+
+	void BLEGATTStateMachine::apply_kernel_timestamps()
+	{
+		dev.set_timestamps(kernel_timestamps);
+		current_packet_time = timespec{};
+		if(sock == -1)
+			return;
+
+		int on = kernel_timestamps;
+		if(setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == -1)
+		{
+			LOG(Warning, "Could not set SO_TIMESTAMPNS: " << strerror(errno));
+			dev.set_timestamps(false);
+		}
+	}
+
 	int BLEGATTStateMachine::socket()
 	{
 		return sock;
@@ -451,7 +459,7 @@ namespace BLEPP
 
 	bool BLEGATTStateMachine::wait_on_write()
 	{
-		if(state == Connecting)
+		if(state == Connecting || state == StreamingWriteCommands)
 			return true;
 		else
 			return false;
@@ -459,10 +467,266 @@ namespace BLEPP
 
 	void BLEGATTStateMachine::fail(Disconnect d)
 	{
+		function<void(Disconnect)> abort;
+		swap(abort, abort_hook);
+
 		close_and_cleanup();
+
+		//Abort first, so that anything submitted by cb_disconnected (e.g. after
+		//reconnecting) survives.
+		if(abort)
+			abort(d);
+		abort_submissions(d);
 		cb_disconnected(d);
 	}
 
+	void BLEGATTStateMachine::complete(const function<void()>& cb)
+	{
+		reset();
+		if(completion_hook)
+		{
+			//The hook may well start the next step and set a new hook.
+			function<void()> f;
+			swap(f, completion_hook);
+			f();
+		}
+		else
+			cb();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Operations submitted from other threads
+	//
+
+	void BLEGATTStateMachine::set_connected(bool connected)
+	{
+		//Only the event loop thread changes it.
+		if(connected != bool(connection.load() & 1))
+			connection++;
+	}
+
+	void BLEGATTStateMachine::submit(function<void()> op, function<void(Disconnect)> abort)
+	{
+		//Nothing would ever run it, or worse, it would run on some later
+		//connection, with handles from this one.
+		uint64_t c = connection.load();
+		if(!(c & 1))
+		{
+			if(abort)
+				abort(Disconnect(Disconnect::ConnectionClosed, Disconnect::NoErrorCode));
+			return;
+		}
+
+		submissions.push(Submission{move(op), move(abort), c});
+
+		//Wake up the event loop. This must come after the push.
+		uint64_t one=1;
+		if(write(submission_event, &one, sizeof(one)) == -1 && errno != EAGAIN)
+			LOG(Error, "Failed to signal submission: " << strerror(errno));
+	}
+
+	int BLEGATTStateMachine::submission_fd()
+	{
+		return submission_event;
+	}
+
+	void BLEGATTStateMachine::run_submissions()
+	{
+		ENTER();
+		//Consume the wakeup before looking at the queue. Anything submitted after
+		//this point will wake us up again, so nothing can get lost.
+		uint64_t count;
+		if(read(submission_event, &count, sizeof(count)) == -1 && errno != EAGAIN)
+			LOG(Error, "Failed to read submission event: " << strerror(errno));
+
+		drain_submissions();
+	}
+
+	void BLEGATTStateMachine::drain_submissions()
+	{
+		//Operations which wait for a response (e.g. a read request) take the
+		//machine out of Idle, so the remainder wait until the response arrives.
+		//Those which don't (e.g. write commands) leave it Idle, so the next one
+		//can go straight away.
+		Submission s;
+		try
+		{
+			while(state == Idle && submissions.pop(s))
+			{
+				//Made on a connection which has since gone, and
+				//raced with the aborts.
+				if(s.connection != connection.load())
+				{
+					if(s.abort)
+						s.abort(Disconnect(Disconnect::ConnectionClosed, Disconnect::NoErrorCode));
+				}
+				else
+					s.run();
+				s = Submission();
+			}
+		}
+		catch(BLEDevice::WriteError)
+		{
+			fail(Disconnect(Disconnect::WriteError, errno));
+		}
+	}
+
+	void BLEGATTStateMachine::abort_submissions(Disconnect d)
+	{
+		Submission s;
+		while(submissions.pop(s))
+		{
+			if(s.abort)
+				s.abort(d);
+			s = Submission();
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Asynchronous operations returning futures. These are all built from
+	// submissions, and run on the event loop thread.
+	//
+
+	ATTError::ATTError(const PDUErrorResponse& r)
+	:std::runtime_error(string("ATT error in response to ") + att_op2str(r.request_opcode()) + ": " + att_ecode2str(r.error_code())),
+	 request_opcode(r.request_opcode()), error_code(r.error_code()), handle(r.handle())
+	{
+	}
+
+	OperationAborted::OperationAborted(BLEGATTStateMachine::Disconnect d)
+	:std::runtime_error(string("Operation aborted: ") + BLEGATTStateMachine::get_disconnect_string(d)),
+	 reason(d)
+	{
+	}
+
+	//std::function must be copyable, so the promises are shared.
+	template<class T>
+	function<void(BLEGATTStateMachine::Disconnect)> abort_promise(const shared_ptr<promise<T>>& p)
+	{
+		return [p](BLEGATTStateMachine::Disconnect d)
+		{
+			p->set_exception(make_exception_ptr(OperationAborted(d)));
+		};
+	}
+
+	void BLEGATTStateMachine::submit_read(uint16_t handle, function<void(const PDUResponse&)> done, function<void(Disconnect)> abort)
+	{
+		submit([this, handle, done, abort]()
+		{
+			abort_hook = abort;
+			response_hook = done;
+			send_read_request(handle);
+		}, abort);
+	}
+
+	void BLEGATTStateMachine::submit_write(uint16_t handle, const uint8_t* data, int length, WriteType type, function<void(const PDUResponse&)> done, function<void(Disconnect)> abort)
+	{
+		vector<uint8_t> value(data, data + length);
+
+		submit([this, handle, value, type, done, abort]()
+		{
+			//Refuse a value too long for the MTU as the device would, rather
+			//than throwing out of whatever is running the submissions.
+			if(int(value.size()) > dev.max_write_length())
+			{
+				uint8_t error[5] = {ATT_OP_ERROR, uint8_t(type == WriteType::Command ? ATT_OP_WRITE_CMD : ATT_OP_WRITE_REQ), 0, 0, ATT_ECODE_INVAL_ATTR_VALUE_LEN};
+				att_put_u16(handle, error + 2);
+				done(PDUResponse(error, sizeof(error)));
+				return;
+			}
+
+			if(type == WriteType::Command)
+			{
+				abort_hook = abort;
+				send_write_command(handle, value.data(), value.size());
+				abort_hook = nullptr;
+
+				//There's no response to a command, so complete it as
+				//though the device had sent one.
+				static const uint8_t write_resp[] = {ATT_OP_WRITE_RESP};
+				done(PDUResponse(write_resp, 1));
+			}
+			else
+			{
+				abort_hook = abort;
+				response_hook = done;
+				send_write_request(handle, value.data(), value.size());
+			}
+		}, abort);
+	}
+
+	future<vector<uint8_t>> BLEGATTStateMachine::read_async(uint16_t handle)
+	{
+		auto p = make_shared<promise<vector<uint8_t>>>();
+
+		submit_read(handle, [p](const PDUResponse& r)
+		{
+			if(r.type() == ATT_OP_ERROR)
+				p->set_exception(make_exception_ptr(ATTError(r)));
+			else
+			{
+				PDUReadResponse read(r);
+				p->set_value(vector<uint8_t>(read.value().first, read.value().second));
+			}
+		}, abort_promise(p));
+
+		return p->get_future();
+	}
+
+	future<void> BLEGATTStateMachine::write_async(uint16_t handle, const uint8_t* data, int length, WriteType type)
+	{
+		auto p = make_shared<promise<void>>();
+
+		submit_write(handle, data, length, type, [p](const PDUResponse& r)
+		{
+			if(r.type() == ATT_OP_ERROR)
+				p->set_exception(make_exception_ptr(ATTError(r)));
+			else
+				p->set_value();
+		}, abort_promise(p));
+
+		return p->get_future();
+	}
+
+	void BLEGATTStateMachine::submit_discover(function<void()> done, function<void(Disconnect)> abort)
+	{
+		submit([this, done, abort]()
+		{
+			//The same chain as setup_standard_scan(), but via the
+			//completion hooks rather than the user's callbacks.
+			abort_hook = abort;
+			completion_hook = [this, done]()
+			{
+				completion_hook = [this, done]()
+				{
+					completion_hook = [this, done]()
+					{
+						abort_hook = nullptr;
+						done();
+					};
+					get_client_characteristic_configuration();
+				};
+				find_all_characteristics();
+			};
+
+			primary_services.clear();
+			read_primary_services();
+		}, abort);
+	}
+
+	future<void> BLEGATTStateMachine::discover_async()
+	{
+		auto p = make_shared<promise<void>>();
+		submit_discover([p]()
+		{
+			p->set_value();
+		}, abort_promise(p));
+
+		return p->get_future();
+	}
+
 	void BLEGATTStateMachine::unexpected_error(const PDUErrorResponse& r)
 	{
 		PDUErrorResponse err(r);
@@ -497,11 +761,14 @@ namespace BLEPP
 				}
 				else
 				{
-					close_and_cleanup();
-					cb_disconnected(Disconnect(Disconnect::Reason::ConnectionFailed, errval));
+					fail(Disconnect(Disconnect::Reason::ConnectionFailed, errval));
 				}
 
 			}
+			else if(state == StreamingWriteCommands)
+			{
+				continue_stream();
+			}
 			else
 			{
 				LOG(Error, "Not implemented!");
@@ -515,6 +782,8 @@ namespace BLEPP
 		{
 			fail(Disconnect(Disconnect::Reason::ReadError, errno));
 		}
+
+		drain_submissions();
 	}
 
 	void BLEGATTStateMachine::read_and_process_next()
@@ -538,244 +807,327 @@ namespace BLEPP
 		try
 		{
 			PDUResponse r = dev.receive(buf);
+			current_packet_time = dev.timestamp();
+			process(r);
+		}
+		catch(BLEDevice::WriteError)
+		{
+			fail(Disconnect(Disconnect::WriteError, errno));
+		}
+		catch(BLEDevice::ReadError)
+		{
+			fail(Disconnect(Disconnect::ReadError, errno));
+		}
+		catch(const InvalidPDU&)
+		{
+			//Already logged. A peer sending malformed PDUs can't be trusted
+			//with anything else.
+			fail(Disconnect(Disconnect::UnexpectedResponse, Disconnect::NoErrorCode));
+		}
 
-			if(r.type() == ATT_OP_HANDLE_NOTIFY || r.type() == ATT_OP_HANDLE_IND)
-			{
-				PDUNotificationOrIndication n(r);
+		//The response may have made room for the next submitted operation.
+		drain_submissions();
+	}
+
+	int BLEGATTStateMachine::process_all_pending(int max)
+	{
+		ENTER();
+		if(state == Connecting)
+			throw logic_error("Trying to read socket while connecting");
+
+		if(state == Disconnected)
+		{
+			LOG(Warning, "Trying to process_all_pending while disconnected");
+			return 0;
+		}
 
-				Characteristic* c = characteristic_of_handle(n.handle());
+		int processed=0;
+		try
+		{
+			//Pull in as many PDUs as the kernel has queued with one system call,
+			//then run them through the state machine in order. Any of them can 
+			//cause a disconnect (e.g. a callback calling close()), in which case
+			//the remainder are dropped, just as the kernel would drop them on close.
+			//cb_disconnected may have connected again, so it's the connection
+			//rather than the state which says whether they're still wanted.
+			uint64_t c = connection.load();
+			while(processed < max)
+			{
+				int n = dev.receive_batch(max - processed, buf.size());
 
-				if(c)
+				for(int i=0; i < n && connection.load() == c; i++, processed++)
 				{
-					if(c->cb_notify_or_indicate)
-						c->cb_notify_or_indicate(n);
-					else if(cb_notify_or_indicate)
-						cb_notify_or_indicate(*c, n);
-					else
-						LOG(Warning, "Notify arrived, but no callback set\n");
+					current_packet_time = dev.batch_timestamp(i);
+					process(dev.batch_pdu(i));
 				}
 
-				//Respond to indications after the callback has run
-				if(!n.notification())
-					dev.send_handle_value_confirmation();
-			}
-			//client is asking for MTU negotiation, VOL 3, PART F 3.4.2.1 Exchange MTU Request of bluetooth core spec
-			else if (r.type() == ATT_OP_MTU_REQ)
-			{
-				dev.process_att_mtu_request(r);
+				if(connection.load() != c || n < BLEDevice::max_batch)
+					break;
 			}
-			//client is responding to our MTU request generated off their request
-			//VOL 3, PART F 3.4.2.2 Exchange MTU Request of bluetooth core spec
-			else if (r.type() == ATT_OP_MTU_RESP)
-			{
-				dev.process_att_mtu_response(r);
-				buf.resize(dev.buf.size());
-			}
-			else if(r.type() == ATT_OP_ERROR && PDUErrorResponse(r).request_opcode() != last_request)
+		}
+		catch(BLEDevice::WriteError)
+		{
+			fail(Disconnect(Disconnect::WriteError, errno));
+		}
+		catch(BLEDevice::ReadError)
+		{
+			fail(Disconnect(Disconnect::ReadError, errno));
+		}
+		catch(const InvalidPDU&)
+		{
+			fail(Disconnect(Disconnect::UnexpectedResponse, Disconnect::NoErrorCode));
+		}
+
+		drain_submissions();
+		return processed;
+	}
+
+	void BLEGATTStateMachine::process(const PDUResponse& r)
+	{
+		//A zero length read on a SEQPACKET socket means the other end has gone away.
+		if(r.length == 0)
+		{
+			LOG(Info, "Connection closed by remote device");
+			fail(Disconnect(Disconnect::ConnectionClosed, Disconnect::NoErrorCode));
+			return;
+		}
+
+
+		if(r.type() == ATT_OP_HANDLE_NOTIFY || r.type() == ATT_OP_HANDLE_IND)
+		{
+			PDUNotificationOrIndication n(r);
+
+			Characteristic* c = characteristic_of_handle(n.handle());
+
+			if(c)
 			{
-				PDUErrorResponse err(r);
-				std::string msg = string("Unexpected opcode in error. Expected ") + att_op2str(last_request) + " got "  + att_op2str(err.request_opcode());
-				LOG(Error, msg);
-				fail(Disconnect(Disconnect::Reason::UnexpectedError, Disconnect::NoErrorCode));
+				if(c->cb_notify_or_indicate)
+					c->cb_notify_or_indicate(n);
+				else if(cb_notify_or_indicate)
+					cb_notify_or_indicate(*c, n);
+				else
+					LOG(Warning, "Notify arrived, but no callback set\n");
 			}
-			else if(r.type() != ATT_OP_ERROR && r.type() != last_request + 1)
+
+			//Respond to indications after the callback has run
+			if(!n.notification())
+				dev.send_handle_value_confirmation();
+		}
+		//client is asking for MTU negotiation, VOL 3, PART F 3.4.2.1 Exchange MTU Request of bluetooth core spec
+		else if (r.type() == ATT_OP_MTU_REQ)
+		{
+			dev.process_att_mtu_request(r);
+		}
+		//client is responding to our MTU request generated off their request
+		//VOL 3, PART F 3.4.2.2 Exchange MTU Request of bluetooth core spec
+		else if (r.type() == ATT_OP_MTU_RESP)
+		{
+			dev.process_att_mtu_response(r);
+			buf.resize(dev.buf.size());
+		}
+		else if(r.type() == ATT_OP_ERROR && PDUErrorResponse(r).request_opcode() != last_request)
+		{
+			PDUErrorResponse err(r);
+			std::string msg = string("Unexpected opcode in error. Expected ") + att_op2str(last_request) + " got "  + att_op2str(err.request_opcode());
+			LOG(Error, msg);
+			fail(Disconnect(Disconnect::Reason::UnexpectedError, Disconnect::NoErrorCode));
+		}
+		else if(r.type() != ATT_OP_ERROR && r.type() != last_request + 1)
+		{
+			string msg = string("Unexpected response. Expected ") + att_op2str(last_request+1) + " got "  + att_op2str(r.type());
+			LOG(Error, msg);
+			fail(Disconnect(Disconnect::Reason::UnexpectedResponse, Disconnect::NoErrorCode));
+		}
+		else
+		{
+			if((state == AwaitingReadResponse || state == AwaitingWriteResponse) && response_hook)
 			{
-				string msg = string("Unexpected response. Expected ") + att_op2str(last_request+1) + " got "  + att_op2str(r.type());
-				LOG(Error, msg);
-				fail(Disconnect(Disconnect::Reason::UnexpectedResponse, Disconnect::NoErrorCode));
+				//Error responses go to the hook too, since they
+				//fail the operation, not the connection.
+				function<void(const PDUResponse&)> f;
+				swap(f, response_hook);
+				abort_hook = nullptr;
+				reset();
+				f(r);
 			}
-			else
+			else if(state == ReadingPrimaryService)
 			{
-				if(state == ReadingPrimaryService)
+				if(r.type() == ATT_OP_ERROR)
 				{
-					if(r.type() == ATT_OP_ERROR)
+					if(PDUErrorResponse(r).error_code() == ATT_ECODE_ATTR_NOT_FOUND)
 					{
-						if(PDUErrorResponse(r).error_code() == ATT_ECODE_ATTR_NOT_FOUND)
-						{
-							//Maybe ? Indicates that the last one has been read.
-							reset();
-							cb_services_read();
-						}
-						else
-							unexpected_error(r);
+						//Maybe ? Indicates that the last one has been read.
+						complete(cb_services_read);
 					}
 					else
-					{
-						GATTReadServiceGroup g(r);
+						unexpected_error(r);
+				}
+				else
+				{
+					GATTReadServiceGroup g(r);
 
-						for(int i=0; i < g.num_elements(); i++)
-						{
-							struct PrimaryService service;
-							service.start_handle = g.start_handle(i);
-							service.end_handle   = g.end_handle(i);
-							service.uuid         = UUID::from(g.uuid(i));
-							primary_services.push_back(service);
-						}
+					for(int i=0; i < g.num_elements(); i++)
+					{
+						struct PrimaryService service;
+						service.start_handle = g.start_handle(i);
+						service.end_handle   = g.end_handle(i);
+						service.uuid         = UUID::from(g.uuid(i));
+						primary_services.push_back(service);
+					}
 
 
-						if(primary_services.back().end_handle == 0xffff)
-						{
-							reset();
-							cb_services_read();
-						}
-						else
-						{
-							next_handle_to_read = primary_services.back().end_handle+1;
-							state_machine_write();
-						}
+					if(primary_services.back().end_handle == 0xffff)
+					{
+						complete(cb_services_read);
+					}
+					else
+					{
+						next_handle_to_read = primary_services.back().end_handle+1;
+						state_machine_write();
 					}
 				}
-				else if(state == FindAllCharacteristics)
+			}
+			else if(state == FindAllCharacteristics)
+			{
+				if(r.type() == ATT_OP_ERROR)
 				{
-					if(r.type() == ATT_OP_ERROR)
+					if(PDUErrorResponse(r).error_code() == ATT_ECODE_ATTR_NOT_FOUND)
 					{
-						if(PDUErrorResponse(r).error_code() == ATT_ECODE_ATTR_NOT_FOUND)
-						{
-							//Maybe ? Indicates that the last one has been read.
-							reset();
-							cb_find_characteristics();
-						}
-						else
-							unexpected_error(r);
+						//Maybe ? Indicates that the last one has been read.
+						complete(cb_find_characteristics);
 					}
 					else
-					{
-						GATTReadCharacteristic rc(r);
+						unexpected_error(r);
+				}
+				else
+				{
+					GATTReadCharacteristic rc(r);
 
-						for(int i=0; i < rc.num_elements(); i++)
-						{
-							uint16_t handle = rc.handle(i);
-							GATTReadCharacteristic::Characteristic ch = rc.characteristic(i);
+					for(int i=0; i < rc.num_elements(); i++)
+					{
+						uint16_t handle = rc.handle(i);
+						GATTReadCharacteristic::Characteristic ch = rc.characteristic(i);
 
-							LOG(Debug, "Found characteristic handle: " << to_hex(handle));
+						LOG(Debug, "Found characteristic handle: " << to_hex(handle));
 
-							//Search for the correct service.
-							for(unsigned int s=0; s < primary_services.size(); s++)
+						//Search for the correct service.
+						for(unsigned int s=0; s < primary_services.size(); s++)
+						{
+							if(handle > primary_services[s].start_handle && handle <= primary_services[s].end_handle)
 							{
-								if(handle > primary_services[s].start_handle && handle <= primary_services[s].end_handle)
-								{
-									LOG(Debug, "  handle belongs to service " << s);
-									Characteristic c(this);
+								LOG(Debug, "  handle belongs to service " << s);
+								Characteristic c(this);
 
 
-									c.broadcast= ch.flags & GATT_CHARACTERISTIC_FLAGS_BROADCAST;
-									c.read     = ch.flags & GATT_CHARACTERISTIC_FLAGS_READ;
-									c.write_without_response= ch.flags & GATT_CHARACTERISTIC_FLAGS_WRITE_WITHOUT_RESPONSE;
-									c.write    = ch.flags & GATT_CHARACTERISTIC_FLAGS_WRITE;
-									c.notify   = ch.flags & GATT_CHARACTERISTIC_FLAGS_NOTIFY;
-									c.indicate = ch.flags & GATT_CHARACTERISTIC_FLAGS_INDICATE;
-									c.authenticated_write = ch.flags & GATT_CHARACTERISTIC_FLAGS_AUTHENTICATED_SIGNED_WRITES;
-									c.extended = ch.flags & GATT_CHARACTERISTIC_FLAGS_EXTENDED_PROPERTIES;
-									c.uuid     = UUID::from(ch.uuid);
-									c.value_handle = ch.handle;
-									c.client_characteric_configuration_handle = 0;
-									c.first_handle = handle;
+								c.broadcast= ch.flags & GATT_CHARACTERISTIC_FLAGS_BROADCAST;
+								c.read     = ch.flags & GATT_CHARACTERISTIC_FLAGS_READ;
+								c.write_without_response= ch.flags & GATT_CHARACTERISTIC_FLAGS_WRITE_WITHOUT_RESPONSE;
+								c.write    = ch.flags & GATT_CHARACTERISTIC_FLAGS_WRITE;
+								c.notify   = ch.flags & GATT_CHARACTERISTIC_FLAGS_NOTIFY;
+								c.indicate = ch.flags & GATT_CHARACTERISTIC_FLAGS_INDICATE;
+								c.authenticated_write = ch.flags & GATT_CHARACTERISTIC_FLAGS_AUTHENTICATED_SIGNED_WRITES;
+								c.extended = ch.flags & GATT_CHARACTERISTIC_FLAGS_EXTENDED_PROPERTIES;
+								c.uuid     = UUID::from(ch.uuid);
+								c.decoder  = find_value_decoder(c.uuid);
+								c.value_handle = ch.handle;
+								c.client_characteric_configuration_handle = 0;
+								c.first_handle = handle;
 
-									//Initially mark the end as the start of the current service
-									c.last_handle = primary_services[s].end_handle;
+								//Initially mark the end as the start of the current service
+								c.last_handle = primary_services[s].end_handle;
 
-									//Terminate the previous characteristic
-									if(!primary_services[s].characteristics.empty())
-										primary_services[s].characteristics.back().last_handle = handle-1;
+								//Terminate the previous characteristic
+								if(!primary_services[s].characteristics.empty())
+									primary_services[s].characteristics.back().last_handle = handle-1;
 
-									primary_services[s].characteristics.push_back(c);
+								primary_services[s].characteristics.push_back(c);
 
 
 
-								}
 							}
-
-							next_handle_to_read = handle+1;
 						}
-						LOG(Debug,  "Reading " << to_hex((uint16_t)next_handle_to_read) << " next");
-						state_machine_write();
+
+						next_handle_to_read = handle+1;
 					}
+					LOG(Debug,  "Reading " << to_hex((uint16_t)next_handle_to_read) << " next");
+					state_machine_write();
 				}
-				else if(state == GetClientCharaceristicConfiguration)
+			}
+			else if(state == GetClientCharaceristicConfiguration)
+			{
+				if(r.type() == ATT_OP_ERROR)
 				{
-					if(r.type() == ATT_OP_ERROR)
+					if(PDUErrorResponse(r).error_code() == ATT_ECODE_ATTR_NOT_FOUND)
 					{
-						if(PDUErrorResponse(r).error_code() == ATT_ECODE_ATTR_NOT_FOUND)
-						{
-							//Maybe ? Indicates that the last one has been read.
-							reset();
-							cb_get_client_characteristic_configuration();
-						}
-						else
-							unexpected_error(r);
+						//Maybe ? Indicates that the last one has been read.
+						complete(cb_get_client_characteristic_configuration);
 					}
 					else
-					{
-						GATTReadCCC rc(r);
+						unexpected_error(r);
+				}
+				else
+				{
+					GATTReadCCC rc(r);
 
-						for(int i=0; i < rc.num_elements(); i++)
-						{
-							uint16_t handle = rc.handle(i);
-							next_handle_to_read = handle + 1;
-							LOG(Debug, "Handle: " << to_hex(rc.handle(i)) << "  ccc: " << to_hex(rc.ccc(i)));
+					for(int i=0; i < rc.num_elements(); i++)
+					{
+						uint16_t handle = rc.handle(i);
+						next_handle_to_read = handle + 1;
+						LOG(Debug, "Handle: " << to_hex(rc.handle(i)) << "  ccc: " << to_hex(rc.ccc(i)));
 
 
-							//Find the correct place
-							for(auto& s:primary_services)
-								if(handle > s.start_handle && handle <= s.end_handle)
-									for(auto& c:s.characteristics)
-										if(handle > c.first_handle && handle <= c.last_handle)
-										{
-											c.client_characteric_configuration_handle = rc.handle(i);
-											c.ccc_last_known_value = rc.ccc(i);
-										}
+						//Find the correct place
+						for(auto& s:primary_services)
+							if(handle > s.start_handle && handle <= s.end_handle)
+								for(auto& c:s.characteristics)
+									if(handle > c.first_handle && handle <= c.last_handle)
+									{
+										c.client_characteric_configuration_handle = rc.handle(i);
+										c.ccc_last_known_value = rc.ccc(i);
+									}
 
-						}
-						state_machine_write();
 					}
+					state_machine_write();
 				}
-				else if(state == AwaitingWriteResponse)
-				{
+			}
+			else if(state == AwaitingWriteResponse)
+			{
 
-					if(r.type() == ATT_OP_ERROR)
-						unexpected_error(r);
-					else
-					{
-						reset();
-						cb_write_response();
-					}
+				if(r.type() == ATT_OP_ERROR)
+					unexpected_error(r);
+				else
+				{
+					reset();
+					cb_write_response();
 				}
-				else if(state == AwaitingReadResponse)
+			}
+			else if(state == AwaitingReadResponse)
+			{
+				if(r.type() == ATT_OP_ERROR)
 				{
-					if(r.type() == ATT_OP_ERROR)
-					{
-						unexpected_error(r);
-					}
-					else
-					{
-						uint16_t h = read_req_handle;
-						reset();
+					unexpected_error(r);
+				}
+				else
+				{
+					uint16_t h = read_req_handle;
+					reset();
 
-						PDUReadResponse read(r);
-						Characteristic* c = characteristic_of_handle(h);
-						LOG(Debug, "Read response: handle requested was " << to_hex(h));
+					PDUReadResponse read(r);
+					Characteristic* c = characteristic_of_handle(h);
+					LOG(Debug, "Read response: handle requested was " << to_hex(h));
 
-						if(c)
-						{
-							if(c->cb_read)
-								c->cb_read(read);
-							else if(cb_read)
-								cb_read(*c, read);
-							else
-								LOG(Warning, "Read arrived, but no callback set\n");
-						}
+					if(c)
+					{
+						if(c->cb_read)
+							c->cb_read(read);
+						else if(cb_read)
+							cb_read(*c, read);
+						else
+							LOG(Warning, "Read arrived, but no callback set\n");
 					}
 				}
 			}
 		}
-		catch(BLEDevice::WriteError)
-		{
-			fail(Disconnect(Disconnect::WriteError, errno));
-		}
-		catch(BLEDevice::ReadError)
-		{
-			fail(Disconnect(Disconnect::ReadError, errno));
-		}
 	}
 		
 	
@@ -827,6 +1179,65 @@ namespace BLEPP
 		dev.send_write_command(handle, data, length);
 	}
 
+	void BLEGATTStateMachine::stream_write_commands(uint16_t handle, const uint8_t* data, int length)
+	{
+		if(state != Idle)
+			throw logic_error("Error trying to issue command mid state");
+		if(length < 0)
+			throw logic_error("Negative length given to stream_write_commands");
+
+		stream_data.assign(data, data + length);
+		stream_pos = 0;
+		stream_handle = handle;
+		stream_stats = StreamStats();
+		stream_start = chrono::steady_clock::now();
+
+		state = StreamingWriteCommands;
+
+		try
+		{
+			continue_stream();
+		}
+		catch(BLEDevice::WriteError)
+		{
+			fail(Disconnect(Disconnect::Reason::WriteError, errno));
+		}
+	}
+
+	void BLEGATTStateMachine::continue_stream()
+	{
+		//A write command is the opcode, the handle and then the data.
+		const size_t chunk = dev.max_write_length();
+
+		while(stream_pos < stream_data.size())
+		{
+			size_t n = min(chunk, stream_data.size() - stream_pos);
+
+			//A full send buffer is backpressure, not an error: wait_on_write()
+			//is true, so we'll be called again when there's room.
+			if(!dev.try_send_write_command(stream_handle, stream_data.data() + stream_pos, n))
+			{
+				stream_stats.stalls++;
+				return;
+			}
+
+			stream_pos += n;
+			stream_stats.packets++;
+		}
+		
+		stream_stats.bytes = stream_data.size();
+		stream_stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - stream_start).count();
+		stream_stats.bytes_per_second = stream_stats.seconds > 0 ? stream_stats.bytes / stream_stats.seconds : 0;
+
+		LOG(Info, "Streamed " << stream_stats.bytes << " bytes in " << stream_stats.packets << " packets at " << stream_stats.bytes_per_second << " bytes/s, stalled " << stream_stats.stalls << " times");
+
+		stream_data.clear();
+		reset();
+
+		if(cb_stream_complete)
+			cb_stream_complete(stream_stats);
+	}
+
 	void Characteristic::write_command(const uint8_t*data, int length)
 	{
 		s->send_write_command(value_handle, data, length);
@@ -840,6 +1251,16 @@ namespace BLEPP
 	}
 
 
+	bool Characteristic::decode(const PDUNotificationOrIndication& n, CharacteristicValue& v) const
+	{
+		return decoder && decoder->decode(n.value().first, n.value().second, v);
+	}
+
+	bool Characteristic::decode(const PDUReadResponse& r, CharacteristicValue& v) const
+	{
+		return decoder && decoder->decode(r.value().first, r.value().second, v);
+	}
+
 	void pretty_print_tree(const BLEGATTStateMachine& s)
 	{
 
@@ -858,7 +1279,10 @@ namespace BLEPP
 
 			for(auto& characteristic: service.characteristics)
 			{
-				cout  << "  Characteristic: " << to_str(characteristic.uuid) << endl;
+				cout  << "  Characteristic: " << to_str(characteristic.uuid);
+				if(const AssignedNumber* a = lookup_characteristic(characteristic.uuid))
+					cout << " (" << a->name << ")";
+				cout << endl;
 				cout  << "   Start: " << to_hex(characteristic.first_handle) << "  End: " << to_hex(characteristic.last_handle) << endl;
 
 				cout << "   Flags: ";
@@ -0,0 +1,427 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "blepp/coroutine.h"
+#include "blepp/logging.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+
+using namespace std;
+
+namespace BLEPP
+{
+	void Task::promise_type::unhandled_exception()
+	{
+		try
+		{
+			throw;
+		}
+		catch(std::exception& e)
+		{
+			LOG(Error, "Unhandled exception in coroutine: " << e.what());
+		}
+		catch(...)
+		{
+			LOG(Error, "Unhandled exception in coroutine");
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// The executor
+	//
+
+	Executor::Executor()
+	{
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if(epoll_fd == -1)
+			throw SocketAllocationFailed(strerror(errno));
+	}
+
+	Executor::~Executor()
+	{
+		::close(epoll_fd);
+	}
+
+	Executor::Device& Executor::device(BLEGATTStateMachine& gatt)
+	{
+		for(auto& d: devices)
+			if(d.gatt == &gatt)
+				return d;
+
+		devices.emplace_back();
+		Device& d = devices.back();
+		d.gatt = &gatt;
+		d.socket_watch = Watch{&d, false};
+		d.submission_watch = Watch{&d, true};
+
+		epoll_event e{};
+		e.events = EPOLLIN;
+		e.data.ptr = &d.submission_watch;
+		if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, gatt.submission_fd(), &e) == -1)
+			throw std::runtime_error(string("Executor: epoll_ctl failed: ") + strerror(errno));
+
+		sync(d);
+		return d;
+	}
+
+	void Executor::add(BLEGATTStateMachine& gatt)
+	{
+		device(gatt);
+	}
+
+	void Executor::remove(BLEGATTStateMachine& gatt)
+	{
+		for(auto d=devices.begin(); d != devices.end(); ++d)
+			if(d->gatt == &gatt)
+			{
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, gatt.submission_fd(), nullptr);
+				if(d->fd != -1)
+					epoll_ctl(epoll_fd, EPOLL_CTL_DEL, d->fd, nullptr);
+
+				//Nothing will deliver to the streams any more, so end them. The
+				//characteristics are still there, so unhook them too.
+				auto streams = d->streams;
+				for(auto s: streams)
+				{
+					if(s->characteristic)
+						s->characteristic->cb_notify_or_indicate = nullptr;
+					s->close(BLEGATTStateMachine::Disconnect(BLEGATTStateMachine::Disconnect::ConnectionClosed, BLEGATTStateMachine::Disconnect::NoErrorCode));
+				}
+				d->streams.clear();
+
+				if(d->connecting)
+				{
+					post(d->connecting);
+					d->connecting = nullptr;
+				}
+
+				//run() may be part way through a batch of events which point
+				//at the device, so keep it until the batch is done.
+				d->removed = true;
+				removed.splice(removed.end(), devices, d);
+				if(!dispatching)
+					removed.clear();
+				return;
+			}
+	}
+
+	void Executor::sync(Device& d)
+	{
+		//The socket comes and goes with connections, and we want to know about
+		//writability only while connecting. Bring epoll up to date if anything
+		//has changed. A reconnection often gets the same fd back, so it's the
+		//connection number which says whether the socket is new.
+		int fd = d.gatt->socket();
+		uint64_t connection = d.gatt->connection_number();
+		uint32_t events = uint32_t(EPOLLIN) | (d.gatt->wait_on_write() ? uint32_t(EPOLLOUT) : 0);
+
+		if(fd != d.fd || connection != d.connection)
+		{
+			//Closing an fd removes it from epoll, so failure here is harmless.
+			if(d.fd != -1)
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, d.fd, nullptr);
+
+			//Whatever the streams were listening to has gone.
+			if(d.fd != -1)
+			{
+				auto streams = d.streams;
+				for(auto s: streams)
+					s->close(BLEGATTStateMachine::Disconnect(BLEGATTStateMachine::Disconnect::ConnectionClosed, BLEGATTStateMachine::Disconnect::NoErrorCode));
+			}
+
+			d.fd = -1;
+			d.events = 0;
+			d.connection = connection;
+		}
+
+		if(fd != -1 && events != d.events)
+		{
+			epoll_event e{};
+			e.events = events;
+			e.data.ptr = &d.socket_watch;
+
+			int op = d.fd == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+			if(epoll_ctl(epoll_fd, op, fd, &e) == -1)
+				throw std::runtime_error(string("Executor: epoll_ctl failed: ") + strerror(errno));
+
+			d.fd = fd;
+			d.events = events;
+		}
+
+		//A connection attempt has finished, one way or the other.
+		if(d.connecting && !d.gatt->is_connecting())
+		{
+			post(d.connecting);
+			d.connecting = nullptr;
+		}
+	}
+
+	void Executor::dispatch(const Watch& w, uint32_t events)
+	{
+		if(w.device->removed)
+			return;
+
+		BLEGATTStateMachine& gatt = *w.device->gatt;
+
+		if(w.submissions)
+			gatt.run_submissions();
+		else
+		{
+			//Writability matters while connecting or streaming writes, but reads
+			//can turn up while streaming too.
+			if(gatt.wait_on_write() && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+				gatt.write_and_process_next();
+
+			if((events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && gatt.socket() != -1 && !gatt.is_connecting())
+				gatt.process_all_pending();
+		}
+
+		//A callback may have removed it.
+		if(!w.device->removed)
+			sync(*w.device);
+	}
+
+	void Executor::post(coroutine_handle<> h)
+	{
+		ready.push_back(h);
+	}
+
+	void Executor::resume_ready()
+	{
+		while(!ready.empty())
+		{
+			coroutine_handle<> h = ready.front();
+			ready.pop_front();
+			h.resume();
+		}
+	}
+
+	void Executor::stop()
+	{
+		running = false;
+	}
+
+	void Executor::run()
+	{
+		//In case an exception escaped the last batch.
+		dispatching = false;
+		removed.clear();
+
+		running = true;
+		const int max_events=64;
+		epoll_event events[max_events];
+
+		while(running)
+		{
+			//Coroutines may well have started connections or closed things.
+			resume_ready();
+			for(auto& d: devices)
+				sync(d);
+
+			if(!running)
+				break;
+			if(!ready.empty())
+				continue;
+
+			int n = epoll_wait(epoll_fd, events, max_events, -1);
+			if(n == -1)
+			{
+				if(errno == EINTR)
+					continue;
+				throw std::runtime_error(string("Executor: epoll_wait failed: ") + strerror(errno));
+			}
+
+			dispatching = true;
+			for(int i=0; i < n; i++)
+				dispatch(*static_cast<Watch*>(events[i].data.ptr), events[i].events);
+			dispatching = false;
+			removed.clear();
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Awaitables
+	//
+
+	bool Executor::Connect::await_ready()
+	{
+		ex.add(gatt);
+		gatt.connect(address, false, pubaddr);
+
+		//Connections can fail or succeed immediately.
+		return !gatt.is_connecting();
+	}
+
+	void Executor::Connect::await_suspend(coroutine_handle<> h)
+	{
+		Device& d = ex.device(gatt);
+		d.connecting = h;
+		ex.sync(d);
+	}
+
+	void Executor::Connect::await_resume()
+	{
+		//Still connecting if the machine was removed from the executor.
+		if(gatt.socket() == -1 || gatt.is_connecting())
+			throw OperationAborted(BLEGATTStateMachine::Disconnect(BLEGATTStateMachine::Disconnect::ConnectionFailed, BLEGATTStateMachine::Disconnect::NoErrorCode));
+	}
+
+	void Executor::Read::await_suspend(coroutine_handle<> h)
+	{
+		ex.add(gatt);
+		gatt.submit_read(handle, [this, h](const PDUResponse& r)
+		{
+			if(r.type() == ATT_OP_ERROR)
+				error = make_exception_ptr(ATTError(r));
+			else
+			{
+				PDUReadResponse read(r);
+				value.assign(read.value().first, read.value().second);
+			}
+			ex.post(h);
+		},
+		[this, h](BLEGATTStateMachine::Disconnect d)
+		{
+			error = make_exception_ptr(OperationAborted(d));
+			ex.post(h);
+		});
+	}
+
+	vector<uint8_t> Executor::Read::await_resume()
+	{
+		if(error)
+			rethrow_exception(error);
+		return std::move(value);
+	}
+
+	void Executor::Write::await_suspend(coroutine_handle<> h)
+	{
+		ex.add(gatt);
+		gatt.submit_write(handle, data.data(), data.size(), type, [this, h](const PDUResponse& r)
+		{
+			if(r.type() == ATT_OP_ERROR)
+				error = make_exception_ptr(ATTError(r));
+			ex.post(h);
+		},
+		[this, h](BLEGATTStateMachine::Disconnect d)
+		{
+			error = make_exception_ptr(OperationAborted(d));
+			ex.post(h);
+		});
+	}
+
+	void Executor::Write::await_resume()
+	{
+		if(error)
+			rethrow_exception(error);
+	}
+
+	void Executor::Discover::await_suspend(coroutine_handle<> h)
+	{
+		ex.add(gatt);
+		gatt.submit_discover([this, h]()
+		{
+			ex.post(h);
+		},
+		[this, h](BLEGATTStateMachine::Disconnect d)
+		{
+			error = make_exception_ptr(OperationAborted(d));
+			ex.post(h);
+		});
+	}
+
+	void Executor::Discover::await_resume()
+	{
+		if(error)
+			rethrow_exception(error);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Notifications
+	//
+
+	NotificationStream::NotificationStream(Executor& e, BLEGATTStateMachine& g, Characteristic& c)
+	:ex(e), gatt(g), characteristic(&c)
+	{
+		ex.device(gatt).streams.push_back(this);
+
+		characteristic->cb_notify_or_indicate = [this](const PDUNotificationOrIndication& n)
+		{
+			pending.emplace_back(n.value().first, n.value().second);
+			if(waiter)
+			{
+				ex.post(waiter);
+				waiter = nullptr;
+			}
+		};
+	}
+
+	NotificationStream::~NotificationStream()
+	{
+		//After a disconnection, the characteristic no longer exists.
+		if(characteristic)
+			characteristic->cb_notify_or_indicate = nullptr;
+
+		for(auto& d: ex.devices)
+			d.streams.remove(this);
+	}
+
+	void NotificationStream::close(BLEGATTStateMachine::Disconnect d)
+	{
+		characteristic = nullptr;
+		error = make_exception_ptr(OperationAborted(d));
+		if(waiter)
+		{
+			ex.post(waiter);
+			waiter = nullptr;
+		}
+	}
+
+	bool NotificationStream::Next::await_ready() const noexcept
+	{
+		return !s.pending.empty() || s.error;
+	}
+
+	void NotificationStream::Next::await_suspend(coroutine_handle<> h) noexcept
+	{
+		s.waiter = h;
+	}
+
+	vector<uint8_t> NotificationStream::Next::await_resume()
+	{
+		//Deliver everything which arrived before the disconnection.
+		if(s.pending.empty())
+			rethrow_exception(s.error);
+
+		vector<uint8_t> v = std::move(s.pending.front());
+		s.pending.pop_front();
+		return v;
+	}
+}
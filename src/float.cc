@@ -1,22 +1,135 @@
 #include <blepp/float.h>
 #include <cmath>
+#include <limits>
 
 using namespace std;
 
+//IEEE 11073-20601 FLOAT and SFLOAT, as used by the medical and sensor
+//profiles. A FLOAT is a 24 bit mantissa and an 8 bit exponent, an SFLOAT is
+//a 12 bit mantissa and a 4 bit exponent, both two's complement and base 10.
+//Some mantissas (with an exponent of 0) are reserved for special values.
+//
+//The value is the mantissa scaled by a power of 10 from a table, computed in
+//double precision, so there is no call to pow(). The batch versions are the
+//same code with no branches, in loops simple enough for the compiler to
+//vectorise where the target has gather instructions.
 namespace BLEPP
 {
+	namespace
+	{
+		//10^e for e in [0, 128], written out so it's correctly rounded and
+		//constant initialised.
+		const double powers_of_10[129] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+			1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+			1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22, 1e23,
+			1e24, 1e25, 1e26, 1e27, 1e28, 1e29, 1e30, 1e31,
+			1e32, 1e33, 1e34, 1e35, 1e36, 1e37, 1e38, 1e39,
+			1e40, 1e41, 1e42, 1e43, 1e44, 1e45, 1e46, 1e47,
+			1e48, 1e49, 1e50, 1e51, 1e52, 1e53, 1e54, 1e55,
+			1e56, 1e57, 1e58, 1e59, 1e60, 1e61, 1e62, 1e63,
+			1e64, 1e65, 1e66, 1e67, 1e68, 1e69, 1e70, 1e71,
+			1e72, 1e73, 1e74, 1e75, 1e76, 1e77, 1e78, 1e79,
+			1e80, 1e81, 1e82, 1e83, 1e84, 1e85, 1e86, 1e87,
+			1e88, 1e89, 1e90, 1e91, 1e92, 1e93, 1e94, 1e95,
+			1e96, 1e97, 1e98, 1e99, 1e100, 1e101, 1e102, 1e103,
+			1e104, 1e105, 1e106, 1e107, 1e108, 1e109, 1e110, 1e111,
+			1e112, 1e113, 1e114, 1e115, 1e116, 1e117, 1e118, 1e119,
+			1e120, 1e121, 1e122, 1e123, 1e124, 1e125, 1e126, 1e127,
+			1e128,
+		};
+
+		//Multiply by 10^e or divide by 10^-e. One of the two is 1, so there
+		//is a single rounding: the result is correctly rounded as long as the
+		//power of 10 is exact, which it is up to 10^22. Multiplying by 10^-e
+		//instead would be faster, but not correct.
+		inline double scale(int mantissa, int exponent)
+		{
+			return mantissa * powers_of_10[exponent > 0 ? exponent : 0] / powers_of_10[exponent < 0 ? -exponent : 0];
+		}
+
+		const double nan = numeric_limits<double>::quiet_NaN();
+		const double inf = numeric_limits<double>::infinity();
+
+		//Indexed by the raw mantissa minus the smallest special one, which
+		//is +INFINITY for both. NRes (not at this resolution) and the
+		//reserved value can only really be NaN.
+		const double special_values[8] = {inf, nan, nan, nan, -inf, 0, 0, 0};
+
+		inline double decode_float(uint32_t raw)
+		{
+			uint32_t m = raw & 0xffffff;
+			int exponent = int8_t(raw >> 24);
+			int mantissa = int32_t(m << 8) >> 8;
+			uint32_t special = m - 0x7ffffe;
+
+			double v = scale(mantissa, exponent);
+			return (exponent == 0 && special < 5) ? special_values[special & 7] : v;
+		}
+
+		inline double decode_sfloat(uint16_t raw)
+		{
+			uint32_t m = raw & 0xfff;
+			int exponent = int16_t(raw) >> 12;
+			int mantissa = int32_t(m << 20) >> 20;
+			uint32_t special = m - 0x7fe;
+
+			double v = scale(mantissa, exponent);
+			return (exponent == 0 && special < 5) ? special_values[special & 7] : v;
+		}
+
+		inline uint32_t get_u32(const uint8_t* p)
+		{
+			return p[0] | (p[1] << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+		}
+
+		inline uint16_t get_u16(const uint8_t* p)
+		{
+			return p[0] | (p[1] << 8);
+		}
+	}
+
+	double bluetooth_float_to_double(uint32_t raw)
+	{
+		return decode_float(raw);
+	}
+
+	double bluetooth_sfloat_to_double(uint16_t raw)
+	{
+		return decode_sfloat(raw);
+	}
 
 	float bluetooth_float_to_IEEE754(const uint8_t* bytes)
 	{
-		int exponent = (int8_t)bytes[3];
+		return decode_float(get_u32(bytes));
+	}
 
-		int mantissa = (bytes[0]) | (bytes[1] << 8) | (bytes[2] << 16);
+	float bluetooth_sfloat_to_IEEE754(const uint8_t* bytes)
+	{
+		return decode_sfloat(get_u16(bytes));
+	}
 
-		if(mantissa > 0x080000)
-			mantissa = - (0x100000-mantissa);
+	void bluetooth_float_to_IEEE754(const uint8_t* bytes, size_t n, float* out)
+	{
+		for(size_t i=0; i < n; i++)
+			out[i] = decode_float(get_u32(bytes + 4*i));
+	}
 
+	void bluetooth_float_to_IEEE754(const uint8_t* bytes, size_t n, double* out)
+	{
+		for(size_t i=0; i < n; i++)
+			out[i] = decode_float(get_u32(bytes + 4*i));
+	}
 
-		return mantissa * pow(10, exponent);
+	void bluetooth_sfloat_to_IEEE754(const uint8_t* bytes, size_t n, float* out)
+	{
+		for(size_t i=0; i < n; i++)
+			out[i] = decode_sfloat(get_u16(bytes + 2*i));
+	}
 
+	void bluetooth_sfloat_to_IEEE754(const uint8_t* bytes, size_t n, double* out)
+	{
+		for(size_t i=0; i < n; i++)
+			out[i] = decode_sfloat(get_u16(bytes + 2*i));
 	}
 }
@@ -0,0 +1,330 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#include "blepp/gatt_values.h"
+#include "blepp/blestatemachine.h"
+#include "blepp/assigned_numbers.h"
+#include "blepp/float.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/*
+	The layouts of the characteristic values, written down once in the same
+	manner as blepp/att_schema.h. A value is a list of fields, each of which
+	is present either always or according to some of the bits in the flags,
+	which come first. The decoder for each characteristic is generated from
+	its list, so decoding is straight line code with a bounds check per
+	field and no allocation.
+*/
+namespace BLEPP
+{
+	const uint16_t HeartRateMeasurement::assigned_number;
+	const int HeartRateMeasurement::max_rr_intervals;
+	const uint16_t TemperatureMeasurement::assigned_number;
+	const uint16_t BatteryLevel::assigned_number;
+	const uint16_t CSCMeasurement::assigned_number;
+	const uint16_t RSCMeasurement::assigned_number;
+
+	namespace
+	{
+		////////////////////////////////////////////////////////////////////////////////
+		//
+		// Field types, all little endian
+		//
+
+		struct U8
+		{
+			typedef uint8_t type;
+			static const int size=1;
+			static type get(const uint8_t* p) { return p[0]; }
+		};
+
+		struct U16
+		{
+			typedef uint16_t type;
+			static const int size=2;
+			static type get(const uint8_t* p) { return p[0] | (p[1] << 8); }
+		};
+
+		struct U24
+		{
+			typedef uint32_t type;
+			static const int size=3;
+			static type get(const uint8_t* p) { return p[0] | (p[1] << 8) | (uint32_t(p[2]) << 16); }
+		};
+
+		struct U32
+		{
+			typedef uint32_t type;
+			static const int size=4;
+			static type get(const uint8_t* p) { return p[0] | (p[1] << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+		};
+
+		//Sign extended from the top bit of the field.
+		template<class F> struct Signed
+		{
+			typedef int32_t type;
+			static const int size = F::size;
+			//Shift the sign bit to the top unsigned, since shifting into the
+			//sign bit of a (promoted) int is undefined, then back down signed.
+			static type get(const uint8_t* p) { return int32_t(uint32_t(F::get(p)) << (32 - 8*size)) >> (32 - 8*size); }
+		};
+
+		//IEEE-11073 32 bit FLOAT
+		struct Float32
+		{
+			typedef float type;
+			static const int size=4;
+			static type get(const uint8_t* p) { return bluetooth_float_to_IEEE754(p); }
+		};
+
+		struct DateTimeField
+		{
+			typedef DateTime type;
+			static const int size=7;
+			static type get(const uint8_t* p) { return {U16::get(p), p[2], p[3], p[4], p[5], p[6]}; }
+		};
+
+		////////////////////////////////////////////////////////////////////////////////
+		//
+		// Lists of fields
+		//
+
+		//A field which is present if (flags & Mask) == Value. It's decoded
+		//into Member of the value.
+		template<class F, uint8_t Mask, uint8_t Value, class T, class M, M T::*Member> struct Field
+		{
+			static bool decode(T& t, const uint8_t*& p, const uint8_t* end)
+			{
+				if((t.flags & Mask) != Value)
+					return true;
+				if(end - p < F::size)
+					return false;
+				t.*Member = F::get(p);
+				p += F::size;
+				return true;
+			}
+		};
+
+		//A field which is always present.
+		template<class F, class T, class M, M T::*Member> struct Field<F, 0, 0, T, M, Member>
+		{
+			static bool decode(T& t, const uint8_t*& p, const uint8_t* end)
+			{
+				if(end - p < F::size)
+					return false;
+				t.*Member = F::get(p);
+				p += F::size;
+				return true;
+			}
+		};
+
+		//As many fields as there are up to the end of the value, if
+		//(flags & Mask) is set. Ones which don't fit in the array are dropped.
+		template<class F, uint8_t Mask, class T, uint8_t T::*Count, class M, int N, M (T::*Array)[N]> struct Repeated
+		{
+			static bool decode(T& t, const uint8_t*& p, const uint8_t* end)
+			{
+				if(!(t.flags & Mask))
+					return true;
+				for(; end - p >= F::size; p += F::size)
+					if(t.*Count < N)
+						(t.*Array)[(t.*Count)++] = F::get(p);
+				return true;
+			}
+		};
+
+		template<class T, class... Fields> struct Layout;
+
+		template<class T> struct Layout<T>
+		{
+			static bool decode(T&, const uint8_t*&, const uint8_t*)
+			{
+				return true;
+			}
+		};
+
+		template<class T, class F, class... Rest> struct Layout<T, F, Rest...>
+		{
+			static bool decode(T& t, const uint8_t*& p, const uint8_t* end)
+			{
+				return F::decode(t, p, end) && Layout<T, Rest...>::decode(t, p, end);
+			}
+		};
+
+		#define MEMBER(T, M) decltype(T::M), &T::M
+
+		typedef HeartRateMeasurement HR;
+		typedef Layout<HR,
+			Field<U8,  0,    0,    HR, MEMBER(HR, flags)>,
+			Field<U8,  0x01, 0x00, HR, MEMBER(HR, bpm)>,
+			Field<U16, 0x01, 0x01, HR, MEMBER(HR, bpm)>,
+			Field<U16, 0x08, 0x08, HR, MEMBER(HR, energy_expended)>,
+			Repeated<U16, 0x10, HR, &HR::num_rr_intervals, uint16_t, HR::max_rr_intervals, &HR::rr_intervals>
+		> HeartRateLayout;
+
+		typedef TemperatureMeasurement TM;
+		typedef Layout<TM,
+			Field<U8,            0,    0,    TM, MEMBER(TM, flags)>,
+			Field<Float32,       0,    0,    TM, MEMBER(TM, temperature)>,
+			Field<DateTimeField, 0x02, 0x02, TM, MEMBER(TM, timestamp)>,
+			Field<U8,            0x04, 0x04, TM, MEMBER(TM, temperature_type)>
+		> TemperatureLayout;
+
+		typedef Layout<BatteryLevel,
+			Field<U8, 0, 0, BatteryLevel, MEMBER(BatteryLevel, level)>
+		> BatteryLevelLayout;
+
+		typedef CSCMeasurement CSC;
+		typedef Layout<CSC,
+			Field<U8,  0,    0,    CSC, MEMBER(CSC, flags)>,
+			Field<U32, 0x01, 0x01, CSC, MEMBER(CSC, cumulative_wheel_revolutions)>,
+			Field<U16, 0x01, 0x01, CSC, MEMBER(CSC, last_wheel_event_time)>,
+			Field<U16, 0x02, 0x02, CSC, MEMBER(CSC, cumulative_crank_revolutions)>,
+			Field<U16, 0x02, 0x02, CSC, MEMBER(CSC, last_crank_event_time)>
+		> CSCLayout;
+
+		typedef RSCMeasurement RSC;
+		typedef Layout<RSC,
+			Field<U8,  0,    0,    RSC, MEMBER(RSC, flags)>,
+			Field<U16, 0,    0,    RSC, MEMBER(RSC, speed)>,
+			Field<U8,  0,    0,    RSC, MEMBER(RSC, cadence)>,
+			Field<U16, 0x01, 0x01, RSC, MEMBER(RSC, stride_length)>,
+			Field<U32, 0x02, 0x02, RSC, MEMBER(RSC, total_distance)>
+		> RSCLayout;
+
+		#undef MEMBER
+
+		template<class L, class T> bool decode_with(const uint8_t* begin, const uint8_t* end, T& value)
+		{
+			value = T();
+			return L::decode(value, begin, end);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////
+		//
+		// The registry
+		//
+
+		template<class T, ValueType Type, T CharacteristicValue::*Member> bool decode_value(const uint8_t* begin, const uint8_t* end, CharacteristicValue& v)
+		{
+			v.type = Type;
+			return decode(begin, end, v.*Member);
+		}
+
+		template<class F> bool decode_integer(const uint8_t* begin, const uint8_t* end, CharacteristicValue& v)
+		{
+			v.type = ValueType::Integer;
+			v.integer = 0;
+			if(end - begin < F::size)
+				return false;
+			v.integer = F::get(begin);
+			return true;
+		}
+
+		struct RegisteredDecoder
+		{
+			uint16_t assigned_number;
+			ValueDecoder decoder;
+		};
+
+		//Sorted by assigned number.
+		const RegisteredDecoder decoders[] = {
+			{BatteryLevel::assigned_number,           {ValueType::BatteryLevel,           decode_value<BatteryLevel, ValueType::BatteryLevel, &CharacteristicValue::battery_level>}},
+			{TemperatureMeasurement::assigned_number, {ValueType::TemperatureMeasurement, decode_value<TemperatureMeasurement, ValueType::TemperatureMeasurement, &CharacteristicValue::temperature>}},
+			{0x2A1E /* Intermediate Temperature */,   {ValueType::TemperatureMeasurement, decode_value<TemperatureMeasurement, ValueType::TemperatureMeasurement, &CharacteristicValue::temperature>}},
+			{HeartRateMeasurement::assigned_number,   {ValueType::HeartRateMeasurement,   decode_value<HeartRateMeasurement, ValueType::HeartRateMeasurement, &CharacteristicValue::heart_rate>}},
+			{RSCMeasurement::assigned_number,         {ValueType::RSCMeasurement,         decode_value<RSCMeasurement, ValueType::RSCMeasurement, &CharacteristicValue::rsc>}},
+			{CSCMeasurement::assigned_number,         {ValueType::CSCMeasurement,         decode_value<CSCMeasurement, ValueType::CSCMeasurement, &CharacteristicValue::csc>}},
+		};
+
+		//For everything else which the assigned numbers say is a single integer.
+		const ValueDecoder integer_decoders[] = {
+			{ValueType::Integer, decode_integer<U8>},
+			{ValueType::Integer, decode_integer<U16>},
+			{ValueType::Integer, decode_integer<U24>},
+			{ValueType::Integer, decode_integer<U32>},
+			{ValueType::Integer, decode_integer<Signed<U8>>},
+			{ValueType::Integer, decode_integer<Signed<U16>>},
+			{ValueType::Integer, decode_integer<Signed<U24>>},
+			{ValueType::Integer, decode_integer<Signed<U32>>},
+		};
+	}
+
+	bool decode(const uint8_t* begin, const uint8_t* end, HeartRateMeasurement& value)
+	{
+		return decode_with<HeartRateLayout>(begin, end, value);
+	}
+
+	bool decode(const uint8_t* begin, const uint8_t* end, TemperatureMeasurement& value)
+	{
+		return decode_with<TemperatureLayout>(begin, end, value);
+	}
+
+	bool decode(const uint8_t* begin, const uint8_t* end, BatteryLevel& value)
+	{
+		return decode_with<BatteryLevelLayout>(begin, end, value);
+	}
+
+	bool decode(const uint8_t* begin, const uint8_t* end, CSCMeasurement& value)
+	{
+		return decode_with<CSCLayout>(begin, end, value);
+	}
+
+	bool decode(const uint8_t* begin, const uint8_t* end, RSCMeasurement& value)
+	{
+		return decode_with<RSCLayout>(begin, end, value);
+	}
+
+	const ValueDecoder* find_value_decoder(const UUID& uuid)
+	{
+		if(!uuid.is_short() || uuid.short_value() > 0xffff)
+			return nullptr;
+		uint16_t n = uuid.short_value();
+
+		auto i = lower_bound(begin(decoders), end(decoders), n, [](const RegisteredDecoder& d, uint16_t n)
+		{
+			return d.assigned_number < n;
+		});
+		if(i != end(decoders) && i->assigned_number == n)
+			return &i->decoder;
+
+		if(const AssignedNumber* a = lookup_characteristic(uuid))
+			switch(a->format)
+			{
+				case ValueFormat::UInt8: return integer_decoders + 0;
+				case ValueFormat::UInt16: return integer_decoders + 1;
+				case ValueFormat::UInt24: return integer_decoders + 2;
+				case ValueFormat::UInt32: return integer_decoders + 3;
+				case ValueFormat::SInt8: return integer_decoders + 4;
+				case ValueFormat::SInt16: return integer_decoders + 5;
+				case ValueFormat::SInt24: return integer_decoders + 6;
+				case ValueFormat::SInt32: return integer_decoders + 7;
+				default: break;
+			}
+
+		return nullptr;
+	}
+}
@@ -0,0 +1,885 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "blepp/gattserver.h"
+#include "blepp/att_schema.h"
+#include "blepp/logging.h"
+#include "blepp/pretty_printers.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/l2cap.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/hci_lib.h>
+
+using namespace std;
+
+namespace BLEPP
+{
+	//Callbacks can call back into the server, for example notify() from
+	//on_write. Clients which fail meanwhile are only removed once the
+	//outermost call has finished with them.
+	struct BLEGATTServer::Busy
+	{
+		BLEGATTServer& s;
+
+		Busy(BLEGATTServer& s_)
+		:s(s_)
+		{
+			s.busy++;
+		}
+
+		~Busy()
+		{
+			if(--s.busy == 0)
+				s.reap();
+		}
+	};
+
+	BLEGATTServer::BLEGATTServer()
+	{
+	}
+
+	BLEGATTServer::~BLEGATTServer()
+	{
+		for(auto& c: client_list)
+			::close(c.fd);
+
+		if(listen_fd != -1)
+			::close(listen_fd);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// The database
+	//
+
+	static BLEGATTServer::Attribute make_attribute(uint16_t handle, const UUID& type, const uint8_t* value, int length, uint8_t permissions)
+	{
+		BLEGATTServer::Attribute a;
+		a.handle = handle;
+		a.type = type;
+		a.value.assign(value, value + length);
+		a.permissions = permissions;
+		a.group_end = handle;
+		a.is_ccc = false;
+		return a;
+	}
+
+	//UUIDs go over the air in their shortest form.
+	static int put_uuid(const bt_uuid_t& uuid, uint8_t* p)
+	{
+		if(uuid.type == BT_UUID16)
+		{
+			ATTSchema::UUID16::put(p, uuid);
+			return ATTSchema::UUID16::size;
+		}
+		else
+		{
+			bt_uuid_t u128;
+			bt_uuid_to_uuid128(&uuid, &u128);
+			ATTSchema::UUID128::put(p, u128);
+			return ATTSchema::UUID128::size;
+		}
+	}
+
+	static uint16_t next_handle(const vector<BLEGATTServer::Attribute>& db)
+	{
+		if(db.empty())
+			return 1;
+		else if(db.back().handle == 0xffff)
+			throw logic_error("BLEGATTServer: out of handles");
+		else
+			return db.back().handle + 1;
+	}
+
+	uint16_t BLEGATTServer::add_primary_service(const UUID& uuid)
+	{
+		uint8_t value[16];
+		int length = put_uuid(uuid, value);
+
+		uint16_t handle = next_handle(db);
+		db.push_back(make_attribute(handle, UUID(GATT_UUID_PRIMARY), value, length, Readable));
+		current_service = db.size() - 1;
+
+		return handle;
+	}
+
+	uint16_t BLEGATTServer::add_characteristic(const UUID& uuid, uint8_t flags, const vector<uint8_t>& value)
+	{
+		if(current_service == -1)
+			throw logic_error("BLEGATTServer: characteristic added before any service");
+
+		//The declaration is the flags, the value handle and the type (3.G.3.3.1)
+		uint16_t handle = next_handle(db);
+		uint16_t value_handle = handle + 1;
+		if(value_handle == 0)
+			throw logic_error("BLEGATTServer: out of handles");
+
+		uint8_t declaration[1 + 2 + 16];
+		declaration[0] = flags;
+		att_put_u16(value_handle, declaration + 1);
+		int length = 3 + put_uuid(uuid, declaration + 3);
+		db.push_back(make_attribute(handle, UUID(GATT_CHARACTERISTIC), declaration, length, Readable));
+
+		uint8_t permissions = 0;
+		if(flags & GATT_CHARACTERISTIC_FLAGS_READ)
+			permissions |= Readable;
+		if(flags & (GATT_CHARACTERISTIC_FLAGS_WRITE | GATT_CHARACTERISTIC_FLAGS_WRITE_WITHOUT_RESPONSE))
+			permissions |= Writable;
+		db.push_back(make_attribute(value_handle, uuid, value.data(), value.size(), permissions));
+
+		if(flags & (GATT_CHARACTERISTIC_FLAGS_NOTIFY | GATT_CHARACTERISTIC_FLAGS_INDICATE))
+		{
+			uint8_t zero[2] = {0, 0};
+			db.push_back(make_attribute(next_handle(db), UUID(GATT_CLIENT_CHARACTERISTIC_CONFIGURATION), zero, 2, Readable | Writable));
+			db.back().is_ccc = true;
+		}
+
+		db[current_service].group_end = db.back().handle;
+		return value_handle;
+	}
+
+	uint16_t BLEGATTServer::add_descriptor(const UUID& uuid, const vector<uint8_t>& value, uint8_t permissions)
+	{
+		if(current_service == -1 || db.back().handle == db[current_service].handle)
+			throw logic_error("BLEGATTServer: descriptor added before any characteristic");
+
+		uint16_t handle = next_handle(db);
+		db.push_back(make_attribute(handle, uuid, value.data(), value.size(), permissions));
+		db[current_service].group_end = handle;
+
+		return handle;
+	}
+
+	vector<BLEGATTServer::Attribute>::iterator BLEGATTServer::first_at_or_after(uint16_t handle)
+	{
+		return lower_bound(db.begin(), db.end(), handle, [](const Attribute& a, uint16_t h)
+		{
+			return a.handle < h;
+		});
+	}
+
+	BLEGATTServer::Attribute* BLEGATTServer::attribute(uint16_t handle)
+	{
+		auto a = first_at_or_after(handle);
+		if(a != db.end() && a->handle == handle)
+			return &*a;
+		else
+			return nullptr;
+	}
+
+	void BLEGATTServer::set_value(uint16_t handle, const uint8_t* data, int length)
+	{
+		Attribute* a = attribute(handle);
+		if(!a)
+			throw logic_error("BLEGATTServer: no attribute with handle " + to_hex(handle));
+
+		a->value.assign(data, data + length);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Clients
+	//
+
+	void BLEGATTServer::listen(const string& device)
+	{
+		int fd = ::socket(PF_BLUETOOTH, SOCK_SEQPACKET | SOCK_CLOEXEC, BTPROTO_L2CAP);
+		if(fd == -1)
+			throw SocketAllocationFailed(strerror(errno));
+
+		//Clients connect to the fixed ATT channel, like we do as a client.
+		sockaddr_l2 addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.l2_family = AF_BLUETOOTH;
+		addr.l2_cid = htobs(LE_ATT_CID);
+		addr.l2_bdaddr_type = BDADDR_LE_PUBLIC;
+
+		if(device != "")
+		{
+			int dev_id = hci_devid(device.c_str());
+			if(dev_id < 0)
+			{
+				::close(fd);
+				throw SocketBindFailed("Error obtaining HCI device ID");
+			}
+			hci_devba(dev_id, &addr.l2_bdaddr);
+		}
+
+		if(bind(fd, (sockaddr*)&addr, sizeof(addr)) == -1)
+		{
+			int e = errno;
+			::close(fd);
+			throw SocketBindFailed(strerror(e));
+		}
+
+		if(::listen(fd, 8) == -1)
+		{
+			int e = errno;
+			::close(fd);
+			throw SocketListenFailed(strerror(e));
+		}
+
+		if(listen_fd != -1)
+			::close(listen_fd);
+		listen_fd = fd;
+	}
+
+	int BLEGATTServer::accept()
+	{
+		int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if(fd == -1)
+		{
+			LOG(Warning, "accept failed: " << strerror(errno));
+			return -1;
+		}
+
+		add_client(fd);
+		return fd;
+	}
+
+	void BLEGATTServer::add_client(int fd)
+	{
+		Client c;
+		c.fd = fd;
+		c.mtu = ATT_DEFAULT_LE_MTU;
+		c.awaiting_confirmation = false;
+		c.dead = false;
+		c.dropped = 0;
+		client_list.push_back(c);
+
+		LOG(Info, "Client " << fd << " connected");
+	}
+
+	void BLEGATTServer::remove_client(int fd)
+	{
+		Busy b(*this);
+
+		if(Client* c = client(fd))
+			c->dead = true;
+	}
+
+	uint64_t BLEGATTServer::dropped_notifications(int fd)
+	{
+		Client* c = client(fd);
+		return c ? c->dropped : 0;
+	}
+
+	void BLEGATTServer::reap()
+	{
+		for(auto c = client_list.begin(); c != client_list.end(); )
+			if(c->dead)
+			{
+				int fd = c->fd;
+				::close(fd);
+				c = client_list.erase(c);
+
+				LOG(Info, "Client " << fd << " disconnected");
+				if(cb_disconnected)
+					cb_disconnected(fd);
+			}
+			else
+				++c;
+	}
+
+	vector<int> BLEGATTServer::clients() const
+	{
+		vector<int> fds;
+		for(const auto& c: client_list)
+			if(!c.dead)
+				fds.push_back(c.fd);
+		return fds;
+	}
+
+	BLEGATTServer::Client* BLEGATTServer::client(int fd)
+	{
+		for(auto& c: client_list)
+			if(c.fd == fd)
+				return &c;
+		return nullptr;
+	}
+
+	uint16_t BLEGATTServer::ccc_value(const Client& c, uint16_t handle) const
+	{
+		for(const auto& h: c.ccc)
+			if(h.first == handle)
+				return h.second;
+		return 0;
+	}
+
+	pair<const uint8_t*, const uint8_t*> BLEGATTServer::value_of(Client& c, Attribute& a, uint8_t* ccc)
+	{
+		if(a.is_ccc)
+		{
+			att_put_u16(ccc_value(c, a.handle), ccc);
+			return make_pair(ccc, ccc + 2);
+		}
+
+		if(a.on_read)
+			a.on_read(c.fd, a);
+
+		return make_pair(a.value.data(), a.value.data() + a.value.size());
+	}
+
+	//Returns 1 if the PDU went, 0 if the socket is full and -1 if the client
+	//has failed, in which case it's marked dead.
+	static int try_send(int fd, const uint8_t* pdu, int length)
+	{
+		for(;;)
+		{
+			ssize_t n = ::send(fd, pdu, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if(n == length)
+				return 1;
+			else if(n >= 0)
+			{
+				//Sockets carrying ATT keep packet boundaries, so this shouldn't
+				//happen, but if it does the PDU is lost.
+				LOG(Warning, "Dropping client " << fd << ": short write of " << n << " of " << length << " bytes");
+				return -1;
+			}
+			else if(errno == EINTR)
+				continue;
+			else if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+				return 0;
+
+			LOG(Warning, "Dropping client " << fd << ": " << strerror(errno));
+			return -1;
+		}
+	}
+
+	bool BLEGATTServer::send(Client& c, const uint8_t* pdu, int length, bool droppable)
+	{
+		if(c.dead)
+			return false;
+
+		//Nothing can overtake what's already waiting.
+		int r = c.unsent.empty() ? try_send(c.fd, pdu, length) : 0;
+		if(r == 1)
+			return true;
+		else if(r == -1)
+		{
+			c.dead = true;
+			return false;
+		}
+
+		//The socket is full, which is normal for a busy link. Notifications
+		//are unreliable anyway, so miss one out rather than hold everyone up.
+		if(droppable)
+		{
+			c.dropped++;
+			return false;
+		}
+
+		//Everything else waits for flush(), unless the client has stopped
+		//reading altogether.
+		if(c.unsent.size() >= max_unsent)
+		{
+			LOG(Warning, "Dropping client " << c.fd << ": " << c.unsent.size() << " PDUs waiting to be sent");
+			c.dead = true;
+			return false;
+		}
+
+		c.unsent.emplace_back(pdu, pdu + length);
+		return true;
+	}
+
+	bool BLEGATTServer::write_unsent(Client& c)
+	{
+		while(!c.dead && !c.unsent.empty())
+		{
+			int r = try_send(c.fd, c.unsent.front().data(), c.unsent.front().size());
+			if(r == 0)
+				break;
+			else if(r == -1)
+				c.dead = true;
+			else
+				c.unsent.pop_front();
+		}
+
+		return !c.dead;
+	}
+
+	bool BLEGATTServer::has_unsent(int fd)
+	{
+		Client* c = client(fd);
+		return c && !c->dead && !c->unsent.empty();
+	}
+
+	bool BLEGATTServer::flush(int fd)
+	{
+		Busy b(*this);
+
+		Client* c = client(fd);
+		return c && write_unsent(*c);
+	}
+
+	void BLEGATTServer::send_error(Client& c, uint8_t opcode, uint16_t handle, uint8_t error)
+	{
+		uint8_t pdu[ATTSchema::ErrorResp::size];
+		enc_error_resp(opcode, handle, error, pdu, sizeof(pdu));
+		send(c, pdu, sizeof(pdu));
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Requests
+	//
+
+	bool BLEGATTServer::process(int fd)
+	{
+		Busy b(*this);
+
+		Client* c = client(fd);
+		if(!c || c->dead)
+			return false;
+
+		in.resize(max_mtu);
+		int len = recv(fd, in.data(), in.size(), MSG_DONTWAIT);
+
+		if(len == -1 && (errno == EAGAIN || errno == EINTR))
+			return true;
+		else if(len <= 0)
+		{
+			c->dead = true;
+			return false;
+		}
+
+		process(fd, in.data(), len);
+		return !c->dead;
+	}
+
+	void BLEGATTServer::process(int fd, const uint8_t* pdu, int length)
+	{
+		Busy b(*this);
+
+		Client* c = client(fd);
+		if(!c || c->dead || length < 1)
+			return;
+
+		vector<uint8_t> buf;
+		buf.swap(out);
+		buf.resize(max_mtu);
+
+		LOG(Debug, "Client " << fd << ": " << att_op2str(pdu[0]));
+
+		switch(pdu[0])
+		{
+			case ATT_OP_MTU_REQ:
+				mtu_exchange(*c, pdu, length);
+				break;
+			case ATT_OP_FIND_INFO_REQ:
+				find_information(*c, pdu, length, buf.data());
+				break;
+			case ATT_OP_FIND_BY_TYPE_REQ:
+				find_by_type_value(*c, pdu, length, buf.data());
+				break;
+			case ATT_OP_READ_BY_TYPE_REQ:
+				read_by_type(*c, pdu, length, buf.data());
+				break;
+			case ATT_OP_READ_REQ:
+				read(*c, pdu, length, buf.data());
+				break;
+			case ATT_OP_READ_BLOB_REQ:
+				read_blob(*c, pdu, length, buf.data());
+				break;
+			case ATT_OP_READ_BY_GROUP_REQ:
+				read_by_group_type(*c, pdu, length, buf.data());
+				break;
+			case ATT_OP_WRITE_REQ:
+				write(*c, pdu, length, false, buf.data());
+				break;
+			case ATT_OP_WRITE_CMD:
+				write(*c, pdu, length, true, buf.data());
+				break;
+			case ATT_OP_HANDLE_CNF:
+				confirmation(*c);
+				break;
+			default:
+				//Unknown commands are ignored (3.F.3.3)
+				if(!(pdu[0] & ATT_OP_CMD_FLAG))
+					send_error(*c, pdu[0], 0, ATT_ECODE_REQ_NOT_SUPP);
+		}
+
+		out.swap(buf);
+	}
+
+	void BLEGATTServer::mtu_exchange(Client& c, const uint8_t* pdu, int length)
+	{
+		uint16_t mtu;
+		if(!dec_mtu_req(pdu, length, &mtu))
+			return send_error(c, ATT_OP_MTU_REQ, 0, ATT_ECODE_INVALID_PDU);
+
+		//Both ends then use the smaller of the two (3.F.3.4.2.2)
+		c.mtu = max<int>(ATT_DEFAULT_LE_MTU, min(mtu, max_mtu));
+
+		uint8_t resp[ATTSchema::MTUResp::size];
+		enc_mtu_resp(max_mtu, resp, sizeof(resp));
+		send(c, resp, sizeof(resp));
+	}
+
+	void BLEGATTServer::find_information(Client& c, const uint8_t* pdu, int length, uint8_t* buf)
+	{
+		uint16_t start, end;
+		if(!dec_find_info_req(pdu, length, &start, &end))
+			return send_error(c, ATT_OP_FIND_INFO_REQ, 0, ATT_ECODE_INVALID_PDU);
+		if(start == 0 || start > end)
+			return send_error(c, ATT_OP_FIND_INFO_REQ, start, ATT_ECODE_INVALID_HANDLE);
+
+		typedef ATTSchema::FindInfoResp Header;
+		uint8_t* p = buf;
+		int size = Header::size;
+		uint8_t format = 0;
+
+		//The first attribute determines the format, and the response
+		//stops at the first one which doesn't match it.
+		for(auto a = first_at_or_after(start); a != db.end() && a->handle <= end; ++a)
+		{
+			uint8_t f = a->type.type() == BT_UUID16 ? ATT_FIND_INFO_RESP_FMT_16BIT : ATT_FIND_INFO_RESP_FMT_128BIT;
+			int elen = f == ATT_FIND_INFO_RESP_FMT_16BIT ? ATTSchema::FindInfoElement16::size : ATTSchema::FindInfoElement128::size;
+
+			if(format == 0)
+				format = f;
+			else if(f != format)
+				break;
+
+			if(size + elen > c.mtu)
+				break;
+
+			ATTSchema::FindInfoElement16::put<0>(p + size, a->handle);
+			put_uuid(a->type, p + size + 2);
+			size += elen;
+		}
+
+		if(format == 0)
+			return send_error(c, ATT_OP_FIND_INFO_REQ, start, ATT_ECODE_ATTR_NOT_FOUND);
+
+		Header::encode(p, c.mtu, format);
+		send(c, p, size);
+	}
+
+	void BLEGATTServer::find_by_type_value(Client& c, const uint8_t* pdu, int length, uint8_t* buf)
+	{
+		uint16_t start, end;
+		bt_uuid_t type;
+		size_t vlen;
+
+		//The value to find is checked in place, rather than copied out.
+		if(!dec_find_by_type_req(pdu, length, &start, &end, &type, nullptr, &vlen))
+			return send_error(c, ATT_OP_FIND_BY_TYPE_REQ, 0, ATT_ECODE_INVALID_PDU);
+		if(start == 0 || start > end)
+			return send_error(c, ATT_OP_FIND_BY_TYPE_REQ, start, ATT_ECODE_INVALID_HANDLE);
+
+		const uint8_t* value = pdu + ATTSchema::FindByTypeReq::size;
+
+		typedef ATTSchema::FindByTypeElement Element;
+		uint8_t* p = buf;
+		int size = ATTSchema::FindByTypeResp::size;
+		uint8_t ccc[2];
+		const UUID wanted = UUID::from(type);
+
+		for(auto a = first_at_or_after(start); a != db.end() && a->handle <= end && size + Element::size <= c.mtu; ++a)
+		{
+			if(a->type != wanted || !(a->permissions & Readable))
+				continue;
+
+			auto v = value_of(c, *a, ccc);
+			if((size_t)(v.second - v.first) != vlen || memcmp(v.first, value, vlen) != 0)
+				continue;
+
+			Element::put<0>(p + size, a->handle);
+			Element::put<1>(p + size, a->group_end);
+			size += Element::size;
+		}
+
+		if(size == ATTSchema::FindByTypeResp::size)
+			return send_error(c, ATT_OP_FIND_BY_TYPE_REQ, start, ATT_ECODE_ATTR_NOT_FOUND);
+
+		ATTSchema::FindByTypeResp::encode(p, c.mtu);
+		send(c, p, size);
+	}
+
+	void BLEGATTServer::read_by_type(Client& c, const uint8_t* pdu, int length, uint8_t* buf)
+	{
+		uint16_t start, end;
+		bt_uuid_t type;
+		if(!dec_read_by_type_req(pdu, length, &start, &end, &type))
+			return send_error(c, ATT_OP_READ_BY_TYPE_REQ, 0, ATT_ECODE_INVALID_PDU);
+		if(start == 0 || start > end)
+			return send_error(c, ATT_OP_READ_BY_TYPE_REQ, start, ATT_ECODE_INVALID_HANDLE);
+
+		typedef ATTSchema::ReadByTypeResp Header;
+		typedef ATTSchema::ReadByTypeElement Element;
+		uint8_t* p = buf;
+		int size = Header::size;
+		int elen = 0;
+		uint8_t ccc[2];
+
+		//Values are truncated to fit, and the response stops at the
+		//first one which is a different size to the first (3.F.3.4.4.2)
+		const int max_value = min(c.mtu - Header::size, 255) - Element::size;
+
+		const UUID wanted = UUID::from(type);
+		for(auto a = first_at_or_after(start); a != db.end() && a->handle <= end; ++a)
+		{
+			if(a->type != wanted)
+				continue;
+
+			if(!(a->permissions & Readable))
+			{
+				if(elen == 0)
+					return send_error(c, ATT_OP_READ_BY_TYPE_REQ, a->handle, ATT_ECODE_READ_NOT_PERM);
+				break;
+			}
+
+			auto v = value_of(c, *a, ccc);
+			int e = Element::size + min<int>(v.second - v.first, max_value);
+
+			if(elen == 0)
+				elen = e;
+			else if(e != elen || size + elen > c.mtu)
+				break;
+
+			Element::put<0>(p + size, a->handle);
+			memcpy(p + size + Element::size, v.first, elen - Element::size);
+			size += elen;
+		}
+
+		if(elen == 0)
+			return send_error(c, ATT_OP_READ_BY_TYPE_REQ, start, ATT_ECODE_ATTR_NOT_FOUND);
+
+		Header::encode(p, c.mtu, elen);
+		send(c, p, size);
+	}
+
+	void BLEGATTServer::read(Client& c, const uint8_t* pdu, int length, uint8_t* buf)
+	{
+		uint16_t handle;
+		if(!dec_read_req(pdu, length, &handle))
+			return send_error(c, ATT_OP_READ_REQ, 0, ATT_ECODE_INVALID_PDU);
+
+		Attribute* a = attribute(handle);
+		if(!a)
+			return send_error(c, ATT_OP_READ_REQ, handle, ATT_ECODE_INVALID_HANDLE);
+		if(!(a->permissions & Readable))
+			return send_error(c, ATT_OP_READ_REQ, handle, ATT_ECODE_READ_NOT_PERM);
+
+		uint8_t ccc[2];
+		auto v = value_of(c, *a, ccc);
+		int size = enc_read_resp(const_cast<uint8_t*>(v.first), v.second - v.first, buf, c.mtu);
+		send(c, buf, size);
+	}
+
+	void BLEGATTServer::read_blob(Client& c, const uint8_t* pdu, int length, uint8_t* buf)
+	{
+		uint16_t handle, offset;
+		if(!dec_read_blob_req(pdu, length, &handle, &offset))
+			return send_error(c, ATT_OP_READ_BLOB_REQ, 0, ATT_ECODE_INVALID_PDU);
+
+		Attribute* a = attribute(handle);
+		if(!a)
+			return send_error(c, ATT_OP_READ_BLOB_REQ, handle, ATT_ECODE_INVALID_HANDLE);
+		if(!(a->permissions & Readable))
+			return send_error(c, ATT_OP_READ_BLOB_REQ, handle, ATT_ECODE_READ_NOT_PERM);
+
+		uint8_t ccc[2];
+		auto v = value_of(c, *a, ccc);
+		if(offset > v.second - v.first)
+			return send_error(c, ATT_OP_READ_BLOB_REQ, handle, ATT_ECODE_INVALID_OFFSET);
+
+		int size = enc_read_blob_resp(const_cast<uint8_t*>(v.first), v.second - v.first, offset, buf, c.mtu);
+		send(c, buf, size);
+	}
+
+	void BLEGATTServer::read_by_group_type(Client& c, const uint8_t* pdu, int length, uint8_t* buf)
+	{
+		uint16_t start, end;
+		bt_uuid_t type;
+		if(!dec_read_by_grp_req(pdu, length, &start, &end, &type))
+			return send_error(c, ATT_OP_READ_BY_GROUP_REQ, 0, ATT_ECODE_INVALID_PDU);
+		if(start == 0 || start > end)
+			return send_error(c, ATT_OP_READ_BY_GROUP_REQ, start, ATT_ECODE_INVALID_HANDLE);
+
+		//Only services are groups.
+		const UUID primary(GATT_UUID_PRIMARY);
+		if(UUID::from(type) != primary)
+			return send_error(c, ATT_OP_READ_BY_GROUP_REQ, start, ATT_ECODE_UNSUPP_GRP_TYPE);
+
+		typedef ATTSchema::ReadByGroupResp Header;
+		typedef ATTSchema::ReadByGroupElement Element;
+		uint8_t* p = buf;
+		int size = Header::size;
+		int elen = 0;
+
+		for(auto a = first_at_or_after(start); a != db.end() && a->handle <= end; ++a)
+		{
+			if(a->type != primary)
+				continue;
+
+			int e = Element::size + a->value.size();
+			if(elen == 0)
+				elen = e;
+			else if(e != elen || size + elen > c.mtu)
+				break;
+
+			Element::put<0>(p + size, a->handle);
+			Element::put<1>(p + size, a->group_end);
+			memcpy(p + size + Element::size, a->value.data(), a->value.size());
+			size += elen;
+		}
+
+		if(elen == 0)
+			return send_error(c, ATT_OP_READ_BY_GROUP_REQ, start, ATT_ECODE_ATTR_NOT_FOUND);
+
+		Header::encode(p, c.mtu, elen);
+		send(c, p, size);
+	}
+
+	void BLEGATTServer::write(Client& c, const uint8_t* pdu, int length, bool command, uint8_t* buf)
+	{
+		uint16_t handle;
+		size_t vlen;
+		uint8_t* value = buf;
+		uint8_t opcode = command ? ATT_OP_WRITE_CMD : ATT_OP_WRITE_REQ;
+
+		//There are no responses to commands, even errors.
+		if(length > max_mtu || !(command ? dec_write_cmd : dec_write_req)(pdu, length, &handle, value, &vlen))
+			return command ? void() : send_error(c, opcode, 0, ATT_ECODE_INVALID_PDU);
+
+		Attribute* a = attribute(handle);
+		if(!a)
+			return command ? void() : send_error(c, opcode, handle, ATT_ECODE_INVALID_HANDLE);
+		if(!(a->permissions & Writable))
+			return command ? void() : send_error(c, opcode, handle, ATT_ECODE_WRITE_NOT_PERM);
+		if(a->is_ccc && vlen != 2)
+			return command ? void() : send_error(c, opcode, handle, ATT_ECODE_INVAL_ATTR_VALUE_LEN);
+
+		if(a->is_ccc)
+		{
+			uint16_t v = att_get_u16(value);
+			auto h = find_if(c.ccc.begin(), c.ccc.end(), [&](const pair<uint16_t, uint16_t>& x){ return x.first == handle; });
+			if(h == c.ccc.end())
+				c.ccc.push_back(make_pair(handle, v));
+			else
+				h->second = v;
+		}
+		else
+			a->value.assign(value, value + vlen);
+
+		//Respond before running the callbacks, since they may well send
+		//notifications about what has just been written.
+		if(!command)
+		{
+			uint8_t resp[ATTSchema::WriteResp::size];
+			enc_write_resp(resp, sizeof(resp));
+			send(c, resp, sizeof(resp));
+		}
+
+		int fd = c.fd;
+		if(a->is_ccc)
+		{
+			if(cb_subscribed)
+				cb_subscribed(fd, handle - 1, att_get_u16(value));
+		}
+		else if(a->on_write)
+			a->on_write(fd, *a);
+	}
+
+	void BLEGATTServer::confirmation(Client& c)
+	{
+		c.awaiting_confirmation = false;
+		send_next_indication(c);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Notifications
+	//
+
+	void BLEGATTServer::send_next_indication(Client& c)
+	{
+		if(c.awaiting_confirmation || c.indications.empty())
+			return;
+
+		send(c, c.indications.front().data(), c.indications.front().size());
+		c.indications.pop_front();
+		c.awaiting_confirmation = true;
+	}
+
+	int BLEGATTServer::notify(uint16_t value_handle, const uint8_t* data, int length)
+	{
+		Busy b(*this);
+
+		auto a = first_at_or_after(value_handle);
+		if(a == db.end() || a->handle != value_handle)
+			throw logic_error("BLEGATTServer: no attribute with handle " + to_hex(value_handle));
+
+		a->value.assign(data, data + length);
+
+		//add_characteristic() puts the configuration straight after the value.
+		if(a+1 == db.end() || !(a+1)->is_ccc)
+			return 0;
+		uint16_t ccc_handle = (a+1)->handle;
+
+		//Encode once and send to everyone. Values are truncated to the MTU (3.F.3.4.7.1).
+		//This may be called from on_read while a response is being built, so
+		//it has buffers of its own.
+		size_t vlen = min<size_t>(length, max_mtu - ATTSchema::Notification::size);
+		uint8_t* v = const_cast<uint8_t*>(data);
+		vector<uint8_t> notification(ATTSchema::Notification::size + vlen);
+		vector<uint8_t> indication(ATTSchema::Indication::size + vlen);
+
+		int notification_size = enc_notification(value_handle, v, vlen, notification.data(), notification.size());
+		enc_indication(value_handle, v, vlen, indication.data(), indication.size());
+
+		int sent=0;
+		for(auto& c: client_list)
+		{
+			uint16_t ccc = ccc_value(c, ccc_handle);
+			if(c.dead || ccc == 0)
+				continue;
+
+			bool delivered = false;
+			if(ccc & GATT_CLIENT_CHARACTERISTIC_CONFIGURATION_NOTIFY)
+				delivered = send(c, notification.data(), min<int>(notification_size, c.mtu), true);
+
+			if(ccc & GATT_CLIENT_CHARACTERISTIC_CONFIGURATION_INDICATE)
+			{
+				c.indications.push_back(indication);
+				c.indications.back().resize(min<int>(indication.size(), c.mtu));
+				send_next_indication(c);
+				delivered = !c.dead;
+			}
+
+			if(delivered)
+				sent++;
+		}
+
+		return sent;
+	}
+}
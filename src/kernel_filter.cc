@@ -0,0 +1,251 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "blepp/kernel_filter.h"
+#include "blepp/logging.h"
+
+#include <stdexcept>
+#include <cerrno>
+#include <sys/socket.h>
+
+using namespace std;
+
+namespace BLEPP
+{
+	namespace
+	{
+		//Where things are in an HCI event packet, as read from the socket,
+		//holding one advertising report.
+		enum Offsets
+		{
+			packet_type = 0,
+			event_code = 1,
+			subevent_code = 3,
+			num_reports = 4,
+			event_type = 5,
+			address_type = 6,
+			address = 7,
+			data = 14,
+		};
+
+		//A tiny assembler. Conditional jumps only reach 255 instructions,
+		//so those are kept local, and anything further goes through an
+		//unconditional jump to a label, fixed up at the end.
+		class Assembler
+		{
+			public:
+				enum Label
+				{
+					Accept,
+					Drop,
+					Matched,
+					Labels
+				};
+
+				void load_byte(uint32_t offset)
+				{
+					emit(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, offset));
+				}
+
+				void load_half(uint32_t offset)
+				{
+					emit(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, offset));
+				}
+
+				void load_word(uint32_t offset)
+				{
+					emit(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offset));
+				}
+
+				//A = A op k, or A op X if op includes BPF_X.
+				void alu(uint16_t op, uint32_t k=0)
+				{
+					emit(BPF_STMT(BPF_ALU | op, k));
+				}
+
+				void a_to_x()
+				{
+					emit(BPF_STMT(BPF_MISC | BPF_TAX, 0));
+				}
+
+				void x_to_a()
+				{
+					emit(BPF_STMT(BPF_MISC | BPF_TXA, 0));
+				}
+
+				void store(uint32_t m)
+				{
+					emit(BPF_STMT(BPF_ST, m));
+				}
+
+				void load_scratch(uint32_t m)
+				{
+					emit(BPF_STMT(BPF_LD | BPF_MEM, m));
+				}
+
+				//If A == k skip over the next jt instructions, else over jf.
+				void jump_if_equal(uint32_t k, uint8_t jt, uint8_t jf)
+				{
+					emit(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, k, jt, jf));
+				}
+
+				void jump(Label l)
+				{
+					fixups.emplace_back(code.size(), l);
+					emit(BPF_JUMP(BPF_JMP | BPF_JA, 0, 0, 0));
+				}
+
+				//Go to the label unless A == k.
+				void unless_equal(uint32_t k, Label l)
+				{
+					jump_if_equal(k, 1, 0);
+					jump(l);
+				}
+
+				void ret(uint32_t k)
+				{
+					emit(BPF_STMT(BPF_RET | BPF_K, k));
+				}
+
+				void place(Label l)
+				{
+					labels[l] = code.size();
+				}
+
+				vector<sock_filter> finish()
+				{
+					for(const auto& f: fixups)
+						code[f.first].k = labels[f.second] - f.first - 1;
+
+					if(code.size() > BPF_MAXINSNS)
+						throw length_error("Kernel filter of " + to_string(code.size()) + " instructions is too long");
+
+					return code;
+				}
+
+			private:
+				vector<sock_filter> code;
+				vector<pair<size_t, Label>> fixups;
+				size_t labels[Labels] = {};
+
+				void emit(const sock_filter& s)
+				{
+					code.push_back(s);
+				}
+		};
+	}
+
+	vector<sock_filter> KernelFilter::compile() const
+	{
+		Assembler a;
+
+		//Anything other than an LE meta event goes through.
+		a.load_byte(packet_type);
+		a.unless_equal(HCI_EVENT_PKT, Assembler::Accept);
+		a.load_byte(event_code);
+		a.unless_equal(EVT_LE_META_EVENT, Assembler::Accept);
+
+		a.load_byte(subevent_code);
+		a.unless_equal(subevent, Assembler::Drop);
+
+		if(subevent == EVT_LE_ADVERTISING_REPORT && (!event_types.empty() || !addresses.empty() || manufacturer))
+		{
+			a.load_byte(num_reports);
+			a.unless_equal(1, Assembler::Accept);
+
+			//Any of the event types.
+			if(!event_types.empty())
+			{
+				a.load_byte(event_type);
+				for(size_t i=0; i < event_types.size(); i++)
+					a.jump_if_equal(static_cast<uint8_t>(event_types[i]), event_types.size() - i, 0);
+				a.jump(Assembler::Drop);
+			}
+
+			//Any of the addresses. BPF loads are big endian, and the address
+			//comes least significant byte first. The first four bytes are
+			//compared in A, and the rest with the address type in X, so most
+			//addresses are passed over with one instruction.
+			if(!addresses.empty())
+			{
+				a.load_byte(address_type);
+				a.alu(BPF_LSH | BPF_K, 16);
+				a.a_to_x();
+				a.load_half(address + 4);
+				a.alu(BPF_OR | BPF_X);
+				a.a_to_x();
+				a.load_word(address);
+				a.store(0);
+
+				for(const auto& e: addresses)
+				{
+					const auto& b = e.address;
+					a.jump_if_equal(uint32_t(b[0]) << 24 | b[1] << 16 | b[2] << 8 | b[3], 0, 4);
+					a.x_to_a();
+					a.jump_if_equal(uint32_t(e.address_type) << 16 | b[4] << 8 | b[5], 0, 1);
+					a.jump(Assembler::Matched);
+					a.load_scratch(0);
+				}
+				a.jump(Assembler::Drop);
+				a.place(Assembler::Matched);
+			}
+
+			//Loads past the end of the packet drop it, so short adverts are
+			//dropped too.
+			if(manufacturer)
+			{
+				a.load_byte(data + manufacturer_offset + 1);
+				a.unless_equal(0xFF, Assembler::Drop);
+				a.load_half(data + manufacturer_offset + 2);
+				a.unless_equal((*manufacturer & 0xff) << 8 | *manufacturer >> 8, Assembler::Drop);
+			}
+		}
+
+		a.place(Assembler::Accept);
+		a.ret(0xffff);
+		a.place(Assembler::Drop);
+		a.ret(0);
+
+		return a.finish();
+	}
+
+	void KernelFilter::attach(int fd) const
+	{
+		vector<sock_filter> code = compile();
+		sock_fprog program;
+		program.len = code.size();
+		program.filter = code.data();
+
+		LOG(Debug, "Attaching kernel filter of " << code.size() << " instructions");
+
+		if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0)
+			throw HCIScanner::IOError("Attaching kernel filter", errno);
+	}
+
+	void KernelFilter::detach(int fd)
+	{
+		int dummy=0;
+		if(setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy)) < 0 && errno != ENOENT)
+			throw HCIScanner::IOError("Detaching kernel filter", errno);
+	}
+}
@@ -1,12 +1,23 @@
 #include "blepp/lescan.h"
 #include "blepp/pretty_printers.h"
 #include "blepp/gap.h"
+#include "blepp/assigned_numbers.h"
+#include "blepp/kernel_filter.h"
 
 #include <bluetooth/hci_lib.h>
 #include <string>
 #include <cstring>
 #include <cerrno>
 #include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+#include <cstdio>
+#include <cmath>
+#include <stdexcept>
+#include <poll.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -116,7 +127,37 @@ namespace BLEPP
 	}
 
 
+	namespace
+	{
+		int open_device(const string& device)
+		{
+			int	dev_id = 0;
+			if (device == "") {
+				//Get a route to any(?) BTLE adapter (?)
+				dev_id = hci_get_route(NULL);
+			}
+			else {
+				dev_id = hci_devid(device.c_str());
+			}
+			if (dev_id < 0) {
+				throw HCIScanner::HCIError("Error obtaining HCI device ID");
+			}
+			
+			//Open the device
+			int fd = hci_open_dev(dev_id);
+			if(fd < 0)
+				throw HCIScanner::IOError("Opening HCI device", errno);
+			return fd;
+		}
+	}
+
 	HCIScanner::HCIScanner(bool start_scan, FilterDuplicates filtering, ScanType st, string device)
+	:HCIScanner(start_scan, filtering, st, open_device(device))
+	{
+	}
+
+	HCIScanner::HCIScanner(bool start_scan, FilterDuplicates filtering, ScanType st, int fd)
+	:hci_fd(fd)
 	{
 		if(filtering == FilterDuplicates::Hardware || filtering == FilterDuplicates::Both)
 			hardware_filtering = true;
@@ -130,22 +171,6 @@ namespace BLEPP
 
 		scan_type=st;
 
-		int	dev_id = 0;
-		if (device == "") {
-			//Get a route to any(?) BTLE adapter (?)
-			dev_id = hci_get_route(NULL);
-		}
-		else {
-			dev_id = hci_devid(device.c_str());
-		}
-		if (dev_id < 0) {
-			throw HCIError("Error obtaining HCI device ID");
-		}
-		
-		//Open the device
-		//FIXME check errors
-		hci_fd.set(hci_open_dev(dev_id));
-
 		if(start_scan)
 			start();
 	}
@@ -156,86 +181,215 @@ namespace BLEPP
 
 	}
 
-	void HCIScanner::start()
+	ScanParameters ScanParameters::from_milliseconds(double interval, double window)
 	{
-		ENTER();
-		if(running)
-		{
-			LOG(Trace, "Scanner is already running");
-			return;
-		}
+		ScanParameters p;
+		p.interval = lround(interval / 0.625);
+		p.window = lround(window / 0.625);
+		return p;
+	}
 
-		//Cadged from the hcitool sources. No idea what
-		//these mean
-		uint16_t interval = htobs(0x0010);
-		uint16_t window = htobs(0x0010);
+	void ScanParameters::validate() const
+	{
+		if(interval < 0x0004 || interval > 0x4000)
+			throw invalid_argument("Scan interval " + to_hex(interval) + " out of range");
+		if(window < 0x0004 || window > interval)
+			throw invalid_argument("Scan window " + to_hex(window) + " out of range");
+		if(timeout <= 0)
+			throw invalid_argument("Scan command timeout must be positive");
+	}
 
-		//Address for the adapter (I think). Use a public address.
-		//other option is random. Works either way it seems.
-		uint8_t own_type = LE_PUBLIC_ADDRESS;
+	ScanScheduler::ScanScheduler(const ScanParameters& full, const AdaptiveScan& a, Clock::time_point now)
+	:current(full),max_window(full.window),adapt(a),period_start(now)
+	{
+		if(adapt.min_window < 0x0004 || adapt.min_window > max_window)
+			throw invalid_argument("Adaptive scan minimum window out of range");
+		if(adapt.period <= 0)
+			throw invalid_argument("Adaptive scan period must be positive");
+	}
 
-		//Don't use a whitelist (?)
-		uint8_t filter_policy = 0x00;
+	bool ScanScheduler::observe(unsigned r, unsigned d, Clock::time_point now)
+	{
+		reports += r;
+		dropped += d;
 
-		
-		//The 10,000 thing seems to be some sort of retry logic timeout
-		//thing. Number of miliseconds, but there are multiple tries
-		//where it gets reduced by 10ms each time. It's a bit odd.
-		int err = hci_le_set_scan_parameters(hci_fd, static_cast<int>(scan_type), interval, window,
-							own_type, filter_policy, 10000);
-		if(err < 0)
+		double elapsed = chrono::duration<double>(now - period_start).count();
+		if(elapsed < adapt.period)
+			return false;
+
+		rate = reports / elapsed;
+		uint16_t window = current.window;
+
+		if(dropped || rate < adapt.idle_rate)
+			window = max<int>(adapt.min_window, window / 2);
+		else if(rate > adapt.busy_rate)
+			window = min<int>(max_window, window * 2);
+
+		LOG(Debug, "Scan rate " << rate << "/s, " << dropped << " dropped, window " << to_hex(current.window) << " -> " << to_hex(window));
+
+		reports = 0;
+		dropped = 0;
+		period_start = now;
+
+		if(window == current.window)
+			return false;
+
+		current.window = window;
+		return true;
+	}
+
+	uint8_t HCIScanner::send_command(uint16_t ocf, const void* params, uint8_t length, vector<uint8_t>* reply)
+	{
+		uint16_t opcode = htobs(cmd_opcode_pack(OGF_LE_CTL, ocf));
+
+		vector<uint8_t> cmd(1 + HCI_COMMAND_HDR_SIZE + length);
+		cmd[0] = HCI_COMMAND_PKT;
+		cmd[1] = opcode & 0xff;
+		cmd[2] = opcode >> 8;
+		cmd[3] = length;
+		if(length)
+			memcpy(cmd.data() + 4, params, length);
+
+		LOG(Debug, "HCI command " << to_hex(cmd));
+
+		while(write(hci_fd, cmd.data(), cmd.size()) < 0)
+			if(errno != EAGAIN && errno != EINTR)
+				throw IOError("Sending HCI command", errno);
+
+		//Wait for the Command Complete or Command Status event for this
+		//command. The socket sees the controller's events for everyone, so
+		//others are ignored, except for adverts which are kept for later.
+		auto deadline = chrono::steady_clock::now() + chrono::milliseconds(scan_parameters.timeout);
+		for(;;)
 		{
-			if(errno != EIO)
-				throw IOError("Setting scan parameters", errno);
-			else
+			int left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+			if(left <= 0)
+				throw IOError("Waiting for HCI command " + to_hex(opcode), ETIMEDOUT);
+
+			pollfd pfd = {hci_fd, POLLIN, 0};
+			int n = poll(&pfd, 1, left);
+			if(n < 0)
 			{
-				//If the BLE device is already set to scanning, then we get an IO error. So
-				//try turning it off and trying again. This bad state would happen, if, to pick
-				//like a *totally* hypothetical example, the program segged-out during scanning
-				//and so never cleaned up properly.
-				LOG(LogLevels::Warning, "Received I/O error while setting scan parameters.");
-				LOG(LogLevels::Warning, "Switching off HCI scanner");
-				err = hci_le_set_scan_enable(hci_fd, 0x00, 0x00, 10000);
-				if(err < 0)
-					throw IOError("Error disabling scan:", errno);
-
-
-				err = hci_le_set_scan_parameters(hci_fd, static_cast<int>(scan_type), interval, window, own_type, filter_policy, 10000);
-				if(err < 0)
-					throw IOError("Error disabling scan:", errno);
+				//A signal isn't a reason to give up on the command, as
+				//hci_send_req() didn't. Wait out the rest of the time.
+				if(errno == EINTR)
+					continue;
 				else
-					LOG(LogLevels::Warning, "Setting scan parameters worked this time.");
+					throw IOError("Waiting for HCI command", errno);
+			}
+			else if(n == 0)
+				continue;
 
+			vector<uint8_t> p;
+			try
+			{
+				p = read_with_retry();
+			}
+			catch(const Interrupted&)
+			{
+				continue;
+			}
+			if(p.size() < 3 || p[0] != HCI_EVENT_PKT)
+				continue;
 
+			if(p[1] == EVT_CMD_COMPLETE && p.size() >= 7 && (p[4] | p[5] << 8) == opcode)
+			{
+				if(reply)
+					reply->assign(p.begin() + 7, p.end());
+				return p[6];
+			}
+			else if(p[1] == EVT_CMD_STATUS && p.size() >= 7 && (p[5] | p[6] << 8) == opcode)
+			{
+				//Only a failure comes as a status for these commands.
+				if(p[3] != 0)
+					return p[3];
 			}
+			else if(p[1] == EVT_LE_META_EVENT)
+				held_packets.push_back(move(p));
 		}
+	}
 
-		LOG(LogLevels::Info, "Starting scanner");
-		scanned_devices.clear();
+	void HCIScanner::set_scan_enable(bool enable)
+	{
+		le_set_scan_enable_cp cp;
+		cp.enable = enable;
 
 		//Removal of duplicates done on the adapter itself
-		uint8_t filter_dup = hardware_filtering?0x01:0x00;
-		
-		
-		//Set up the filters. 
-		socklen_t olen = sizeof(old_filter);
-		if (getsockopt(hci_fd, SOL_HCI, HCI_FILTER, &old_filter, &olen) < 0) 
-			throw IOError("Getting HCI filter socket options", errno);
+		cp.filter_dup = enable && hardware_filtering;
 
-		
-		//Magic incantations to get scan events
-		struct hci_filter nf;
-		hci_filter_clear(&nf);
-		hci_filter_set_ptype(HCI_EVENT_PKT, &nf);
-		hci_filter_set_event(EVT_LE_META_EVENT, &nf);
-		if (setsockopt(hci_fd, SOL_HCI, HCI_FILTER, &nf, sizeof(nf)) < 0)
-			throw IOError("Setting HCI filter socket options", errno);
+		uint8_t status = send_command(OCF_LE_SET_SCAN_ENABLE, &cp, LE_SET_SCAN_ENABLE_CP_SIZE);
+		if(status)
+		{
+			LOG(LogLevels::Warning, "Controller status " << to_hex(status) << (enable?" enabling":" disabling") << " scan");
+			throw IOError(enable?"Enabling scan":"Error disabling scan:", EIO);
+		}
+	}
 
+	void HCIScanner::set_scan_parameters()
+	{
+		const ScanParameters& p = parameters();
+		le_set_scan_parameters_cp cp;
+		cp.type = static_cast<uint8_t>(scan_type);
+		cp.interval = htobs(p.interval);
+		cp.window = htobs(p.window);
+		cp.own_bdaddr_type = p.own_address_type;
+		cp.filter = hardware_accept ? 0x01 : p.filter_policy;
+
+		uint8_t status = send_command(OCF_LE_SET_SCAN_PARAMETERS, &cp, LE_SET_SCAN_PARAMETERS_CP_SIZE);
+		if(status)
+		{
+			//If the BLE device is already set to scanning, then the command is
+			//refused. So try turning it off and trying again. This bad state
+			//would happen, if, to pick like a *totally* hypothetical example, the
+			//program segged-out during scanning and so never cleaned up properly.
+			LOG(LogLevels::Warning, "Controller status " << to_hex(status) << " while setting scan parameters.");
+			LOG(LogLevels::Warning, "Switching off HCI scanner");
+			set_scan_enable(false);
+
+			status = send_command(OCF_LE_SET_SCAN_PARAMETERS, &cp, LE_SET_SCAN_PARAMETERS_CP_SIZE);
+			if(status)
+				throw IOError("Setting scan parameters", EIO);
+			else
+				LOG(LogLevels::Warning, "Setting scan parameters worked this time.");
+		}
+	}
 
-		//device disable/enable duplictes ????
-		err = hci_le_set_scan_enable(hci_fd, 0x01, filter_dup, 10000);
-		if(err < 0)
-			throw IOError("Enabling scan", errno);
+	void HCIScanner::start()
+	{
+		ENTER();
+		if(running)
+		{
+			LOG(Trace, "Scanner is already running");
+			return;
+		}
+
+		//Set up the filters to get scan events and the answers to commands.
+		//Stand-ins for the HCI socket, such as in the tests, have no filter.
+		int domain=0;
+		socklen_t dlen = sizeof(domain);
+		has_filter = getsockopt(hci_fd, SOL_SOCKET, SO_DOMAIN, &domain, &dlen) == 0 && domain == AF_BLUETOOTH;
+
+		if(has_filter)
+		{
+			socklen_t olen = sizeof(old_filter);
+			if (getsockopt(hci_fd, SOL_HCI, HCI_FILTER, &old_filter, &olen) < 0) 
+				throw IOError("Getting HCI filter socket options", errno);
+
+			struct hci_filter nf;
+			hci_filter_clear(&nf);
+			hci_filter_set_ptype(HCI_EVENT_PKT, &nf);
+			hci_filter_set_event(EVT_LE_META_EVENT, &nf);
+			hci_filter_set_event(EVT_CMD_COMPLETE, &nf);
+			hci_filter_set_event(EVT_CMD_STATUS, &nf);
+			if (setsockopt(hci_fd, SOL_HCI, HCI_FILTER, &nf, sizeof(nf)) < 0)
+				throw IOError("Setting HCI filter socket options", errno);
+		}
+
+		set_scan_parameters();
+
+		LOG(LogLevels::Info, "Starting scanner");
+		scanned_devices.clear();
+		set_scan_enable(true);
 
 		running=true;
 	}
@@ -249,19 +403,199 @@ namespace BLEPP
 		}
 
 		LOG(LogLevels::Info, "Cleaning up HCI scanner");
-		int err = hci_le_set_scan_enable(hci_fd, 0x00, 0x00, 10000);
+		set_scan_enable(false);
 
-		if(err < 0)
-			throw IOError("Error disabling scan:", errno);
-
-		err = setsockopt(hci_fd, SOL_HCI, HCI_FILTER, &old_filter, sizeof(old_filter));
-
-		if(err < 0)
+		if(has_filter && setsockopt(hci_fd, SOL_HCI, HCI_FILTER, &old_filter, sizeof(old_filter)) < 0)
 			throw IOError("Error resetting HCI socket:", errno);
 
 		running = false;
 	}
 
+	void HCIScanner::set_parameters(const ScanParameters& p)
+	{
+		p.validate();
+		scheduler.reset();
+		scan_parameters = p;
+		reconfigure();
+	}
+
+	void HCIScanner::reconfigure()
+	{
+		//The parameters can't be changed mid scan.
+		if(running)
+		{
+			set_scan_enable(false);
+			set_scan_parameters();
+			set_scan_enable(true);
+		}
+	}
+
+	const ScanParameters& HCIScanner::parameters() const
+	{
+		//The ones set by hand stay as they were, as the adaptive scan's limit.
+		if(scheduler)
+			return scheduler->parameters();
+		else
+			return scan_parameters;
+	}
+
+	void HCIScanner::set_adaptive(const AdaptiveScan& a)
+	{
+		//It starts again from the parameters last set, which may well
+		//not be the ones in use.
+		uint16_t window = parameters().window;
+		scheduler.reset(new ScanScheduler(scan_parameters, a));
+		dropped = 0;
+		if(parameters().window != window)
+			reconfigure();
+	}
+
+	void HCIScanner::set_filter(const AdvertFilter& f)
+	{
+		filter = f;
+	}
+
+	void HCIScanner::set_kernel_filter(const KernelFilter& f)
+	{
+		f.attach(hci_fd);
+	}
+
+	void HCIScanner::clear_kernel_filter()
+	{
+		KernelFilter::detach(hci_fd);
+	}
+
+	void HCIScanner::count_dropped(unsigned n)
+	{
+		dropped += n;
+	}
+
+	AcceptListEntry::AcceptListEntry(const string& a, uint8_t type)
+	:address_type(type)
+	{
+		unsigned int b[6];
+		int n=0;
+		if(sscanf(a.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x%n", b+5, b+4, b+3, b+2, b+1, b, &n) != 6 || n != 17 || a.size() != 17)
+			throw invalid_argument("Bad device address " + a);
+		copy(b, b+6, address.begin());
+	}
+
+	AcceptListEntry::AcceptListEntry(const uint8_t* a, uint8_t type)
+	:address_type(type)
+	{
+		copy(a, a+6, address.begin());
+	}
+
+	bool AcceptListEntry::operator<(const AcceptListEntry& e) const
+	{
+		return tie(address_type, address) < tie(e.address_type, e.address);
+	}
+
+	bool AcceptListEntry::operator==(const AcceptListEntry& e) const
+	{
+		return address_type == e.address_type && address == e.address;
+	}
+
+	int HCIScanner::accept_list_size()
+	{
+		if(controller_accept_list_size < 0)
+		{
+			vector<uint8_t> reply;
+			if(send_command(OCF_LE_READ_WHITE_LIST_SIZE, nullptr, 0, &reply) || reply.empty())
+				throw IOError("Reading the accept list size", EIO);
+			controller_accept_list_size = reply[0];
+		}
+		return controller_accept_list_size;
+	}
+
+	bool HCIScanner::accept_list_in_hardware() const
+	{
+		return hardware_accept;
+	}
+
+	void HCIScanner::accept_list_command(uint16_t ocf, const AcceptListEntry& e)
+	{
+		//Adding and removing take the same parameters.
+		le_add_device_to_white_list_cp cp;
+		cp.bdaddr_type = e.address_type;
+		copy(e.address.begin(), e.address.end(), cp.bdaddr.b);
+
+		if(send_command(ocf, &cp, LE_ADD_DEVICE_TO_WHITE_LIST_CP_SIZE))
+			throw IOError("Updating the accept list", EIO);
+	}
+
+	void HCIScanner::sync_accept_list()
+	{
+		vector<AcceptListEntry> removals, additions;
+		set_difference(controller_accept_list.begin(), controller_accept_list.end(), accept_list.begin(), accept_list.end(), back_inserter(removals));
+		set_difference(accept_list.begin(), accept_list.end(), controller_accept_list.begin(), controller_accept_list.end(), back_inserter(additions));
+
+		//Start again if that's fewer commands, or if there's no knowing
+		//what's on the list already.
+		if(!controller_accept_list_known || removals.size() + additions.size() > 1 + accept_list.size())
+		{
+			if(send_command(OCF_LE_CLEAR_WHITE_LIST, nullptr, 0))
+				throw IOError("Clearing the accept list", EIO);
+
+			controller_accept_list.clear();
+			controller_accept_list_known = true;
+			removals.clear();
+			additions.assign(accept_list.begin(), accept_list.end());
+		}
+
+		LOG(Debug, "Accept list: removing " << removals.size() << ", adding " << additions.size());
+
+		for(const auto& e: removals)
+		{
+			accept_list_command(OCF_LE_REMOVE_DEVICE_FROM_WHITE_LIST, e);
+			controller_accept_list.erase(e);
+		}
+
+		for(const auto& e: additions)
+		{
+			accept_list_command(OCF_LE_ADD_DEVICE_TO_WHITE_LIST, e);
+			controller_accept_list.insert(e);
+		}
+	}
+
+	void HCIScanner::set_accept_list(const vector<AcceptListEntry>& devices)
+	{
+		set<AcceptListEntry> wanted(devices.begin(), devices.end());
+
+		bool hardware = !wanted.empty() && int(wanted.size()) <= accept_list_size();
+		if(!wanted.empty() && !hardware)
+			LOG(Info, wanted.size() << " devices won't fit on the controller's accept list of " << accept_list_size() << ", so filtering in software");
+
+		//The list can't be changed while the scan is using it, and the
+		//filter policy can't be changed mid scan.
+		bool restart = running && (hardware || hardware_accept);
+		if(restart)
+			set_scan_enable(false);
+
+		accept_list = move(wanted);
+		hardware_accept = hardware;
+		software_accept = !hardware && !accept_list.empty();
+
+		if(hardware)
+			sync_accept_list();
+
+		if(restart)
+		{
+			set_scan_parameters();
+			set_scan_enable(true);
+		}
+	}
+
+	//Whether a packet could hold an advert from a device on the accept list,
+	//checked without parsing it. Only single reports are checked this way.
+	bool HCIScanner::accepted(const vector<uint8_t>& p) const
+	{
+		if(p.size() < 13 || p[1] != EVT_LE_META_EVENT || p[3] != EVT_LE_ADVERTISING_REPORT || p[4] != 1)
+			return true;
+		else
+			return accept_list.count(AcceptListEntry(p.data() + 7, p[6])) != 0;
+	}
+
 	int HCIScanner::get_fd() const
 	{
 		return hci_fd;
@@ -274,7 +608,7 @@ namespace BLEPP
 		{
 			stop();
 		}
-		catch(IOError)
+		catch(const Error&)
 		{
 		}
 	}
@@ -295,9 +629,16 @@ namespace BLEPP
 	}
 
 	vector<uint8_t> HCIScanner::read_with_retry()
+	{
+		vector<uint8_t> buf;
+		read_with_retry(buf);
+		return buf;
+	}
+
+	void HCIScanner::read_with_retry(vector<uint8_t>& buf)
 	{
 		int len;
-		std::vector<uint8_t> buf(HCI_MAX_EVENT_SIZE);
+		buf.resize(HCI_MAX_EVENT_SIZE);
 
 
 		while((len = read(hci_fd, buf.data(), buf.size())) < 0)
@@ -311,12 +652,79 @@ namespace BLEPP
 		}
 
 		buf.resize(len);
-		return buf;
+	}
+
+	bool HCIScanner::has_pending() const
+	{
+		return !held_packets.empty();
+	}
+
+	int HCIScanner::poll_timeout() const
+	{
+		if(has_pending())
+			return 0;
+		else if(!scheduler)
+			return -1;
+
+		//Rounded up, so the period has ended when poll returns.
+		auto d = scheduler->period_end() - ScanScheduler::Clock::now();
+		if(d <= d.zero())
+			return 0;
+		else
+			return chrono::duration_cast<chrono::milliseconds>(d + chrono::milliseconds(1) - chrono::nanoseconds(1)).count();
+	}
+
+	void HCIScanner::check_idle()
+	{
+		adapt(0);
+	}
+
+	bool HCIScanner::next_packet(vector<uint8_t>& packet)
+	{
+		if(held_packets.empty())
+			read_with_retry(packet);
+		else
+		{
+			packet = move(held_packets.front());
+			held_packets.pop_front();
+		}
+
+		//The answers to commands, ours or anyone else's.
+		if(packet.size() >= 2 && packet[0] == HCI_EVENT_PKT && (packet[1] == EVT_CMD_COMPLETE || packet[1] == EVT_CMD_STATUS))
+		{
+			LOG(Debug, "Ignoring command response " << to_hex(packet));
+			return false;
+		}
+		else
+			return true;
+	}
+
+	void HCIScanner::adapt(size_t reports)
+	{
+		if(scheduler && scheduler->observe(reports, dropped))
+		{
+			LOG(Info, "Adapting scan window to " << to_hex(scheduler->parameters().window));
+			reconfigure();
+		}
+		dropped = 0;
 	}
 
 	vector<AdvertisingResponse> HCIScanner::get_advertisements()
 	{
-		vector<AdvertisingResponse> adverts = parse_packet(read_with_retry());
+		vector<uint8_t> packet;
+		if(!next_packet(packet))
+			return {};
+
+		vector<AdvertisingResponse> adverts;
+		if(!software_accept || accepted(packet))
+			adverts = parse_packet(packet, filter);
+
+		if(software_accept)
+			adverts.erase(remove_if(adverts.begin(), adverts.end(), [&](const AdvertisingResponse& a){
+				return accept_list.count(AcceptListEntry(a.address, a.address_type)) == 0;
+			}), adverts.end());
+
+		adapt(adverts.size());
 		
 		if(software_filtering)
 		{
@@ -338,6 +746,61 @@ namespace BLEPP
 			return adverts;
 	}
 
+	namespace
+	{
+		//Decode the beacon frames straight from the packet, without going
+		//via an AdvertisingResponse.
+		size_t parse_beacon_reports(const vector<uint8_t>& p, vector<BeaconReport>& beacons, const AdvertFilter& filter, const set<AcceptListEntry>* accept)
+		{
+			if(p.size() < 5 || p[0] != HCI_EVENT_PKT || p[1] != EVT_LE_META_EVENT || p[3] != EVT_LE_ADVERTISING_REPORT)
+				return 0;
+
+			//Each report is: event type, address type, address (6),
+			//length, data, RSSI.
+			const uint8_t* r = p.data() + 5;
+			const uint8_t* end = p.data() + p.size();
+			size_t n=0;
+
+			for(int i=0; i < p[4] && end - r >= 10 && end - r >= 10 + r[8]; i++)
+			{
+				RawAdvert a{r[0], r[1], r + 2, r + 9, r[8], int8_t(r[9 + r[8]])};
+				r += 10 + r[8];
+
+				if(accept && accept->count(AcceptListEntry(a.address, a.address_type)) == 0)
+					continue;
+				if(!filter.accepts_all() && !filter(a))
+					continue;
+
+				BeaconReport b;
+				if(find_beacon(a.data, a.length, b.beacon))
+				{
+					copy(a.address, a.address + 6, b.address);
+					b.address_type = a.address_type;
+					b.rssi = a.rssi;
+					beacons.push_back(b);
+					n++;
+				}
+			}
+
+			return n;
+		}
+	}
+
+	size_t HCIScanner::parse_beacons(const vector<uint8_t>& packet, vector<BeaconReport>& beacons, const AdvertFilter& filter)
+	{
+		return parse_beacon_reports(packet, beacons, filter, nullptr);
+	}
+
+	size_t HCIScanner::get_beacons(vector<BeaconReport>& beacons)
+	{
+		if(!next_packet(packet_buffer))
+			return 0;
+
+		size_t n = parse_beacon_reports(packet_buffer, beacons, filter, software_accept ? &accept_list : nullptr);
+		adapt(n);
+		return n;
+	}
+
 	/*
 	   Hello comment-reader!
 
@@ -454,11 +917,16 @@ namespace BLEPP
 
 	*/
 
-	vector<AdvertisingResponse> parse_event_packet(Span packet);
-	vector<AdvertisingResponse> parse_le_meta_event(Span packet);
-	vector<AdvertisingResponse> parse_le_meta_event_advertisement(Span packet);
+	vector<AdvertisingResponse> parse_event_packet(Span packet, const AdvertFilter& filter);
+	vector<AdvertisingResponse> parse_le_meta_event(Span packet, const AdvertFilter& filter);
+	vector<AdvertisingResponse> parse_le_meta_event_advertisement(Span packet, const AdvertFilter& filter);
 
 	vector<AdvertisingResponse> HCIScanner::parse_packet(const vector<uint8_t>& p)
+	{
+		return parse_packet(p, AdvertFilter());
+	}
+
+	vector<AdvertisingResponse> HCIScanner::parse_packet(const vector<uint8_t>& p, const AdvertFilter& filter)
 	{
 		Span  packet(p);
 		LOG(Debug, to_hex(p));
@@ -475,7 +943,7 @@ namespace BLEPP
 		if(packet_id == HCI_EVENT_PKT)
 		{
 			LOG(Debug, "Event packet received");
-			return parse_event_packet(packet);
+			return parse_event_packet(packet, filter);
 		}
 		else
 		{
@@ -484,7 +952,7 @@ namespace BLEPP
 		}
 	}
 
-	vector<AdvertisingResponse> parse_event_packet(Span packet)
+	vector<AdvertisingResponse> parse_event_packet(Span packet, const AdvertFilter& filter)
 	{
 		if(packet.size() < 2)
 			throw HCIScanner::HCIError("Truncated event packet");
@@ -501,7 +969,7 @@ namespace BLEPP
 			LOG(Info, "event_code = 0x" << hex << (int)event_code << ": Meta event" << dec);
 			LOGVAR(Info, length);
 
-			return parse_le_meta_event(packet);
+			return parse_le_meta_event(packet, filter);
 		}
 		else
 		{
@@ -512,14 +980,14 @@ namespace BLEPP
 	}
 
 
-	vector<AdvertisingResponse> parse_le_meta_event(Span packet)
+	vector<AdvertisingResponse> parse_le_meta_event(Span packet, const AdvertFilter& filter)
 	{
 		uint8_t subevent_code = packet.pop_front();
 
 		if(subevent_code == 0x02) // see big blob of comments above
 		{
 			LOG(Info, "subevent_code = 0x02: LE Advertising Report Event");
-			return parse_le_meta_event_advertisement(packet);
+			return parse_le_meta_event_advertisement(packet, filter);
 		}
 		else
 		{
@@ -528,7 +996,7 @@ namespace BLEPP
 		}
 	}
 
-	vector<AdvertisingResponse> parse_le_meta_event_advertisement(Span packet)
+	vector<AdvertisingResponse> parse_le_meta_event_advertisement(Span packet, const AdvertFilter& filter)
 	{
 		vector<AdvertisingResponse> ret;
 
@@ -562,19 +1030,7 @@ namespace BLEPP
 				LOG(Info, "Address type = 0x" << to_hex(address_type) << ": unknown");
 
 
-			string address;
-			for(int j=0; j < 6; j++)
-			{
-				ostringstream s;
-				s << hex << setw(2) << setfill('0') << (int) packet.pop_front();
-				if(j != 0)
-					s << ":";
-
-				address = s.str() + address;
-			}
-
-
-			LOGVAR(Info, address);
+			const uint8_t* address_bytes = packet.pop_front(6).begin();
 
 			uint8_t length = packet.pop_front();
 			LOGVAR(Info, length);
@@ -593,10 +1049,21 @@ namespace BLEPP
 			else
 				LOG(Info, "RSSI = " << to_hex((uint8_t)rssi) << " unknown");
 
+			//Unwanted adverts are dropped before anything is allocated.
+			if(!filter.accepts_all() && !filter(RawAdvert{uint8_t(event_type), address_type, address_bytes, data.begin(), data.size(), rssi}))
+			{
+				LOG(Debug, "Rejected by the filter");
+				continue;
+			}
+
+			string address = address_to_short_str(address_bytes);
+			LOGVAR(Info, address);
+
 			try{
 				AdvertisingResponse rsp;
 				rsp.address = address;
 				rsp.type = event_type;
+				rsp.address_type = address_type;
 				rsp.rssi = rssi;
 				rsp.raw_packet.push_back({data.begin(), data.end()});
 
@@ -605,6 +1072,7 @@ namespace BLEPP
 					LOGVAR(Debug, data.size());
 					LOG(Debug, "Packet = " << to_hex(data));
 					//Format is length, type, crap
+					const uint8_t* structure = data.begin();
 					int length = data.pop_front();
 					
 					LOGVAR(Debug, length);
@@ -669,12 +1137,25 @@ namespace BLEPP
 						chunk.pop_front();
 						rsp.manufacturer_specific_data.push_back({chunk.begin(), chunk.end()});
 						LOG(Info, "Manufacturer data: " << to_hex(chunk));
+
+						if(rsp.beacon.type == BeaconType::None)
+							decode(structure, length + 1, rsp.beacon);
+					}
+					else if(type == GAP::service_data_16_bit_UUID || type == GAP::service_data_32_bit_UUID || type == GAP::service_data_128_bit_UUID)
+					{
+						chunk.pop_front();
+						rsp.service_data.push_back({chunk.begin(), chunk.end()});
+						LOG(Info, "Service data: " << to_hex(chunk));
+
+						if(rsp.beacon.type == BeaconType::None)
+							decode(structure, length + 1, rsp.beacon);
 					}
 					else
 					{
 						rsp.unparsed_data_with_types.push_back({chunk.begin(), chunk.end()});
 
-						LOG(Info, "Unparsed chunk " << to_hex(chunk));
+						const AssignedNumber* ad_type = lookup_ad_type(type);
+						LOG(Info, "Unparsed chunk " << to_hex(chunk) << " (" << (ad_type ? ad_type->name : "unknown type") << ")");
 					}
 				}
 
@@ -691,7 +1172,7 @@ namespace BLEPP
 
 
 			}
-			catch(out_of_range r)
+			catch(const out_of_range&)
 			{
 				LOG(LogLevels::Error, "Corrupted data sent by device " << address);
 			}
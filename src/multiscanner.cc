@@ -0,0 +1,238 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "blepp/multiscanner.h"
+#include "blepp/logging.h"
+
+#include <cerrno>
+#include <poll.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace BLEPP
+{
+	namespace
+	{
+		//The same advert from the same device: address, type and contents.
+		string key(const AdvertisingResponse& a)
+		{
+			string k = a.address;
+			k += char(a.type);
+			for(const auto& r: a.raw_packet)
+				k.append(r.begin(), r.end());
+			return k;
+		}
+
+		//Rounded up, so the time has passed when poll returns.
+		int milliseconds_until(steady_clock::time_point t)
+		{
+			auto d = t - steady_clock::now();
+			if(d <= d.zero())
+				return 0;
+			else
+				return duration_cast<milliseconds>(d + milliseconds(1) - nanoseconds(1)).count();
+		}
+
+		//127 means the RSSI isn't available, so anything beats it.
+		int8_t best_rssi(int8_t a, int8_t b)
+		{
+			if(a == 127)
+				return b;
+			else if(b == 127)
+				return a;
+			else
+				return max(a, b);
+		}
+	}
+
+	MultiScanner::MultiScanner(double w)
+	:window(duration_cast<nanoseconds>(duration<double>(w)))
+	{
+	}
+
+	MultiScanner::MultiScanner(const vector<string>& devices, HCIScanner::FilterDuplicates filter, HCIScanner::ScanType type, double w)
+	:MultiScanner(w)
+	{
+		for(const auto& d: devices)
+			add_adapter(d, filter, type);
+	}
+
+	int MultiScanner::add_adapter(const string& device, HCIScanner::FilterDuplicates filter, HCIScanner::ScanType type, bool start)
+	{
+		adapters.emplace_back(new HCIScanner(start, filter, type, device));
+		return adapters.size() - 1;
+	}
+
+	int MultiScanner::add_adapter(int fd, HCIScanner::FilterDuplicates filter, HCIScanner::ScanType type, bool start)
+	{
+		adapters.emplace_back(new HCIScanner(start, filter, type, fd));
+		return adapters.size() - 1;
+	}
+
+	HCIScanner& MultiScanner::adapter(int i)
+	{
+		return *adapters.at(i);
+	}
+
+	int MultiScanner::num_adapters() const
+	{
+		return adapters.size();
+	}
+
+	void MultiScanner::start()
+	{
+		for(auto& a: adapters)
+			a->start();
+	}
+
+	void MultiScanner::stop()
+	{
+		for(auto& a: adapters)
+			a->stop();
+	}
+
+	vector<int> MultiScanner::get_fds() const
+	{
+		vector<int> fds;
+		for(const auto& a: adapters)
+			fds.push_back(a->get_fd());
+		return fds;
+	}
+
+	void MultiScanner::merge(int adapter, AdvertisingResponse&& a)
+	{
+		string k = key(a);
+		auto i = pending.find(k);
+
+		if(i == pending.end())
+		{
+			Pending p;
+			p.report.rssi.assign(adapters.size(), 127);
+			p.report.rssi[adapter] = a.rssi;
+			p.report.first_adapter = adapter;
+			p.report.sightings = 1;
+			p.report.advertisement = move(a);
+			p.closes = Clock::now() + window;
+
+			order.push_back(pending.emplace(move(k), move(p)).first);
+		}
+		else
+		{
+			//Adapters can be added while reports are open.
+			Report& r = i->second.report;
+			if(size_t(adapter) >= r.rssi.size())
+				r.rssi.resize(adapters.size(), 127);
+			r.rssi[adapter] = best_rssi(r.rssi[adapter], a.rssi);
+			r.advertisement.rssi = best_rssi(r.advertisement.rssi, a.rssi);
+			r.sightings++;
+		}
+	}
+
+	void MultiScanner::read(int adapter)
+	{
+		for(auto& a: adapters.at(adapter)->get_advertisements())
+			merge(adapter, move(a));
+	}
+
+	vector<MultiScanner::Report> MultiScanner::get_finished()
+	{
+		vector<Report> finished;
+		Clock::time_point now = Clock::now();
+
+		while(!order.empty() && order.front()->second.closes <= now)
+		{
+			finished.push_back(move(order.front()->second.report));
+			finished.back().rssi.resize(adapters.size(), 127);
+			pending.erase(order.front());
+			order.pop_front();
+		}
+
+		return finished;
+	}
+
+	vector<MultiScanner::Report> MultiScanner::flush()
+	{
+		vector<Report> all;
+		for(auto i: order)
+		{
+			all.push_back(move(i->second.report));
+			all.back().rssi.resize(adapters.size(), 127);
+		}
+		order.clear();
+		pending.clear();
+		return all;
+	}
+
+	vector<MultiScanner::Report> MultiScanner::get_advertisements(int timeout)
+	{
+		Clock::time_point deadline = Clock::now() + milliseconds(timeout);
+		vector<pollfd> fds;
+		for(int fd: get_fds())
+			fds.push_back({fd, POLLIN, 0});
+
+		for(;;)
+		{
+			vector<Report> finished = get_finished();
+			if(!finished.empty())
+				return finished;
+
+			//Wait until the deadline, or the next window closes, or an adapter
+			//wants attention without its socket becoming readable.
+			int wait = timeout < 0 ? -1 : milliseconds_until(deadline);
+			auto sooner = [&](int w)
+			{
+				if(w >= 0)
+					wait = wait < 0 ? w : min(wait, w);
+			};
+			if(!order.empty())
+				sooner(milliseconds_until(order.front()->second.closes));
+			for(const auto& a: adapters)
+				sooner(a->poll_timeout());
+
+			int n = poll(fds.data(), fds.size(), wait);
+			if(n < 0)
+			{
+				if(errno == EINTR)
+					throw HCIScanner::Interrupted("interrupted waiting for HCI packets");
+				else
+					throw HCIScanner::IOError("polling HCI devices", errno);
+			}
+
+			for(size_t i=0; i < fds.size(); i++)
+			{
+				if((fds[i].revents & POLLIN) || adapters[i]->has_pending())
+					read(i);
+				else
+					adapters[i]->check_idle();
+
+				//A hung up socket stays readable, so check this as well.
+				if(fds[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+					throw HCIScanner::IOError("HCI device " + to_string(i) + " has gone away", EPIPE);
+			}
+
+			if(timeout >= 0 && Clock::now() >= deadline)
+				return get_finished();
+		}
+	}
+}
@@ -0,0 +1,531 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "blepp/notification_log.h"
+#include "blepp/logging.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace BLEPP
+{
+	namespace
+	{
+		const uint32_t version = 1;
+		const char file_magic[8] = {'B', 'L', 'E', 'P', 'P', 'N', 'T', 'F'};
+
+		struct FileHeader
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t header_size;
+			int64_t created;
+			uint64_t reserved;
+		};
+
+		//Each record is a 20 byte header, unaligned, and then the payload:
+		//   stream (16 bits)
+		//   payload length (16 bits)
+		//   monotonic time in ns (64 bits)
+		//   kernel time in ns (64 bits)
+		//Stream 0 never appears, so zeros mark the end of a file whose last
+		//block was padded out by O_DIRECT. Stream 0xFFFF describes a stream:
+		//the payload is its ID, device, characteristic and label, separated
+		//by tabs.
+		const size_t record_header_size = 20;
+		const uint16_t definition_stream = 0xFFFF;
+
+		const size_t block_size = 4096;
+
+		string error_string(const string& what, const string& filename)
+		{
+			return what + " " + filename + ": " + strerror(errno);
+		}
+
+		vector<string> split(const string& s, char c)
+		{
+			vector<string> parts;
+			size_t start=0, end;
+			while((end = s.find(c, start)) != string::npos)
+			{
+				parts.push_back(s.substr(start, end - start));
+				start = end + 1;
+			}
+			parts.push_back(s.substr(start));
+			return parts;
+		}
+	}
+
+	void SequenceCounter::observe(const uint8_t* data, size_t length)
+	{
+		received++;
+		if(offset < 0)
+			return;
+
+		if(length < size_t(offset + size))
+		{
+			malformed++;
+			return;
+		}
+
+		uint32_t v=0;
+		for(int i=0; i < size; i++)
+			v |= uint32_t(data[offset + i]) << (8*i);
+
+		if(started)
+		{
+			//How far it's moved on, allowing for wrapping. Anything more
+			//than half way round is taken to be a step backwards.
+			uint64_t modulus = uint64_t(1) << (8*size);
+			uint64_t step = (v + modulus - last) % modulus;
+
+			if(step == 0 || step > modulus / 2)
+			{
+				out_of_order++;
+				return;
+			}
+			else if(step > 1)
+			{
+				gaps++;
+				missed += step - 1;
+			}
+		}
+
+		started = true;
+		last = v;
+	}
+
+
+
+	NotificationLogWriter::NotificationLogWriter(const string& prefix_, const NotificationLogOptions& options_)
+	:prefix(prefix_), options(options_)
+	{
+		if(options.buffer_size % block_size != 0 || options.buffer_size < (128 << 10))
+			throw invalid_argument("The notification log buffer must be a multiple of 4096, and at least 128k");
+
+		void* b;
+		if(posix_memalign(&b, block_size, options.buffer_size) != 0)
+			throw bad_alloc();
+		buffer = static_cast<uint8_t*>(b);
+
+		vector<string> existing = files(prefix);
+		if(!existing.empty())
+			file_number = strtoul(existing.back().c_str() + prefix.size() + 1, nullptr, 10) + 1;
+
+		try
+		{
+			open_file();
+		}
+		catch(...)
+		{
+			free(buffer);
+			throw;
+		}
+	}
+
+	NotificationLogWriter::~NotificationLogWriter()
+	{
+		try
+		{
+			close();
+		}
+		catch(const exception& e)
+		{
+			LOG(Error, "Failed to finish " << filename << ": " << e.what());
+		}
+		free(buffer);
+	}
+
+	string NotificationLogWriter::file_name(const string& prefix, unsigned n)
+	{
+		char number[16];
+		snprintf(number, sizeof(number), "-%06u", n);
+		return prefix + number + ".blepplog";
+	}
+
+	vector<string> NotificationLogWriter::files(const string& prefix)
+	{
+		vector<pair<unsigned long, string>> found;
+		glob_t g;
+		if(glob((prefix + "-*.blepplog").c_str(), 0, nullptr, &g) == 0)
+		{
+			for(size_t i=0; i < g.gl_pathc; i++)
+			{
+				string name = g.gl_pathv[i];
+				string number = name.substr(prefix.size() + 1, name.size() - prefix.size() - 10);
+				if(!number.empty() && number.find_first_not_of("0123456789") == string::npos)
+					found.emplace_back(strtoul(number.c_str(), nullptr, 10), name);
+			}
+		}
+		globfree(&g);
+
+		sort(found.begin(), found.end());
+		vector<string> names;
+		for(const auto& f: found)
+			names.push_back(f.second);
+		return names;
+	}
+
+	const string& NotificationLogWriter::file() const
+	{
+		return filename;
+	}
+
+	bool NotificationLogWriter::direct() const
+	{
+		return using_direct;
+	}
+
+	void NotificationLogWriter::open_file()
+	{
+		filename = file_name(prefix, file_number);
+		LOG(Info, "Logging to " << filename);
+
+		fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if(fd == -1)
+			throw NotificationLogError(error_string("Could not create", filename));
+
+		//Set afterwards, so that where the filesystem doesn't support it
+		//(tmpfs, for one) the file is still there to write normally.
+		using_direct = false;
+		if(options.direct)
+		{
+			int flags = fcntl(fd, F_GETFL);
+			if(flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) != -1)
+				using_direct = true;
+			else
+				LOG(Warning, "O_DIRECT isn't available for " << filename << ": " << strerror(errno));
+		}
+
+		used = 0;
+		file_offset = 0;
+		first_in_file = true;
+
+		FileHeader h{};
+		memcpy(h.magic, file_magic, sizeof(h.magic));
+		h.version = version;
+		h.header_size = sizeof(FileHeader);
+		timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		h.created = now.tv_sec * 1000000000ll + now.tv_nsec;
+		append(&h, sizeof(h));
+
+		for(const auto& s: streams)
+			append_definition(s);
+	}
+
+	void NotificationLogWriter::close_file()
+	{
+		write_out(true);
+
+		//Drop the padding after the last record.
+		int ret = 0;
+		if(using_direct)
+			ret = ftruncate(fd, file_offset + used);
+		::close(fd);
+		fd = -1;
+
+		if(ret == -1)
+			throw NotificationLogError(error_string("Could not truncate", filename));
+	}
+
+	//Write the buffer to the file. With O_DIRECT, writes have to be whole
+	//blocks, so a partial last block stays in the buffer to be written
+	//again, and it's only written now, padded with zeros, if all is set.
+	void NotificationLogWriter::write_out(bool all)
+	{
+		size_t whole = used, length = used;
+		if(using_direct)
+		{
+			whole = used / block_size * block_size;
+			length = whole;
+			if(all && used > whole)
+			{
+				length = whole + block_size;
+				memset(buffer + used, 0, length - used);
+			}
+		}
+
+		for(size_t done=0; done < length;)
+		{
+			ssize_t n = pwrite(fd, buffer + done, length - done, file_offset + done);
+			if(n == -1 && errno == EINTR)
+				continue;
+			if(n <= 0)
+				throw NotificationLogError(error_string("Could not write", filename));
+			done += n;
+		}
+
+		memmove(buffer, buffer + whole, used - whole);
+		file_offset += whole;
+		used -= whole;
+	}
+
+	void NotificationLogWriter::append(const void* data, size_t length)
+	{
+		if(used + length > options.buffer_size)
+			write_out(false);
+		memcpy(buffer + used, data, length);
+		used += length;
+	}
+
+	void NotificationLogWriter::append_record(uint16_t stream, const uint8_t* data, size_t length, int64_t monotonic_ns, int64_t kernel_ns)
+	{
+		uint8_t header[record_header_size];
+		uint16_t length16 = length;
+		memcpy(header, &stream, 2);
+		memcpy(header + 2, &length16, 2);
+		memcpy(header + 4, &monotonic_ns, 8);
+		memcpy(header + 12, &kernel_ns, 8);
+
+		if(used + record_header_size + length > options.buffer_size)
+			write_out(false);
+		memcpy(buffer + used, header, record_header_size);
+		if(length)
+			memcpy(buffer + used + record_header_size, data, length);
+		used += record_header_size + length;
+	}
+
+	void NotificationLogWriter::append_definition(const NotificationLogStream& s)
+	{
+		string text = to_string(s.id) + "\t" + s.device + "\t" + s.characteristic + "\t" + s.label;
+		append_record(definition_stream, reinterpret_cast<const uint8_t*>(text.data()), text.size(), 0, 0);
+	}
+
+	uint16_t NotificationLogWriter::add_stream(const string& device, const string& characteristic, const string& label)
+	{
+		for(const string* s: {&device, &characteristic, &label})
+			if(s->find_first_of("\t\n") != string::npos)
+				throw invalid_argument("Stream names can't contain tabs or newlines");
+		if(device.size() + characteristic.size() + label.size() > 60000)
+			throw invalid_argument("Stream names too long");
+		if(streams.size() + 1 >= definition_stream)
+			throw length_error("Too many streams");
+
+		streams.push_back(NotificationLogStream{uint16_t(streams.size() + 1), device, characteristic, label});
+		if(fd != -1)
+			append_definition(streams.back());
+		return streams.back().id;
+	}
+
+	void NotificationLogWriter::log(uint16_t stream, const uint8_t* data, size_t length, int64_t monotonic_ns, int64_t kernel_ns)
+	{
+		if(fd == -1)
+			throw NotificationLogError("Logging to " + filename + " is closed");
+		if(stream == 0 || stream > streams.size())
+			throw invalid_argument("No such stream");
+		if(length > 0xFFFF)
+			throw invalid_argument("Notification too long to log");
+
+		if(first_in_file)
+		{
+			first_in_file = false;
+			file_start_ns = monotonic_ns;
+		}
+		else if((options.rotate_bytes && file_offset + used + record_header_size + length > options.rotate_bytes) || (options.rotate_seconds > 0 && monotonic_ns - file_start_ns >= options.rotate_seconds * 1e9))
+		{
+			rotate();
+			first_in_file = false;
+			file_start_ns = monotonic_ns;
+		}
+
+		append_record(stream, data, length, monotonic_ns, kernel_ns);
+	}
+
+	void NotificationLogWriter::flush()
+	{
+		if(fd != -1)
+			write_out(true);
+	}
+
+	void NotificationLogWriter::rotate()
+	{
+		if(fd == -1)
+			throw NotificationLogError("Logging to " + filename + " is closed");
+
+		close_file();
+		file_number++;
+		open_file();
+	}
+
+	void NotificationLogWriter::close()
+	{
+		if(fd != -1)
+			close_file();
+	}
+
+
+
+	NotificationLogReader::NotificationLogReader(const string& filename)
+	{
+		int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd == -1)
+			throw NotificationLogError(error_string("Could not open", filename));
+
+		struct stat s;
+		if(fstat(fd, &s) == -1)
+		{
+			string err = error_string("Could not stat", filename);
+			::close(fd);
+			throw NotificationLogError(err);
+		}
+		size = s.st_size;
+
+		if(size < sizeof(FileHeader))
+		{
+			::close(fd);
+			throw NotificationLogError(filename + " is not a notification log");
+		}
+
+		void* m = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(m == MAP_FAILED)
+			throw NotificationLogError(error_string("Could not map", filename));
+		map = static_cast<const uint8_t*>(m);
+		madvise(m, size, MADV_SEQUENTIAL);
+
+		FileHeader h;
+		memcpy(&h, map, sizeof(h));
+		if(memcmp(h.magic, file_magic, sizeof(h.magic)) != 0 || h.header_size < sizeof(FileHeader) || h.header_size > size)
+		{
+			munmap(m, size);
+			throw NotificationLogError(filename + " is not a notification log");
+		}
+		if(h.version != version)
+		{
+			munmap(m, size);
+			throw NotificationLogError(filename + " is a notification log of an unknown version");
+		}
+		offset = h.header_size;
+
+		//The streams are described at the start, so they're known before
+		//the first notification is read.
+		for(;;)
+		{
+			size_t start = offset;
+			uint16_t stream, length;
+			const uint8_t* record = next_record(stream, length);
+			if(record == nullptr || stream != definition_stream)
+			{
+				offset = start;
+				ended_early = false;
+				break;
+			}
+			add_definition(record + record_header_size, length);
+		}
+	}
+
+	NotificationLogReader::~NotificationLogReader()
+	{
+		munmap(const_cast<uint8_t*>(map), size);
+	}
+
+	//The record at offset, moving past it. Null at the end.
+	const uint8_t* NotificationLogReader::next_record(uint16_t& stream, uint16_t& length)
+	{
+		size_t left = size - offset;
+		if(left < record_header_size)
+		{
+			ended_early = any_of(map + offset, map + size, [](uint8_t b){ return b != 0; });
+			offset = size;
+			return nullptr;
+		}
+
+		memcpy(&stream, map + offset, 2);
+		memcpy(&length, map + offset + 2, 2);
+
+		if(stream == 0)
+		{
+			offset = size;
+			return nullptr;
+		}
+		if(length > left - record_header_size)
+		{
+			ended_early = true;
+			offset = size;
+			return nullptr;
+		}
+
+		const uint8_t* record = map + offset;
+		offset += record_header_size + length;
+		return record;
+	}
+
+	void NotificationLogReader::add_definition(const uint8_t* text, size_t length)
+	{
+		vector<string> fields = split(string(text, text + length), '\t');
+		unsigned long id = fields.size() == 4 ? strtoul(fields[0].c_str(), nullptr, 10) : 0;
+		if(id == 0 || id >= definition_stream)
+		{
+			LOG(Warning, "Bad stream description in notification log");
+			return;
+		}
+
+		if(streams.size() <= id)
+			streams.resize(id + 1, NotificationLogStream{0, "", "", ""});
+		streams[id] = NotificationLogStream{uint16_t(id), fields[1], fields[2], fields[3]};
+	}
+
+	bool NotificationLogReader::next(Notification& n)
+	{
+		uint16_t stream, length;
+		while(const uint8_t* record = next_record(stream, length))
+		{
+			if(stream == definition_stream)
+			{
+				add_definition(record + record_header_size, length);
+				continue;
+			}
+
+			n.stream = stream;
+			memcpy(&n.monotonic_ns, record + 4, 8);
+			memcpy(&n.kernel_ns, record + 12, 8);
+			n.data = record + record_header_size;
+			n.length = length;
+			return true;
+		}
+		return false;
+	}
+
+	const NotificationLogStream* NotificationLogReader::stream(uint16_t id) const
+	{
+		if(id < streams.size() && streams[id].id == id && id != 0)
+			return &streams[id];
+		return nullptr;
+	}
+
+	bool NotificationLogReader::truncated() const
+	{
+		return ended_early;
+	}
+}
@@ -21,61 +21,136 @@
  */
 #include <blepp/pretty_printers.h>
 
-#include <sstream>
-#include <iomanip>
+#include <algorithm>
 using namespace std;
 
 namespace BLEPP
 {
+	static const char hex_digits[] = "0123456789abcdef";
 
-	std::string to_hex(const std::uint16_t& u)
+	char* to_hex_chars(char* out, std::uint8_t u)
 	{
-		stringstream os;
-		os << setw(4) << setfill('0') << hex << u;
-		return os.str();
+		out[0] = hex_digits[u >> 4];
+		out[1] = hex_digits[u & 15];
+		return out + 2;
 	}
 
-	std::string to_hex(const std::uint8_t& u)
+	char* to_hex_chars(char* out, std::uint16_t u)
 	{
-		stringstream os;
-		os << setw(2) << setfill('0') << hex << (int)u;
-		return os.str();
+		out = to_hex_chars(out, std::uint8_t(u >> 8));
+		return to_hex_chars(out, std::uint8_t(u));
 	}
 
-	std::string to_str(const std::uint8_t& u)
+	char* to_hex_chars(char* out, const std::uint8_t* d, int l)
 	{
-		if(u < 32 || u > 126)
-			return "\\x" + to_hex(u);
-		else
+		for(int i=0; i < l; i++)
 		{
-			char buf[] = {(char)u, 0};
-			return buf;
+			out = to_hex_chars(out, d[i]);
+			*out++ = ' ';
 		}
+		return out;
 	}
 
-	std::string to_str(const bt_uuid_t& uuid)
+	char* to_str_chars(char* out, const std::uint8_t* d, int l)
+	{
+		for(int i=0; i < l; i++)
+			if(d[i] < 32 || d[i] > 126)
+			{
+				*out++ = '\\';
+				*out++ = 'x';
+				out = to_hex_chars(out, d[i]);
+			}
+			else
+				*out++ = d[i];
+		return out;
+	}
+
+	char* to_str_chars(char* out, const bt_uuid_t& uuid)
 	{
-		//8 4 4 4 12
 		if(uuid.type == BT_UUID16)
-			return to_hex(uuid.value.u16);
+			return to_hex_chars(out, uuid.value.u16);
+		else if(uuid.type == BT_UUID32)
+		{
+			out = to_hex_chars(out, std::uint16_t(uuid.value.u32 >> 16));
+			return to_hex_chars(out, std::uint16_t(uuid.value.u32));
+		}
 		else if(uuid.type == BT_UUID128)
 		{
-			char s[] = "xoxoxoxo-xoxo-xoxo-xoxo-xoxoxoxoxoxo";
-			bt_uuid_to_string(&uuid, s, sizeof(s));
-			return s;
+			//Stored little endian, printed big endian as 8 4 4 4 12.
+			const std::uint8_t* d = uuid.value.u128.data;
+			for(int i=15; i >= 0; i--)
+			{
+				out = to_hex_chars(out, d[i]);
+				if(i == 12 || i == 10 || i == 8 || i == 6)
+					*out++ = '-';
+			}
+			return out;
 		}
 		else
-			return "uuid.wtf";
+		{
+			static const char wtf[] = "uuid.wtf";
+			memcpy(out, wtf, sizeof(wtf) - 1);
+			return out + sizeof(wtf) - 1;
+		}
+	}
+
+	char* address_to_chars(char* out, const std::uint8_t* address)
+	{
+		for(int i=5; i >= 0; i--)
+		{
+			out = to_hex_chars(out, address[i]);
+			if(i != 0)
+				*out++ = ':';
+		}
+		return out;
+	}
+
+	UUIDString to_short_str(const bt_uuid_t& uuid)
+	{
+		UUIDString s;
+		s.set_end(to_str_chars(s.data(), uuid));
+		return s;
+	}
 
+	AddressString address_to_short_str(const std::uint8_t* address)
+	{
+		AddressString s;
+		s.set_end(address_to_chars(s.data(), address));
+		return s;
+	}
+
+	//The string versions are all wrappers around the ones above.
+
+	std::string to_hex(const std::uint16_t& u)
+	{
+		char buf[4];
+		return string(buf, to_hex_chars(buf, u));
+	}
+
+	std::string to_hex(const std::uint8_t& u)
+	{
+		char buf[2];
+		return string(buf, to_hex_chars(buf, u));
+	}
+
+	std::string to_str(const std::uint8_t& u)
+	{
+		char buf[4];
+		return string(buf, to_str_chars(buf, &u, 1));
+	}
+
+	std::string to_str(const bt_uuid_t& uuid)
+	{
+		return to_short_str(uuid);
 	}
 
 	std::string to_hex(const std::uint8_t* d, int l)
 	{
-		stringstream os;
-		for(int i=0; i < l; i++)
-			os << to_hex(d[i]) << " ";
-		return os.str();
+		string s(3 * max(l, 0), ' ');
+		to_hex_chars(&s[0], d, l);
+		return s;
 	}
+
 	std::string to_hex(pair<const std::uint8_t*, int> d)
 	{
 		return to_hex(d.first, d.second);
@@ -88,15 +163,16 @@ namespace BLEPP
 
 	std::string to_str(const std::uint8_t* d, int l)
 	{
-		stringstream os;
-		for(int i=0; i < l; i++)
-			os << to_str(d[i]);
-		return os.str();
+		string s(4 * max(l, 0), ' ');
+		s.resize(to_str_chars(&s[0], d, l) - &s[0]);
+		return s;
 	}
+
 	std::string to_str(pair<const std::uint8_t*, int> d)
 	{
 		return to_str(d.first, d.second);
 	}
+
 	std::string to_str(pair<const std::uint8_t*, const std::uint8_t*> d)
 	{
 		return to_str(d.first, d.second - d.first);
@@ -106,5 +182,4 @@ namespace BLEPP
 	{
 		return to_str(v.data(), v.size());
 	}
-
 }
@@ -0,0 +1,528 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "blepp/recorder.h"
+#include "blepp/logging.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace BLEPP
+{
+	namespace
+	{
+		const uint32_t version = 1;
+		const uint32_t block_magic = 0x4b4c4250; //"PBLK"
+		const uint32_t index_magic = 0x58444e49; //"INDX"
+
+		struct FileHeader
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t header_size;
+			int64_t created;
+			uint64_t reserved;
+		};
+
+		struct BlockHeader
+		{
+			uint32_t magic;
+			uint32_t count;
+			int64_t first_time;
+			int64_t last_time;
+			uint32_t payload_size;
+			uint32_t size;
+		};
+
+		struct Trailer
+		{
+			uint64_t index_offset;
+			uint32_t blocks;
+			uint32_t magic;
+		};
+
+		const char file_magic[8] = {'B', 'L', 'E', 'P', 'P', 'R', 'E', 'C'};
+
+		//Every column starts on an 8 byte boundary.
+		size_t pad(size_t n)
+		{
+			return (n + 7) & ~size_t(7);
+		}
+
+		//Where the columns go in a block.
+		struct Layout
+		{
+			size_t times, addresses, rssis, event_types, payload_offsets, payload, size;
+
+			Layout(size_t count, size_t payload_size)
+			{
+				size_t o = sizeof(BlockHeader);
+				times = o;
+				o += pad(4 * count);
+				addresses = o;
+				o += 8 * count;
+				rssis = o;
+				o += pad(count);
+				event_types = o;
+				o += pad(count);
+				payload_offsets = o;
+				o += pad(4 * (count + 1));
+				payload = o;
+				o += pad(payload_size);
+				size = o;
+			}
+		};
+
+		string error_string(const string& what, const string& filename)
+		{
+			return what + " " + filename + ": " + strerror(errno);
+		}
+
+		int64_t to_microseconds(system_clock::time_point t)
+		{
+			return duration_cast<microseconds>(t.time_since_epoch()).count();
+		}
+
+		//The numbered segments with a prefix, in order.
+		vector<pair<unsigned, string>> find_segments(const string& prefix)
+		{
+			vector<pair<unsigned, string>> found;
+			glob_t g;
+			if(glob((prefix + "-*.blepp").c_str(), 0, nullptr, &g) == 0)
+			{
+				for(size_t i=0; i < g.gl_pathc; i++)
+				{
+					string name = g.gl_pathv[i];
+					string number = name.substr(prefix.size() + 1, name.size() - prefix.size() - 7);
+					if(!number.empty() && number.find_first_not_of("0123456789") == string::npos)
+						found.emplace_back(strtoul(number.c_str(), nullptr, 10), name);
+				}
+			}
+			globfree(&g);
+
+			sort(found.begin(), found.end());
+			return found;
+		}
+	}
+
+	AdvertRecorder::AdvertRecorder(const string& prefix_, size_t segment_size_, uint32_t block_adverts_)
+	:prefix(prefix_), segment_size(segment_size_), block_adverts(block_adverts_)
+	{
+		if(block_adverts == 0)
+			throw invalid_argument("Blocks must hold at least one advert");
+		if(segment_size < 65536)
+			throw invalid_argument("Segments must be at least 64k");
+
+		auto existing = find_segments(prefix);
+		if(!existing.empty())
+			segment_number = existing.back().first + 1;
+
+		payload_offsets.push_back(0);
+		open_segment();
+	}
+
+	AdvertRecorder::~AdvertRecorder()
+	{
+		try
+		{
+			close();
+		}
+		catch(const exception& e)
+		{
+			LOG(Error, "Failed to finish " << segment_filename << ": " << e.what());
+		}
+	}
+
+	string AdvertRecorder::segment_name(const string& prefix, unsigned n)
+	{
+		char number[16];
+		snprintf(number, sizeof(number), "-%06u", n);
+		return prefix + number + ".blepp";
+	}
+
+	const string& AdvertRecorder::segment() const
+	{
+		return segment_filename;
+	}
+
+	void AdvertRecorder::open_segment()
+	{
+		segment_filename = segment_name(prefix, segment_number);
+		LOG(Info, "Recording to " << segment_filename);
+
+		fd = open(segment_filename.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if(fd == -1)
+			throw RecordingError(error_string("Could not create", segment_filename));
+
+		//Reserve the whole segment now. Writing to a sparse mapping on a full
+		//disk raises SIGBUS, rather than anything we could report.
+		if(int e = posix_fallocate(fd, 0, segment_size))
+		{
+			errno = e;
+			string err = error_string("Could not reserve space for", segment_filename);
+			::close(fd);
+			fd = -1;
+			unlink(segment_filename.c_str());
+			throw RecordingError(err);
+		}
+
+		void* m = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(m == MAP_FAILED)
+		{
+			string err = error_string("Could not map", segment_filename);
+			::close(fd);
+			fd = -1;
+			throw RecordingError(err);
+		}
+		map = static_cast<uint8_t*>(m);
+
+		FileHeader h{};
+		memcpy(h.magic, file_magic, sizeof(h.magic));
+		h.version = version;
+		h.header_size = sizeof(FileHeader);
+		h.created = to_microseconds(Clock::now());
+		memcpy(map, &h, sizeof(h));
+
+		write_offset = sizeof(FileHeader);
+		index.clear();
+	}
+
+	void AdvertRecorder::close_segment()
+	{
+		Trailer t;
+		t.index_offset = write_offset;
+		t.blocks = index.size();
+		t.magic = index_magic;
+
+		if(!index.empty())
+			memcpy(map + write_offset, index.data(), index.size() * sizeof(IndexEntry));
+		size_t size = write_offset + index.size() * sizeof(IndexEntry);
+		memcpy(map + size, &t, sizeof(t));
+		size += sizeof(t);
+
+		munmap(map, segment_size);
+		map = nullptr;
+
+		int ret = ftruncate(fd, size);
+		::close(fd);
+		fd = -1;
+
+		if(ret == -1)
+			throw RecordingError(error_string("Could not truncate", segment_filename));
+		LOG(Info, "Finished " << segment_filename << ", " << size << " bytes");
+	}
+
+	//Room for blocks and the index and trailer which go after them.
+	size_t AdvertRecorder::space_left(size_t blocks) const
+	{
+		size_t needed = write_offset + blocks * sizeof(IndexEntry) + sizeof(Trailer);
+		return needed > segment_size ? 0 : segment_size - needed;
+	}
+
+	void AdvertRecorder::write_block()
+	{
+		uint32_t n = times.size();
+		if(n == 0)
+			return;
+
+		Layout l(n, payload.size());
+		if(l.size > space_left(index.size() + 1))
+		{
+			close_segment();
+			segment_number++;
+			open_segment();
+		}
+
+		uint8_t* b = map + write_offset;
+
+		uint32_t* time_offsets = reinterpret_cast<uint32_t*>(b + l.times);
+		for(uint32_t i=0; i < n; i++)
+			time_offsets[i] = times[i] - first_time;
+
+		memcpy(b + l.addresses, addresses.data(), 8 * n);
+		memcpy(b + l.rssis, rssis.data(), n);
+		memcpy(b + l.event_types, event_types.data(), n);
+		memcpy(b + l.payload_offsets, payload_offsets.data(), 4 * (n + 1));
+		memcpy(b + l.payload, payload.data(), payload.size());
+
+		//The header goes last, so a block is only found once it's all there.
+		BlockHeader h;
+		h.magic = block_magic;
+		h.count = n;
+		h.first_time = first_time;
+		h.last_time = last_time;
+		h.payload_size = payload.size();
+		h.size = l.size;
+		memcpy(b, &h, sizeof(h));
+
+		index.push_back(IndexEntry{write_offset, n, h.size, first_time, last_time});
+		write_offset += l.size;
+
+		times.clear();
+		addresses.clear();
+		rssis.clear();
+		event_types.clear();
+		payload_offsets.resize(1);
+		payload.clear();
+	}
+
+	void AdvertRecorder::record(const RawAdvert& a, Clock::time_point time)
+	{
+		if(fd == -1)
+			throw RecordingError("Recording to " + segment_filename + " is closed");
+
+		//The largest block which fits in an empty segment.
+		size_t largest = segment_size - sizeof(FileHeader) - sizeof(IndexEntry) - sizeof(Trailer);
+		if(Layout(1, a.length).size > largest)
+			throw invalid_argument("Advert too large to record");
+
+		//A block covers a time range, which is no more than a 32 bit
+		//offset in microseconds: over an hour.
+		int64_t t = to_microseconds(time);
+		if(!times.empty() && (times.size() == block_adverts || t < first_time || t - first_time > UINT32_MAX || Layout(times.size() + 1, payload.size() + a.length).size > largest))
+			write_block();
+
+		if(times.empty())
+			first_time = last_time = t;
+		last_time = max(last_time, t);
+
+		times.push_back(t);
+		array<uint8_t, 8> address{};
+		copy(a.address, a.address + 6, address.begin());
+		address[6] = a.address_type;
+		addresses.push_back(address);
+		rssis.push_back(a.rssi);
+		event_types.push_back(a.event_type);
+		payload.insert(payload.end(), a.data, a.data + a.length);
+		payload_offsets.push_back(payload.size());
+	}
+
+	void AdvertRecorder::record(const AdvertisingResponse& a, Clock::time_point time)
+	{
+		AcceptListEntry address(a.address, a.address_type);
+
+		RawAdvert r;
+		r.event_type = static_cast<uint8_t>(a.type);
+		r.address_type = a.address_type;
+		r.address = address.address.data();
+		r.data = a.raw_packet.empty() ? nullptr : a.raw_packet[0].data();
+		r.length = a.raw_packet.empty() ? 0 : a.raw_packet[0].size();
+		r.rssi = a.rssi;
+		record(r, time);
+	}
+
+	void AdvertRecorder::flush()
+	{
+		if(fd == -1)
+			return;
+
+		write_block();
+		if(msync(map, segment_size, MS_ASYNC) == -1)
+			throw RecordingError(error_string("Could not sync", segment_filename));
+	}
+
+	void AdvertRecorder::rotate()
+	{
+		if(fd == -1)
+			throw RecordingError("Recording to " + segment_filename + " is closed");
+
+		write_block();
+		close_segment();
+		segment_number++;
+		open_segment();
+	}
+
+	void AdvertRecorder::close()
+	{
+		if(fd == -1)
+			return;
+
+		write_block();
+		close_segment();
+	}
+
+
+
+	RecordingReader::RecordingReader(const string& filename)
+	{
+		int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd == -1)
+			throw RecordingError(error_string("Could not open", filename));
+
+		struct stat s;
+		if(fstat(fd, &s) == -1)
+		{
+			string err = error_string("Could not stat", filename);
+			::close(fd);
+			throw RecordingError(err);
+		}
+		map_size = s.st_size;
+
+		if(map_size < sizeof(FileHeader))
+		{
+			::close(fd);
+			throw RecordingError(filename + " is not a recording");
+		}
+
+		//The mapping outlives the file descriptor.
+		void* m = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(m == MAP_FAILED)
+			throw RecordingError(error_string("Could not map", filename));
+		map = static_cast<const uint8_t*>(m);
+		madvise(m, map_size, MADV_SEQUENTIAL);
+
+		FileHeader h;
+		memcpy(&h, map, sizeof(h));
+		if(memcmp(h.magic, file_magic, sizeof(h.magic)) != 0 || h.header_size != sizeof(FileHeader))
+		{
+			munmap(m, map_size);
+			throw RecordingError(filename + " is not a recording");
+		}
+		if(h.version != version)
+		{
+			munmap(m, map_size);
+			throw RecordingError(filename + " is a recording of an unknown version");
+		}
+
+		has_index = read_index();
+		if(!has_index)
+		{
+			LOG(Warning, filename << " has no index. Looking for its blocks.");
+			find_blocks();
+		}
+	}
+
+	RecordingReader::~RecordingReader()
+	{
+		munmap(const_cast<uint8_t*>(map), map_size);
+	}
+
+	const vector<RecordingReader::Block>& RecordingReader::blocks() const
+	{
+		return block_list;
+	}
+
+	size_t RecordingReader::size() const
+	{
+		return count;
+	}
+
+	bool RecordingReader::complete() const
+	{
+		return has_index;
+	}
+
+	//Check the block at offset, which must end by limit, and add it. Returns
+	//its size, or 0 if there isn't a good one there.
+	size_t RecordingReader::add_block(size_t offset, size_t limit)
+	{
+		if(offset % 8 != 0 || offset > limit || limit - offset < sizeof(BlockHeader))
+			return 0;
+
+		BlockHeader h;
+		memcpy(&h, map + offset, sizeof(h));
+		if(h.magic != block_magic || h.last_time < h.first_time)
+			return 0;
+
+		Layout l(h.count, h.payload_size);
+		if(l.size != h.size || l.size > limit - offset)
+			return 0;
+
+		const uint8_t* b = map + offset;
+		Block block;
+		block.size = h.count;
+		block.first_time = h.first_time;
+		block.last_time = h.last_time;
+		block.time_offsets = reinterpret_cast<const uint32_t*>(b + l.times);
+		block.addresses = b + l.addresses;
+		block.rssis = reinterpret_cast<const int8_t*>(b + l.rssis);
+		block.event_types = b + l.event_types;
+		block.payload_offsets = reinterpret_cast<const uint32_t*>(b + l.payload_offsets);
+		block.payload = b + l.payload;
+
+		//Otherwise the adverts could point outside the file.
+		if(block.payload_offsets[0] != 0 || block.payload_offsets[h.count] != h.payload_size)
+			return 0;
+		for(uint32_t i=0; i < h.count; i++)
+			if(block.payload_offsets[i] > block.payload_offsets[i+1])
+				return 0;
+
+		block_list.push_back(block);
+		count += h.count;
+		return l.size;
+	}
+
+	bool RecordingReader::read_index()
+	{
+		if(map_size < sizeof(FileHeader) + sizeof(Trailer))
+			return false;
+
+		Trailer t;
+		memcpy(&t, map + map_size - sizeof(t), sizeof(t));
+		if(t.magic != index_magic || t.index_offset < sizeof(FileHeader) || t.index_offset > map_size - sizeof(t) || (map_size - sizeof(t) - t.index_offset) != size_t(t.blocks) * sizeof(AdvertRecorder::IndexEntry))
+			return false;
+
+		for(uint32_t i=0; i < t.blocks; i++)
+		{
+			AdvertRecorder::IndexEntry e;
+			memcpy(&e, map + t.index_offset + i * sizeof(e), sizeof(e));
+			size_t size = add_block(e.offset, t.index_offset);
+			if(size == 0 || size != e.size || block_list.back().size != e.count)
+			{
+				block_list.clear();
+				count = 0;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void RecordingReader::find_blocks()
+	{
+		size_t offset = sizeof(FileHeader);
+		while(size_t size = add_block(offset, map_size))
+			offset += size;
+	}
+
+	vector<string> RecordingReader::segments(const string& prefix)
+	{
+		vector<string> names;
+		for(const auto& s: find_segments(prefix))
+			names.push_back(s.second);
+		return names;
+	}
+}
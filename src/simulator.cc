@@ -0,0 +1,343 @@
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "blepp/simulator.h"
+#include "blepp/logging.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+namespace BLEPP
+{
+	SimulatedPeripheral::SimulatedPeripheral()
+	:SimulatedPeripheral(Link())
+	{
+	}
+
+	SimulatedPeripheral::SimulatedPeripheral(const Link& l)
+	:link(l), rng(l.seed), uniform(0, 1), buf(65536), start(chrono::steady_clock::now())
+	{
+		to_peripheral.count = &pdus_to_peripheral;
+		to_central.count = &pdus_to_central;
+	}
+
+	SimulatedPeripheral::~SimulatedPeripheral()
+	{
+		disconnect();
+	}
+
+	void SimulatedPeripheral::disconnect()
+	{
+		for(Direction* d: {&to_peripheral, &to_central})
+		{
+			if(d->from != -1)
+				::close(d->from);
+			d->from = d->to = -1;
+			d->queue.clear();
+			d->event = -1;
+			d->used = 0;
+		}
+
+		if(server_fd != -1)
+			server.remove_client(server_fd);
+		server_fd = -1;
+	}
+
+	int SimulatedPeripheral::connect()
+	{
+		disconnect();
+
+		//central <-> link <-> server
+		int c[2], p[2];
+		if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, c) == -1)
+			throw runtime_error(string("socketpair: ") + strerror(errno));
+		if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, p) == -1)
+		{
+			int e = errno;
+			::close(c[0]);
+			::close(c[1]);
+			throw runtime_error(string("socketpair: ") + strerror(e));
+		}
+
+		to_peripheral.from = to_central.to = c[1];
+		to_central.from = to_peripheral.to = p[1];
+		to_peripheral.last = to_central.last = now();
+
+		server_fd = p[0];
+		server.add_client(server_fd);
+
+		return c[0];
+	}
+
+	void SimulatedPeripheral::notify_every(uint16_t value_handle, double period, function<vector<uint8_t>()> generate)
+	{
+		if(period <= 0)
+			throw logic_error("SimulatedPeripheral: the notification period must be positive");
+
+		Notifier n;
+		n.handle = value_handle;
+		n.period = period;
+		n.next = now() + period;
+		n.generate = generate;
+		notifiers.push_back(n);
+	}
+
+	void SimulatedPeripheral::stop_notifying()
+	{
+		notifiers.clear();
+	}
+
+	double SimulatedPeripheral::now() const
+	{
+		if(link.real_time)
+			return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		else
+			return simulated_now;
+	}
+
+	bool SimulatedPeripheral::idle() const
+	{
+		return to_peripheral.queue.empty() && to_central.queue.empty();
+	}
+
+	//Work out when a PDU sent at time t arrives. PDUs in one direction
+	//always arrive in the order they were sent.
+	double SimulatedPeripheral::schedule(Direction& d, double t)
+	{
+		double arrival;
+
+		if(link.connection_interval > 0)
+		{
+			//The first connection event at or after t, allowing for rounding.
+			long long e = ceil(t / link.connection_interval - 1e-9);
+			if(e > d.event)
+			{
+				d.event = e;
+				d.used = 0;
+			}
+
+			for(;;)
+			{
+				if(link.pdus_per_event > 0 && d.used >= link.pdus_per_event)
+				{
+					d.event++;
+					d.used = 0;
+					continue;
+				}
+
+				//A lost PDU still uses its slot.
+				d.used++;
+				if(link.loss > 0 && uniform(rng) < link.loss)
+				{
+					retransmissions++;
+					d.event++;
+					d.used = 0;
+					continue;
+				}
+				break;
+			}
+
+			arrival = d.event * link.connection_interval + link.latency;
+		}
+		else
+		{
+			arrival = t + link.latency;
+			while(link.loss > 0 && uniform(rng) < link.loss)
+			{
+				retransmissions++;
+				arrival += link.latency;
+			}
+		}
+
+		d.last = max(d.last, arrival);
+		return d.last;
+	}
+
+	//Pick up a PDU sent into the link. Returns true if there was one.
+	bool SimulatedPeripheral::receive(Direction& d)
+	{
+		if(d.from == -1)
+			return false;
+
+		ssize_t len = recv(d.from, buf.data(), buf.size(), MSG_DONTWAIT);
+
+		if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return false;
+		else if(len <= 0)
+		{
+			//One end has hung up, so hang up the other.
+			LOG(Info, "Simulated link closed");
+			disconnect();
+			return true;
+		}
+
+		Packet p;
+		p.deliver_at = schedule(d, now());
+		p.data.assign(buf.begin(), buf.begin() + len);
+		d.queue.push_back(move(p));
+		return true;
+	}
+
+	//Pass on the PDU at the front of the queue if it's due.
+	bool SimulatedPeripheral::deliver(Direction& d)
+	{
+		if(d.queue.empty() || d.queue.front().deliver_at > now())
+			return false;
+
+		const vector<uint8_t>& data = d.queue.front().data;
+		ssize_t len = send(d.to, data.data(), data.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return false;
+		else if(len < 0)
+		{
+			LOG(Info, "Simulated link closed: " << strerror(errno));
+			disconnect();
+			return true;
+		}
+
+		d.queue.pop_front();
+		(*d.count)++;
+		return true;
+	}
+
+	bool SimulatedPeripheral::fire_notifiers()
+	{
+		bool fired=false;
+		for(auto& n: notifiers)
+			while(n.next <= now())
+			{
+				vector<uint8_t> v = n.generate();
+				server.notify(n.handle, v.data(), v.size());
+				n.next += n.period;
+				fired = true;
+			}
+		return fired;
+	}
+
+	double SimulatedPeripheral::next_event() const
+	{
+		double next = numeric_limits<double>::infinity();
+
+		for(const Direction* d: {&to_peripheral, &to_central})
+			if(!d->queue.empty())
+				next = min(next, d->queue.front().deliver_at);
+
+		for(const auto& n: notifiers)
+			next = min(next, n.next);
+
+		return next;
+	}
+
+	bool SimulatedPeripheral::run(BLEGATTStateMachine& gatt, const function<bool()>& done, double timeout)
+	{
+		double deadline = now() + timeout;
+
+		for(;;)
+		{
+			short server_events = POLLIN;
+			if(server_fd != -1 && server.has_unsent(server_fd))
+				server_events |= POLLOUT;
+
+			pollfd fds[4] = {
+				{gatt.socket(), POLLIN, 0},
+				{server_fd, server_events, 0},
+				{to_peripheral.from, POLLIN, 0},
+				{to_central.from, POLLIN, 0},
+			};
+
+			bool progress=false;
+
+			if(poll(fds, 4, 0) > 0)
+			{
+				if(fds[0].revents)
+				{
+					gatt.read_and_process_next();
+					progress = true;
+				}
+
+				if((fds[1].revents & POLLOUT) && server_fd != -1)
+				{
+					if(!server.flush(server_fd))
+						server_fd = -1;
+					progress = true;
+				}
+
+				if((fds[1].revents & ~POLLOUT) && server_fd != -1)
+				{
+					if(!server.process(server_fd))
+						server_fd = -1;
+					progress = true;
+				}
+
+				progress |= receive(to_peripheral);
+				progress |= receive(to_central);
+			}
+
+			progress |= deliver(to_peripheral);
+			progress |= deliver(to_central);
+			progress |= fire_notifiers();
+
+			if(progress)
+				continue;
+
+			//Nothing is runnable until the next thing is due.
+			if(done())
+				return true;
+
+			double next = next_event();
+			if(next > deadline)
+				return done();
+
+			if(link.real_time)
+			{
+				int ms = ceil(max(0.0, next - now()) * 1000);
+				poll(fds, 4, ms);
+			}
+			else if(next > simulated_now)
+				simulated_now = next;
+			else
+			{
+				LOG(Warning, "Simulated link stalled");
+				return done();
+			}
+		}
+	}
+
+	bool SimulatedPeripheral::run_until_idle(BLEGATTStateMachine& gatt, double timeout)
+	{
+		return run(gatt, [&]()
+		{
+			return gatt.is_idle() && idle();
+		}, timeout);
+	}
+}
@@ -80,7 +80,7 @@ namespace BLEPP
 
 	int bt_uuid16_create(bt_uuid_t *btuuid, uint16_t value)
 	{
-		memset(btuuid, 0, sizeof(bt_uuid_t));
+		memset(static_cast<void*>(btuuid), 0, sizeof(bt_uuid_t));
 		btuuid->type = BT_UUID16;
 		btuuid->value.u16 = value;
 
@@ -89,7 +89,7 @@ namespace BLEPP
 
 	int bt_uuid32_create(bt_uuid_t *btuuid, uint32_t value)
 	{
-		memset(btuuid, 0, sizeof(bt_uuid_t));
+		memset(static_cast<void*>(btuuid), 0, sizeof(bt_uuid_t));
 		btuuid->type = BT_UUID32;
 		btuuid->value.u32 = value;
 
@@ -98,7 +98,7 @@ namespace BLEPP
 
 	int bt_uuid128_create(bt_uuid_t *btuuid, uint128_t value)
 	{
-		memset(btuuid, 0, sizeof(bt_uuid_t));
+		memset(static_cast<void*>(btuuid), 0, sizeof(bt_uuid_t));
 		btuuid->type = BT_UUID128;
 		btuuid->value.u128 = value;
 
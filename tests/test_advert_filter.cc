@@ -0,0 +1,214 @@
+#include <blepp/lescan.h>
+#include <blepp/advert_filter.h>
+#include <bluetooth/hci.h>
+#include <vector>
+#include <string>
+#include <random>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+//An LE Advertising Report event with one report, as read from the HCI socket.
+vector<uint8_t> report(uint8_t event_type, uint8_t addr_type, const vector<uint8_t>& ad, int8_t rssi=-68)
+{
+	vector<uint8_t> p = {HCI_EVENT_PKT, EVT_LE_META_EVENT, uint8_t(ad.size() + 12), 0x02, 1, event_type, addr_type, 0x0B, 0x57, 0x16, 0x21, 0x76, 0x7C, uint8_t(ad.size())};
+	for(uint8_t b: ad)
+		p.push_back(b);
+	p.push_back(rssi);
+	return p;
+}
+
+RawAdvert raw(const vector<uint8_t>& p)
+{
+	return RawAdvert{p[5], p[6], p.data() + 7, p.data() + 14, p[13], int8_t(p.back())};
+}
+
+//The same tests, done on the parsed advert.
+typedef function<bool(const AdvertisingResponse&)> Reference;
+
+Reference ref_uuid(const UUID& u)
+{
+	return [=](const AdvertisingResponse& a){ return find(a.UUIDs.begin(), a.UUIDs.end(), u) != a.UUIDs.end(); };
+}
+
+Reference ref_manufacturer(uint16_t m)
+{
+	return [=](const AdvertisingResponse& a){
+		for(const auto& d: a.manufacturer_specific_data)
+			if(d.size() >= 2 && (d[0] | d[1] << 8) == m)
+				return true;
+		return false;
+	};
+}
+
+Reference ref_name(const string& n)
+{
+	return [=](const AdvertisingResponse& a){ return a.local_name && a.local_name->name.compare(0, n.size(), n) == 0 && a.local_name->name.size() >= n.size(); };
+}
+
+Reference ref_rssi(int r)
+{
+	return [=](const AdvertisingResponse& a){ return a.rssi != 127 && a.rssi > r; };
+}
+
+Reference ref_address(const string& s)
+{
+	return [=](const AdvertisingResponse& a){ return a.address.compare(0, s.size(), s) == 0; };
+}
+
+int main()
+{
+	const vector<vector<uint8_t>> adverts = {
+		//Flags and a 128 bit service
+		report(0x00, 0x00, {0x02, 0x01, 0x06, 0x11, 0x06, 0x64, 0x97, 0x81, 0xD1, 0xED, 0xBA, 0x6B, 0xAC, 0x11, 0x4C, 0x9D, 0x34, 0x3E, 0x20, 0x09, 0x73}),
+
+		//Scan response with a name
+		report(0x04, 0x00, {0x17, 0x09, 'D', 'y', 'n', 'o', 'f', 'i', 't', ' ', 'I', 'n', 'c', ' ', 'D', 'O', 'T', 'S', ' ', 'x', 'x', 'x', 'x', '1'}),
+
+		//Apple manufacturer data
+		report(0x00, 0x01, {0x02, 0x01, 0x1A, 0x07, 0xFF, 0x4C, 0x00, 0x10, 0x02, 0x0A, 0x00}, -50),
+
+		//iBeacon
+		report(0x03, 0x01, {0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5}, -90),
+
+		//Eddystone UID
+		report(0x03, 0x01, {0x03, 0x03, 0xAA, 0xFE, 0x17, 0x16, 0xAA, 0xFE, 0x00, 0xEE, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x00, 0x00}, -75),
+
+		//16 bit services, TX power and a short name, with no RSSI
+		report(0x00, 0x00, {0x02, 0x01, 0x06, 0x05, 0x02, 0x0D, 0x18, 0x0F, 0x18, 0x02, 0x0A, 0x04, 0x05, 0x08, 'H', 'R', 'M', '1'}, 127),
+	};
+
+	auto matches = [&](const AdvertFilter& f){
+		string m;
+		for(const auto& p: adverts)
+			m += f(raw(p)) ? '1' : '0';
+		return m;
+	};
+
+	check(matches(AdvertFilter()) == "111111");
+	check(AdvertFilter().accepts_all());
+	check(matches(uuid_is(0xFEAA)) == "000010");
+	check(matches(uuid_is(0x180F)) == "000001");
+	check(matches(uuid_is(UUID("0000180d-0000-1000-8000-00805f9b34fb"))) == "000001");
+	check(matches(uuid_is("7309203e-349d-4c11-ac6b-baedd1819764"_uuid)) == "100000");
+	check(matches(uuid_is(0x1800)) == "000000");
+	check(matches(manufacturer_is(0x004C)) == "001100");
+	check(matches(name_starts_with("Dyno")) == "010000");
+	check(matches(name_starts_with("HRM")) == "000001");
+	check(matches(name_starts_with("HRM12")) == "000000");
+	check(matches(name_starts_with("")) == "010001");
+	check(matches(rssi_above(-80)) == "111010");
+	check(matches(rssi_above(-60)) == "001000");
+	check(matches(address_starts_with("7c:76:21")) == "111111");
+	check(matches(address_starts_with("7C:76:21:16:57:0B")) == "111111");
+	check(matches(address_starts_with("7c:77")) == "000000");
+
+	check(matches(uuid_is(0xFEAA) || manufacturer_is(0x004C)) == "001110");
+	check(matches(manufacturer_is(0x004C) && rssi_above(-80)) == "001000");
+	check(matches(!manufacturer_is(0x004C)) == "110011");
+	check(matches(!(uuid_is(0xFEAA) || manufacturer_is(0x004C)) && rssi_above(-100)) == "110000");
+	check(matches(AdvertFilter() && uuid_is(0xFEAA)) == "000010");
+	check(matches(!AdvertFilter()) == "000000");
+
+	//Service data on its own is enough.
+	vector<uint8_t> service_data = report(0x03, 0x01, {0x05, 0x16, 0xAA, 0xFE, 0x10, 0x00});
+	check(uuid_is(0xFEAA)(raw(service_data)));
+	check(!uuid_is(0xFEAB)(raw(service_data)));
+
+	//32 bit lists, and 16 bit services written out in full.
+	vector<uint8_t> list32 = report(0x00, 0x00, {0x05, 0x05, 0x0D, 0x18, 0x00, 0x00});
+	check(uuid_is(0x180D)(raw(list32)));
+	check(uuid_is(UUID::from_uuid32(0x180D))(raw(list32)));
+	vector<uint8_t> long_list = report(0x00, 0x00, {0x11, 0x07, 0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0x0D, 0x18, 0x00, 0x00});
+	check(uuid_is(0x180D)(raw(long_list)));
+	check(!uuid_is(0x180F)(raw(long_list)));
+
+	//Malformed data is rejected, not read past.
+	vector<uint8_t> truncated = report(0x00, 0x00, {0x03, 0x03, 0xAA, 0xFE, 0x09, 0xFF, 0x4C, 0x00});
+	check(uuid_is(0xFEAA)(raw(truncated)));
+	check(!manufacturer_is(0x004C)(raw(truncated)));
+
+	for(const char* bad: {"7", "7c:", "7c:7", "7c-76", "7g", "7c:76:21:16:57:0b:00", "7c::76"})
+	{
+		bool threw=false;
+		try
+		{
+			address_starts_with(bad);
+		}
+		catch(const invalid_argument&)
+		{
+			threw = true;
+		}
+		check(threw);
+	}
+
+	//Random expressions agree with the same tests on the parsed adverts.
+	vector<pair<AdvertFilter, Reference>> leaves = {
+		{uuid_is(0xFEAA), ref_uuid(UUID(0xFEAA))},
+		{uuid_is(0x180D), ref_uuid(UUID(0x180D))},
+		{uuid_is("7309203e-349d-4c11-ac6b-baedd1819764"_uuid), ref_uuid("7309203e-349d-4c11-ac6b-baedd1819764"_uuid)},
+		{manufacturer_is(0x004C), ref_manufacturer(0x004C)},
+		{manufacturer_is(0x0059), ref_manufacturer(0x0059)},
+		{name_starts_with("Dyn"), ref_name("Dyn")},
+		{name_starts_with("HRM1"), ref_name("HRM1")},
+		{rssi_above(-70), ref_rssi(-70)},
+		{rssi_above(-95), ref_rssi(-95)},
+		{address_starts_with("7c:76"), ref_address("7c:76")},
+		{address_starts_with("00"), ref_address("00")},
+	};
+
+	mt19937 rng(1);
+	function<pair<AdvertFilter, Reference>(int)> random_filter = [&](int depth) -> pair<AdvertFilter, Reference> {
+		int r = depth == 0 ? 0 : rng() % 4;
+		if(r == 0)
+			return leaves[rng() % leaves.size()];
+
+		auto a = random_filter(depth - 1);
+		if(r == 1)
+		{
+			Reference ra = a.second;
+			return {!a.first, [=](const AdvertisingResponse& x){ return !ra(x); }};
+		}
+
+		auto b = random_filter(depth - 1);
+		Reference ra = a.second, rb = b.second;
+		if(r == 2)
+			return {a.first && b.first, [=](const AdvertisingResponse& x){ return ra(x) && rb(x); }};
+		else
+			return {a.first || b.first, [=](const AdvertisingResponse& x){ return ra(x) || rb(x); }};
+	};
+
+	for(int i=0; i < 2000; i++)
+	{
+		auto f = random_filter(4);
+		for(const auto& p: adverts)
+		{
+			vector<AdvertisingResponse> all = HCIScanner::parse_packet(p);
+			vector<AdvertisingResponse> some = HCIScanner::parse_packet(p, f.first);
+			check(all.size() == 1);
+			check(some.size() == (f.second(all[0]) ? 1u : 0u));
+			check(f.first(raw(p)) == f.second(all[0]));
+		}
+	}
+
+	//In a packet with several reports, each is tested.
+	vector<uint8_t> two = {HCI_EVENT_PKT, EVT_LE_META_EVENT, 25, 0x02, 2,
+		0x00, 0x00, 0x0B, 0x57, 0x16, 0x21, 0x76, 0x7C, 3, 0x02, 0x01, 0x06, 0xC0,
+		0x00, 0x00, 0x0B, 0x57, 0x16, 0x21, 0x76, 0x7D, 0, 0xB0};
+	check(HCIScanner::parse_packet(two).size() == 2);
+	vector<AdvertisingResponse> r = HCIScanner::parse_packet(two, address_starts_with("7d"));
+	check(r.size() == 1 && r[0].address == "7d:76:21:16:57:0b");
+	check(HCIScanner::parse_packet(two, rssi_above(-70)).size() == 1);
+}
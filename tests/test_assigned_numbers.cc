@@ -0,0 +1,67 @@
+#include <blepp/assigned_numbers.h>
+#include <blepp/blestatemachine.h>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+int main()
+{
+	for(auto kind: {AssignedNumberKind::Service, AssignedNumberKind::Characteristic, AssignedNumberKind::Descriptor, AssignedNumberKind::Company, AssignedNumberKind::ADType})
+	{
+		AssignedNumberTable t = assigned_numbers(kind);
+		check(t.size() > 0);
+
+		//Every entry can be found, and nothing in between.
+		int previous = -1;
+		for(const AssignedNumber& a: t)
+		{
+			check(a.number > previous);
+			check(strlen(a.name) > 0);
+			check(lookup_assigned_number(kind, a.number) == &a);
+			for(int n=previous+1; n < a.number; n++)
+				check(lookup_assigned_number(kind, n) == nullptr);
+			previous = a.number;
+		}
+		check(lookup_assigned_number(kind, 0xffff) == nullptr || t.end()[-1].number == 0xffff);
+	}
+
+	check(strcmp(lookup_service(UUID(0x180d))->name, "Heart Rate") == 0);
+	check(strcmp(lookup_service(UUID("0000180d-0000-1000-8000-00805f9b34fb"))->id, "org.bluetooth.service.heart_rate") == 0);
+	check(lookup_service(UUID::from_uuid32(0x180d)) == lookup_service(UUID(0x180d)));
+	check(lookup_service(UUID(0x2a37)) == nullptr);
+	check(lookup_service(UUID::from_uuid32(0x1180d)) == nullptr);
+	check(lookup_service(UUID("7309203e-349d-4c11-ac6b-baedd1819764")) == nullptr);
+
+	const AssignedNumber* battery = lookup_characteristic(UUID(0x2a19));
+	check(battery && strcmp(battery->name, "Battery Level") == 0 && battery->format == ValueFormat::UInt8);
+	check(lookup_characteristic(UUID(0x2a00))->format == ValueFormat::UTF8S);
+	check(lookup_characteristic(UUID(0x2a37))->format == ValueFormat::Struct);
+	check(strcmp(lookup_descriptor(UUID(0x2902))->name, "Client Characteristic Configuration") == 0);
+	check(strcmp(lookup_company(0x004c)->name, "Apple, Inc.") == 0);
+	check(strcmp(lookup_company(0x0059)->name, "Nordic Semiconductor ASA") == 0);
+	check(strcmp(lookup_ad_type(0xff)->name, "Manufacturer Specific Data") == 0);
+	check(*lookup_company(0x004c)->id == 0);
+
+	//The services that lookup_service_by_UUID has always known about.
+	const uint16_t old_services[] = {0x1811, 0x180F, 0x1810, 0x181B, 0x181E, 0x1805, 0x1818, 0x1816, 0x180A, 0x1800, 0x1801, 0x1808, 0x1809, 0x180D, 0x1812, 0x1802, 0x1803, 0x1819, 0x1807, 0x180E, 0x1806, 0x1814, 0x1813, 0x1804, 0x181C, 0x181D};
+	for(uint16_t u: old_services)
+	{
+		const ServiceInfo* s = lookup_service_by_UUID(UUID(u));
+		check(s != nullptr);
+		check(s->uuid == UUID(u));
+		check(strcmp(s->name, lookup_service(UUID(u))->name) == 0);
+		check(strcmp(s->id, lookup_service(UUID(u))->id) == 0);
+	}
+	check(strcmp(lookup_service_by_UUID(UUID(0x180F))->name, "Battery Service") == 0);
+	check(lookup_service_by_UUID(UUID(0x2a19)) == nullptr);
+}
@@ -0,0 +1,953 @@
+#include <blepp/att.h>
+#include <blepp/blestatemachine.h>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <sys/socket.h>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+#define MIN(A, B) (((A)<(B))?(A):(B))
+
+//The hand written fixed layout codecs from before they were generated from
+//att_schema.h. The schema versions must agree with them everywhere, apart
+//from the bugs listed in main().
+namespace legacy
+{
+	uint16_t enc_read_by_grp_req(uint16_t start, uint16_t end, bt_uuid_t *uuid,
+							uint8_t *pdu, size_t len)
+	{
+		uint16_t min_len = sizeof(pdu[0]) + sizeof(start) + sizeof(end);
+		uint16_t length;
+
+		if (!uuid)
+			return 0;
+
+		if (uuid->type == BT_UUID16)
+			length = 2;
+		else if (uuid->type == BT_UUID128)
+			length = 16;
+		else
+			return 0;
+
+		if (len < min_len + length)
+			return 0;
+
+		pdu[0] = ATT_OP_READ_BY_GROUP_REQ;
+		att_put_u16(start, &pdu[1]);
+		att_put_u16(end, &pdu[3]);
+
+		att_put_uuid(*uuid, &pdu[5]);
+
+		return min_len + length;
+	}
+	uint16_t enc_find_by_type_req(uint16_t start, uint16_t end, bt_uuid_t *uuid,
+						const uint8_t *value, size_t vlen,
+						uint8_t *pdu, size_t len)
+	{
+		uint16_t min_len = sizeof(pdu[0]) + sizeof(start) + sizeof(end) +
+								sizeof(uint16_t);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (!uuid)
+			return 0;
+
+		if (uuid->type != BT_UUID16)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (vlen > len - min_len)
+			vlen = len - min_len;
+
+		pdu[0] = ATT_OP_FIND_BY_TYPE_REQ;
+		att_put_u16(start, &pdu[1]);
+		att_put_u16(end, &pdu[3]);
+		att_put_uuid16(*uuid, &pdu[5]);
+
+		if (vlen > 0) {
+			memcpy(&pdu[7], value, vlen);
+			return min_len + vlen;
+		}
+
+		return min_len;
+	}
+
+	uint16_t dec_find_by_type_req(const uint8_t *pdu, size_t len, uint16_t *start,
+							uint16_t *end, bt_uuid_t *uuid,
+							uint8_t *value, size_t *vlen)
+	{
+		size_t valuelen;
+		uint16_t min_len = sizeof(pdu[0]) + sizeof(*start) +
+							sizeof(*end) + sizeof(uint16_t);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (pdu[0] != ATT_OP_FIND_BY_TYPE_REQ)
+			return 0;
+
+		/* First requested handle number */
+		if (start)
+			*start = att_get_u16(&pdu[1]);
+
+		/* Last requested handle number */
+		if (end)
+			*end = att_get_u16(&pdu[3]);
+
+		/* Always UUID16 */
+		if (uuid)
+			*uuid = att_get_uuid16(&pdu[5]);
+
+		valuelen = len - min_len;
+
+		/* Attribute value to find */
+		if (valuelen > 0 && value)
+			memcpy(value, pdu + min_len, valuelen);
+
+		if (vlen)
+			*vlen = valuelen;
+
+		return len;
+	}
+
+	uint16_t enc_read_by_type_req(uint16_t start, uint16_t end, bt_uuid_t *uuid,
+							uint8_t *pdu, size_t len)
+	{
+		uint16_t min_len = sizeof(pdu[0]) + sizeof(start) + sizeof(end);
+		uint16_t length;
+
+		if (!uuid)
+			return 0;
+
+		if (uuid->type == BT_UUID16)
+			length = 2;
+		else if (uuid->type == BT_UUID128)
+			length = 16;
+		else
+			return 0;
+
+		if (len < min_len + length)
+			return 0;
+
+		pdu[0] = ATT_OP_READ_BY_TYPE_REQ;
+		att_put_u16(start, &pdu[1]);
+		att_put_u16(end, &pdu[3]);
+
+		att_put_uuid(*uuid, &pdu[5]);
+
+		return min_len + length;
+	}
+
+	uint16_t dec_read_by_type_req(const uint8_t *pdu, size_t len, uint16_t *start,
+							uint16_t *end, bt_uuid_t *uuid)
+	{
+		const size_t min_len = sizeof(pdu[0]) + sizeof(*start) + sizeof(*end);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (start == NULL || end == NULL || uuid == NULL)
+			return 0;
+
+		if (len < min_len + 2)
+			return 0;
+
+		if (pdu[0] != ATT_OP_READ_BY_TYPE_REQ)
+			return 0;
+
+		*start = att_get_u16(&pdu[1]);
+		*end = att_get_u16(&pdu[3]);
+
+		if (len == min_len + 2)
+			*uuid = att_get_uuid16(&pdu[5]);
+		else
+			*uuid = att_get_uuid128(&pdu[5]);
+
+		return len;
+	}
+	uint16_t enc_write_cmd(uint16_t handle, const uint8_t *value, size_t vlen,
+							uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (vlen > len - min_len)
+			vlen = len - min_len;
+
+		pdu[0] = ATT_OP_WRITE_CMD;
+		att_put_u16(handle, &pdu[1]);
+
+		if (vlen > 0) {
+			memcpy(&pdu[3], value, vlen);
+			return min_len + vlen;
+		}
+
+		return min_len;
+	}
+
+	uint16_t dec_write_cmd(const uint8_t *pdu, size_t len, uint16_t *handle,
+							uint8_t *value, size_t *vlen)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (value == NULL || vlen == NULL || handle == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (pdu[0] != ATT_OP_WRITE_CMD)
+			return 0;
+
+		*handle = att_get_u16(&pdu[1]);
+		memcpy(value, pdu + min_len, len - min_len);
+		*vlen = len - min_len;
+
+		return len;
+	}
+
+	uint16_t enc_write_req(uint16_t handle, const uint8_t *value, size_t vlen,
+							uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (vlen > len - min_len)
+			vlen = len - min_len;
+
+		pdu[0] = ATT_OP_WRITE_REQ;
+		att_put_u16(handle, &pdu[1]);
+
+		if (vlen > 0) {
+			memcpy(&pdu[3], value, vlen);
+			return min_len + vlen;
+		}
+
+		return min_len;
+	}
+
+	uint16_t dec_write_req(const uint8_t *pdu, size_t len, uint16_t *handle,
+							uint8_t *value, size_t *vlen)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (value == NULL || vlen == NULL || handle == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (pdu[0] != ATT_OP_WRITE_REQ)
+			return 0;
+
+		*handle = att_get_u16(&pdu[1]);
+		*vlen = len - min_len;
+		if (*vlen > 0)
+			memcpy(value, pdu + min_len, *vlen);
+
+		return len;
+	}
+
+	uint16_t enc_write_resp(uint8_t *pdu, size_t /*len*/)
+	{
+		if (pdu == NULL)
+			return 0;
+
+		pdu[0] = ATT_OP_WRITE_RESP;
+
+		return sizeof(pdu[0]);
+	}
+
+	uint16_t dec_write_resp(const uint8_t *pdu, size_t len)
+	{
+		if (pdu == NULL)
+			return 0;
+
+		if (pdu[0] != ATT_OP_WRITE_RESP)
+			return 0;
+
+		return len;
+	}
+
+	uint16_t enc_read_req(uint16_t handle, uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		pdu[0] = ATT_OP_READ_REQ;
+		att_put_u16(handle, &pdu[1]);
+
+		return min_len;
+	}
+
+	uint16_t enc_read_blob_req(uint16_t handle, uint16_t offset, uint8_t *pdu,
+										size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle) +
+								sizeof(offset);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		pdu[0] = ATT_OP_READ_BLOB_REQ;
+		att_put_u16(handle, &pdu[1]);
+		att_put_u16(offset, &pdu[3]);
+
+		return min_len;
+	}
+
+	uint16_t dec_read_req(const uint8_t *pdu, size_t len, uint16_t *handle)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (handle == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (pdu[0] != ATT_OP_READ_REQ)
+			return 0;
+
+		*handle = att_get_u16(&pdu[1]);
+
+		return min_len;
+	}
+
+	uint16_t dec_read_blob_req(const uint8_t *pdu, size_t len, uint16_t *handle,
+								uint16_t *offset)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle) +
+								sizeof(*offset);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (handle == NULL)
+			return 0;
+
+		if (offset == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (pdu[0] != ATT_OP_READ_BLOB_REQ)
+			return 0;
+
+		*handle = att_get_u16(&pdu[1]);
+		*offset = att_get_u16(&pdu[3]);
+
+		return min_len;
+	}
+
+	uint16_t enc_read_resp(uint8_t *value, size_t vlen, uint8_t *pdu, size_t len)
+	{
+		if (pdu == NULL)
+			return 0;
+
+		/* If the attribute value length is longer than the allowed PDU size,
+		 * send only the octets that fit on the PDU. The remaining octets can
+		 * be requested using the Read Blob Request. */
+		if (vlen > len - 1)
+			vlen = len - 1;
+
+		pdu[0] = ATT_OP_READ_RESP;
+
+		memcpy(pdu + 1, value, vlen);
+
+		return vlen + 1;
+	}
+
+	uint16_t enc_read_blob_resp(uint8_t *value, size_t vlen, uint16_t offset,
+								uint8_t *pdu, size_t len)
+	{
+		if (pdu == NULL)
+			return 0;
+
+		vlen -= offset;
+		if (vlen > len - 1)
+			vlen = len - 1;
+
+		pdu[0] = ATT_OP_READ_BLOB_RESP;
+
+		memcpy(pdu + 1, &value[offset], vlen);
+
+		return vlen + 1;
+	}
+
+	ssize_t dec_read_resp(const uint8_t *pdu, size_t len, uint8_t *value, size_t vlen)
+	{
+		if (pdu == NULL)
+			return -EINVAL;
+
+		if (value == NULL)
+			return -EINVAL;
+
+		if (pdu[0] != ATT_OP_READ_RESP)
+			return -EINVAL;
+
+		if (vlen < (len - 1))
+			return -ENOBUFS;
+
+		memcpy(value, pdu + 1, len - 1);
+
+		return len - 1;
+	}
+
+	uint16_t enc_error_resp(uint8_t opcode, uint16_t handle, uint8_t status,
+								uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(opcode) +
+							sizeof(handle) + sizeof(status);
+		uint16_t u16;
+
+		if (len < min_len)
+			return 0;
+
+		u16 = htobs(handle);
+		pdu[0] = ATT_OP_ERROR;
+		pdu[1] = opcode;
+		memcpy(&pdu[2], &u16, sizeof(u16));
+		pdu[4] = status;
+
+		return min_len;
+	}
+
+	uint16_t enc_find_info_req(uint16_t start, uint16_t end, uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(start) + sizeof(end);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		pdu[0] = ATT_OP_FIND_INFO_REQ;
+		att_put_u16(start, &pdu[1]);
+		att_put_u16(end, &pdu[3]);
+
+		return min_len;
+	}
+
+	uint16_t dec_find_info_req(const uint8_t *pdu, size_t len, uint16_t *start,
+									uint16_t *end)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*start) + sizeof(*end);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (start == NULL || end == NULL)
+			return 0;
+
+		if (pdu[0] != ATT_OP_FIND_INFO_REQ)
+			return 0;
+
+		*start = att_get_u16(&pdu[1]);
+		*end = att_get_u16(&pdu[3]);
+
+		return min_len;
+	}
+	uint16_t enc_notification(uint16_t handle, uint8_t *value, size_t vlen,
+							uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(uint16_t);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < (vlen + min_len))
+			return 0;
+
+		pdu[0] = ATT_OP_HANDLE_NOTIFY;
+		att_put_u16(handle, &pdu[1]);
+		memcpy(&pdu[3], value, vlen);
+
+		return vlen + min_len;
+	}
+
+	uint16_t enc_indication(uint16_t handle, uint8_t *value, size_t vlen,
+							uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(uint16_t);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < (vlen + min_len))
+			return 0;
+
+		pdu[0] = ATT_OP_HANDLE_IND;
+		att_put_u16(handle, &pdu[1]);
+		memcpy(&pdu[3], value, vlen);
+
+		return vlen + min_len;
+	}
+
+	uint16_t dec_indication(const uint8_t *pdu, size_t len, uint16_t *handle,
+							uint8_t *value, size_t vlen)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(uint16_t);
+		uint16_t dlen;
+
+		if (pdu == NULL)
+			return 0;
+
+		if (pdu[0] != ATT_OP_HANDLE_IND)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		dlen = MIN(len - min_len, vlen);
+
+		if (handle)
+			*handle = att_get_u16(&pdu[1]);
+
+		memcpy(value, &pdu[3], dlen);
+
+		return dlen;
+	}
+
+	uint16_t enc_confirmation(uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		pdu[0] = ATT_OP_HANDLE_CNF;
+
+		return min_len;
+	}
+
+	uint16_t enc_mtu_req(uint16_t mtu, uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(mtu);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		pdu[0] = ATT_OP_MTU_REQ;
+		att_put_u16(mtu, &pdu[1]);
+
+		return min_len;
+	}
+
+	uint16_t dec_mtu_req(const uint8_t *pdu, size_t len, uint16_t *mtu)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*mtu);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (mtu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (pdu[0] != ATT_OP_MTU_REQ)
+			return 0;
+
+		*mtu = att_get_u16(&pdu[1]);
+
+		return min_len;
+	}
+
+	uint16_t enc_mtu_resp(uint16_t mtu, uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(mtu);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		pdu[0] = ATT_OP_MTU_RESP;
+		att_put_u16(mtu, &pdu[1]);
+
+		return min_len;
+	}
+
+	uint16_t dec_mtu_resp(const uint8_t *pdu, size_t len, uint16_t *mtu)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*mtu);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (mtu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (pdu[0] != ATT_OP_MTU_RESP)
+			return 0;
+
+		*mtu = att_get_u16(&pdu[1]);
+
+		return min_len;
+	}
+
+	uint16_t enc_prep_write_req(uint16_t handle, uint16_t offset,
+				const uint8_t *value, size_t vlen, uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(handle) +
+									sizeof(offset);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (vlen > len - min_len)
+			vlen = len - min_len;
+
+		pdu[0] = ATT_OP_PREP_WRITE_REQ;
+		att_put_u16(handle, &pdu[1]);
+		att_put_u16(offset, &pdu[3]);
+
+		if (vlen > 0) {
+			memcpy(&pdu[5], value, vlen);
+			return min_len + vlen;
+		}
+
+		return min_len;
+	}
+
+	uint16_t dec_prep_write_resp(const uint8_t *pdu, size_t len, uint16_t *handle,
+					uint16_t *offset, uint8_t *value, size_t *vlen)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(*handle) +
+									sizeof(*offset);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (handle == NULL || offset == NULL || value == NULL || vlen == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (pdu[0] != ATT_OP_PREP_WRITE_REQ)
+			return 0;
+
+		*handle = att_get_u16(&pdu[1]);
+		*offset = att_get_u16(&pdu[3]);
+		*vlen = len - min_len;
+		if (*vlen > 0)
+			memcpy(value, pdu + min_len, *vlen);
+
+		return len;
+	}
+
+	uint16_t enc_exec_write_req(uint8_t flags, uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]) + sizeof(flags);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (flags > 1)
+			return 0;
+
+		pdu[0] = ATT_OP_EXEC_WRITE_REQ;
+		pdu[1] = flags;
+
+		return min_len;
+	}
+
+	uint16_t dec_exec_write_resp(const uint8_t *pdu, size_t len)
+	{
+		const uint16_t min_len = sizeof(pdu[0]);
+
+		if (pdu == NULL)
+			return 0;
+
+		if (len < min_len)
+			return 0;
+
+		if (pdu[0] != ATT_OP_EXEC_WRITE_RESP)
+			return 0;
+
+		return len;
+	}
+}
+
+static const size_t max_len = 48;
+
+//Everything a codec can write to. Both versions start from the same junk,
+//so anything written by one and not the other shows up.
+struct Out
+{
+	uint16_t a, b;
+	bt_uuid_t uuid;
+	uint8_t value[max_len];
+	size_t vlen;
+	uint8_t pdu[max_len];
+
+	bool operator==(const Out& o) const
+	{
+		return memcmp(this, &o, sizeof(*this)) == 0;
+	}
+};
+
+Out junk()
+{
+	Out o;
+	memset(static_cast<void*>(&o), 0xa5, sizeof(o));
+	return o;
+}
+
+//Run CALL, which writes through O, with both versions.
+#define agree(CALL) do{\
+	Out O = junk();\
+	auto old_ret = legacy::CALL;\
+	Out old_out = O;\
+	O = junk();\
+	auto new_ret = BLEPP::CALL;\
+	check(old_ret == new_ret);\
+	check(old_out == O);\
+}while(0)
+
+int main()
+{
+	mt19937 rng(1);
+
+	const uint8_t opcodes[] = {
+		ATT_OP_ERROR, ATT_OP_MTU_REQ, ATT_OP_MTU_RESP, ATT_OP_FIND_INFO_REQ,
+		ATT_OP_FIND_BY_TYPE_REQ, ATT_OP_READ_BY_TYPE_REQ, ATT_OP_READ_REQ,
+		ATT_OP_READ_RESP, ATT_OP_READ_BLOB_REQ, ATT_OP_WRITE_REQ,
+		ATT_OP_WRITE_RESP, ATT_OP_PREP_WRITE_REQ, ATT_OP_PREP_WRITE_RESP,
+		ATT_OP_EXEC_WRITE_RESP, ATT_OP_HANDLE_NOTIFY, ATT_OP_HANDLE_IND,
+		ATT_OP_WRITE_CMD
+	};
+
+	//Decoders, over every opcode and every length up to a bit more than
+	//the longest fixed part.
+	for(int round=0; round < 16; round++)
+		for(uint8_t op: opcodes)
+			for(size_t len=0; len <= max_len; len++)
+			{
+				uint8_t pdu[max_len];
+				for(auto& b: pdu)
+					b = rng();
+				pdu[0] = op;
+
+				agree(dec_find_by_type_req(pdu, len, &O.a, &O.b, &O.uuid, O.value, &O.vlen));
+				agree(dec_write_cmd(pdu, len, &O.a, O.value, &O.vlen));
+				agree(dec_write_req(pdu, len, &O.a, O.value, &O.vlen));
+				agree(dec_write_resp(pdu, len));
+				agree(dec_read_req(pdu, len, &O.a));
+				agree(dec_read_blob_req(pdu, len, &O.a, &O.b));
+				agree(dec_find_info_req(pdu, len, &O.a, &O.b));
+				agree(dec_mtu_req(pdu, len, &O.a));
+				agree(dec_mtu_resp(pdu, len, &O.a));
+				agree(dec_exec_write_resp(pdu, len));
+
+				for(size_t vlen: {size_t(0), size_t(1), len/2, len, max_len})
+					agree(dec_indication(pdu, len, &O.a, O.value, vlen));
+
+				//Bug: the opcode of an empty PDU was read.
+				if(len == 0)
+				{
+					Out o;
+					check(BLEPP::dec_read_resp(pdu, len, o.value, max_len) == -EINVAL);
+				}
+				else
+					for(size_t vlen: {size_t(0), size_t(1), len/2, len-1, len, max_len})
+						agree(dec_read_resp(pdu, len, O.value, vlen));
+
+				//Bug: lengths between the 16 and 128 bit forms, or past the
+				//128 bit one, were read as 128 bit UUIDs, reading past the end
+				//in the first case.
+				if(len <= 7 || len == 21)
+					agree(dec_read_by_type_req(pdu, len, &O.a, &O.b, &O.uuid));
+				else
+				{
+					Out o;
+					check(BLEPP::dec_read_by_type_req(pdu, len, &o.a, &o.b, &o.uuid) == 0);
+				}
+
+				//Bug: the response decoder wanted the request's opcode.
+				if(op == ATT_OP_PREP_WRITE_REQ)
+				{
+					Out o;
+					check(BLEPP::dec_prep_write_resp(pdu, len, &o.a, &o.b, o.value, &o.vlen) == 0);
+				}
+				else if(op == ATT_OP_PREP_WRITE_RESP)
+				{
+					uint8_t as_req[max_len];
+					memcpy(as_req, pdu, max_len);
+					as_req[0] = ATT_OP_PREP_WRITE_REQ;
+
+					Out o, n;
+					uint16_t old_ret = legacy::dec_prep_write_resp(as_req, len, &o.a, &o.b, o.value, &o.vlen);
+					uint16_t new_ret = BLEPP::dec_prep_write_resp(pdu, len, &n.a, &n.b, n.value, &n.vlen);
+					check(old_ret == new_ret && o == n);
+				}
+				else
+					agree(dec_prep_write_resp(pdu, len, &O.a, &O.b, O.value, &O.vlen));
+			}
+
+	//Encoders, into every buffer length up to a bit more than they need,
+	//with 16 and 128 bit UUIDs and one which neither can send.
+	for(int round=0; round < 16; round++)
+		for(size_t len=0; len <= max_len; len++)
+		{
+			uint16_t a = rng(), b = rng();
+			uint8_t value[max_len];
+			for(auto& v: value)
+				v = rng();
+
+			bt_uuid_t uuids[3];
+			bt_uuid16_create(&uuids[0], rng());
+			uint128_t u128;
+			for(auto& v: u128.data)
+				v = rng();
+			bt_uuid128_create(&uuids[1], u128);
+			bt_uuid32_create(&uuids[2], rng());
+
+			for(bt_uuid_t& uuid: uuids)
+			{
+				agree(enc_read_by_grp_req(a, b, &uuid, O.pdu, len));
+				agree(enc_read_by_type_req(a, b, &uuid, O.pdu, len));
+				for(size_t vlen=0; vlen + 7 <= max_len; vlen++)
+					agree(enc_find_by_type_req(a, b, &uuid, value, vlen, O.pdu, len));
+			}
+
+			agree(enc_read_req(a, O.pdu, len));
+			agree(enc_read_blob_req(a, b, O.pdu, len));
+			agree(enc_error_resp(ATT_OP_READ_REQ, a, ATT_ECODE_INVALID_HANDLE, O.pdu, len));
+			agree(enc_find_info_req(a, b, O.pdu, len));
+			agree(enc_confirmation(O.pdu, len));
+			agree(enc_mtu_req(a, O.pdu, len));
+			agree(enc_mtu_resp(a, O.pdu, len));
+			agree(enc_exec_write_req(0, O.pdu, len));
+			agree(enc_exec_write_req(1, O.pdu, len));
+			agree(enc_exec_write_req(2, O.pdu, len));
+
+			for(size_t vlen=0; vlen <= max_len; vlen++)
+			{
+				agree(enc_write_cmd(a, value, vlen, O.pdu, len));
+				agree(enc_write_req(a, value, vlen, O.pdu, len));
+				agree(enc_prep_write_req(a, b, value, vlen, O.pdu, len));
+				agree(enc_notification(a, value, vlen, O.pdu, len));
+				agree(enc_indication(a, value, vlen, O.pdu, len));
+
+				//Bug: these wrote the opcode into an empty buffer, and
+				//read_blob read before the start of the value if the offset
+				//was past its end.
+				if(len == 0)
+				{
+					Out o;
+					check(BLEPP::enc_write_resp(o.pdu, len) == 0);
+					check(BLEPP::enc_read_resp(value, vlen, o.pdu, len) == 0);
+					check(BLEPP::enc_read_blob_resp(value, vlen, 0, o.pdu, len) == 0);
+				}
+				else
+				{
+					agree(enc_write_resp(O.pdu, len));
+					agree(enc_read_resp(value, vlen, O.pdu, len));
+					for(uint16_t offset=0; offset <= vlen; offset++)
+						agree(enc_read_blob_resp(value, vlen, offset, O.pdu, len));
+
+					Out o;
+					check(BLEPP::enc_read_blob_resp(value, vlen, vlen+1, o.pdu, len) == 0);
+				}
+			}
+		}
+
+	//A PDU too short for its type disconnects, rather than throwing out of
+	//the state machine.
+	for(int batch=0; batch < 2; batch++)
+	{
+		BLEGATTStateMachine gatt;
+		int sv[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+		gatt.adopt_socket(sv[0]);
+
+		int disconnections = 0;
+		gatt.cb_disconnected = [&](BLEGATTStateMachine::Disconnect d)
+		{
+			check(d.reason == BLEGATTStateMachine::Disconnect::UnexpectedResponse);
+			disconnections++;
+		};
+
+		uint8_t notification[] = {ATT_OP_HANDLE_NOTIFY, 3};
+		check(write(sv[1], notification, sizeof(notification)) == sizeof(notification));
+		if(batch)
+			gatt.process_all_pending();
+		else
+			gatt.read_and_process_next();
+
+		check(disconnections == 1);
+		check(gatt.socket() == -1);
+		close(sv[1]);
+	}
+}
@@ -0,0 +1,194 @@
+#include <blepp/lescan.h>
+#include <blepp/beacons.h>
+#include <bluetooth/hci.h>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+typedef vector<uint8_t> Packet;
+
+//An LE Advertising Report event with one report, as read from the HCI socket.
+Packet report(uint8_t last_address_byte, const Packet& ad, int8_t rssi=-68)
+{
+	Packet p = {HCI_EVENT_PKT, EVT_LE_META_EVENT, uint8_t(ad.size() + 12), 0x02, 1, 0x03, 0x01, 0x0B, 0x57, 0x16, 0x21, 0x76, last_address_byte, uint8_t(ad.size())};
+	for(uint8_t b: ad)
+		p.push_back(b);
+	p.push_back(rssi);
+	return p;
+}
+
+const Packet flags = {0x02, 0x01, 0x06};
+
+const Packet ibeacon = {0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5};
+
+const Packet altbeacon = {0x1B, 0xFF, 0x18, 0x01, 0xBE, 0xAC, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0xBB, 0x55};
+
+const Packet uid = {0x17, 0x16, 0xAA, 0xFE, 0x00, 0xEE, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x00, 0x00};
+
+//https://www.google.com/
+const Packet url = {0x0D, 0x16, 0xAA, 0xFE, 0x10, 0xEB, 0x01, 'g', 'o', 'o', 'g', 'l', 'e', 0x00};
+
+const Packet tlm = {0x11, 0x16, 0xAA, 0xFE, 0x20, 0x00, 0x0B, 0xB8, 0x18, 0x80, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x10, 0x00};
+
+const Packet eid = {0x0D, 0x16, 0xAA, 0xFE, 0x30, 0xF0, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+
+Packet operator+(Packet a, const Packet& b)
+{
+	a.insert(a.end(), b.begin(), b.end());
+	return a;
+}
+
+int main()
+{
+	IBeacon i;
+	check(decode(ibeacon.data(), ibeacon.size(), i));
+	check(i.uuid() == UUID("e2c56db5-dffb-48d2-b060-d0f5a71096e0"));
+	check(i.major == 1 && i.minor == 2 && i.measured_power == -59);
+
+	AltBeacon a;
+	check(decode(altbeacon.data(), altbeacon.size(), a));
+	check(a.manufacturer == 0x0118);
+	check(a.beacon_id[0] == 0x01 && a.beacon_id[19] == 0x14);
+	check(a.reference_rssi == -69 && a.manufacturer_reserved == 0x55);
+	check(!decode(ibeacon.data(), ibeacon.size(), a));
+	check(!decode(altbeacon.data(), altbeacon.size(), i));
+
+	EddystoneUID u;
+	check(decode(uid.data(), uid.size(), u));
+	check(u.tx_power == -18);
+	check(u.name_space[0] == 0x01 && u.name_space[9] == 0x0A);
+	check(u.instance[0] == 0x0B && u.instance[5] == 0x10);
+
+	EddystoneURL l;
+	check(decode(url.data(), url.size(), l));
+	check(l.tx_power == -21 && l.scheme == 1 && l.length == 7);
+	check(l.url() == "https://www.google.com/");
+
+	EddystoneTLM t;
+	check(decode(tlm.data(), tlm.size(), t));
+	check(t.battery_mv == 3000);
+	check(t.has_temperature() && t.temperature_celsius() == 24.5);
+	check(t.advert_count == 256 && t.uptime == 4096);
+
+	EddystoneEID e;
+	check(decode(eid.data(), eid.size(), e));
+	check(e.tx_power == -16 && e.eid[0] == 0x11 && e.eid[7] == 0x88);
+
+	//The wrong frame type, or something that isn't a beacon.
+	check(!decode(uid.data(), uid.size(), l));
+	check(!decode(url.data(), url.size(), u));
+	check(!decode(flags.data(), flags.size(), i));
+	Packet apple = {0x07, 0xFF, 0x4C, 0x00, 0x10, 0x02, 0x0A, 0x00};
+	check(!decode(apple.data(), apple.size(), i));
+
+	//Truncated, or running past the end of what's there.
+	check(!decode(ibeacon.data(), ibeacon.size() - 1, i));
+	Packet short_ibeacon = ibeacon;
+	short_ibeacon[0]--;
+	short_ibeacon.pop_back();
+	check(!decode(short_ibeacon.data(), short_ibeacon.size(), i));
+	Packet short_uid(uid.begin(), uid.end() - 3);
+	short_uid[0] -= 3;
+	check(!decode(short_uid.data(), short_uid.size(), u));
+
+	//The two reserved bytes on the end of UID frames are optional.
+	short_uid = Packet(uid.begin(), uid.end() - 2);
+	short_uid[0] -= 2;
+	check(decode(short_uid.data(), short_uid.size(), u));
+
+	//Encrypted telemetry isn't decoded.
+	Packet etlm = tlm;
+	etlm[5] = 0x01;
+	check(!decode(etlm.data(), etlm.size(), t));
+
+	//URLs too long to be valid.
+	Packet long_url = url + Packet(11, 'x');
+	long_url[0] += 11;
+	check(!decode(long_url.data(), long_url.size(), l));
+	long_url[0]--;
+	long_url.pop_back();
+	check(decode(long_url.data(), long_url.size(), l) && l.length == 17);
+
+	//Any kind, found in a whole advert.
+	Beacon b;
+	check(find_beacon((flags + ibeacon).data(), (flags + ibeacon).size(), b) && b.type == BeaconType::IBeacon && b.ibeacon.minor == 2);
+	check(find_beacon((flags + altbeacon).data(), (flags + altbeacon).size(), b) && b.type == BeaconType::AltBeacon);
+	check(find_beacon(uid.data(), uid.size(), b) && b.type == BeaconType::EddystoneUID);
+	check(find_beacon((Packet{0x03, 0x03, 0xAA, 0xFE} + url).data(), url.size() + 4, b) && b.type == BeaconType::EddystoneURL);
+	check(find_beacon(tlm.data(), tlm.size(), b) && b.type == BeaconType::EddystoneTLM && b.eddystone_tlm.battery_mv == 3000);
+	check(find_beacon(eid.data(), eid.size(), b) && b.type == BeaconType::EddystoneEID);
+	check(!find_beacon(flags.data(), flags.size(), b));
+	check(!find_beacon((flags + apple).data(), (flags + apple).size(), b));
+
+	//Parsed adverts carry the beacon, and the service data.
+	vector<AdvertisingResponse> r = HCIScanner::parse_packet(report(0x7C, Packet{0x03, 0x03, 0xAA, 0xFE} + tlm));
+	check(r.size() == 1);
+	check(r[0].beacon.type == BeaconType::EddystoneTLM);
+	check(r[0].service_data.size() == 1);
+	check((r[0].service_data[0] == Packet(tlm.begin() + 2, tlm.end())));
+	check(r[0].unparsed_data_with_types.empty());
+
+	r = HCIScanner::parse_packet(report(0x7C, flags + ibeacon));
+	check(r.size() == 1 && r[0].beacon.type == BeaconType::IBeacon && r[0].beacon.ibeacon.major == 1);
+	check(r[0].manufacturer_specific_data.size() == 1);
+
+	r = HCIScanner::parse_packet(report(0x7C, flags + apple));
+	check(r.size() == 1 && r[0].beacon.type == BeaconType::None);
+
+	//Straight from the packets, several reports to a packet.
+	Packet two = {HCI_EVENT_PKT, EVT_LE_META_EVENT, 0, 0x02, 2};
+	for(auto ad: {flags + ibeacon, uid})
+	{
+		two = two + Packet{0x03, 0x01, 0x0B, 0x57, 0x16, 0x21, 0x76, 0x7D, uint8_t(ad.size())} + ad;
+		two.push_back(0xB0);
+	}
+	two[2] = two.size() - 3;
+	check(HCIScanner::parse_packet(two).size() == 2);
+
+	vector<BeaconReport> beacons;
+	check(HCIScanner::parse_beacons(two, beacons) == 2);
+	check(beacons.size() == 2);
+	check(beacons[0].beacon.type == BeaconType::IBeacon && beacons[1].beacon.type == BeaconType::EddystoneUID);
+	check(beacons[0].address[5] == 0x7D && beacons[0].address[0] == 0x0B && beacons[0].address_type == 1 && beacons[0].rssi == -80);
+
+	check(HCIScanner::parse_beacons(two, beacons, uuid_is(0xFEAA)) == 1);
+	check(beacons.size() == 3 && beacons[2].beacon.type == BeaconType::EddystoneUID);
+	check(HCIScanner::parse_beacons(report(0x7C, flags + apple), beacons) == 0);
+
+	//Truncated packets don't read past the end.
+	Packet truncated = report(0x7C, flags + ibeacon);
+	truncated.resize(truncated.size() - 5);
+	check(HCIScanner::parse_beacons(truncated, beacons) == 0);
+
+	//Through the scanner.
+	{
+		int sv[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+		HCIScanner s(false, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, sv[0]);
+
+		for(const auto& p: {report(0x7C, flags + ibeacon), report(0x7C, flags + apple), report(0x70, eid, -50)})
+			check(write(sv[1], p.data(), p.size()) == ssize_t(p.size()));
+
+		beacons.clear();
+		check(s.get_beacons(beacons) == 1);
+		check(s.get_beacons(beacons) == 0);
+		check(s.get_beacons(beacons) == 1);
+		check(beacons.size() == 2);
+		check(beacons[1].beacon.type == BeaconType::EddystoneEID && beacons[1].rssi == -50);
+		close(sv[1]);
+	}
+}
@@ -0,0 +1,132 @@
+#include <blepp/float.h>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+//The exact value, correctly rounded by the C library.
+double reference(int mantissa, int exponent)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%de%d", mantissa, exponent);
+	return strtod(buf, nullptr);
+}
+
+float reference_f(int mantissa, int exponent)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%de%d", mantissa, exponent);
+	return strtof(buf, nullptr);
+}
+
+bool same(double a, double b)
+{
+	return (std::isnan(a) && std::isnan(b)) || a == b;
+}
+
+int main()
+{
+	//Every SFLOAT, scalar and batch, single and double precision.
+	vector<uint8_t> all;
+	for(int i=0; i < 65536; i++)
+	{
+		all.push_back(i);
+		all.push_back(i >> 8);
+	}
+	vector<float> batch_f(65536);
+	vector<double> batch_d(65536);
+	bluetooth_sfloat_to_IEEE754(all.data(), 65536, batch_f.data());
+	bluetooth_sfloat_to_IEEE754(all.data(), 65536, batch_d.data());
+
+	for(int i=0; i < 65536; i++)
+	{
+		int mantissa = int32_t(uint32_t(i) << 20) >> 20;
+		int exponent = int16_t(i) >> 12;
+
+		double expected;
+		float expected_f;
+		if(exponent == 0 && mantissa == 2047)
+			expected = expected_f = NAN;
+		else if(exponent == 0 && (mantissa == -2048 || mantissa == -2047))
+			expected = expected_f = NAN;
+		else if(exponent == 0 && mantissa == 2046)
+			expected = expected_f = INFINITY;
+		else if(exponent == 0 && mantissa == -2046)
+			expected = expected_f = -INFINITY;
+		else
+		{
+			expected = reference(mantissa, exponent);
+			expected_f = reference_f(mantissa, exponent);
+		}
+
+		check(same(bluetooth_sfloat_to_double(i), expected));
+		check(same(bluetooth_sfloat_to_IEEE754(&all[2*i]), expected_f));
+		check(same(batch_f[i], expected_f));
+		check(same(batch_d[i], expected));
+	}
+
+	//The special FLOAT values.
+	check(std::isnan(bluetooth_float_to_double(0x007fffff)));
+	check(std::isnan(bluetooth_float_to_double(0x00800000)));
+	check(std::isnan(bluetooth_float_to_double(0x00800001)));
+	check(bluetooth_float_to_double(0x007ffffe) == INFINITY);
+	check(bluetooth_float_to_double(0x00800002) == -INFINITY);
+
+	//...are only special with an exponent of 0.
+	check(bluetooth_float_to_double(0x017fffff) == 83886070.);
+	check(bluetooth_float_to_double(0xff800002) == -838860.6);
+
+	//The full range of 24 bit mantissas, including the top half, which
+	//is negative.
+	check(bluetooth_float_to_double(0x000a0000) == 655360.);
+	check(bluetooth_float_to_double(0x00ffffff) == -1.);
+	check(bluetooth_float_to_double(0xfe00016e) == 3.66);
+
+	//A sample of FLOATs. Single precision is correctly rounded. So is
+	//double precision, as far as the powers of 10 in the table are exact.
+	mt19937 rng(1);
+	vector<uint8_t> bytes;
+	vector<uint32_t> raw;
+	for(int i=0; i < 200000; i++)
+	{
+		uint32_t r = rng();
+		if(i % 2)
+			r = (r & 0x00ffffff) | (uint32_t(int8_t(rng() % 41 - 20)) << 24);
+		raw.push_back(r);
+		for(int j=0; j < 4; j++)
+			bytes.push_back(r >> (8*j));
+	}
+	vector<float> floats(raw.size());
+	vector<double> doubles(raw.size());
+	bluetooth_float_to_IEEE754(bytes.data(), raw.size(), floats.data());
+	bluetooth_float_to_IEEE754(bytes.data(), raw.size(), doubles.data());
+
+	for(size_t i=0; i < raw.size(); i++)
+	{
+		int mantissa = int32_t(raw[i] << 8) >> 8;
+		int exponent = int8_t(raw[i] >> 24);
+		if(exponent == 0 && (mantissa >= 0x7ffffe || mantissa <= -0x7ffffe))
+			continue;
+
+		check(floats[i] == reference_f(mantissa, exponent));
+		check(floats[i] == bluetooth_float_to_IEEE754(&bytes[4*i]));
+		check(doubles[i] == bluetooth_float_to_double(raw[i]));
+		if(abs(exponent) <= 22)
+			check(doubles[i] == reference(mantissa, exponent));
+		else
+			check(fabs(doubles[i] - reference(mantissa, exponent)) <= fabs(reference(mantissa, exponent)) * 4e-16);
+	}
+}
@@ -0,0 +1,154 @@
+#include <blepp/gatt_values.h>
+#include <blepp/blestatemachine.h>
+#include <blepp/simulator.h>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+template<class T> bool decode_bytes(const vector<uint8_t>& v, T& t)
+{
+	return decode(v.data(), v.data() + v.size(), t);
+}
+
+int main()
+{
+	//Heart rate: 8 bit bpm, contact detected.
+	HeartRateMeasurement hr;
+	check(decode_bytes({0x06, 72}, hr));
+	check(hr.bpm == 72 && hr.sensor_contact_supported() && hr.sensor_contact_detected());
+	check(!hr.has_energy_expended() && hr.num_rr_intervals == 0);
+
+	//16 bit bpm, energy expended and two RR intervals.
+	check(decode_bytes({0x19, 0x2c, 0x01, 0x10, 0x27, 0x00, 0x04, 0x00, 0x03}, hr));
+	check(hr.bpm == 300 && hr.energy_expended == 10000);
+	check(hr.num_rr_intervals == 2 && hr.rr_intervals[0] == 1024 && hr.rr_intervals[1] == 768);
+
+	//More RR intervals than fit are dropped, and a trailing odd byte ignored.
+	vector<uint8_t> many = {0x10, 60};
+	for(int i=0; i < 12; i++)
+	{
+		many.push_back(i);
+		many.push_back(0);
+	}
+	many.push_back(0xff);
+	check(decode_bytes(many, hr));
+	check(hr.num_rr_intervals == HeartRateMeasurement::max_rr_intervals && hr.rr_intervals[8] == 8);
+
+	//Too short for what the flags say.
+	check(!decode_bytes({0x01, 0x2c}, hr));
+	check(!decode_bytes({0x08, 72, 0x10}, hr));
+	check(!decode_bytes({}, hr));
+
+	//Temperature: 36.6 C as mantissa 366, exponent -1, with a timestamp and type.
+	TemperatureMeasurement t;
+	check(decode_bytes({0x06, 0x6e, 0x01, 0x00, 0xff, 0xe2, 0x07, 12, 25, 13, 30, 59, 2}, t));
+	check(fabs(t.temperature - 36.6f) < 1e-4 && !t.fahrenheit());
+	check(t.has_timestamp() && t.timestamp.year == 2018 && t.timestamp.month == 12 && t.timestamp.day == 25);
+	check(t.timestamp.hours == 13 && t.timestamp.minutes == 30 && t.timestamp.seconds == 59);
+	check(t.has_temperature_type() && t.temperature_type == 2);
+	check(decode_bytes({0x01, 0x6e, 0x01, 0x00, 0xff}, t));
+	check(t.fahrenheit() && !t.has_timestamp() && t.timestamp.year == 0);
+	check(!decode_bytes({0x02, 0x6e, 0x01, 0x00, 0xff, 0xe2, 0x07}, t));
+
+	BatteryLevel b;
+	check(decode_bytes({87}, b) && b.level == 87);
+	check(!decode_bytes({}, b));
+
+	CSCMeasurement csc;
+	check(decode_bytes({0x03, 0x10, 0x00, 0x01, 0x00, 0x00, 0x04, 0x05, 0x00, 0x00, 0x08}, csc));
+	check(csc.has_wheel_revolutions() && csc.cumulative_wheel_revolutions == 0x10010 && csc.last_wheel_event_time == 1024);
+	check(csc.has_crank_revolutions() && csc.cumulative_crank_revolutions == 5 && csc.last_crank_event_time == 2048);
+	check(decode_bytes({0x02, 0x05, 0x00, 0x00, 0x08}, csc));
+	check(!csc.has_wheel_revolutions() && csc.cumulative_wheel_revolutions == 0 && csc.cumulative_crank_revolutions == 5);
+
+	RSCMeasurement rsc;
+	check(decode_bytes({0x07, 0x00, 0x03, 180, 0x78, 0x00, 0x10, 0x27, 0x00, 0x00}, rsc));
+	check(rsc.speed == 768 && rsc.cadence == 180 && rsc.stride_length == 120 && rsc.total_distance == 10000 && rsc.running());
+	check(!decode_bytes({0x01, 0x00, 0x03, 180}, rsc));
+
+	//The registry picks decoders by UUID, however it's written.
+	const ValueDecoder* d = find_value_decoder(UUID(0x2a37));
+	check(d && d->type == ValueType::HeartRateMeasurement);
+	check(find_value_decoder(UUID("00002a37-0000-1000-8000-00805f9b34fb")) == d);
+	check(find_value_decoder(UUID(0x2a1e))->type == ValueType::TemperatureMeasurement);
+	check(find_value_decoder(UUID("7309203e-349d-4c11-ac6b-baedd1819764")) == nullptr);
+	check(find_value_decoder(UUID(0x2a00)) == nullptr);
+
+	CharacteristicValue v;
+	vector<uint8_t> bytes = {0x00, 99};
+	check(d->decode(bytes.data(), bytes.data() + bytes.size(), v));
+	check(v.type == ValueType::HeartRateMeasurement && v.heart_rate.bpm == 99);
+
+	//Single integers come from the assigned numbers: Tx Power Level is signed.
+	d = find_value_decoder(UUID(0x2a07));
+	check(d && d->type == ValueType::Integer);
+	bytes = {0xf6};
+	check(d->decode(bytes.data(), bytes.data() + bytes.size(), v) && v.integer == -10);
+	bytes = {0x80};
+	check(d->decode(bytes.data(), bytes.data() + bytes.size(), v) && v.integer == -128);
+	bytes = {0x7f};
+	check(d->decode(bytes.data(), bytes.data() + bytes.size(), v) && v.integer == 127);
+	d = find_value_decoder(UUID(0x2a6e));
+	bytes = {0x01, 0x80};
+	check(d->decode(bytes.data(), bytes.data() + bytes.size(), v) && v.integer == -32767);
+	d = find_value_decoder(UUID(0x2a6c));
+	bytes = {0x00, 0x00, 0x80};
+	check(d->decode(bytes.data(), bytes.data() + bytes.size(), v) && v.integer == -8388608);
+	d = find_value_decoder(UUID(0x2a6d));
+	bytes = {0xff, 0xff, 0xff, 0xff};
+	check(d->decode(bytes.data(), bytes.data() + bytes.size(), v) && v.integer == 0xffffffff);
+	check(!d->decode(bytes.data(), bytes.data() + 3, v));
+
+	//End to end: the decoder is chosen at discovery.
+	SimulatedPeripheral sim;
+	sim.server.add_primary_service(UUID(0x180d));
+	uint16_t handle = sim.server.add_characteristic(UUID(0x2a37), GATT_CHARACTERISTIC_FLAGS_NOTIFY, {0x00, 0});
+	sim.server.add_primary_service(UUID(0x180f));
+	sim.server.add_characteristic(UUID(0x2a19), GATT_CHARACTERISTIC_FLAGS_READ, {55});
+
+	BLEGATTStateMachine gatt;
+	bool done=false;
+	std::function<void()> cb = [&](){ done = true; };
+	gatt.setup_standard_scan(cb);
+	gatt.adopt_socket(sim.connect());
+	check(sim.run(gatt, [&](){ return done; }));
+
+	Characteristic& heart_rate = gatt.primary_services.at(0).characteristics.at(0);
+	Characteristic& battery = gatt.primary_services.at(1).characteristics.at(0);
+	check(heart_rate.decoder && heart_rate.decoder->type == ValueType::HeartRateMeasurement);
+	check(battery.decoder && battery.decoder->type == ValueType::BatteryLevel);
+
+	int bpm=0, level=0;
+	heart_rate.cb_notify_or_indicate = [&](const PDUNotificationOrIndication& n)
+	{
+		CharacteristicValue v;
+		if(heart_rate.decode(n, v))
+			bpm = v.heart_rate.bpm;
+	};
+	battery.cb_read = [&](const PDUReadResponse& r)
+	{
+		CharacteristicValue v;
+		if(battery.decode(r, v))
+			level = v.battery_level.level;
+	};
+	gatt.set_notify_and_indicate(heart_rate, true, false);
+	check(sim.run_until_idle(gatt));
+	battery.read_request();
+	check(sim.run_until_idle(gatt));
+
+	uint8_t value[] = {0x00, 123};
+	sim.server.notify(handle, value, sizeof(value));
+	check(sim.run(gatt, [&](){ return bpm != 0; }));
+	check(bpm == 123 && level == 55);
+}
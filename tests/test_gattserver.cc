@@ -0,0 +1,324 @@
+#include <blepp/gattserver.h>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+//Send a raw PDU to the server, and return whatever comes back.
+vector<uint8_t> transact(BLEGATTServer& server, int server_fd, int fd, vector<uint8_t> pdu)
+{
+	check(write(fd, pdu.data(), pdu.size()) == (int)pdu.size());
+	check(server.process(server_fd));
+
+	vector<uint8_t> r(600);
+	int len = recv(fd, r.data(), r.size(), MSG_DONTWAIT);
+	r.resize(max(len, 0));
+	return r;
+}
+
+//Run the client and server until the client goes idle.
+void run(BLEGATTServer& server, int server_fd, BLEGATTStateMachine& gatt)
+{
+	for(int i=0; i < 1000; i++)
+	{
+		//Stop once the client has nothing outstanding and nothing is in flight.
+		pollfd fds[2] = {{server_fd, POLLIN, 0}, {gatt.socket(), POLLIN, 0}};
+		int n = poll(fds, 2, gatt.is_idle() ? 0 : 1000);
+		if(n == 0 && gatt.is_idle())
+			return;
+		check(n > 0);
+
+		if(fds[0].revents)
+			server.process(server_fd);
+		if(fds[1].revents)
+			gatt.read_and_process_next();
+	}
+	check(!"client never went idle");
+}
+
+int main()
+{
+	log_level = LogLevels::Warning;
+
+	BLEGATTServer server;
+
+	//Handles: 1 service, 2 declaration, 3 value, 4 configuration,
+	//5 service, 6 declaration, 7 value, 8 configuration, 9 description.
+	check(server.add_primary_service(UUID("180f")) == 1);
+	check(server.add_characteristic(UUID("2a19"), GATT_CHARACTERISTIC_FLAGS_READ | GATT_CHARACTERISTIC_FLAGS_NOTIFY, {87}) == 3);
+	check(server.add_primary_service(UUID("7309203e-349d-4c11-ac6b-baedd1819764")) == 5);
+	check(server.add_characteristic(UUID("7309203e-349d-4c11-ac6b-baedd1819765"), GATT_CHARACTERISTIC_FLAGS_WRITE | GATT_CHARACTERISTIC_FLAGS_READ | GATT_CHARACTERISTIC_FLAGS_INDICATE) == 7);
+	check(server.add_descriptor(UUID("2901"), {'L', 'e', 'd'}) == 9);
+
+	check(server.attribute(7) && server.attribute(7)->handle == 7);
+	check(server.attribute(10) == nullptr);
+	check(server.attribute(1)->group_end == 4);
+	check(server.attribute(5)->group_end == 9);
+
+	vector<uint8_t> written;
+	server.attribute(7)->on_write = [&](int, BLEGATTServer::Attribute& a)
+	{
+		written = a.value;
+	};
+
+	int disconnected = -1;
+	server.cb_disconnected = [&](int fd)
+	{
+		disconnected = fd;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Raw ATT
+	//
+	int raw[2];
+	check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, raw) == 0);
+	server.add_client(raw[0]);
+
+	//Read the battery level
+	vector<uint8_t> r = transact(server, raw[0], raw[1], {ATT_OP_READ_REQ, 3, 0});
+	check((r == vector<uint8_t>{ATT_OP_READ_RESP, 87}));
+
+	//Nonexistent handles, forbidden writes, unsupported requests, bad offsets
+	r = transact(server, raw[0], raw[1], {ATT_OP_READ_REQ, 0x10, 0});
+	check((r == vector<uint8_t>{ATT_OP_ERROR, ATT_OP_READ_REQ, 0x10, 0, ATT_ECODE_INVALID_HANDLE}));
+	r = transact(server, raw[0], raw[1], {ATT_OP_WRITE_REQ, 3, 0, 1});
+	check((r == vector<uint8_t>{ATT_OP_ERROR, ATT_OP_WRITE_REQ, 3, 0, ATT_ECODE_WRITE_NOT_PERM}));
+	r = transact(server, raw[0], raw[1], {ATT_OP_PREP_WRITE_REQ, 7, 0, 0, 0});
+	check((r == vector<uint8_t>{ATT_OP_ERROR, ATT_OP_PREP_WRITE_REQ, 0, 0, ATT_ECODE_REQ_NOT_SUPP}));
+	r = transact(server, raw[0], raw[1], {ATT_OP_READ_BLOB_REQ, 9, 0, 4, 0});
+	check((r == vector<uint8_t>{ATT_OP_ERROR, ATT_OP_READ_BLOB_REQ, 9, 0, ATT_ECODE_INVALID_OFFSET}));
+	r = transact(server, raw[0], raw[1], {ATT_OP_READ_BLOB_REQ, 9, 0, 1, 0});
+	check((r == vector<uint8_t>{ATT_OP_READ_BLOB_RESP, 'e', 'd'}));
+
+	//Commands never get a response
+	r = transact(server, raw[0], raw[1], {ATT_OP_WRITE_CMD, 3, 0, 1});
+	check(r.empty());
+
+	//Find the battery service by UUID
+	r = transact(server, raw[0], raw[1], {ATT_OP_FIND_BY_TYPE_REQ, 1, 0, 0xff, 0xff, 0x00, 0x28, 0x0f, 0x18});
+	check((r == vector<uint8_t>{ATT_OP_FIND_BY_TYPE_RESP, 1, 0, 4, 0}));
+
+	//Find information stops where the UUID size changes
+	r = transact(server, raw[0], raw[1], {ATT_OP_FIND_INFO_REQ, 3, 0, 0xff, 0xff});
+	check((r == vector<uint8_t>{ATT_OP_FIND_INFO_RESP, ATT_FIND_INFO_RESP_FMT_16BIT, 3, 0, 0x19, 0x2a, 4, 0, 0x02, 0x29, 5, 0, 0x00, 0x28, 6, 0, 0x03, 0x28}));
+	r = transact(server, raw[0], raw[1], {ATT_OP_FIND_INFO_REQ, 7, 0, 7, 0});
+	check(r.size() == 2 + 2 + 16 && r[1] == ATT_FIND_INFO_RESP_FMT_128BIT && r[2] == 7);
+	r = transact(server, raw[0], raw[1], {ATT_OP_FIND_INFO_REQ, 10, 0, 0xff, 0xff});
+	check((r == vector<uint8_t>{ATT_OP_ERROR, ATT_OP_FIND_INFO_REQ, 10, 0, ATT_ECODE_ATTR_NOT_FOUND}));
+
+	//The MTU goes up, and with it the size of responses
+	r = transact(server, raw[0], raw[1], {ATT_OP_MTU_REQ, 100, 0});
+	check(r.size() == 3 && r[0] == ATT_OP_MTU_RESP && att_get_u16(&r[1]) == server.max_mtu);
+	r = transact(server, raw[0], raw[1], {ATT_OP_FIND_INFO_REQ, 1, 0, 0xff, 0xff});
+	check(r.size() == 2 + 6*4);
+
+	//Subscribe to notifications, from the raw client
+	r = transact(server, raw[0], raw[1], {ATT_OP_WRITE_REQ, 4, 0, 1, 0});
+	check((r == vector<uint8_t>{ATT_OP_WRITE_RESP}));
+	r = transact(server, raw[0], raw[1], {ATT_OP_READ_REQ, 4, 0});
+	check((r == vector<uint8_t>{ATT_OP_READ_RESP, 1, 0}));
+
+	//on_read can send notifications while a response is being built. This
+	//reads both characteristic declarations, though only the first fits.
+	server.attribute(6)->on_read = [&](int, BLEGATTServer::Attribute&)
+	{
+		uint8_t v = 85;
+		server.notify(3, &v, 1);
+	};
+	r = transact(server, raw[0], raw[1], {ATT_OP_READ_BY_TYPE_REQ, 1, 0, 0xff, 0xff, 0x03, 0x28});
+	check((r == vector<uint8_t>{ATT_OP_HANDLE_NOTIFY, 3, 0, 85}));
+	r.resize(600);
+	r.resize(max<int>(0, recv(raw[1], r.data(), r.size(), MSG_DONTWAIT)));
+	check((r == vector<uint8_t>{ATT_OP_READ_BY_TYPE_RESP, 7, 2, 0, GATT_CHARACTERISTIC_FLAGS_READ | GATT_CHARACTERISTIC_FLAGS_NOTIFY, 3, 0, 0x19, 0x2a}));
+	server.attribute(6)->on_read = nullptr;
+	uint8_t level_value = 87;
+	server.set_value(3, &level_value, 1);
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// The client state machine as the peer
+	//
+	int sv[2];
+	check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+	server.add_client(sv[0]);
+	check(server.clients().size() == 2);
+
+	//The scan starts as soon as the socket is adopted.
+	BLEGATTStateMachine gatt;
+	bool done=false;
+	std::function<void()> cb = [&](){ done = true; };
+	gatt.setup_standard_scan(cb);
+	gatt.adopt_socket(sv[1]);
+	run(server, sv[0], gatt);
+	check(done);
+
+	check(gatt.primary_services.size() == 2);
+	check(gatt.primary_services[0].uuid == UUID("180f"));
+	check(gatt.primary_services[0].start_handle == 1);
+	check(gatt.primary_services[0].end_handle == 4);
+	check(gatt.primary_services[1].uuid == UUID("7309203e-349d-4c11-ac6b-baedd1819764"));
+	check(gatt.primary_services[1].characteristics.size() == 1);
+
+	Characteristic& level = gatt.primary_services[0].characteristics.at(0);
+	Characteristic& led = gatt.primary_services[1].characteristics.at(0);
+	check(level.uuid == UUID("2a19"));
+	check(level.read && level.notify && !level.write);
+	check(level.value_handle == 3);
+	check(level.client_characteric_configuration_handle == 4);
+	check(led.uuid == UUID("7309203e-349d-4c11-ac6b-baedd1819765"));
+	check(led.write && led.indicate);
+	check(led.client_characteric_configuration_handle == 8);
+
+	//Read
+	vector<uint8_t> value;
+	level.cb_read = [&](const PDUReadResponse& p)
+	{
+		value.assign(p.value().first, p.value().second);
+	};
+	level.read_request();
+	run(server, sv[0], gatt);
+	check((value == vector<uint8_t>{87}));
+
+	//Write
+	led.write_request((uint8_t)1);
+	run(server, sv[0], gatt);
+	check((written == vector<uint8_t>{1}));
+
+	//Notifications go to both subscribers
+	vector<uint8_t> notified;
+	level.cb_notify_or_indicate = [&](const PDUNotificationOrIndication& n)
+	{
+		notified.assign(n.value().first, n.value().second);
+	};
+	gatt.set_notify_and_indicate(level, true, false);
+	run(server, sv[0], gatt);
+
+	uint8_t new_level = 86;
+	check(server.notify(3, &new_level, 1) == 2);
+	run(server, sv[0], gatt);
+	check((notified == vector<uint8_t>{86}));
+	r.resize(10);
+	check(recv(raw[1], r.data(), r.size(), MSG_DONTWAIT) == 4);
+	check(r[0] == ATT_OP_HANDLE_NOTIFY && r[1] == 3 && r[3] == 86);
+
+	//Indications are held back until the last one is confirmed, which
+	//the state machine does automatically.
+	int indications = 0;
+	led.cb_notify_or_indicate = [&](const PDUNotificationOrIndication& n)
+	{
+		check(!n.notification());
+		indications++;
+	};
+	gatt.set_notify_and_indicate(led, false, true);
+	run(server, sv[0], gatt);
+
+	for(uint8_t i=0; i < 3; i++)
+		check(server.notify(7, &i, 1) == 1);
+
+	pollfd p = {sv[1], POLLIN, 0};
+	check(poll(&p, 1, 0) == 1);
+	gatt.read_and_process_next();
+	check(indications == 1);
+	check(poll(&p, 1, 0) == 0);
+	run(server, sv[0], gatt);
+	check(indications == 3);
+
+	//Disconnection
+	::close(raw[1]);
+	check(!server.process(raw[0]));
+	check(disconnected == raw[0]);
+	check(server.clients().size() == 1);
+
+	////////////////////////////////////////////////////////////////////////////////
+	//
+	// Clients which don't keep up
+	//
+	{
+		BLEGATTServer s;
+		s.add_primary_service(UUID("180f"));
+		uint16_t handle = s.add_characteristic(UUID("2a19"), GATT_CHARACTERISTIC_FLAGS_READ | GATT_CHARACTERISTIC_FLAGS_NOTIFY, {87});
+		int slow[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, slow) == 0);
+		s.add_client(slow[0]);
+		r = transact(s, slow[0], slow[1], {ATT_OP_WRITE_REQ, uint8_t(handle + 1), 0, 1, 0});
+		check((r == vector<uint8_t>{ATT_OP_WRITE_RESP}));
+
+		//Notifications are dropped once its socket is full, but it stays.
+		uint8_t value[20] = {};
+		int sent=0;
+		while(sent < 1000000 && s.notify(handle, value, sizeof(value)) == 1)
+			sent++;
+		check(sent > 0 && sent < 1000000);
+		check(s.notify(handle, value, sizeof(value)) == 0);
+		check(s.dropped_notifications(slow[0]) == 2);
+		check(s.clients().size() == 1);
+
+		//A response waits in the server until there's room, without holding
+		//up anyone else.
+		uint8_t read_req[] = {ATT_OP_READ_REQ, uint8_t(handle), 0};
+		check(write(slow[1], read_req, sizeof(read_req)) == sizeof(read_req));
+		check(s.process(slow[0]));
+		check(s.has_unsent(slow[0]));
+
+		int fast[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fast) == 0);
+		s.add_client(fast[0]);
+		r = transact(s, fast[0], fast[1], {ATT_OP_READ_REQ, uint8_t(handle), 0});
+		check(r.size() == 1 + sizeof(value) && r[0] == ATT_OP_READ_RESP);
+		check(!s.has_unsent(fast[0]));
+
+		//Nothing overtakes it, so notifications are still dropped.
+		check(s.notify(handle, value, sizeof(value)) == 0);
+		check(s.dropped_notifications(slow[0]) == 3);
+
+		//It goes once the client has caught up.
+		uint8_t pdu[600];
+		int received=0;
+		while(recv(slow[1], pdu, sizeof(pdu), MSG_DONTWAIT) > 0)
+			received++;
+		check(received == sent);
+		check(s.flush(slow[0]));
+		check(!s.has_unsent(slow[0]));
+		check(recv(slow[1], pdu, sizeof(pdu), MSG_DONTWAIT) == 1 + int(sizeof(value)) && pdu[0] == ATT_OP_READ_RESP);
+
+		//And notifications get through again.
+		check(s.notify(handle, value, sizeof(value)) == 1);
+		check(recv(slow[1], pdu, sizeof(pdu), MSG_DONTWAIT) == 3 + int(sizeof(value)));
+
+		//But a client which stops reading can't pile up responses forever.
+		s.max_unsent = 2;
+		while(s.notify(handle, value, sizeof(value)) == 1)
+			;
+		disconnected = -1;
+		s.cb_disconnected = [&](int fd)
+		{
+			disconnected = fd;
+		};
+		for(int i=0; i < 2; i++)
+		{
+			check(write(slow[1], read_req, sizeof(read_req)) == sizeof(read_req));
+			check(s.process(slow[0]));
+		}
+		check(write(slow[1], read_req, sizeof(read_req)) == sizeof(read_req));
+		check(!s.process(slow[0]));
+		check(disconnected == slow[0]);
+		check(s.clients().size() == 1);
+		::close(fast[1]);
+		::close(slow[1]);
+	}
+}
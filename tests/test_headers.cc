@@ -0,0 +1,42 @@
+//Every public header can be included in the same program, so no two of them
+//declare the same name.
+#include <blepp/advert_filter.h>
+#include <blepp/assigned_numbers.h>
+#include <blepp/att.h>
+#include <blepp/att_pdu.h>
+#include <blepp/att_schema.h>
+#include <blepp/beacons.h>
+#include <blepp/bledevice.h>
+#include <blepp/blestatemachine.h>
+#include <blepp/float.h>
+#include <blepp/gap.h>
+#include <blepp/gatt_values.h>
+#include <blepp/gattserver.h>
+#include <blepp/kernel_filter.h>
+#include <blepp/lescan.h>
+#include <blepp/logging.h>
+#include <blepp/mpsc_queue.h>
+#include <blepp/multiscanner.h>
+#include <blepp/notification_log.h>
+#include <blepp/pretty_printers.h>
+#include <blepp/recorder.h>
+#include <blepp/simulator.h>
+#include <blepp/uuid.h>
+#include <blepp/xtoa.h>
+
+#if __cplusplus >= 202002L
+	#include <blepp/coroutine.h>
+#endif
+
+#include <type_traits>
+
+using namespace BLEPP;
+
+static_assert(std::is_class<NotificationLogStream>::value, "notification log streams");
+#if __cplusplus >= 202002L
+static_assert(!std::is_same<NotificationLogStream, NotificationStream>::value, "distinct from coroutine streams");
+#endif
+
+int main()
+{
+}
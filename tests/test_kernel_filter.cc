@@ -0,0 +1,173 @@
+#include <blepp/kernel_filter.h>
+#include <bluetooth/hci.h>
+#include <vector>
+#include <string>
+#include <random>
+#include <stdexcept>
+#include <cstdlib>
+#include <iostream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+typedef vector<uint8_t> Packet;
+
+//An LE Advertising Report event with one report, as read from the HCI socket.
+Packet report(uint8_t event_type, uint8_t addr_type, uint8_t last_address_byte, const Packet& ad)
+{
+	Packet p = {HCI_EVENT_PKT, EVT_LE_META_EVENT, uint8_t(ad.size() + 12), 0x02, 1, event_type, addr_type, 0x0B, 0x57, 0x16, 0x21, 0x76, last_address_byte, uint8_t(ad.size())};
+	for(uint8_t b: ad)
+		p.push_back(b);
+	p.push_back(0xBC);
+	return p;
+}
+
+//Recorded adverts, and other things the socket sees.
+const Packet flags_and_service = report(0x00, 0x00, 0x7C, {0x02, 0x01, 0x06, 0x11, 0x06, 0x64, 0x97, 0x81, 0xD1, 0xED, 0xBA, 0x6B, 0xAC, 0x11, 0x4C, 0x9D, 0x34, 0x3E, 0x20, 0x09, 0x73});
+const Packet scan_response = report(0x04, 0x00, 0x7C, {0x17, 0x09, 'D', 'y', 'n', 'o', 'f', 'i', 't', ' ', 'I', 'n', 'c', ' ', 'D', 'O', 'T', 'S', ' ', 'x', 'x', 'x', 'x', '1'});
+const Packet apple = report(0x00, 0x01, 0x10, {0x07, 0xFF, 0x4C, 0x00, 0x10, 0x02, 0x0A, 0x00});
+const Packet ibeacon = report(0x03, 0x01, 0x20, {0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5});
+const Packet eddystone = report(0x03, 0x01, 0x30, {0x03, 0x03, 0xAA, 0xFE, 0x17, 0x16, 0xAA, 0xFE, 0x00, 0xEE, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x00, 0x00});
+const Packet no_data = report(0x03, 0x01, 0x40, {});
+const Packet two_reports = {HCI_EVENT_PKT, EVT_LE_META_EVENT, 25, 0x02, 2,
+	0x00, 0x00, 0x0B, 0x57, 0x16, 0x21, 0x76, 0x50, 3, 0x02, 0x01, 0x06, 0xC0,
+	0x00, 0x00, 0x0B, 0x57, 0x16, 0x21, 0x76, 0x51, 0, 0xC1};
+const Packet connection_complete = {HCI_EVENT_PKT, EVT_LE_META_EVENT, 19, 0x01, 0, 0x40, 0x00, 0x00, 0x00, 0x0B, 0x57, 0x16, 0x21, 0x76, 0x7C, 0x18, 0x00, 0x00, 0x00, 0x48, 0x00, 0x00};
+const Packet command_complete = {HCI_EVENT_PKT, EVT_CMD_COMPLETE, 4, 1, 0x0C, 0x20, 0x00};
+
+const vector<Packet> recording = {flags_and_service, scan_response, apple, ibeacon, eddystone, no_data, two_reports, connection_complete, command_complete};
+
+//Which of the recording get through a socket with the filter attached.
+string passed(const KernelFilter& f)
+{
+	int sv[2];
+	check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+	f.attach(sv[1]);
+
+	for(const auto& p: recording)
+		check(write(sv[0], p.data(), p.size()) == ssize_t(p.size()));
+
+	string result(recording.size(), '0');
+	uint8_t buf[300];
+	ssize_t n;
+	while((n = recv(sv[1], buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+	{
+		Packet p(buf, buf + n);
+		bool found=false;
+		for(size_t i=0; i < recording.size(); i++)
+			if(recording[i] == p)
+			{
+				check(result[i] == '0');
+				result[i] = '1';
+				found = true;
+			}
+		check(found);
+	}
+
+	close(sv[0]);
+	close(sv[1]);
+	return result;
+}
+
+int main()
+{
+	KernelFilter f;
+
+	//By default only advertising reports, and anything which isn't an LE
+	//meta event, get through.
+	check(passed(f) == "111111101");
+
+	f.subevent = 0x01;
+	check(passed(f) == "000000011");
+	f.subevent = EVT_LE_ADVERTISING_REPORT;
+
+	f.event_types = {LeAdvertisingEventType::ADV_NONCONN_IND};
+	check(passed(f) == "000111101");
+	f.event_types = {LeAdvertisingEventType::ADV_IND, LeAdvertisingEventType::SCAN_RSP};
+	check(passed(f) == "111000101");
+	f.event_types.clear();
+
+	f.addresses = {AcceptListEntry("7c:76:21:16:57:0b"), AcceptListEntry("30:76:21:16:57:0b", LE_RANDOM_ADDRESS)};
+	check(passed(f) == "110010101");
+
+	//The address type matters.
+	f.addresses = {AcceptListEntry("30:76:21:16:57:0b")};
+	check(passed(f) == "000000101");
+	f.addresses.clear();
+
+	//Manufacturer data at a fixed offset: Apple's first, or after the flags.
+	f.manufacturer = 0x004C;
+	check(passed(f) == "001000101");
+	f.manufacturer_offset = 3;
+	check(passed(f) == "000100101");
+	f.manufacturer = 0x0059;
+	check(passed(f) == "000000101");
+
+	//All together.
+	f.manufacturer = 0x004C;
+	f.event_types = {LeAdvertisingEventType::ADV_NONCONN_IND};
+	f.addresses = {AcceptListEntry("20:76:21:16:57:0b", LE_RANDOM_ADDRESS)};
+	check(passed(f) == "000100101");
+	f.addresses = {AcceptListEntry("10:76:21:16:57:0b", LE_RANDOM_ADDRESS)};
+	check(passed(f) == "000000101");
+
+	//Long lists of addresses, where the jumps won't fit in a conditional.
+	mt19937 rng(1);
+	KernelFilter fleet;
+	for(int i=0; i < 400; i++)
+	{
+		uint8_t a[6];
+		for(auto& b: a)
+			b = rng();
+		fleet.addresses.emplace_back(a, rng() % 2);
+	}
+	fleet.addresses.emplace_back("20:76:21:16:57:0b", LE_RANDOM_ADDRESS);
+	fleet.manufacturer = 0x004C;
+	fleet.manufacturer_offset = 3;
+	check(passed(fleet) == "000100101");
+
+	for(int i=0; i < 450; i++)
+		fleet.addresses.insert(fleet.addresses.begin(), AcceptListEntry("00:00:00:00:00:00"));
+	bool threw=false;
+	try
+	{
+		fleet.compile();
+	}
+	catch(const length_error&)
+	{
+		threw = true;
+	}
+	check(threw);
+
+	//Through the scanner.
+	{
+		int sv[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+		HCIScanner s(false, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, sv[0]);
+
+		KernelFilter k;
+		k.manufacturer = 0x004C;
+		s.set_kernel_filter(k);
+		for(const auto& p: {flags_and_service, apple, eddystone, apple})
+			check(write(sv[1], p.data(), p.size()) == ssize_t(p.size()));
+		vector<AdvertisingResponse> a = s.get_advertisements();
+		check(a.size() == 1 && a[0].address == "10:76:21:16:57:0b");
+		a = s.get_advertisements();
+		check(a.size() == 1 && a[0].address == "10:76:21:16:57:0b");
+
+		s.clear_kernel_filter();
+		check(write(sv[1], eddystone.data(), eddystone.size()) == ssize_t(eddystone.size()));
+		a = s.get_advertisements();
+		check(a.size() == 1 && a[0].address == "30:76:21:16:57:0b");
+		close(sv[1]);
+	}
+}
@@ -0,0 +1,153 @@
+#include <blepp/multiscanner.h>
+#include <bluetooth/hci.h>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <iostream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+//An LE Advertising Report event with one report, as read from the HCI socket.
+vector<uint8_t> report(uint8_t last_address_byte, int8_t rssi, const vector<uint8_t>& ad)
+{
+	vector<uint8_t> p = {HCI_EVENT_PKT, EVT_LE_META_EVENT, uint8_t(ad.size() + 12), 0x02, 1, 0x00, 0x00, 0x0B, 0x57, 0x16, 0x21, 0x76, last_address_byte, uint8_t(ad.size())};
+	for(uint8_t b: ad)
+		p.push_back(b);
+	p.push_back(rssi);
+	return p;
+}
+
+void send(int fd, const vector<uint8_t>& p)
+{
+	check(write(fd, p.data(), p.size()) == ssize_t(p.size()));
+}
+
+//Read until there's nothing waiting on any of the sockets.
+vector<MultiScanner::Report> drain(MultiScanner& s)
+{
+	vector<MultiScanner::Report> r;
+	for(int i=0; i < 100; i++)
+		for(auto& a: s.get_advertisements(0))
+			r.push_back(move(a));
+	return r;
+}
+
+int main()
+{
+	const vector<uint8_t> hrm = {0x02, 0x01, 0x06, 0x03, 0x02, 0x0D, 0x18};
+	const vector<uint8_t> battery = {0x02, 0x01, 0x06, 0x03, 0x02, 0x0F, 0x18};
+
+	//Three adapters, as the far ends of socket pairs.
+	MultiScanner scanner(60);
+	vector<int> radio;
+	for(int i=0; i < 3; i++)
+	{
+		int sv[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+		check(scanner.add_adapter(sv[0], HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, false) == i);
+		radio.push_back(sv[1]);
+	}
+	check(scanner.num_adapters() == 3);
+	check(scanner.get_fds().size() == 3);
+
+	//The same advert heard by the first two, and twice by the first.
+	send(radio[0], report(0x7C, -70, hrm));
+	send(radio[1], report(0x7C, -50, hrm));
+	send(radio[0], report(0x7C, -60, hrm));
+
+	//Another device, and the same device with something else to say.
+	send(radio[2], report(0x7D, -40, hrm));
+	send(radio[1], report(0x7C, -80, battery));
+
+	//Nothing comes out until the window closes.
+	check(drain(scanner).empty());
+
+	vector<MultiScanner::Report> r = scanner.flush();
+	check(r.size() == 3);
+
+	check(r[0].advertisement.address == "7c:76:21:16:57:0b");
+	check(r[0].advertisement.UUIDs.at(0) == UUID(0x180d));
+	check(r[0].advertisement.rssi == -50);
+	check(r[0].sightings == 3);
+	check(r[0].first_adapter == 0);
+	check((r[0].rssi == vector<int8_t>{-60, -50, 127}));
+
+	check(r[1].advertisement.address == "7d:76:21:16:57:0b");
+	check(r[1].advertisement.rssi == -40);
+	check(r[1].sightings == 1);
+	check(r[1].first_adapter == 2);
+	check((r[1].rssi == vector<int8_t>{127, 127, -40}));
+
+	check(r[2].advertisement.address == "7c:76:21:16:57:0b");
+	check(r[2].advertisement.UUIDs.at(0) == UUID(0x180f));
+	check((r[2].rssi == vector<int8_t>{127, -80, 127}));
+
+	check(scanner.flush().empty());
+
+	//An adapter added while reports are open gets its own RSSI in them,
+	//and 127 in those it didn't hear.
+	send(radio[0], report(0x7C, -70, hrm));
+	send(radio[0], report(0x7D, -70, hrm));
+	check(drain(scanner).empty());
+	{
+		int sv[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+		check(scanner.add_adapter(sv[0], HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, false) == 3);
+		radio.push_back(sv[1]);
+	}
+	send(radio[3], report(0x7C, -30, hrm));
+	check(drain(scanner).empty());
+	r = scanner.flush();
+	check(r.size() == 2);
+	check((r[0].rssi == vector<int8_t>{-70, 127, 127, -30}));
+	check((r[1].rssi == vector<int8_t>{-70, 127, 127, 127}));
+
+	//With a short window, reports come out on their own once it closes,
+	//and a repeat after that starts a new report.
+	MultiScanner quick(0.02);
+	int sv[2];
+	check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+	quick.add_adapter(sv[0], HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, false);
+
+	send(sv[1], report(0x7C, -70, hrm));
+	send(sv[1], report(0x7C, -65, hrm));
+	check(drain(quick).empty());
+
+	r = quick.get_advertisements(1000);
+	check(r.size() == 1);
+	check(r[0].sightings == 2);
+	check(r[0].advertisement.rssi == -65);
+
+	send(sv[1], report(0x7C, -90, hrm));
+	this_thread::sleep_for(chrono::milliseconds(30));
+	r = quick.get_advertisements(-1);
+	check(r.size() == 1);
+	check(r[0].sightings == 1);
+	check(r[0].advertisement.rssi == -90);
+
+	//Nothing to come: the timeout is honoured.
+	check(quick.get_advertisements(10).empty());
+
+	//An adapter going away is an error, not a busy loop.
+	close(sv[1]);
+	bool threw=false;
+	try
+	{
+		quick.get_advertisements(1000);
+	}
+	catch(const HCIScanner::IOError&)
+	{
+		threw = true;
+	}
+	check(threw);
+}
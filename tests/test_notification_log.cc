@@ -0,0 +1,357 @@
+#include <blepp/notification_log.h>
+#include <blepp/blestatemachine.h>
+#include <vector>
+#include <string>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+struct Logged
+{
+	uint16_t stream;
+	int64_t monotonic_ns, kernel_ns;
+	vector<uint8_t> data;
+};
+
+vector<Logged> random_notifications(mt19937& rng, size_t n, uint16_t streams)
+{
+	vector<Logged> v(n);
+	int64_t t = 1000000000;
+	for(auto& l: v)
+	{
+		l.stream = 1 + rng() % streams;
+		t += rng() % 1000000;
+		l.monotonic_ns = t;
+		l.kernel_ns = 1700000000000000000ll + t + rng() % 1000;
+		l.data.resize(rng() % 4 ? rng() % 21 : rng() % 245);
+		for(auto& b: l.data)
+			b = rng();
+	}
+	return v;
+}
+
+void write_all(NotificationLogWriter& w, const vector<Logged>& v)
+{
+	for(const auto& l: v)
+		w.log(l.stream, l.data.data(), l.data.size(), l.monotonic_ns, l.kernel_ns);
+}
+
+//Everything in the files, checking each one describes its streams.
+vector<Logged> read_all(const vector<string>& files, const vector<string>& labels)
+{
+	vector<Logged> all;
+	for(const auto& f: files)
+	{
+		NotificationLogReader r(f);
+		NotificationLogReader::Notification n;
+		while(r.next(n))
+		{
+			const NotificationLogStream* s = r.stream(n.stream);
+			check(s != nullptr && s->label == labels.at(n.stream));
+			all.push_back(Logged{n.stream, n.monotonic_ns, n.kernel_ns, vector<uint8_t>(n.data, n.data + n.length)});
+		}
+		check(!r.truncated());
+	}
+	return all;
+}
+
+bool same(const vector<Logged>& a, const vector<Logged>& b)
+{
+	if(a.size() != b.size())
+		return false;
+	for(size_t i=0; i < a.size(); i++)
+		if(a[i].stream != b[i].stream || a[i].monotonic_ns != b[i].monotonic_ns || a[i].kernel_ns != b[i].kernel_ns || a[i].data != b[i].data)
+			return false;
+	return true;
+}
+
+template<class F> bool throws(F f)
+{
+	try
+	{
+		f();
+	}
+	catch(const exception&)
+	{
+		return true;
+	}
+	return false;
+}
+
+timespec realtime()
+{
+	timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	return t;
+}
+
+double seconds_between(const timespec& a, const timespec& b)
+{
+	return (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) * 1e-9;
+}
+
+int main()
+{
+	//Sequence numbers, with gaps, wrapping and repeats.
+	{
+		SequenceCounter c;
+		c.offset = 1;
+		c.size = 1;
+		for(int v: {250, 251, 253, 254, 255, 0, 1, 1, 5, 3, 6})
+		{
+			uint8_t data[2] = {0xAA, uint8_t(v)};
+			c.observe(data, 2);
+		}
+		uint8_t short_one[1] = {0};
+		c.observe(short_one, 1);
+
+		check(c.received == 12);
+		check(c.gaps == 2 && c.missed == 4);
+		check(c.out_of_order == 2);
+		check(c.malformed == 1);
+
+		SequenceCounter c16;
+		c16.offset = 0;
+		c16.size = 2;
+		for(int v: {65534, 65535, 0, 3})
+		{
+			uint8_t data[2] = {uint8_t(v), uint8_t(v >> 8)};
+			c16.observe(data, 2);
+		}
+		check(c16.gaps == 1 && c16.missed == 2 && c16.out_of_order == 0);
+
+		SequenceCounter c32;
+		c32.offset = 0;
+		c32.size = 4;
+		for(uint32_t v: {0xFFFFFFFEu, 0xFFFFFFFFu, 0u, 1u, 100u})
+		{
+			uint8_t data[4];
+			memcpy(data, &v, 4);
+			c32.observe(data, 4);
+		}
+		check(c32.gaps == 1 && c32.missed == 98 && c32.out_of_order == 0);
+
+		SequenceCounter none;
+		none.observe(nullptr, 0);
+		check(none.received == 1 && none.malformed == 0);
+	}
+
+	char dir_template[] = "/tmp/blepp_notification_log_XXXXXX";
+	check(mkdtemp(dir_template) != nullptr);
+	string dir = dir_template;
+
+	mt19937 rng(1);
+	vector<string> labels = {"", "emg", "battery", "heart rate"};
+	vector<Logged> notifications = random_notifications(rng, 50000, 3);
+
+	//Everything comes back, across files, with the streams described in each.
+	for(bool direct: {false, true})
+	{
+		string prefix = dir + (direct ? "/direct" : "/buffered");
+		NotificationLogOptions o;
+		o.rotate_bytes = 300000;
+		o.buffer_size = 128 << 10;
+		o.direct = direct;
+		{
+			NotificationLogWriter w(prefix, o);
+			check(w.file() == prefix + "-000000.blepplog");
+			check(w.add_stream("AA:BB:CC:DD:EE:FF", "53f72b8c-ff27-4177-9eee-30ace844f8f2", "emg") == 1);
+			check(w.add_stream("AA:BB:CC:DD:EE:FF", "2a19", "battery") == 2);
+			check(w.add_stream("11:22:33:44:55:66", "2a37", "heart rate") == 3);
+			write_all(w, notifications);
+		}
+
+		vector<string> files = NotificationLogWriter::files(prefix);
+		check(files.size() > 3);
+		for(size_t i=0; i < files.size(); i++)
+		{
+			check(files[i] == NotificationLogWriter::file_name(prefix, i));
+
+			struct stat s;
+			check(stat(files[i].c_str(), &s) == 0 && s.st_size <= 300000);
+		}
+		check(same(read_all(files, labels), notifications));
+
+		NotificationLogReader r(files[0]);
+		check(r.stream(2)->device == "AA:BB:CC:DD:EE:FF" && r.stream(2)->characteristic == "2a19");
+		check(r.stream(0) == nullptr && r.stream(4) == nullptr);
+	}
+
+	//Flushed notifications can be read while logging, and O_DIRECT's
+	//padding isn't mistaken for anything.
+	for(bool direct: {false, true})
+	{
+		string prefix = dir + (direct ? "/flushed_direct" : "/flushed");
+		NotificationLogOptions o;
+		o.direct = direct;
+		NotificationLogWriter w(prefix, o);
+		w.add_stream("AA:BB:CC:DD:EE:FF", "2a37", "emg");
+		w.add_stream("AA:BB:CC:DD:EE:FF", "2a38", "battery");
+
+		//Only the first two streams, for now.
+		vector<Logged> first(notifications.begin(), notifications.begin() + 100);
+		vector<Logged> second(notifications.begin() + 100, notifications.begin() + 250);
+		for(auto* v: {&first, &second})
+			for(auto& l: *v)
+				l.stream = 1 + l.stream % 2;
+		write_all(w, first);
+		w.flush();
+		check(same(read_all({w.file()}, labels), first));
+
+		//And again, rewriting the last block.
+		write_all(w, second);
+		w.flush();
+		first.insert(first.end(), second.begin(), second.end());
+		check(same(read_all({w.file()}, labels), first));
+
+		//A stream added part way through.
+		uint16_t s = w.add_stream("11:22:33:44:55:66", "2a37", "heart rate");
+		uint8_t beat[] = {0x00, 72};
+		w.log(s, beat, sizeof(beat), 5, 6);
+		w.close();
+		first.push_back(Logged{s, 5, 6, {0x00, 72}});
+		check(same(read_all({w.file()}, labels), first));
+
+		check(throws([&]{ w.log(1, beat, 2, 0, 0); }));
+	}
+
+	//Files also start anew after a span of time, and numbering carries on
+	//from the files already there.
+	{
+		string prefix = dir + "/timed";
+		NotificationLogOptions o;
+		o.rotate_seconds = 1;
+		{
+			NotificationLogWriter w(prefix, o);
+			w.add_stream("AA:BB:CC:DD:EE:FF", "2a37", "emg");
+			uint8_t v = 0;
+			for(int64_t t=0; t < 3500000000ll; t += 100000000)
+				w.log(1, &v, 1, t, 0);
+		}
+		check(NotificationLogWriter::files(prefix).size() == 4);
+
+		NotificationLogWriter w(prefix, o);
+		check(w.file() == NotificationLogWriter::file_name(prefix, 4));
+	}
+
+	//A log cut off part way through a notification.
+	{
+		string name = NotificationLogWriter::file_name(dir + "/buffered", 0);
+		string copy = dir + "/copy.blepplog";
+		check(system(("cp " + name + " " + copy).c_str()) == 0);
+
+		struct stat s;
+		check(stat(copy.c_str(), &s) == 0);
+		check(truncate(copy.c_str(), s.st_size - 3) == 0);
+
+		NotificationLogReader r(copy);
+		NotificationLogReader::Notification n;
+		size_t count=0;
+		while(r.next(n))
+		{
+			check(n.monotonic_ns == notifications[count].monotonic_ns);
+			count++;
+		}
+		check(r.truncated());
+		check(count > 0);
+	}
+
+	check(throws([&]{ NotificationLogReader r(dir + "/nothing"); }));
+	check(system(("echo not a notification log > " + dir + "/text").c_str()) == 0);
+	check(throws([&]{ NotificationLogReader r(dir + "/text"); }));
+
+	{
+		NotificationLogOptions o;
+		o.buffer_size = 100000;
+		check(throws([&]{ NotificationLogWriter w(dir + "/x", o); }));
+		o.buffer_size = 4096;
+		check(throws([&]{ NotificationLogWriter w(dir + "/x", o); }));
+	}
+	{
+		NotificationLogWriter w(dir + "/y");
+		check(throws([&]{ w.add_stream("a\tb", "2a37", "emg"); }));
+		check(throws([&]{ w.log(1, nullptr, 0, 0, 0); }));
+	}
+
+	check(system(("rm -r " + dir).c_str()) == 0);
+
+	//The kernel's receive times come through to the notification callbacks,
+	//whether PDUs are read one at a time or in batches.
+	for(bool batch: {false, true})
+	{
+		int sv[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+
+		BLEGATTStateMachine gatt;
+		gatt.set_kernel_timestamps(true);
+		gatt.adopt_socket(sv[0]);
+
+		Characteristic c(&gatt);
+		c.broadcast = c.read = c.write_without_response = c.write = c.indicate = c.authenticated_write = c.extended = false;
+		c.uuid = UUID(0x2a37);
+		c.notify = true;
+		c.value_handle = 3;
+		c.first_handle = 2;
+		c.last_handle = 3;
+		c.client_characteric_configuration_handle = c.ccc_last_known_value = 0;
+		gatt.primary_services.push_back(PrimaryService{1, 10, UUID(0x180d), {c}});
+
+		vector<timespec> times;
+		gatt.primary_services[0].characteristics[0].cb_notify_or_indicate = [&](const PDUNotificationOrIndication& n)
+		{
+			check(n.value().second - n.value().first == 1);
+			check(*n.value().first == times.size());
+			times.push_back(gatt.packet_time());
+		};
+
+		timespec before = realtime();
+		for(uint8_t i=0; i < 5; i++)
+		{
+			uint8_t pdu[] = {ATT_OP_HANDLE_NOTIFY, 3, 0, i};
+			check(write(sv[1], pdu, sizeof(pdu)) == sizeof(pdu));
+		}
+		timespec after = realtime();
+
+		if(batch)
+			check(gatt.process_all_pending() == 5);
+		else
+			for(int i=0; i < 5; i++)
+				gatt.read_and_process_next();
+
+		check(times.size() == 5);
+		for(size_t i=0; i < times.size(); i++)
+		{
+			check(seconds_between(before, times[i]) >= 0);
+			check(seconds_between(times[i], after) >= 0);
+			if(i)
+				check(seconds_between(times[i-1], times[i]) >= 0);
+		}
+
+		//And they're zero when turned off.
+		gatt.set_kernel_timestamps(false);
+		uint8_t pdu[] = {ATT_OP_HANDLE_NOTIFY, 3, 0, 5};
+		check(write(sv[1], pdu, sizeof(pdu)) == sizeof(pdu));
+		if(batch)
+			check(gatt.process_all_pending() == 1);
+		else
+			gatt.read_and_process_next();
+		check(times.size() == 6 && times[5].tv_sec == 0 && times[5].tv_nsec == 0);
+
+		::close(sv[1]);
+	}
+}
@@ -0,0 +1,100 @@
+#include <blepp/pretty_printers.h>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+//The formatting as it was done with iostreams.
+string reference_hex(int v, int width)
+{
+	ostringstream os;
+	os << setw(width) << setfill('0') << hex << v;
+	return os.str();
+}
+
+string reference_str(uint8_t u)
+{
+	if(u < 32 || u > 126)
+		return "\\x" + reference_hex(u, 2);
+	else
+		return string(1, (char)u);
+}
+
+int main()
+{
+	for(int i=0; i < 256; i++)
+	{
+		check(to_hex(uint8_t(i)) == reference_hex(i, 2));
+		check(to_str(uint8_t(i)) == reference_str(i));
+	}
+
+	for(int i=0; i < 65536; i++)
+		check(to_hex(uint16_t(i)) == reference_hex(i, 4));
+
+	mt19937 rng(1);
+	for(int i=0; i < 1000; i++)
+	{
+		vector<uint8_t> v(rng() % 30);
+		for(auto& b: v)
+			b = rng();
+
+		string hex, str;
+		for(uint8_t b: v)
+		{
+			hex += reference_hex(b, 2) + " ";
+			str += reference_str(b);
+		}
+		check(to_hex(v) == hex);
+		check(to_str(v) == str);
+
+		//UUIDs of every size match BlueZ's formatting.
+		bt_uuid_t u;
+		if(i % 3 == 0)
+			bt_uuid16_create(&u, rng());
+		else if(i % 3 == 1)
+			bt_uuid32_create(&u, rng());
+		else
+		{
+			uint128_t x;
+			for(auto& b: x.data)
+				b = rng();
+			bt_uuid128_create(&u, x);
+		}
+		char s[MAX_LEN_UUID_STR];
+		bt_uuid_to_string(&u, s, sizeof(s));
+		check(to_short_str(u) == s);
+		check(to_str(u) == s);
+	}
+
+	check(to_hex(nullptr, 0) == "");
+	check(to_str(nullptr, 0) == "");
+
+	//Addresses come off the air backwards.
+	const uint8_t address[] = {0x0B, 0x57, 0x16, 0x21, 0x76, 0x7C};
+	AddressString a = address_to_short_str(address);
+	check(a == "7c:76:21:16:57:0b");
+	check(a.size() == 17);
+
+	ostringstream os;
+	os << a << " " << to_short_str(bt_uuid_t{BT_UUID16, {0x2a37}});
+	check(os.str() == "7c:76:21:16:57:0b 2a37");
+
+	//The buffer versions write exactly what they say.
+	char buf[8];
+	memset(buf, '#', sizeof(buf));
+	check(to_hex_chars(buf, uint16_t(0xbeef)) == buf + 4);
+	check(string(buf, 8) == "beef####");
+}
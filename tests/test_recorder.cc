@@ -0,0 +1,312 @@
+#include <blepp/recorder.h>
+#include <vector>
+#include <string>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <csignal>
+
+using namespace BLEPP;
+using namespace std;
+using namespace std::chrono;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+typedef system_clock::time_point Time;
+
+struct Advert
+{
+	int64_t time;
+	uint8_t event_type;
+	uint8_t address_type;
+	uint8_t address[6];
+	vector<uint8_t> data;
+	int8_t rssi;
+
+	RawAdvert raw() const
+	{
+		return RawAdvert{event_type, address_type, address, data.data(), data.size(), rssi};
+	}
+
+	Time when() const
+	{
+		return Time(microseconds(time));
+	}
+
+	bool operator==(const RawAdvert& a) const
+	{
+		return a.event_type == event_type && a.address_type == address_type && memcmp(a.address, address, 6) == 0 && a.length == data.size() && (data.empty() || memcmp(a.data, data.data(), data.size()) == 0) && a.rssi == rssi;
+	}
+};
+
+//Adverts from a busy site, with the odd clock jump.
+vector<Advert> random_adverts(mt19937& rng, size_t n)
+{
+	vector<Advert> adverts(n);
+	int64_t t = 1700000000000000;
+	for(auto& a: adverts)
+	{
+		switch(rng() % 1000)
+		{
+			case 0:
+				t -= rng() % 10000000; //Backwards
+				break;
+			case 1:
+				t += 5000000000ll; //Over the most a block covers
+				break;
+			default:
+				t += rng() % 2000;
+		}
+		a.time = t;
+		a.event_type = rng() % 5;
+		a.address_type = rng() % 2;
+		for(auto& b: a.address)
+			b = rng() % 4; //So some addresses repeat
+		a.data.resize(rng() % 32);
+		if(rng() % 4 == 0)
+			a.data.clear();
+		for(auto& b: a.data)
+			b = rng();
+		a.rssi = -int(rng() % 100);
+	}
+	return adverts;
+}
+
+//Everything recorded with a prefix, copied out of the files.
+vector<Advert> read_all(const string& prefix)
+{
+	vector<Advert> all;
+	for(const auto& name: RecordingReader::segments(prefix))
+	{
+		RecordingReader reader(name);
+		check(reader.complete());
+		reader.for_each([&](Time t, const RawAdvert& a){
+			Advert c;
+			c.time = duration_cast<microseconds>(t.time_since_epoch()).count();
+			c.event_type = a.event_type;
+			c.address_type = a.address_type;
+			memcpy(c.address, a.address, 6);
+			c.data.assign(a.data, a.data + a.length);
+			c.rssi = a.rssi;
+			all.push_back(c);
+		});
+	}
+	return all;
+}
+
+template<class F> bool throws(F f)
+{
+	try
+	{
+		f();
+	}
+	catch(const exception&)
+	{
+		return true;
+	}
+	return false;
+}
+
+int main()
+{
+	char dir_template[] = "/tmp/blepp_recorder_XXXXXX";
+	check(mkdtemp(dir_template) != nullptr);
+	string dir = dir_template;
+	string prefix = dir + "/scan";
+
+	mt19937 rng(1);
+	vector<Advert> adverts = random_adverts(rng, 20000);
+
+	//Everything comes back as it went in, across several segments.
+	{
+		AdvertRecorder r(prefix, 1<<16, 500);
+		check(r.segment() == prefix + "-000000.blepp");
+		for(const auto& a: adverts)
+			r.record(a.raw(), a.when());
+	}
+
+	vector<string> segments = RecordingReader::segments(prefix);
+	check(segments.size() > 5);
+	for(size_t i=0; i < segments.size(); i++)
+		check(segments[i] == AdvertRecorder::segment_name(prefix, i));
+
+	auto all = read_all(prefix);
+	check(all.size() == adverts.size());
+	for(size_t i=0; i < adverts.size(); i++)
+	{
+		check(all[i].time == adverts[i].time);
+		check(adverts[i] == all[i].raw());
+	}
+
+	//Each block covers the times of its adverts, and a segment is no more
+	//than its limit.
+	size_t total=0;
+	for(const auto& name: segments)
+	{
+		struct stat s;
+		check(stat(name.c_str(), &s) == 0 && s.st_size <= 1<<16);
+
+		RecordingReader reader(name);
+		for(const auto& b: reader.blocks())
+		{
+			check(b.size > 0 && b.size <= 500);
+			for(uint32_t i=0; i < b.size; i++)
+			{
+				int64_t t = duration_cast<microseconds>(b.time(i).time_since_epoch()).count();
+				check(t >= b.first_time && t <= b.last_time);
+			}
+		}
+		total += reader.size();
+	}
+	check(total == adverts.size());
+
+	//Time range queries give what a scan through everything would.
+	RecordingReader middle(segments[segments.size()/2]);
+	Time from = middle.blocks()[1].time(10);
+	Time to = middle.blocks().back().time(0);
+	vector<const Advert*> expected;
+	for(const auto& a: adverts)
+		if(a.when() >= from && a.when() < to)
+			expected.push_back(&a);
+
+	size_t found = 0;
+	for(const auto& name: segments)
+	{
+		RecordingReader reader(name);
+		reader.for_each(from, to, [&](Time t, const RawAdvert& a){
+			check(found < expected.size());
+			check(t == expected[found]->when() && *expected[found] == a);
+			found++;
+		});
+	}
+	check(found == expected.size() && found > 0);
+
+	//And the filters work on recorded adverts.
+	size_t loud = 0;
+	middle.for_each(rssi_above(-20), [&](Time, const RawAdvert& a){
+		check(a.rssi > -20);
+		loud++;
+	});
+	size_t expected_loud = 0;
+	middle.for_each([&](Time, const RawAdvert& a){
+		expected_loud += a.rssi > -20;
+	});
+	check(loud == expected_loud && loud > 0);
+
+	//A new recorder carries on after the last segment.
+	{
+		AdvertRecorder r(prefix);
+		check(r.segment() == AdvertRecorder::segment_name(prefix, segments.size()));
+
+		//Flushed blocks can be read while recording, without the index.
+		//The times are steady here, so nothing else ends a block.
+		Time start = adverts[0].when();
+		for(int i=0; i < 100; i++)
+			r.record(adverts[i].raw(), start + microseconds(i));
+		r.flush();
+		for(int i=100; i < 150; i++)
+			r.record(adverts[i].raw(), start + microseconds(i));
+
+		{
+			RecordingReader reader(r.segment());
+			check(!reader.complete());
+			check(reader.size() == 100);
+			size_t i=0;
+			reader.for_each([&](Time t, const RawAdvert& a){
+				check(t == start + microseconds(i) && adverts[i] == a);
+				i++;
+			});
+		}
+
+		r.rotate();
+		check(r.segment() == AdvertRecorder::segment_name(prefix, segments.size() + 1));
+		RecordingReader reader(AdvertRecorder::segment_name(prefix, segments.size()));
+		check(reader.complete() && reader.size() == 150);
+
+		r.close();
+		check(throws([&]{r.record(adverts[0].raw());}));
+	}
+	check(RecordingReader::segments(prefix).size() == segments.size() + 2);
+
+	//Parsed adverts are recorded from their raw data.
+	{
+		vector<uint8_t> packet = {HCI_EVENT_PKT, EVT_LE_META_EVENT, 0x15, 0x02, 1, 0x03, 0x01, 0x0B, 0x57, 0x16, 0x21, 0x76, 0x7C, 0x09, 0x02, 0x01, 0x06, 0x05, 0x09, 'a', 'b', 'c', 'd', 0xB0};
+		auto parsed = HCIScanner::parse_packet(packet);
+		check(parsed.size() == 1);
+
+		string p = dir + "/parsed";
+		{
+			AdvertRecorder r(p);
+			r.record(parsed[0], Time(microseconds(5)));
+		}
+
+		RecordingReader reader(AdvertRecorder::segment_name(p, 0));
+		check(reader.size() == 1);
+		reader.for_each([&](Time t, const RawAdvert& a){
+			check(t == Time(microseconds(5)));
+			check(a.event_type == 3 && a.address_type == 1 && a.rssi == -80);
+			check(memcmp(a.address, packet.data() + 7, 6) == 0);
+			check(a.length == 9 && memcmp(a.data, packet.data() + 14, 9) == 0);
+		});
+	}
+
+	//Damage is noticed.
+	{
+		string name = AdvertRecorder::segment_name(prefix, 0);
+		RecordingReader whole(name);
+
+		//Losing the index still leaves the blocks.
+		string copy = dir + "/copy-000000.blepp";
+		struct stat s;
+		check(stat(name.c_str(), &s) == 0);
+		check(system(("cp " + name + " " + copy).c_str()) == 0);
+		check(truncate(copy.c_str(), s.st_size - 1) == 0);
+		{
+			RecordingReader reader(copy);
+			check(!reader.complete());
+			check(reader.size() == whole.size());
+		}
+
+		//Losing part of the last block loses that block.
+		const uint8_t* first = reinterpret_cast<const uint8_t*>(whole.blocks().front().time_offsets);
+		const uint8_t* last = reinterpret_cast<const uint8_t*>(whole.blocks().back().time_offsets);
+		check(truncate(copy.c_str(), (last - first) + whole.blocks().back().size) == 0);
+		{
+			RecordingReader reader(copy);
+			check(!reader.complete());
+			check(reader.blocks().size() == whole.blocks().size() - 1);
+		}
+	}
+
+	check(throws([&]{RecordingReader r(dir + "/nothing");}));
+	check(system(("echo not a recording > " + dir + "/text").c_str()) == 0);
+	check(throws([&]{RecordingReader r(dir + "/text");}));
+
+	check(throws([&]{AdvertRecorder r(dir + "/x", 1000);}));
+	check(throws([&]{AdvertRecorder r(dir + "/x", 1<<20, 0);}));
+
+	//No room for a segment, as on a full disk, is an error up front, and
+	//leaves nothing behind.
+	{
+		rlimit old_limit, limit;
+		check(getrlimit(RLIMIT_FSIZE, &old_limit) == 0);
+		limit = old_limit;
+		limit.rlim_cur = 1 << 20;
+		signal(SIGXFSZ, SIG_IGN);
+		check(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+		check(throws([&]{AdvertRecorder r(dir + "/full", 2<<20);}));
+		check(setrlimit(RLIMIT_FSIZE, &old_limit) == 0);
+		check(RecordingReader::segments(dir + "/full").empty());
+	}
+
+	check(system(("rm -r " + dir).c_str()) == 0);
+}
@@ -0,0 +1,527 @@
+#include <blepp/lescan.h>
+#include <blepp/multiscanner.h>
+#include <blepp/pretty_printers.h>
+#include <bluetooth/hci.h>
+#include <vector>
+#include <array>
+#include <string>
+#include <thread>
+#include <stdexcept>
+#include <cstdlib>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+typedef vector<uint8_t> Packet;
+
+//Stands in for the controller, in a child process. It records each command
+//it gets, and answers with Command Complete, with the statuses given in
+//order, then success, after delay_ms. Its accept list holds accept_list_size
+//devices.
+struct FakeController
+{
+	int host;      //The scanner's end.
+	int radio;     //For sending events as if from the controller.
+	int recording; //The commands, one per packet.
+	pid_t pid;
+
+	explicit FakeController(const Packet& statuses={}, uint8_t accept_list_size=4, int delay_ms=0)
+	{
+		int sv[2], rec[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, rec) == 0);
+
+		pid = fork();
+		check(pid >= 0);
+		if(pid == 0)
+		{
+			close(sv[0]);
+			close(rec[0]);
+			for(size_t i=0;; i++)
+			{
+				uint8_t buf[300];
+				ssize_t n = read(sv[1], buf, sizeof(buf));
+				if(n <= 0)
+					_exit(0);
+				if(write(rec[1], buf, n) != n)
+					_exit(1);
+				usleep(delay_ms * 1000);
+
+				uint8_t status = i < statuses.size() ? statuses[i] : 0;
+				Packet complete = {HCI_EVENT_PKT, EVT_CMD_COMPLETE, 4, 1, buf[1], buf[2], status};
+				if(buf[1] == OCF_LE_READ_WHITE_LIST_SIZE)
+				{
+					complete[2]++;
+					complete.push_back(accept_list_size);
+				}
+				if(write(sv[1], complete.data(), complete.size()) != ssize_t(complete.size()))
+					_exit(1);
+			}
+		}
+
+		close(rec[1]);
+		host = sv[0];
+		radio = sv[1];
+		recording = rec[0];
+	}
+
+	//The commands sent since last time.
+	vector<Packet> commands()
+	{
+		vector<Packet> c;
+		uint8_t buf[300];
+		ssize_t n;
+		while((n = recv(recording, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+			c.emplace_back(buf, buf + n);
+		return c;
+	}
+
+	void send(const Packet& p)
+	{
+		check(write(radio, p.data(), p.size()) == ssize_t(p.size()));
+	}
+
+	//Call once the scanner has gone, closing its end.
+	void finish()
+	{
+		close(radio);
+		close(recording);
+		int status;
+		check(waitpid(pid, &status, 0) == pid);
+		check(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+};
+
+Packet set_parameters(uint8_t type, uint16_t interval, uint16_t window, uint8_t own=0, uint8_t policy=0)
+{
+	return {HCI_COMMAND_PKT, 0x0B, 0x20, 7, type, uint8_t(interval), uint8_t(interval >> 8), uint8_t(window), uint8_t(window >> 8), own, policy};
+}
+
+Packet set_enable(uint8_t enable, uint8_t filter_dup)
+{
+	return {HCI_COMMAND_PKT, 0x0C, 0x20, 2, enable, filter_dup};
+}
+
+Packet accept_list_command(uint8_t ocf, uint8_t type, uint8_t last_address_byte)
+{
+	return {HCI_COMMAND_PKT, ocf, 0x20, 7, type, 0x0B, 0x57, 0x16, 0x21, 0x76, last_address_byte};
+}
+
+const Packet read_accept_list_size = {HCI_COMMAND_PKT, 0x0F, 0x20, 0};
+const Packet clear_accept_list = {HCI_COMMAND_PKT, 0x10, 0x20, 0};
+
+Packet add(uint8_t last_address_byte, uint8_t type=0)
+{
+	return accept_list_command(0x11, type, last_address_byte);
+}
+
+Packet remove(uint8_t last_address_byte, uint8_t type=0)
+{
+	return accept_list_command(0x12, type, last_address_byte);
+}
+
+Packet advert(int8_t rssi, uint8_t last_address_byte=0x7C, uint8_t type=0)
+{
+	return {HCI_EVENT_PKT, EVT_LE_META_EVENT, 15, 0x02, 1, 0x00, type, 0x0B, 0x57, 0x16, 0x21, 0x76, last_address_byte, 3, 0x02, 0x01, 0x06, uint8_t(rssi)};
+}
+
+//Two reports in one packet, which is checked after parsing.
+Packet adverts(uint8_t first, uint8_t second)
+{
+	return {HCI_EVENT_PKT, EVT_LE_META_EVENT, 25, 0x02, 2,
+		0x00, 0x00, 0x0B, 0x57, 0x16, 0x21, 0x76, first, 3, 0x02, 0x01, 0x06, 0xC0,
+		0x00, 0x00, 0x0B, 0x57, 0x16, 0x21, 0x76, second, 0, 0xC1};
+}
+
+string address(uint8_t last_address_byte)
+{
+	return to_hex(last_address_byte) + ":76:21:16:57:0b";
+}
+
+int main()
+{
+	//Parameters in the controller's units.
+	ScanParameters p = ScanParameters::from_milliseconds(100, 30);
+	check(p.interval == 160 && p.window == 48);
+	check(p.duty_cycle() == 0.3);
+	p.validate();
+	for(auto bad: {ScanParameters::from_milliseconds(1, 1), ScanParameters::from_milliseconds(100, 200), ScanParameters::from_milliseconds(20000, 10)})
+	{
+		bool threw=false;
+		try
+		{
+			bad.validate();
+		}
+		catch(const invalid_argument&)
+		{
+			threw = true;
+		}
+		check(threw);
+	}
+
+	//The defaults are what hcitool uses.
+	{
+		FakeController c;
+		{
+			HCIScanner s(true, HCIScanner::FilterDuplicates::Both, HCIScanner::ScanType::Active, c.host);
+			check((c.commands() == vector<Packet>{set_parameters(1, 0x10, 0x10), set_enable(1, 1)}));
+		}
+		check((c.commands() == vector<Packet>{set_enable(0, 0)}));
+		c.finish();
+	}
+
+	//Given parameters are used as given, and changing them mid scan restarts it.
+	{
+		FakeController c;
+		{
+			HCIScanner s(false, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Passive, c.host);
+			ScanParameters q;
+			q.interval = 0x0800;
+			q.window = 0x0012;
+			q.own_address_type = LE_RANDOM_ADDRESS;
+			q.filter_policy = 1;
+			s.set_parameters(q);
+			check(c.commands().empty());
+
+			s.start();
+			check((c.commands() == vector<Packet>{set_parameters(0, 0x0800, 0x0012, 1, 1), set_enable(1, 0)}));
+
+			q.window = 0x0400;
+			s.set_parameters(q);
+			check(s.parameters().window == 0x0400);
+			check((c.commands() == vector<Packet>{set_enable(0, 0), set_parameters(0, 0x0800, 0x0400, 1, 1), set_enable(1, 0)}));
+
+			s.stop();
+			check((c.commands() == vector<Packet>{set_enable(0, 0)}));
+		}
+		check(c.commands().empty());
+		c.finish();
+	}
+
+	//If the controller refuses the parameters, perhaps because it was left
+	//scanning, the scan is turned off and they're tried again.
+	{
+		FakeController c({0x0C});
+		{
+			HCIScanner s(true, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, c.host);
+			check((c.commands() == vector<Packet>{set_parameters(1, 0x10, 0x10), set_enable(0, 0), set_parameters(1, 0x10, 0x10), set_enable(1, 0)}));
+		}
+		c.finish();
+	}
+
+	//Adverts arriving while waiting for a command aren't lost, and the answers
+	//to other commands aren't mistaken for adverts.
+	{
+		FakeController c;
+		{
+			HCIScanner s(false, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, c.host);
+			c.send(advert(-40));
+			s.start();
+			vector<AdvertisingResponse> a = s.get_advertisements();
+			check(a.size() == 1 && a[0].rssi == -40);
+
+			c.send({HCI_EVENT_PKT, EVT_CMD_COMPLETE, 4, 1, 0x03, 0x0C, 0});
+			c.send(advert(-41));
+			check(s.get_advertisements().empty());
+			a = s.get_advertisements();
+			check(a.size() == 1 && a[0].rssi == -41);
+		}
+		c.finish();
+	}
+
+	//Signals, such as from a timer, don't interrupt commands, even when they
+	//come while stopping in the destructor.
+	{
+		FakeController c({}, 4, 30);
+
+		struct sigaction sa, old;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = [](int){};
+		check(sigaction(SIGALRM, &sa, &old) == 0);
+		itimerval every_2ms = {{0, 2000}, {0, 2000}}, off = {{0, 0}, {0, 0}};
+		check(setitimer(ITIMER_REAL, &every_2ms, nullptr) == 0);
+		{
+			HCIScanner s(true, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, c.host);
+			check((c.commands() == vector<Packet>{set_parameters(1, 0x10, 0x10), set_enable(1, 0)}));
+			s.set_accept_list({});
+		}
+		check(setitimer(ITIMER_REAL, &off, nullptr) == 0);
+		check(sigaction(SIGALRM, &old, nullptr) == 0);
+
+		vector<Packet> stopped = c.commands();
+		check(!stopped.empty() && stopped.back() == set_enable(0, 0));
+		c.finish();
+	}
+
+	//A controller which doesn't answer.
+	{
+		int sv[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+		HCIScanner s(false, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, sv[0]);
+		ScanParameters q;
+		q.timeout = 20;
+		s.set_parameters(q);
+		bool threw=false;
+		try
+		{
+			s.start();
+		}
+		catch(const HCIScanner::IOError&)
+		{
+			threw = true;
+		}
+		check(threw);
+		close(sv[1]);
+	}
+
+	//The scheduler on its own, on a made up clock.
+	{
+		ScanScheduler::Clock::time_point t;
+		ScanParameters full;
+		full.interval = 0x0100;
+		full.window = 0x0100;
+		AdaptiveScan adapt;
+		adapt.min_window = 0x0010;
+		adapt.idle_rate = 1;
+		adapt.busy_rate = 20;
+		adapt.period = 1;
+		ScanScheduler sched(full, adapt, t);
+		auto at = [&](double s){ return t + chrono::duration_cast<ScanScheduler::Clock::duration>(chrono::duration<double>(s)); };
+
+		//Quiet: the window halves each period, down to the minimum.
+		check(!sched.observe(0, 0, at(0.5)));
+		check(sched.observe(0, 0, at(1)));
+		check(sched.parameters().window == 0x0080);
+		check(sched.parameters().interval == 0x0100);
+		check(sched.observe(0, 0, at(2)) && sched.parameters().window == 0x0040);
+		check(sched.observe(0, 0, at(3)) && sched.parameters().window == 0x0020);
+		check(sched.observe(0, 0, at(4)) && sched.parameters().window == 0x0010);
+		check(!sched.observe(0, 0, at(5)) && sched.parameters().window == 0x0010);
+
+		//In between: it stays put.
+		check(!sched.observe(5, 0, at(6)) && sched.parameters().window == 0x0010);
+		check(sched.report_rate() == 5);
+
+		//Busy: it doubles, up to the full window.
+		for(int i=0; i < 5; i++)
+			sched.observe(50, 0, at(7 + i));
+		check(sched.parameters().window == 0x0100);
+		check(!sched.observe(100, 0, at(12)));
+
+		//Dropping reports backs off, however busy.
+		check(sched.observe(100, 3, at(13)) && sched.parameters().window == 0x0080);
+	}
+
+	//Adapting a running scan.
+	{
+		FakeController c;
+		{
+			HCIScanner s(true, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, c.host);
+			c.commands();
+
+			AdaptiveScan adapt;
+			adapt.idle_rate = 1000;
+			adapt.busy_rate = 10000;
+			adapt.period = 0.01;
+			s.set_adaptive(adapt);
+
+			this_thread::sleep_for(chrono::milliseconds(20));
+			c.send(advert(-50));
+			check(s.get_advertisements().size() == 1);
+			check(s.parameters().window == 0x0008);
+			check((c.commands() == vector<Packet>{set_enable(0, 0), set_parameters(1, 0x10, 0x08), set_enable(1, 0)}));
+
+			//Setting the parameters by hand stops it adapting.
+			s.set_parameters(ScanParameters());
+			c.commands();
+			this_thread::sleep_for(chrono::milliseconds(20));
+			c.send(advert(-50));
+			check(s.get_advertisements().size() == 1);
+			check(c.commands().empty());
+		}
+		c.finish();
+	}
+
+	//Adapting when nothing at all is heard, and keeping the parameters set
+	//by hand as the limit.
+	{
+		FakeController c;
+		{
+			HCIScanner s(true, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, c.host);
+			c.commands();
+			check(s.poll_timeout() == -1);
+
+			AdaptiveScan adapt;
+			adapt.idle_rate = 1000;
+			adapt.busy_rate = 10000;
+			adapt.period = 0.01;
+			s.set_adaptive(adapt);
+			check(s.poll_timeout() >= 0 && s.poll_timeout() <= 10);
+			check(c.commands().empty());
+
+			this_thread::sleep_for(chrono::milliseconds(20));
+			check(s.poll_timeout() == 0);
+			s.check_idle();
+			check(s.parameters().window == 0x0008);
+			check((c.commands() == vector<Packet>{set_enable(0, 0), set_parameters(1, 0x10, 0x08), set_enable(1, 0)}));
+
+			//Starting again starts from the window set by hand.
+			adapt.idle_rate = 0;
+			adapt.busy_rate = 0;
+			s.set_adaptive(adapt);
+			check(s.parameters().window == 0x0010);
+			check((c.commands() == vector<Packet>{set_enable(0, 0), set_parameters(1, 0x10, 0x10), set_enable(1, 0)}));
+
+			//However busy, it listens no more than that.
+			this_thread::sleep_for(chrono::milliseconds(20));
+			c.send(advert(-50));
+			check(s.get_advertisements().size() == 1);
+			check(s.parameters().window == 0x0010);
+			check(c.commands().empty());
+		}
+		c.finish();
+	}
+
+	//Adverts heard while waiting for the controller come out first, without
+	//the socket becoming readable.
+	{
+		FakeController c;
+		{
+			HCIScanner s(true, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, c.host);
+			check(!s.has_pending());
+
+			c.send(advert(-60));
+			s.set_parameters(ScanParameters());
+			check(s.has_pending());
+			check(s.poll_timeout() == 0);
+
+			pollfd p = {s.get_fd(), POLLIN, 0};
+			check(poll(&p, 1, 0) == 0);
+
+			vector<AdvertisingResponse> a = s.get_advertisements();
+			check(a.size() == 1 && a[0].rssi == -60);
+			check(!s.has_pending());
+		}
+		c.finish();
+	}
+
+	//MultiScanner doesn't wait on the socket for those either, and runs the
+	//adaptive scan when nothing is heard.
+	{
+		FakeController c;
+		{
+			MultiScanner m(0.001);
+			m.add_adapter(c.host);
+
+			c.send(advert(-60));
+			m.adapter(0).set_parameters(ScanParameters());
+			check(m.adapter(0).has_pending());
+			vector<MultiScanner::Report> r = m.get_advertisements(1000);
+			check(r.size() == 1 && r[0].advertisement.rssi == -60);
+			c.commands();
+
+			AdaptiveScan adapt;
+			adapt.idle_rate = 1000;
+			adapt.busy_rate = 10000;
+			adapt.period = 0.01;
+			m.adapter(0).set_adaptive(adapt);
+			check(m.get_advertisements(30).empty());
+			check(m.adapter(0).parameters().window < 0x0010);
+			check(!c.commands().empty());
+		}
+		c.finish();
+	}
+
+	//Addresses.
+	check(AcceptListEntry("7C:76:21:16:57:0B") == AcceptListEntry("7c:76:21:16:57:0b", LE_PUBLIC_ADDRESS));
+	check(!(AcceptListEntry("7c:76:21:16:57:0b") == AcceptListEntry("7c:76:21:16:57:0b", LE_RANDOM_ADDRESS)));
+	check((AcceptListEntry("7c:76:21:16:57:0b").address == array<uint8_t, 6>{{0x0B, 0x57, 0x16, 0x21, 0x76, 0x7C}}));
+	for(auto bad: {"", "7c:76:21:16:57", "7c:76:21:16:57:0b:", "7c-76-21-16-57-0b", "7c:76:21:16:57:0g"})
+	{
+		bool threw=false;
+		try
+		{
+			AcceptListEntry e(bad);
+		}
+		catch(const invalid_argument&)
+		{
+			threw = true;
+		}
+		check(threw);
+	}
+
+	//The accept list, kept in step with as few commands as possible.
+	{
+		FakeController c;
+		{
+			HCIScanner s(false, HCIScanner::FilterDuplicates::Off, HCIScanner::ScanType::Active, c.host);
+
+			//What's there already is unknown, so it's cleared first.
+			s.set_accept_list({AcceptListEntry(address(0x7C)), AcceptListEntry(address(0x7D))});
+			check(s.accept_list_in_hardware());
+			check(s.accept_list_size() == 4);
+			check((c.commands() == vector<Packet>{read_accept_list_size, clear_accept_list, add(0x7C), add(0x7D)}));
+
+			s.start();
+			check((c.commands() == vector<Packet>{set_parameters(1, 0x10, 0x10, 0, 1), set_enable(1, 0)}));
+
+			//Mid scan, the scan stops while the list changes.
+			s.set_accept_list({AcceptListEntry(address(0x7D)), AcceptListEntry(address(0x7E), LE_RANDOM_ADDRESS)});
+			check((c.commands() == vector<Packet>{set_enable(0, 0), remove(0x7C), add(0x7E, 1), set_parameters(1, 0x10, 0x10, 0, 1), set_enable(1, 0)}));
+
+			//Nothing to change.
+			s.set_accept_list({AcceptListEntry(address(0x7E), LE_RANDOM_ADDRESS), AcceptListEntry(address(0x7D))});
+			check((c.commands() == vector<Packet>{set_enable(0, 0), set_parameters(1, 0x10, 0x10, 0, 1), set_enable(1, 0)}));
+
+			//Clearing is cheaper than removing two to add one.
+			s.set_accept_list({AcceptListEntry(address(0x70))});
+			check((c.commands() == vector<Packet>{set_enable(0, 0), clear_accept_list, add(0x70), set_parameters(1, 0x10, 0x10, 0, 1), set_enable(1, 0)}));
+
+			//Too many for the controller: filter in software, hearing everyone.
+			vector<AcceptListEntry> fleet;
+			for(uint8_t i=0x70; i < 0x80; i++)
+				fleet.emplace_back(address(i));
+			s.set_accept_list(fleet);
+			check(!s.accept_list_in_hardware());
+			check((c.commands() == vector<Packet>{set_enable(0, 0), set_parameters(1, 0x10, 0x10, 0, 0), set_enable(1, 0)}));
+
+			c.send(advert(-40, 0x7C));
+			c.send(advert(-41, 0x80));
+			c.send(advert(-42, 0x7C, LE_RANDOM_ADDRESS));
+			c.send(adverts(0x60, 0x71));
+			vector<AdvertisingResponse> a = s.get_advertisements();
+			check(a.size() == 1 && a[0].rssi == -40 && a[0].address_type == LE_PUBLIC_ADDRESS);
+			check(s.get_advertisements().empty());
+			check(s.get_advertisements().empty());
+			a = s.get_advertisements();
+			check(a.size() == 1 && a[0].address == address(0x71));
+
+			//Hearing everyone again needs nothing from the controller.
+			s.set_accept_list({});
+			check(!s.accept_list_in_hardware());
+			check(c.commands().empty());
+			c.send(advert(-41, 0x80));
+			check(s.get_advertisements().size() == 1);
+
+			//Back in hardware, only the difference is sent.
+			s.set_accept_list({AcceptListEntry(address(0x70)), AcceptListEntry(address(0x71))});
+			check((c.commands() == vector<Packet>{set_enable(0, 0), add(0x71), set_parameters(1, 0x10, 0x10, 0, 1), set_enable(1, 0)}));
+		}
+		c.finish();
+	}
+}
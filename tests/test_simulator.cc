@@ -0,0 +1,191 @@
+#include <blepp/simulator.h>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+//Handles: 1 service, 2 declaration, 3 value, 4 configuration,
+//5 service, 6 declaration, 7 value
+void make_table(BLEGATTServer& s)
+{
+	s.add_primary_service(UUID("180d"));
+	s.add_characteristic(UUID("2a37"), GATT_CHARACTERISTIC_FLAGS_NOTIFY | GATT_CHARACTERISTIC_FLAGS_READ, {0, 60});
+	s.add_primary_service(UUID("180f"));
+	s.add_characteristic(UUID("2a19"), GATT_CHARACTERISTIC_FLAGS_READ | GATT_CHARACTERISTIC_FLAGS_WRITE, {100});
+}
+
+//Connect and discover everything, returning the time it took.
+double discover(SimulatedPeripheral& sim, BLEGATTStateMachine& gatt)
+{
+	bool done=false;
+	std::function<void()> cb = [&](){ done = true; };
+	gatt.setup_standard_scan(cb);
+
+	double t0 = sim.now();
+	gatt.adopt_socket(sim.connect());
+	check(sim.run(gatt, [&](){ return done; }));
+	check(gatt.primary_services.size() == 2);
+	return sim.now() - t0;
+}
+
+int read_battery(SimulatedPeripheral& sim, BLEGATTStateMachine& gatt)
+{
+	Characteristic& c = gatt.primary_services.at(1).characteristics.at(0);
+	int value=-1;
+	c.cb_read = [&](const PDUReadResponse& r)
+	{
+		value = r.value().first[0];
+	};
+	c.read_request();
+	check(sim.run_until_idle(gatt));
+	return value;
+}
+
+int main()
+{
+	log_level = LogLevels::Warning;
+
+	//No link at all: everything happens at time 0.
+	{
+		SimulatedPeripheral sim;
+		make_table(sim.server);
+		BLEGATTStateMachine gatt;
+
+		check(discover(sim, gatt) == 0);
+		check(read_battery(sim, gatt) == 100);
+		check(sim.retransmissions == 0);
+	}
+
+	//Connection events: a request goes out at one event and the response comes
+	//back at the next, so every round trip takes two intervals.
+	{
+		SimulatedPeripheral::Link link;
+		link.connection_interval = 0.030;
+		link.latency = 0.002;
+
+		SimulatedPeripheral sim(link);
+		make_table(sim.server);
+		BLEGATTStateMachine gatt;
+
+		double t = discover(sim, gatt);
+		uint64_t round_trips = sim.pdus_to_peripheral;
+		check(round_trips >= 3);
+		check(sim.pdus_to_central == round_trips);
+		check(fabs(t - ((2*round_trips - 1) * link.connection_interval + link.latency)) < 1e-9);
+
+		//Writes, and the value they leave behind.
+		Characteristic& c = gatt.primary_services.at(1).characteristics.at(0);
+		c.write_request((uint8_t)42);
+		check(sim.run_until_idle(gatt));
+		check(read_battery(sim, gatt) == 42);
+		check(sim.server.attribute(7)->value == vector<uint8_t>{42});
+	}
+
+	//Notifications are limited by how many PDUs fit in a connection event.
+	{
+		SimulatedPeripheral::Link link;
+		link.connection_interval = 0.010;
+		link.pdus_per_event = 4;
+
+		SimulatedPeripheral sim(link);
+		make_table(sim.server);
+		BLEGATTStateMachine gatt;
+		discover(sim, gatt);
+
+		Characteristic& hr = gatt.primary_services.at(0).characteristics.at(0);
+		int received=0;
+		hr.cb_notify_or_indicate = [&](const PDUNotificationOrIndication& n)
+		{
+			check(n.notification());
+			received++;
+		};
+		gatt.set_notify_and_indicate(hr, true, false);
+		check(sim.run_until_idle(gatt));
+
+		int sent=0;
+		sim.notify_every(3, 0.001, [&]()
+		{
+			return vector<uint8_t>{0, (uint8_t)sent++};
+		});
+
+		double t0 = sim.now();
+		check(!sim.run(gatt, [](){ return false; }, 1.0));
+		check(fabs(sim.now() - t0 - 1.0) < 0.01);
+		check(sent >= 999 && sent <= 1001);
+		check(received >= 396 && received <= 404);
+
+		//Stop, and let the backlog drain.
+		sim.stop_notifying();
+		check(sim.run_until_idle(gatt, 100));
+		check(received == sent);
+	}
+
+	//Loss costs time, but nothing goes missing.
+	{
+		SimulatedPeripheral::Link link;
+		link.connection_interval = 0.010;
+		link.latency = 0.001;
+
+		SimulatedPeripheral lossless(link);
+		make_table(lossless.server);
+		BLEGATTStateMachine gatt1;
+		double t_lossless = discover(lossless, gatt1);
+
+		link.loss = 0.3;
+		link.seed = 7;
+		SimulatedPeripheral sim(link);
+		make_table(sim.server);
+		BLEGATTStateMachine gatt;
+
+		double t = discover(sim, gatt);
+		check(sim.retransmissions > 0);
+		check(sim.pdus_to_peripheral == lossless.pdus_to_peripheral);
+		check(t >= t_lossless + link.connection_interval);
+		for(int i=0; i < 20; i++)
+			check(read_battery(sim, gatt) == 100);
+	}
+
+	//Against the real clock
+	{
+		SimulatedPeripheral::Link link;
+		link.connection_interval = 0.005;
+		link.real_time = true;
+
+		SimulatedPeripheral sim(link);
+		make_table(sim.server);
+		BLEGATTStateMachine gatt;
+		discover(sim, gatt);
+
+		double t0 = sim.now();
+		check(read_battery(sim, gatt) == 100);
+		check(sim.now() - t0 >= link.connection_interval);
+	}
+
+	//Hanging up
+	{
+		SimulatedPeripheral sim;
+		make_table(sim.server);
+		int disconnected=0;
+		sim.server.cb_disconnected = [&](int)
+		{
+			disconnected++;
+		};
+
+		BLEGATTStateMachine gatt;
+		discover(sim, gatt);
+		gatt.close();
+		sim.run(gatt, [](){ return false; });
+		check(disconnected == 1);
+		check(sim.server.clients().empty());
+	}
+}
@@ -0,0 +1,160 @@
+#include <blepp/blestatemachine.h>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+//Everything the machine has sent so far.
+vector<vector<uint8_t>> received(int fd)
+{
+	vector<vector<uint8_t>> pdus;
+	vector<uint8_t> buf(512);
+	ssize_t n;
+	while((n = read(fd, buf.data(), buf.size())) > 0)
+		pdus.emplace_back(buf.begin(), buf.begin() + n);
+	return pdus;
+}
+
+bool writable(int fd)
+{
+	pollfd p{fd, POLLOUT, 0};
+	return poll(&p, 1, 1000) == 1 && (p.revents & POLLOUT);
+}
+
+int main()
+{
+	//A small send buffer, so the stream has to stall, and the peer reading
+	//nothing until the machine is told to carry on.
+	int sv[2];
+	check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+	int small = 1;
+	check(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof(small)) == 0);
+	check(fcntl(sv[1], F_SETFL, O_NONBLOCK) == 0);
+	int peer = sv[1];
+
+	BLEGATTStateMachine gatt;
+	gatt.adopt_socket(sv[0]);
+
+	//Something to notify about while the stream is stalled.
+	gatt.primary_services.resize(1);
+	gatt.primary_services[0].start_handle = 1;
+	gatt.primary_services[0].end_handle = 10;
+	gatt.primary_services[0].characteristics.emplace_back(&gatt);
+	gatt.primary_services[0].characteristics[0].value_handle = 3;
+	int notifications = 0;
+	gatt.cb_notify_or_indicate = [&](Characteristic& c, const PDUNotificationOrIndication& n)
+	{
+		check(c.value_handle == 3);
+		check(n.value().second - n.value().first == 1 && *n.value().first == 42);
+		notifications++;
+	};
+
+	int completions = 0;
+	StreamStats stats;
+	gatt.cb_stream_complete = [&](const StreamStats& s)
+	{
+		completions++;
+		stats = s;
+	};
+
+	//Negative lengths are rejected before anything is sent.
+	uint8_t junk = 0;
+	try
+	{
+		gatt.stream_write_commands(0x10, &junk, -1);
+		check(false);
+	}
+	catch(const logic_error&)
+	{
+	}
+	check(gatt.is_idle() && !gatt.wait_on_write());
+	check(received(peer).empty());
+
+	vector<uint8_t> data(2000);
+	for(size_t i=0; i < data.size(); i++)
+		data[i] = i * 7;
+
+	gatt.stream_write_commands(0x10, data.data(), data.size());
+	check(completions == 0);
+	check(gatt.wait_on_write());
+
+	//Nothing else can start while it's going.
+	try
+	{
+		gatt.send_read_request(3);
+		check(false);
+	}
+	catch(const logic_error&)
+	{
+	}
+
+	vector<vector<uint8_t>> sent;
+	int resumptions = 0;
+	while(completions == 0)
+	{
+		check(gatt.wait_on_write());
+
+		//Notifications are still processed during the stall.
+		uint8_t notification[] = {ATT_OP_HANDLE_NOTIFY, 3, 0, 42};
+		check(write(peer, notification, sizeof(notification)) == sizeof(notification));
+		gatt.read_and_process_next();
+		check(notifications == resumptions + 1);
+		check(completions == 0);
+
+		for(auto& p: received(peer))
+			sent.push_back(p);
+
+		check(writable(gatt.socket()));
+		gatt.write_and_process_next();
+		resumptions++;
+		check(resumptions < 1000);
+	}
+
+	for(auto& p: received(peer))
+		sent.push_back(p);
+
+	check(!gatt.wait_on_write());
+	check(gatt.is_idle());
+	check(completions == 1);
+
+	//Every packet is a full size write command, apart from the last, and
+	//together they're the data.
+	const size_t chunk = ATT_DEFAULT_MTU - 3;
+	vector<uint8_t> got;
+	for(size_t i=0; i < sent.size(); i++)
+	{
+		check(sent[i].size() > 3);
+		check(sent[i][0] == ATT_OP_WRITE_CMD && sent[i][1] == 0x10 && sent[i][2] == 0);
+		check(i + 1 == sent.size() || sent[i].size() == chunk + 3);
+		got.insert(got.end(), sent[i].begin() + 3, sent[i].end());
+	}
+	check(got == data);
+
+	check(resumptions > 0);
+	check(stats.bytes == data.size());
+	check(stats.packets == (int)sent.size());
+	check(stats.packets == (int)((data.size() + chunk - 1) / chunk));
+	check(stats.stalls == resumptions);
+	check(stats.seconds >= 0);
+
+	//Once it's done, the machine is usable as normal.
+	gatt.send_read_request(3);
+	auto req = received(peer);
+	check(req.size() == 1 && req[0] == (vector<uint8_t>{ATT_OP_READ_REQ, 3, 0}));
+
+	close(peer);
+}
@@ -0,0 +1,288 @@
+#include <blepp/blestatemachine.h>
+#include <vector>
+#include <future>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+template<class T> bool ready(future<T>& f)
+{
+	return f.wait_for(chrono::seconds(0)) == future_status::ready;
+}
+
+template<class T> bool aborted(future<T>& f)
+{
+	if(!ready(f))
+		return false;
+	try
+	{
+		f.get();
+	}
+	catch(const OperationAborted&)
+	{
+		return true;
+	}
+	return false;
+}
+
+//The peer's end of a connection, which the machine sends its requests to.
+struct Peer
+{
+	int fd;
+
+	Peer(BLEGATTStateMachine& gatt)
+	{
+		int sv[2];
+		check(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+		check(fcntl(sv[1], F_SETFL, O_NONBLOCK) == 0);
+		gatt.adopt_socket(sv[0]);
+		fd = sv[1];
+	}
+
+	~Peer()
+	{
+		close(fd);
+	}
+
+	//Everything the machine has sent.
+	vector<vector<uint8_t>> received()
+	{
+		vector<vector<uint8_t>> pdus;
+		vector<uint8_t> buf(512);
+		ssize_t n;
+		while((n = read(fd, buf.data(), buf.size())) > 0)
+			pdus.emplace_back(buf.begin(), buf.begin() + n);
+		return pdus;
+	}
+};
+
+int main()
+{
+	//With no connection, nothing would ever run them.
+	{
+		BLEGATTStateMachine gatt;
+		auto r = gatt.read_async(3);
+		uint8_t v = 1;
+		auto w = gatt.write_async(3, &v, 1);
+		auto d = gatt.discover_async();
+		check(aborted(r));
+		check(aborted(w));
+		check(aborted(d));
+
+		bool aborted_cb = false;
+		gatt.submit([]{ check(false); }, [&](BLEGATTStateMachine::Disconnect){ aborted_cb = true; });
+		check(aborted_cb);
+		gatt.submit([]{ check(false); });
+	}
+
+	//Submitted from another thread, they run on the thread which calls
+	//run_submissions(), in the order submitted.
+	{
+		BLEGATTStateMachine gatt;
+		Peer peer(gatt);
+		vector<int> order;
+		thread t([&]{
+			for(int i=0; i < 100; i++)
+				gatt.submit([&order, i]{ order.push_back(i); });
+		});
+		t.join();
+		check(order.empty());
+
+		gatt.run_submissions();
+		check(order.size() == 100);
+		for(int i=0; i < 100; i++)
+			check(order[i] == i);
+	}
+
+	//One which waits for a response holds up the rest, and those still
+	//queued are aborted when the connection goes.
+	{
+		BLEGATTStateMachine gatt;
+		Peer peer(gatt);
+		bool ran = false;
+		int aborts = 0;
+		gatt.submit([&]{ gatt.read_primary_services(); });
+		gatt.submit([&]{ ran = true; }, [&](BLEGATTStateMachine::Disconnect d)
+		{
+			check(d.reason == BLEGATTStateMachine::Disconnect::ConnectionClosed);
+			aborts++;
+		});
+		gatt.run_submissions();
+		check(peer.received().size() == 1);
+		check(!ran);
+
+		gatt.close();
+		check(!ran);
+		check(aborts == 1);
+	}
+
+	//When connected, they're run, one at a time.
+	{
+		BLEGATTStateMachine gatt;
+		Peer peer(gatt);
+		auto r = gatt.read_async(3);
+		auto r2 = gatt.read_async(4);
+		check(!ready(r));
+		gatt.run_submissions();
+
+		auto sent = peer.received();
+		check(sent.size() == 1 && sent[0] == (vector<uint8_t>{ATT_OP_READ_REQ, 3, 0}));
+
+		uint8_t resp[] = {ATT_OP_READ_RESP, 42};
+		check(write(peer.fd, resp, sizeof(resp)) == sizeof(resp));
+		gatt.read_and_process_next();
+		check(ready(r) && r.get() == vector<uint8_t>{42});
+		check(peer.received().size() == 1);
+
+		//Those still waiting go when the connection does.
+		gatt.close();
+		check(aborted(r2));
+		auto r3 = gatt.read_async(5);
+		check(aborted(r3));
+	}
+
+	//Values too long for the MTU aren't cut short. Submitted, they fail as
+	//though the device refused them, and called directly, they throw.
+	{
+		BLEGATTStateMachine gatt;
+		Peer peer(gatt);
+		vector<uint8_t> v(ATT_DEFAULT_MTU - 2, 7);
+		auto w = gatt.write_async(3, v.data(), v.size());
+		auto c = gatt.write_async(3, v.data(), v.size(), WriteType::Command);
+		gatt.run_submissions();
+		check(peer.received().empty());
+		for(auto f: {&w, &c})
+		{
+			check(ready(*f));
+			try
+			{
+				f->get();
+				check(false);
+			}
+			catch(const ATTError& e)
+			{
+				check(e.error_code == ATT_ECODE_INVAL_ATTR_VALUE_LEN && e.handle == 3);
+			}
+		}
+
+		for(int command=0; command < 2; command++)
+		{
+			bool threw = false;
+			try
+			{
+				if(command)
+					gatt.send_write_command(3, v.data(), v.size());
+				else
+					gatt.send_write_request(3, v.data(), v.size());
+			}
+			catch(const logic_error&)
+			{
+				threw = true;
+			}
+			check(threw);
+			check(gatt.is_idle());
+			check(peer.received().empty());
+		}
+
+		//One byte less just fits.
+		auto fits = gatt.write_async(3, v.data(), v.size() - 1);
+		gatt.run_submissions();
+		auto sent = peer.received();
+		check(sent.size() == 1 && sent[0].size() == ATT_DEFAULT_MTU && sent[0][0] == ATT_OP_WRITE_REQ);
+	}
+
+	//Those outstanding when the machine goes are aborted too, including the
+	//one waiting for a response.
+	{
+		future<vector<uint8_t>> r, r2;
+		future<void> w;
+		int aborts = 0;
+		{
+			BLEGATTStateMachine gatt;
+			Peer peer(gatt);
+			r = gatt.read_async(3);
+			gatt.run_submissions();
+			check(peer.received().size() == 1);
+
+			r2 = gatt.read_async(4);
+			uint8_t v = 1;
+			thread t([&]{
+				w = gatt.write_async(5, &v, 1);
+				gatt.submit([]{ check(false); }, [&](BLEGATTStateMachine::Disconnect d)
+				{
+					check(d.reason == BLEGATTStateMachine::Disconnect::ConnectionClosed);
+					aborts++;
+				});
+			});
+			t.join();
+			check(!ready(r) && !ready(r2) && !ready(w));
+		}
+		check(aborted(r));
+		check(aborted(r2));
+		check(aborted(w));
+		check(aborts == 1);
+	}
+
+	//Nothing made on one connection runs on the next, even if the socket
+	//comes back with the same number.
+	{
+		BLEGATTStateMachine gatt;
+		Peer* first = new Peer(gatt);
+		auto r = gatt.read_async(3);
+
+		delete first;
+		Peer second(gatt);
+		check(!ready(r));
+		gatt.run_submissions();
+		check(aborted(r));
+		check(second.received().empty());
+
+		auto r2 = gatt.read_async(3);
+		gatt.run_submissions();
+		check(second.received().size() == 1);
+		check(!ready(r2));
+	}
+
+	//Reconnecting from cb_disconnected, part way through a batch. What's
+	//left of the batch came from the old connection, so it's dropped.
+	{
+		BLEGATTStateMachine gatt;
+		Peer* first = new Peer(gatt);
+		Peer* second = nullptr;
+		int disconnections=0;
+		gatt.cb_disconnected = [&](BLEGATTStateMachine::Disconnect)
+		{
+			disconnections++;
+			second = new Peer(gatt);
+		};
+
+		uint8_t notification[] = {ATT_OP_HANDLE_NOTIFY, 3, 0, 1};
+		check(write(first->fd, notification, sizeof(notification)) == sizeof(notification));
+		delete first;
+
+		gatt.process_all_pending();
+		check(disconnections == 1);
+		check(second != nullptr && gatt.socket() != -1);
+
+		auto r = gatt.read_async(3);
+		gatt.run_submissions();
+		check(second->received().size() == 1);
+		check(!ready(r));
+		delete second;
+	}
+}
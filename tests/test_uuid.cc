@@ -0,0 +1,175 @@
+#include <blepp/blestatemachine.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+#include <type_traits>
+
+using namespace BLEPP;
+using namespace std;
+
+#define check(X) do{\
+if(!(X))\
+{\
+	cerr << "Test failed on line " << __LINE__ << ": " << #X << endl;\
+	exit(1);\
+}}while(0)
+
+//16 bit UUIDs are usable at compile time.
+constexpr UUID heart_rate(0x180d);
+static_assert(heart_rate == UUID(0x180d), "constexpr comparison");
+static_assert(heart_rate != UUID(0x180f), "constexpr comparison");
+static_assert(heart_rate < UUID(0x180f), "constexpr ordering");
+static_assert(heart_rate.is_short() && heart_rate.short_value() == 0x180d, "short form");
+static_assert(!(UUID() == heart_rate), "default is nothing");
+
+//So are the literals, of every size.
+constexpr UUID service = "7309203e-349d-4c11-ac6b-baedd1819764"_uuid;
+static_assert(service.high64() == 0x7309203e349d4c11ull && service.low64() == 0xac6bbaedd1819764ull, "128 bit literal");
+static_assert(service.type() == BT_UUID128 && !service.is_short(), "128 bit literal");
+static_assert("180d"_uuid == heart_rate && "180d"_uuid.type() == BT_UUID16, "16 bit literal");
+static_assert("0x180D"_uuid == heart_rate, "16 bit literal with 0x");
+static_assert("0000180d"_uuid == heart_rate && "0000180d"_uuid.type() == BT_UUID32, "32 bit literal");
+static_assert("0000180D-0000-1000-8000-00805F9B34FB"_uuid == heart_rate, "written out in full");
+static_assert("0x12345678"_uuid.short_value() == 0x12345678, "32 bit literal with 0x");
+static_assert(UUID::from_uuid32(0x180d) == heart_rate, "constexpr 32 bit");
+
+//Unspecified is neither the all zero UUID nor anything else, and sorts first.
+static_assert(UUID() == UUID() && UUID().type() == BT_UUID_UNSPEC, "unspecified");
+static_assert(UUID() != UUID::from_uuid128(0, 0) && UUID() < UUID::from_uuid128(0, 0), "unspecified isn't zero");
+
+//The value can't be changed behind the cached one's back, and it's no
+//bigger than what BlueZ uses.
+static_assert(!std::is_base_of<bt_uuid_t, UUID>::value, "no public bt_uuid_t");
+static_assert(sizeof(UUID) == sizeof(bt_uuid_t), "size of a bt_uuid_t");
+static_assert(heart_rate.bt_uuid().type == BT_UUID16 && heart_rate.bt_uuid().value.u16 == 0x180d, "back to BlueZ");
+
+UUID random_uuid(mt19937& rng)
+{
+	bt_uuid_t b;
+	switch(rng() % 3)
+	{
+		case 0:
+			bt_uuid16_create(&b, rng());
+			break;
+		case 1:
+			bt_uuid32_create(&b, rng() % 4 ? rng() & 0xffff : rng());
+			break;
+		default:
+		{
+			uint128_t x;
+			for(auto& d: x.data)
+				d = rng();
+
+			//Sometimes in the base range, written out in full
+			if(rng() % 2)
+			{
+				bt_uuid_t s, l;
+				bt_uuid16_create(&s, rng());
+				bt_uuid_to_uuid128(&s, &l);
+				x = l.value.u128;
+			}
+			bt_uuid128_create(&b, x);
+		}
+	}
+	return UUID::from(b);
+}
+
+int main()
+{
+	//Every way of writing the same UUID is the same UUID.
+	UUID a(0x2a37);
+	UUID b("2a37");
+	UUID c("00002a37-0000-1000-8000-00805f9b34fb");
+	UUID d = UUID::from_uuid32(0x2a37);
+	check(a == b && a == c && a == d);
+	check(a.type() == BT_UUID16 && c.type() == BT_UUID128 && d.type() == BT_UUID32);
+	check(c.is_short() && c.short_value() == 0x2a37);
+	check(a.hash() == c.hash() && hash<UUID>()(a) == hash<UUID>()(d));
+
+	UUID e("7309203e-349d-4c11-ac6b-baedd1819764");
+	check(!e.is_short());
+	check(e.high64() == 0x7309203e349d4c11ull);
+	check(e.low64() == 0xac6bbaedd1819764ull);
+	check(a != e);
+
+	//Literals and strings parse to what BlueZ makes of them, byte for byte.
+	for(const char* str: {"2a37", "0x2A37", "00002a37", "0x12345678", "7309203e-349d-4c11-ac6b-baedd1819764", "00002A37-0000-1000-8000-00805F9B34FB"})
+	{
+		bt_uuid_t bz;
+		check(bt_string_to_uuid(&bz, str) == 0);
+		UUID u(str);
+		bt_uuid_t ub = u.bt_uuid();
+		check(u.type() == bz.type && ub.type == bz.type);
+		check(bt_uuid_cmp(&ub, &bz) == 0);
+		if(u.type() == BT_UUID128)
+			check(memcmp(ub.value.u128.data, bz.value.u128.data, 16) == 0);
+		else if(u.type() == BT_UUID16)
+			check(ub.value.u16 == bz.value.u16);
+		else
+			check(ub.value.u32 == bz.value.u32);
+		check(u == UUID::from(bz));
+	}
+	check("e5f49879-6ee1-479e-bfec-3d35e13d3b88"_uuid == UUID("e5f49879-6ee1-479e-bfec-3d35e13d3b88"));
+
+	//Malformed strings are rejected rather than giving nonsense.
+	for(const char* str: {"", "2a3", "2a37a", "2a3g", "0x", "0x2a3", "7309203e-349d-4c11-ac6b_baedd1819764", "7309203e-349d-4c11-ac6b-baedd181976z", "7309203e-349d-4c11-ac6b-baedd18197640"})
+	{
+		bool threw=false;
+		try
+		{
+			UUID u(str);
+		}
+		catch(const invalid_argument&)
+		{
+			threw = true;
+		}
+		check(threw);
+	}
+
+	//Equality agrees with BlueZ, and ordering is by value.
+	mt19937 rng(1);
+	for(int i=0; i < 100000; i++)
+	{
+		UUID x = random_uuid(rng);
+		UUID y = random_uuid(rng);
+		bt_uuid_t xb = x, yb = y;
+		check((x == y) == (bt_uuid_cmp(&xb, &yb) == 0));
+		check((x == y) == (!(x < y) && !(y < x)));
+		check((x < y) == (x.high64() < y.high64() || (x.high64() == y.high64() && x.low64() < y.low64())));
+		check((x <= y) == !(x > y));
+		if(x == y)
+			check(x.hash() == y.hash());
+
+		UUID z = UUID::from(x);
+		check(z == x && z.type() == x.type());
+	}
+
+	//Nor does it hash like zero.
+	check(UUID().hash() != UUID::from_uuid128(0, 0).hash());
+	check(UUID::from(UUID().bt_uuid()) == UUID());
+
+	//16 bit UUIDs don't collide in the hash.
+	unordered_set<size_t> hashes;
+	for(int i=0; i < 65536; i++)
+		hashes.insert(UUID(i).hash());
+	check(hashes.size() == 65536);
+
+	unordered_map<UUID, int> m;
+	m[UUID(0x180d)] = 1;
+	m[UUID("0000180f-0000-1000-8000-00805f9b34fb")] = 2;
+	m[e] = 3;
+	check(m.at(UUID("180d")) == 1);
+	check(m.at(UUID(0x180f)) == 2);
+	check(m.at(UUID("7309203e-349d-4c11-ac6b-baedd1819764")) == 3);
+	check(m.count(UUID(0x1800)) == 0);
+
+	set<UUID> s = {e, UUID(0x180f), UUID(0x180d), UUID("180d")};
+	check(s.size() == 3);
+	check(*s.begin() == UUID(0x180d));
+	check(*s.rbegin() == e);
+}
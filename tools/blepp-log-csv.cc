@@ -0,0 +1,205 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+//Convert notification logs written by blepp-logger to CSV, one row per
+//notification:
+//
+//   label,device,characteristic,monotonic_ns,kernel_ns,payload
+//
+//with the payload in hex. Give the files in order, e.g. log-*.blepplog.
+
+#include <blepp/notification_log.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+using namespace BLEPP;
+
+namespace
+{
+	//Formatting by hand: printf would take most of the time.
+	char* write_int(char* p, int64_t v)
+	{
+		char digits[20];
+		uint64_t u = v < 0 ? -uint64_t(v) : v;
+		int n=0;
+		do
+		{
+			digits[n++] = '0' + u % 10;
+			u /= 10;
+		}
+		while(u);
+
+		if(v < 0)
+			*p++ = '-';
+		while(n)
+			*p++ = digits[--n];
+		return p;
+	}
+
+	char* write_hex(char* p, const uint8_t* data, size_t length)
+	{
+		static const char hex[] = "0123456789abcdef";
+		for(size_t i=0; i < length; i++)
+		{
+			*p++ = hex[data[i] >> 4];
+			*p++ = hex[data[i] & 15];
+		}
+		return p;
+	}
+
+	//Quoted if need be, as RFC 4180 has it.
+	string csv_field(const string& s)
+	{
+		if(s.find_first_of(",\"\r\n") == string::npos)
+			return s;
+
+		string q = "\"";
+		for(char c: s)
+		{
+			if(c == '"')
+				q += '"';
+			q += c;
+		}
+		return q + "\"";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	set<string> labels;
+	bool header = true;
+	int c;
+	string help = R"X([-nh] [-l label]... file...
+  -l  only this stream (may be given more than once)
+  -n  no header row
+  -h  show this message
+)X";
+	while((c=getopt(argc, argv, "l:nh")) != -1)
+	{
+		if(c == 'l')
+			labels.insert(optarg);
+		else if(c == 'n')
+			header = false;
+		else if(c == 'h')
+		{
+			cout << "Usage: " << argv[0] << " " << help;
+			return 0;
+		}
+		else
+		{
+			cerr << "Usage: " << argv[0] << " " << help;
+			return 1;
+		}
+	}
+
+	if(optind == argc)
+	{
+		cerr << "Usage: " << argv[0] << " " << help;
+		return 1;
+	}
+
+	//Rows are gathered and written in large chunks.
+	vector<char> out(1 << 20);
+	size_t used = 0;
+	auto write_out = [&]()
+	{
+		if(fwrite(out.data(), 1, used, stdout) != used)
+		{
+			perror("blepp-log-csv: write");
+			exit(1);
+		}
+		used = 0;
+	};
+
+	if(header)
+		fputs("label,device,characteristic,monotonic_ns,kernel_ns,payload\n", stdout);
+
+	int status = 0;
+	for(int i=optind; i < argc; i++)
+	{
+		try
+		{
+			NotificationLogReader reader(argv[i]);
+
+			//The start of each row, by stream. Empty for streams not wanted.
+			vector<string> prefixes;
+
+			NotificationLogReader::Notification n;
+			while(reader.next(n))
+			{
+				if(n.stream >= prefixes.size())
+					prefixes.resize(n.stream + 1);
+				string& prefix = prefixes[n.stream];
+				if(prefix.empty())
+				{
+					const NotificationLogStream* s = reader.stream(n.stream);
+					if(s == nullptr)
+						prefix = "?," + to_string(n.stream) + ",?,";
+					else if(labels.empty() || labels.count(s->label))
+						prefix = csv_field(s->label) + "," + csv_field(s->device) + "," + csv_field(s->characteristic) + ",";
+					else
+						prefix = "-";
+				}
+				if(prefix == "-")
+					continue;
+
+				//The largest row: two 20 digit numbers, and a 64k payload.
+				if(used + prefix.size() + 44 + 2 * n.length + 1 > out.size())
+				{
+					write_out();
+					if(prefix.size() + 44 + 2 * n.length + 1 > out.size())
+						out.resize(prefix.size() + 44 + 2 * n.length + 1);
+				}
+
+				char* p = out.data() + used;
+				memcpy(p, prefix.data(), prefix.size());
+				p += prefix.size();
+				p = write_int(p, n.monotonic_ns);
+				*p++ = ',';
+				p = write_int(p, n.kernel_ns);
+				*p++ = ',';
+				p = write_hex(p, n.data, n.length);
+				*p++ = '\n';
+				used = p - out.data();
+			}
+
+			if(reader.truncated())
+				cerr << argv[0] << ": " << argv[i] << " ends part way through a notification" << endl;
+		}
+		catch(const exception& e)
+		{
+			cerr << argv[0] << ": " << e.what() << endl;
+			status = 1;
+		}
+	}
+
+	write_out();
+	return status;
+}
@@ -0,0 +1,417 @@
+
+/*
+ *
+ *  blepp - Implementation of the Generic ATTribute Protocol
+ *
+ *  Copyright (C) 2013, 2014 Edward Rosten
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+//Log notifications from several characteristics on several devices, at a
+//high rate, to a binary log. See blepp/notification_log.h for the format,
+//and blepp-log-csv to read it.
+//
+//The configuration file has one line per characteristic:
+//
+//   device  characteristic  label  [random]  [sequence=offset:size]
+//
+//e.g.
+//
+//   # Two sensors on the same board
+//   AA:BB:CC:DD:EE:FF  53f72b8c-ff27-4177-9eee-30ace844f8f2  emg      sequence=0:2
+//   AA:BB:CC:DD:EE:FF  2a19                                  battery
+//   11:22:33:44:55:66  2a37                                  heart    random
+//
+//"random" means the device has a random address. With sequence, the
+//notifications carry a little endian counter of size bytes at offset, and
+//the gaps in it are counted.
+//
+//Devices which disconnect are reconnected. SIGHUP starts a new log file,
+//and SIGINT or SIGTERM finishes the log and exits.
+
+#include <blepp/blestatemachine.h>
+#include <blepp/notification_log.h>
+#include <blepp/logging.h>
+#include <blepp/pretty_printers.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace BLEPP;
+
+namespace
+{
+	volatile sig_atomic_t stop_requested = 0;
+	volatile sig_atomic_t rotate_requested = 0;
+
+	void request_stop(int)
+	{
+		stop_requested = 1;
+	}
+
+	void request_rotate(int)
+	{
+		rotate_requested = 1;
+	}
+
+	int64_t monotonic_ns()
+	{
+		timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return t.tv_sec * 1000000000ll + t.tv_nsec;
+	}
+
+	struct Subscription
+	{
+		UUID uuid;
+		string label;
+		uint16_t stream;
+		SequenceCounter counter;
+		bool subscribed=false;
+	};
+
+	struct Device
+	{
+		string address;
+		bool random=false;
+		vector<Subscription> subscriptions;
+
+		unique_ptr<BLEGATTStateMachine> gatt;
+		std::function<void()> discovered;
+		bool connected=false;
+		int64_t reconnect_at=0;
+		int64_t retry_delay=0;
+	};
+
+	void parse_config(const string& filename, vector<Device>& devices)
+	{
+		ifstream in(filename);
+		if(!in)
+			throw runtime_error("Could not open " + filename);
+
+		string line;
+		for(int n=1; getline(in, line); n++)
+		{
+			line = line.substr(0, line.find('#'));
+			istringstream words(line);
+			string address, characteristic, label, option;
+			if(!(words >> address))
+				continue;
+			if(!(words >> characteristic >> label))
+				throw runtime_error(filename + ":" + to_string(n) + ": expected a device, characteristic and label");
+
+			auto d = find_if(devices.begin(), devices.end(), [&](const Device& d){ return d.address == address; });
+			if(d == devices.end())
+			{
+				devices.emplace_back();
+				d = devices.end() - 1;
+				d->address = address;
+			}
+
+			Subscription s;
+			try
+			{
+				s.uuid = UUID(characteristic);
+			}
+			catch(const invalid_argument&)
+			{
+				throw runtime_error(filename + ":" + to_string(n) + ": bad characteristic UUID " + characteristic);
+			}
+			s.label = label;
+
+			while(words >> option)
+			{
+				int offset, size;
+				char end;
+				if(option == "random")
+					d->random = true;
+				else if(sscanf(option.c_str(), "sequence=%d:%d%c", &offset, &size, &end) == 2 && offset >= 0 && (size == 1 || size == 2 || size == 4))
+				{
+					s.counter.offset = offset;
+					s.counter.size = size;
+				}
+				else
+					throw runtime_error(filename + ":" + to_string(n) + ": unknown option " + option);
+			}
+
+			d->subscriptions.push_back(s);
+		}
+	}
+
+	void print_stats(const vector<Device>& devices, double seconds)
+	{
+		cerr << "stream            received      rate      gaps    missed  disorder malformed\n";
+		for(const auto& d: devices)
+			for(const auto& s: d.subscriptions)
+				cerr << left << setw(12) << s.label << right
+				     << setw(14) << s.counter.received
+				     << setw(10) << fixed << setprecision(1) << (seconds > 0 ? s.counter.received / seconds : 0)
+				     << setw(10) << s.counter.gaps
+				     << setw(10) << s.counter.missed
+				     << setw(10) << s.counter.out_of_order
+				     << setw(10) << s.counter.malformed
+				     << (s.subscribed ? "" : "  (not subscribed)") << "\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	NotificationLogOptions options;
+	double stats_interval = 10;
+	string adapter;
+	int c;
+	string help = R"X([-dh] [-r megabytes] [-t seconds] [-s seconds] [-i adapter] config prefix
+  -d  write with O_DIRECT
+  -r  start a new file after this many megabytes (default 256, 0 for never)
+  -t  start a new file after this many seconds (default never)
+  -s  print statistics this often (default 10, 0 for never)
+  -i  use this adapter, e.g. hci1
+  -h  show this message
+)X";
+	while((c=getopt(argc, argv, "dr:t:s:i:h")) != -1)
+	{
+		if(c == 'd')
+			options.direct = true;
+		else if(c == 'r')
+			options.rotate_bytes = strtoull(optarg, nullptr, 10) << 20;
+		else if(c == 't')
+			options.rotate_seconds = atof(optarg);
+		else if(c == 's')
+			stats_interval = atof(optarg);
+		else if(c == 'i')
+			adapter = optarg;
+		else if(c == 'h')
+		{
+			cout << "Usage: " << argv[0] << " " << help;
+			return 0;
+		}
+		else
+		{
+			cerr << "Usage: " << argv[0] << " " << help;
+			return 1;
+		}
+	}
+
+	if(argc - optind != 2)
+	{
+		cerr << "Usage: " << argv[0] << " " << help;
+		return 1;
+	}
+
+	log_level = LogLevels::Warning;
+
+	vector<Device> devices;
+	try
+	{
+		parse_config(argv[optind], devices);
+	}
+	catch(const exception& e)
+	{
+		cerr << argv[0] << ": " << e.what() << endl;
+		return 1;
+	}
+
+	if(devices.empty())
+	{
+		cerr << argv[0] << ": nothing to log in " << argv[optind] << endl;
+		return 1;
+	}
+
+	NotificationLogWriter writer(argv[optind+1], options);
+	for(auto& d: devices)
+		for(auto& s: d.subscriptions)
+			s.stream = writer.add_stream(d.address, to_str(s.uuid), s.label);
+
+	signal(SIGINT, request_stop);
+	signal(SIGTERM, request_stop);
+	signal(SIGHUP, request_rotate);
+
+	//Hooked up once the characteristics are known. Subscribing is a write
+	//request, which has to wait for the previous one's response, so they
+	//go through the state machine's submission queue.
+	auto subscribe = [&writer](Device& d)
+	{
+		BLEGATTStateMachine& gatt = *d.gatt;
+		for(auto& s: d.subscriptions)
+		{
+			s.subscribed = false;
+			for(auto& service: gatt.primary_services)
+				for(auto& characteristic: service.characteristics)
+					if(characteristic.uuid == s.uuid && characteristic.notify)
+					{
+						Subscription* sub = &s;
+						characteristic.cb_notify_or_indicate = [&writer, &gatt, sub](const PDUNotificationOrIndication& n)
+						{
+							const timespec& k = gatt.packet_time();
+							const uint8_t* data = n.value().first;
+							size_t length = n.value().second - data;
+							writer.log(sub->stream, data, length, monotonic_ns(), k.tv_sec * 1000000000ll + k.tv_nsec);
+							sub->counter.observe(data, length);
+						};
+
+						Characteristic* ch = &characteristic;
+						gatt.submit([&gatt, ch](){ gatt.set_notify_and_indicate(*ch, true, false); });
+						s.subscribed = true;
+					}
+
+			if(!s.subscribed)
+				cerr << d.address << ": no notifiable characteristic " << to_str(s.uuid) << " for " << s.label << endl;
+		}
+	};
+
+	auto connect = [&](Device& d)
+	{
+		d.gatt.reset(new BLEGATTStateMachine);
+		d.gatt->set_kernel_timestamps(true);
+
+		Device* dp = &d;
+		d.discovered = [dp, &subscribe](){ subscribe(*dp); };
+		d.gatt->setup_standard_scan(d.discovered);
+
+		d.gatt->cb_disconnected = [dp](BLEGATTStateMachine::Disconnect why)
+		{
+			cerr << dp->address << ": disconnected: " << BLEGATTStateMachine::get_disconnect_string(why) << endl;
+			dp->connected = false;
+
+			//Back off, up to a minute, while it stays away.
+			dp->retry_delay = min<int64_t>(max<int64_t>(dp->retry_delay * 2, 1000000000ll), 60000000000ll);
+			dp->reconnect_at = monotonic_ns() + dp->retry_delay;
+		};
+
+		try
+		{
+			d.gatt->connect(d.address, false, !d.random, adapter);
+			d.connected = true;
+		}
+		catch(const exception& e)
+		{
+			cerr << d.address << ": " << e.what() << endl;
+			d.gatt->cb_disconnected(BLEGATTStateMachine::Disconnect(BLEGATTStateMachine::Disconnect::ConnectionFailed, errno));
+		}
+	};
+
+	for(auto& d: devices)
+		connect(d);
+
+	int64_t start = monotonic_ns();
+	int64_t next_flush = start + 1000000000ll;
+	int64_t next_stats = stats_interval > 0 ? start + int64_t(stats_interval * 1e9) : INT64_MAX;
+
+	vector<pollfd> fds;
+	vector<Device*> polled;
+
+	try
+	{
+		while(!stop_requested)
+		{
+			int64_t now = monotonic_ns();
+
+			if(rotate_requested)
+			{
+				rotate_requested = 0;
+				writer.rotate();
+			}
+
+			//At most a second's notifications are lost if the logger dies.
+			if(now >= next_flush)
+			{
+				writer.flush();
+				next_flush = now + 1000000000ll;
+			}
+
+			if(now >= next_stats)
+			{
+				print_stats(devices, (now - start) * 1e-9);
+				next_stats = now + int64_t(stats_interval * 1e9);
+			}
+
+			int64_t wake = min(next_flush, next_stats);
+			fds.clear();
+			polled.clear();
+			for(auto& d: devices)
+			{
+				if(!d.connected)
+				{
+					if(now >= d.reconnect_at)
+						connect(d);
+					if(!d.connected)
+					{
+						wake = min(wake, d.reconnect_at);
+						continue;
+					}
+				}
+
+				short events = d.gatt->is_connecting() || d.gatt->wait_on_write() ? POLLOUT : POLLIN;
+				fds.push_back(pollfd{d.gatt->socket(), events, 0});
+				fds.push_back(pollfd{d.gatt->submission_fd(), POLLIN, 0});
+				polled.push_back(&d);
+			}
+
+			int timeout = max<int64_t>(0, (wake - monotonic_ns() + 999999) / 1000000);
+			if(poll(fds.data(), fds.size(), timeout) == -1)
+			{
+				if(errno == EINTR)
+					continue;
+				throw runtime_error(string("poll: ") + strerror(errno));
+			}
+
+			for(size_t i=0; i < polled.size(); i++)
+			{
+				Device& d = *polled[i];
+				const pollfd& socket = fds[2*i];
+
+				//A failed connection shows up as an error, not as writable.
+				if(socket.events & POLLOUT)
+				{
+					if(socket.revents)
+						d.gatt->write_and_process_next();
+				}
+				else if(socket.revents)
+				{
+					if(d.gatt->process_all_pending() > 0)
+						d.retry_delay = 0;
+				}
+
+				if(d.connected && (fds[2*i+1].revents & POLLIN))
+					d.gatt->run_submissions();
+			}
+		}
+	}
+	catch(const exception& e)
+	{
+		cerr << argv[0] << ": " << e.what() << endl;
+		writer.close();
+		return 1;
+	}
+
+	writer.close();
+	print_stats(devices, (monotonic_ns() - start) * 1e-9);
+}